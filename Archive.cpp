@@ -0,0 +1,198 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "Archive.h"
+#include "Hash.h"
+
+#include <unordered_map>
+
+static const char MAGIC[8] = { 'P', 'E', 'R', 'D', 'A', 'R', 'C', '1' };
+static const size_t ENTRY_SIZE = 48, FOOTER_SIZE = 32;
+
+// Entry offsets: data offset (8), data size (8), XXH64 (8), string offsets of the file, type, name, and
+// extension (4 each), lang (2), and 6 reserved bytes
+#define ENTRY_DATA   0
+#define ENTRY_LENGTH 8
+#define ENTRY_HASH   16
+#define ENTRY_FILE   24
+#define ENTRY_TYPE   28
+#define ENTRY_NAME   32
+#define ENTRY_EXT    36
+#define ENTRY_LANG   40
+
+static inline void write16(uint8_t* p, uint16_t x) { p[0] = (uint8_t)x; p[1] = (uint8_t)(x >> 8); }
+static inline void write32(uint8_t* p, uint32_t x) { for (int i = 0; i < 4; i++) { p[i] = (uint8_t)(x >> (8*i)); } }
+static inline void write64(uint8_t* p, uint64_t x) { for (int i = 0; i < 8; i++) { p[i] = (uint8_t)(x >> (8*i)); } }
+static inline uint16_t read16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t read32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+static inline uint64_t read64(const uint8_t* p) { return (uint64_t)read32(p) | ((uint64_t)read32(p + 4) << 32); }
+
+// The order of the index, strings are compared as bytes
+static int compare(const char* file1, const char* type1, const char* name1, uint16_t lang1, const char* file2, const char* type2, const char* name2, uint16_t lang2) {
+	int c;
+	if ((c = strcmp(file1, file2)) != 0) { return c; }
+	if ((c = strcmp(type1, type2)) != 0) { return c; }
+	if ((c = strcmp(name1, name2)) != 0) { return c; }
+	return (int)lang1 - (int)lang2;
+}
+
+#pragma region Writer
+////////////////////////////////////////////////////////////////////////////////
+///// Writer
+////////////////////////////////////////////////////////////////////////////////
+ArchiveWriter::ArchiveWriter() : f(nullptr), offset(0), failed(false) { }
+
+ArchiveWriter::~ArchiveWriter() {
+	if (this->f) { fclose(this->f); }
+}
+
+bool ArchiveWriter::create(const std::wstring& path) {
+	this->f = openFile(path, "wb");
+	return this->f != nullptr;
+}
+
+bool ArchiveWriter::add(const std::wstring& file, PE::const_resid type, PE::const_resid name, uint16_t lang, const DumpOutput& out) {
+	Entry e;
+	e.file = toUTF8(file);
+	e.type = toUTF8(getTypeName(type));
+	e.name = toUTF8(getName(name));
+	e.ext = toUTF8(out.ext);
+	e.lang = lang;
+	e.size = out.size();
+	XXH64 xxh;
+	out.stream([&xxh](const void* data, size_t size) { xxh.update(data, size); return true; });
+	e.hash = xxh.digest();
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	if (this->failed) { return false; }
+	FILE* f = this->f;
+	if (!out.stream([f](const void* data, size_t size) { return fwrite(data, 1, size, f) == size; }, true)) { this->failed = true; return false; }
+	e.offset = this->offset;
+	this->offset += e.size;
+	this->entries.push_back(std::move(e));
+	return true;
+}
+
+bool ArchiveWriter::close() {
+	if (!this->f) { return false; }
+	std::sort(this->entries.begin(), this->entries.end(), [](const Entry& a, const Entry& b) {
+		return compare(a.file.c_str(), a.type.c_str(), a.name.c_str(), a.lang, b.file.c_str(), b.type.c_str(), b.name.c_str(), b.lang) < 0;
+	});
+
+	// the same strings are used by many entries (every type and file name) so each is stored once
+	std::string strings;
+	std::unordered_map<std::string, uint32_t> string_offs;
+	auto addString = [&](const std::string& s) {
+		auto itr = string_offs.find(s);
+		if (itr != string_offs.end()) { return itr->second; }
+		uint32_t off = (uint32_t)strings.size();
+		strings.append(s.c_str(), s.size() + 1);
+		string_offs.emplace(s, off);
+		return off;
+	};
+	addString(std::string()); // the strings are never empty, which the reader relies on
+	std::vector<uint8_t> index(this->entries.size() * ENTRY_SIZE, 0);
+	uint8_t* p = index.data();
+	for (const Entry& e : this->entries) {
+		write64(p + ENTRY_DATA, e.offset);
+		write64(p + ENTRY_LENGTH, e.size);
+		write64(p + ENTRY_HASH, e.hash);
+		write32(p + ENTRY_FILE, addString(e.file));
+		write32(p + ENTRY_TYPE, addString(e.type));
+		write32(p + ENTRY_NAME, addString(e.name));
+		write32(p + ENTRY_EXT, addString(e.ext));
+		write16(p + ENTRY_LANG, e.lang);
+		p += ENTRY_SIZE;
+	}
+	uint8_t footer[FOOTER_SIZE];
+	write64(footer, this->offset);
+	write64(footer + 8, this->entries.size());
+	write64(footer + 16, strings.size());
+	memcpy(footer + 24, MAGIC, sizeof(MAGIC));
+
+	bool ok = !this->failed &&
+		fwrite(index.data(), 1, index.size(), this->f) == index.size() &&
+		fwrite(strings.data(), 1, strings.size(), this->f) == strings.size() &&
+		fwrite(footer, 1, FOOTER_SIZE, this->f) == FOOTER_SIZE;
+	ok = (fclose(this->f) == 0) && ok;
+	this->f = nullptr;
+	return ok;
+}
+#pragma endregion
+
+#pragma region Reader
+////////////////////////////////////////////////////////////////////////////////
+///// Reader
+////////////////////////////////////////////////////////////////////////////////
+bool ArchiveReader::open(const wchar_t* path) {
+	if (!this->map.open(path)) { return false; }
+	const uint8_t* base = this->map.data();
+	size_t size = this->map.size();
+	if (size < FOOTER_SIZE || memcmp(base + size - sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0) { SetLastError(ERROR_BAD_FORMAT); return false; }
+	const uint8_t* footer = base + size - FOOTER_SIZE;
+	uint64_t index_off = read64(footer), count = read64(footer + 8), strings_size = read64(footer + 16);
+	uint64_t avail = size - FOOTER_SIZE;
+	if (index_off > avail || count > (avail - index_off) / ENTRY_SIZE || strings_size != avail - index_off - count * ENTRY_SIZE ||
+		strings_size == 0 || base[avail - 1] != 0) {
+		SetLastError(ERROR_BAD_FORMAT);
+		return false;
+	}
+
+	// check every entry now so they can be used without any more checks
+	const uint8_t* index = base + index_off;
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t* p = index + i * ENTRY_SIZE;
+		uint64_t off = read64(p + ENTRY_DATA), sz = read64(p + ENTRY_LENGTH);
+		if (off > index_off || sz > index_off - off ||
+			read32(p + ENTRY_FILE) >= strings_size || read32(p + ENTRY_TYPE) >= strings_size ||
+			read32(p + ENTRY_NAME) >= strings_size || read32(p + ENTRY_EXT) >= strings_size) {
+			SetLastError(ERROR_BAD_FORMAT);
+			return false;
+		}
+	}
+	this->index = index;
+	this->strings = (const char*)(index + count * ENTRY_SIZE);
+	this->_count = (size_t)count;
+	return true;
+}
+
+ArchiveReader::Entry ArchiveReader::operator[](size_t i) const {
+	const uint8_t* p = this->index + i * ENTRY_SIZE;
+	Entry e;
+	e.file = this->strings + read32(p + ENTRY_FILE);
+	e.type = this->strings + read32(p + ENTRY_TYPE);
+	e.name = this->strings + read32(p + ENTRY_NAME);
+	e.ext = this->strings + read32(p + ENTRY_EXT);
+	e.lang = read16(p + ENTRY_LANG);
+	e.size = read64(p + ENTRY_LENGTH);
+	e.hash = read64(p + ENTRY_HASH);
+	e.data = this->map.data() + read64(p + ENTRY_DATA);
+	return e;
+}
+
+bool ArchiveReader::find(const char* file, const char* type, const char* name, uint16_t lang, Entry& e) const {
+	size_t lo = 0, hi = this->_count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		Entry m = (*this)[mid];
+		int c = compare(m.file, m.type, m.name, m.lang, file, type, name, lang);
+		if (c == 0) { e = m; return true; }
+		if (c < 0) { lo = mid + 1; } else { hi = mid; }
+	}
+	return false;
+}
+#pragma endregion
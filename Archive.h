@@ -0,0 +1,97 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// A single-file archive of dumped resources, used instead of a directory tree with one file per resource.
+//
+// The archive is written append-only: the outputs are written back to back as they are converted, then an
+// index sorted by (file, type, name, lang) and a small footer are written at the end. The reader maps the
+// archive and finds any entry with a binary search of the index, the data itself is never scanned.
+//
+// Layout (all integers are little-endian):
+//   data     the outputs, in the order they were written
+//   index    one 48 byte entry per output, sorted
+//   strings  the UTF-8 strings of the entries, each null-terminated
+//   footer   index offset (8), entry count (8), size of the strings (8), and "PERDARC1" (8)
+
+#pragma once
+
+#include "general.h"
+#include "MappedFile.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+
+class ArchiveWriter {
+public:
+	ArchiveWriter();
+	~ArchiveWriter();
+
+	// Creates the archive, replacing any existing file
+	bool create(const std::wstring& path);
+
+	// Appends an output to the data of the archive, file is the name of the PE file it came from (which
+	// is empty when only one PE file is being dumped). Safe to call from multiple threads at once.
+	bool add(const std::wstring& file, PE::const_resid type, PE::const_resid name, uint16_t lang, const DumpOutput& out);
+
+	// Writes the index and footer and closes the archive
+	bool close();
+
+	size_t count() const { return this->entries.size(); }
+
+private:
+	ArchiveWriter(const ArchiveWriter&) = delete;
+	ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+	struct Entry {
+		std::string file, type, name, ext;
+		uint16_t lang;
+		uint64_t offset, size, hash;
+	};
+
+	FILE* f;
+	uint64_t offset;
+	bool failed;
+	std::vector<Entry> entries;
+	std::mutex mutex;
+};
+
+class ArchiveReader {
+public:
+	// An entry in the archive, the strings and data point into the mapped archive
+	struct Entry {
+		const char *file, *type, *name, *ext;
+		uint16_t lang;
+		uint64_t size, hash;
+		const uint8_t* data;
+	};
+
+	// Maps the archive and checks its index, fails with ERROR_BAD_FORMAT if it is not a valid archive
+	bool open(const wchar_t* path);
+
+	size_t count() const { return this->_count; }
+	Entry operator[](size_t i) const;
+	// Finds an entry, returns false if it is not in the archive
+	bool find(const char* file, const char* type, const char* name, uint16_t lang, Entry& e) const;
+
+private:
+	MappedFile map;
+	const uint8_t* index = nullptr;
+	const char* strings = nullptr;
+	size_t _count = 0;
+};
@@ -0,0 +1,146 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Batch mode is a pipeline of three stages connected by bounded queues: one thread opens and parses the
+// PE files, the converter threads run the dumpers on each resource, and one thread writes the outputs.
+// A problem with one file is reported and then the rest of the batch continues.
+
+#include "stdafx.h"
+#include "Dump.h"
+#include "BoundedQueue.h"
+
+#include <string>
+#include <set>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+// A PE file in batch mode, shared by all of its converted resources and closed once they are all written
+struct BatchFile {
+	std::wstring filename;
+	std::unique_ptr<PE::File> pe;
+	std::unique_ptr<DumpContext> ctx;
+	std::set<std::wstring> dirs;
+	std::vector<DumpTask> tasks;
+};
+
+// A converted resource waiting to be written, the file is a BatchFile or NestedFile that owns the context and task
+struct BatchItem {
+	std::shared_ptr<const void> file;
+	const DumpContext* ctx;
+	const DumpTask* task;
+	DumpOutput out;
+	BatchItem(const std::shared_ptr<const void>& file, const DumpContext* ctx, const DumpTask* task) : file(file), ctx(ctx), task(task) { }
+};
+
+/* Opens a PE file for batch mode and prepares its output subdirectory, which is named after the file.
+   Files without resources are skipped without being a failure. */
+static std::shared_ptr<BatchFile> openBatchFile(const std::wstring& filename, const std::wstring& directory, const DumpOptions& opts, std::set<std::wstring>& used, bool& failed) {
+	PE::File* pe = nullptr;
+	const PE::Rsrc* rsrc = nullptr;
+	int status = openPE(filename.c_str(), pe, rsrc, opts);
+	failed = status == 1;
+	if (status != 0) { return nullptr; }
+	std::shared_ptr<BatchFile> file = std::make_shared<BatchFile>();
+	file->filename = filename;
+	file->pe.reset(pe);
+
+	// files with the same name from different directories get a numbered subdirectory
+	std::wstring base = sanitizeFilename(getBaseName(filename)), name = base, upper;
+	for (int i = 1; ; i++) {
+		upper = name;
+		std::transform(upper.begin(), upper.end(), upper.begin(), ::towupper);
+		if (used.insert(upper).second) { break; }
+		name = base + L"_" + to_string(i);
+	}
+	if (isUnchanged(opts, name, filename, pe)) { return nullptr; }
+	std::wstring dir = directory + PATH_SEP + name;
+	if (opts.output().usesFiles() && !createDirectory(dir)) { ReportLastError(L"Cannot create directory '" + dir + L"'"); failed = true; return nullptr; }
+
+	if (opts.index) { opts.index->begin(filename); }
+	file->ctx.reset(new DumpContext(rsrc, opts, name, nullptr, filename));
+	if (opts.rc && opts.output().usesFiles()) { beginScript(*file->ctx, dir); }
+	file->tasks = enumerateResources(rsrc, dir, file->dirs, opts);
+	return file;
+}
+
+/* Converts the resources of a file and queues them to be written, along with those of the PE files embedded
+   in them which are converted right away on the same thread */
+static void convertFile(const DumpContext& ctx, const std::vector<DumpTask>& tasks, const std::shared_ptr<const void>& file, BoundedQueue<std::unique_ptr<BatchItem>>& converted) {
+	for (const DumpTask& task : tasks) {
+		if (scriptResource(ctx, task)) { continue; }
+		std::unique_ptr<BatchItem> item(new BatchItem(file, &ctx, &task));
+		if (convertResource(ctx, task, item->out)) {
+			// a background writer may still have the output after the item is done
+			item->out.keepAlive(file);
+			converted.push(std::move(item));
+		}
+		else { warnCannotSave(task); }
+		if (ctx.opts.recurse) {
+			std::shared_ptr<NestedFile> nested = openNested(ctx, task, file);
+			if (nested) { convertFile(*nested->ctx, nested->tasks, nested, converted); }
+		}
+	}
+}
+
+/* Dumps every file into its own subdirectory of the output directory, returns the number of files that failed */
+size_t dumpBatch(const std::vector<std::wstring>& files, const std::wstring& directory, const DumpOptions& opts) {
+	BoundedQueue<std::shared_ptr<BatchFile>> opened(4);
+	BoundedQueue<std::unique_ptr<BatchItem>> converted(1024);
+	std::atomic<size_t> failed(0);
+
+	std::thread opener([&] {
+		std::set<std::wstring> used;
+		for (const std::wstring& filename : files) {
+			bool file_failed;
+			std::shared_ptr<BatchFile> file = openBatchFile(filename, directory, opts, used, file_failed);
+			if (file_failed) { ++failed; }
+			if (!file) { continue; }
+			if (!opened.push(std::move(file))) { break; }
+		}
+		opened.close();
+	});
+
+	unsigned int jobs = opts.jobs ? opts.jobs : std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<std::thread> converters;
+	for (unsigned int i = 0; i < jobs; i++) {
+		converters.emplace_back([&] {
+			std::shared_ptr<BatchFile> file;
+			while (opened.pop(file)) {
+				convertFile(*file->ctx, file->tasks, file, converted);
+				// the resource scripts are complete once the file and the files embedded in it are converted
+				if (file->ctx->script) { writeScripts(*file->ctx); }
+				file.reset();
+			}
+		});
+	}
+
+	std::thread writer([&] {
+		std::unique_ptr<BatchItem> item;
+		while (converted.pop(item)) {
+			if (!saveResource(*item->ctx, *item->task, item->out)) { warnCannotSave(*item->task); }
+			item.reset();
+		}
+	});
+
+	opener.join();
+	for (std::thread& t : converters) { t.join(); }
+	converted.close();
+	writer.join();
+	return failed;
+}
@@ -0,0 +1,174 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// The benchmark: generates a corpus of synthetic PE files for each resource mix and measures dumping them
+// into memory, both end-to-end and for each dumper
+
+#include "stdafx.h"
+
+#include "Dump.h"
+#include "SyntheticPE.h"
+#include "ThreadPool.h"
+#include "PNG.h"
+
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <algorithm>
+
+// Outputs are copied into a buffer instead of being written, which reads every span like writing to the
+// page cache would but without any of the filesystem cost
+struct CopyingSink : public Sink {
+	std::atomic<uint64_t> resources, bytes;
+	CopyingSink() : resources(0), bytes(0) { }
+	bool save(const DumpContext&, const DumpTask&, const std::wstring&, DumpOutput& out) override {
+		static thread_local std::vector<uint8_t> buffer;
+		buffer.resize(out.size());
+		uint8_t* p = buffer.data();
+		for (const DataSpan& span : out.spans()) { memcpy(p, span.data, span.size); p += span.size; }
+		this->resources.fetch_add(1, std::memory_order_relaxed);
+		this->bytes.fetch_add(out.size(), std::memory_order_relaxed);
+		return true;
+	}
+};
+
+/* Dumps every file once into the sink of the options, returns the time taken in nanoseconds */
+uint64_t dumpAll(const std::vector<std::wstring>& files, const DumpOptions& opts, ThreadPool* pool) {
+	uint64_t start = Stats::now();
+	for (const std::wstring& filename : files) {
+		PE::File* pe = nullptr;
+		const PE::Rsrc* rsrc = nullptr;
+		if (openPE(filename.c_str(), pe, rsrc, opts) != 0) { continue; }
+		{
+			const DumpContext ctx(rsrc, opts);
+			std::set<std::wstring> dirs;
+			const std::vector<DumpTask> tasks = enumerateResources(rsrc, L"", dirs, opts);
+			if (!pool) {
+				for (const DumpTask& task : tasks) { dumpResource(ctx, task); }
+			}
+			else {
+				for (const DumpTask& task : tasks) { pool->submit([&ctx, &task] { dumpResource(ctx, task); }); }
+				pool->wait();
+			}
+		}
+		delete pe;
+	}
+	return Stats::now() - start;
+}
+
+/* Generates the corpus files for a profile, returns false if they cannot be written */
+bool generateCorpus(const CorpusProfile& profile, const std::wstring& directory, unsigned int count, uint32_t seed, std::vector<std::wstring>& files, uint64_t& bytes_in) {
+	bytes_in = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		std::vector<uint8_t> pe = generatePE(profile, seed + i);
+		std::wstring path = directory + PATH_SEP + fromUTF8(profile.name, strlen(profile.name)) + L"_" + to_string(i) + L".dll";
+		if (!writeFile(path, pe.data(), pe.size())) { ReportLastError(L"Cannot write '" + path + L"'"); return false; }
+		files.push_back(path);
+		bytes_in += pe.size();
+	}
+	return true;
+}
+
+static double mb(uint64_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+int wmain(int argc, const wchar_t *argv[]) {
+	std::wstring corpus = L"bench_corpus";
+	const wchar_t* only = nullptr;
+	unsigned int files_per_profile = 1, iterations = 5, jobs = 1;
+	uint32_t seed = 1;
+	bool png = false;
+	for (int i = 1; i < argc; i++) {
+		if (wcscmp(argv[i], L"--corpus") == 0 && i + 1 < argc) { corpus = argv[++i]; }
+		else if (wcscmp(argv[i], L"--profile") == 0 && i + 1 < argc) { only = argv[++i]; }
+		else if (wcscmp(argv[i], L"--files") == 0 && i + 1 < argc) { files_per_profile = (unsigned int)wcstoul(argv[++i], nullptr, 10); }
+		else if (wcscmp(argv[i], L"--iterations") == 0 && i + 1 < argc) { iterations = std::max((unsigned int)wcstoul(argv[++i], nullptr, 10), 1u); }
+		else if (wcscmp(argv[i], L"--jobs") == 0 && i + 1 < argc) { jobs = (unsigned int)wcstoul(argv[++i], nullptr, 10); }
+		else if (wcscmp(argv[i], L"--seed") == 0 && i + 1 < argc) { seed = (uint32_t)wcstoul(argv[++i], nullptr, 10); }
+		else if (wcscmp(argv[i], L"--png") == 0) { png = true; }
+		else if (wcscmp(argv[i], L"--simd") == 0 && i + 1 < argc && (wcscmp(argv[i+1], L"scalar") == 0 || wcscmp(argv[i+1], L"sse2") == 0 || wcscmp(argv[i+1], L"avx2") == 0)) {
+			i++;
+			setPixelSIMD(argv[i][0] == L's' ? (argv[i][1] == L'c' ? SIMD_SCALAR : SIMD_SSE2) : SIMD_AVX2);
+		}
+		else {
+			std::wcerr << L"Usage: PEResourceBench [--corpus DIR] [--profile NAME] [--files N] [--iterations N] [--jobs N] [--seed N]" << std::endl;
+			std::wcerr << L"                       [--png] [--simd scalar|sse2|avx2]" << std::endl;
+			std::wcerr << L"The synthetic PE files are written to DIR (bench_corpus by default) and left there. Profiles:";
+			for (size_t p = 0; p < corpus_profile_count; p++) { std::wcerr << L' ' << corpus_profiles[p].name; }
+			std::wcerr << std::endl;
+			return 1;
+		}
+	}
+	if (!createDirectory(corpus)) { ReportLastError(L"Cannot create directory '" + corpus + L"'"); return 1; }
+
+	std::vector<const char*> dumper_names;
+	for (size_t i = 0; i < dumper_count; i++) { dumper_names.push_back(dumpers[i].name); }
+	std::unique_ptr<ThreadPool> pool(jobs == 1 ? nullptr : new ThreadPool(jobs));
+
+	if (png) { std::wcout << L"Converting to PNG with " << pixelSIMDName(pixelSIMD()) << L" pixel kernels" << std::endl; }
+	std::wcout << L"Profile       files  resources     MB in    MB out   best ms  median ms  resources/s      MB/s" << std::endl;
+	for (size_t p = 0; p < corpus_profile_count; p++) {
+		const CorpusProfile& profile = corpus_profiles[p];
+		if (only && toUTF8(only) != profile.name) { continue; }
+		std::vector<std::wstring> files;
+		uint64_t bytes_in;
+		if (!generateCorpus(profile, corpus, files_per_profile, seed, files, bytes_in)) { return 1; }
+
+		// end-to-end without any instrumentation, the first pass warms up the page cache and is not counted
+		CopyingSink sink;
+		DumpOptions opts;
+		opts.jobs = jobs;
+		opts.sink = &sink;
+		opts.png = png;
+		dumpAll(files, opts, pool.get());
+		uint64_t resources = sink.resources, bytes_out = sink.bytes;
+		std::vector<uint64_t> times;
+		for (unsigned int i = 0; i < iterations; i++) { times.push_back(dumpAll(files, opts, pool.get())); }
+		std::sort(times.begin(), times.end());
+		double best = times[0] / 1e9, median = times[times.size() / 2] / 1e9;
+		std::wcout << std::left << std::setw(12) << fromUTF8(profile.name, strlen(profile.name)) << std::right <<
+			std::setw(7) << files.size() << std::setw(11) << resources << std::fixed << std::setprecision(1) <<
+			std::setw(10) << mb(bytes_in) << std::setw(10) << mb(bytes_out) << std::setprecision(2) <<
+			std::setw(10) << best * 1e3 << std::setw(11) << median * 1e3 << std::setprecision(0) <<
+			std::setw(13) << resources / best << std::setprecision(1) << std::setw(10) << mb(bytes_out) / best << std::endl;
+
+		// one more pass with the instrumentation to see the cost of each dumper, the dumpers reference the data
+		// instead of copying it so their cost is per resource and not per byte
+		Stats stats(dumper_names);
+		opts.stats = &stats;
+		dumpAll(files, opts, pool.get());
+		for (size_t i = 0; i < dumper_count; i++) {
+			const Stats::Metric& m = stats.dumper(i);
+			if (m.count() == 0) { continue; }
+			std::wcout << L"  " << std::left << std::setw(10) << fromUTF8(dumpers[i].name, strlen(dumpers[i].name)) << std::right <<
+				std::setw(8) << m.count() << L" resources" << std::setprecision(1) << std::setw(10) << (double)m.totalNs() / m.count() <<
+				L" ns/resource" << std::setw(8) << m.allocations() << L" allocations" << std::setw(10) << m.bytesCopied() << L" bytes copied" << std::endl;
+		}
+	}
+	return 0;
+}
+
+#ifndef _WIN32
+// Everywhere besides Windows the arguments are converted from UTF-8
+int main(int argc, char *argv[]) {
+	setlocale(LC_ALL, "");
+	std::vector<std::wstring> args;
+	std::vector<const wchar_t*> wargv;
+	for (int i = 0; i < argc; i++) { args.push_back(fromUTF8(argv[i], strlen(argv[i]))); }
+	for (int i = 0; i < argc; i++) { wargv.push_back(args[i].c_str()); }
+	return wmain(argc, wargv.data());
+}
+#endif
@@ -0,0 +1,72 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// A blocking queue with a maximum size used to connect the stages of a pipeline
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+template <class T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(capacity ? capacity : 1), closed(false) { }
+
+	// Adds an item, waiting while the queue is full. Returns false if the queue was closed.
+	bool push(T item) {
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->not_full.wait(lock, [this] { return this->closed || this->items.size() < this->capacity; });
+		if (this->closed) { return false; }
+		this->items.push_back(std::move(item));
+		lock.unlock();
+		this->not_empty.notify_one();
+		return true;
+	}
+
+	// Removes an item, waiting while the queue is empty. Returns false once the queue is closed and empty.
+	bool pop(T& item) {
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->not_empty.wait(lock, [this] { return this->closed || !this->items.empty(); });
+		if (this->items.empty()) { return false; }
+		item = std::move(this->items.front());
+		this->items.pop_front();
+		lock.unlock();
+		this->not_full.notify_one();
+		return true;
+	}
+
+	// No more items can be pushed, the remaining items can still be popped
+	void close() {
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->closed = true;
+		}
+		this->not_full.notify_all();
+		this->not_empty.notify_all();
+	}
+
+private:
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	std::mutex mutex;
+	std::condition_variable not_full, not_empty;
+	std::deque<T> items;
+	const size_t capacity;
+	bool closed;
+};
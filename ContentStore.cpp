@@ -0,0 +1,146 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "ContentStore.h"
+#include "Hash.h"
+
+#include <inttypes.h>
+
+ContentStore::ContentStore() : index(nullptr), added(0), reused(0), saved(0) { }
+
+ContentStore::~ContentStore() {
+	if (this->index) { fclose(this->index); }
+}
+
+// Each line of the index is "<xxh64> <size> <blob name> <sha256 or ->". A blob appears again when its
+// SHA-256 is computed later, the last line for a blob wins.
+bool ContentStore::open(const std::wstring& directory) {
+	if (!createDirectory(directory)) { return false; }
+	this->directory = directory;
+	std::wstring path = directory + PATH_SEP + L"index.txt";
+	FILE* f = openFile(path, "rb");
+	if (f) {
+		char line[512], name[256], sha[128];
+		while (fgets(line, sizeof(line), f)) {
+			Key key;
+			if (sscanf(line, "%" SCNx64 " %" SCNu64 " %255s %127s", &key.hash, &key.size, name, sha) != 4) { continue; }
+			std::deque<Blob>& candidates = this->blobs[key];
+			Blob* blob = nullptr;
+			for (Blob& b : candidates) { if (b.name == name) { blob = &b; break; } }
+			if (!blob) { candidates.push_back(Blob()); blob = &candidates.back(); blob->name = name; }
+			if (strcmp(sha, "-") != 0) { blob->sha = sha; }
+		}
+		fclose(f);
+	}
+	this->index = openFile(path, "ab");
+	return this->index != nullptr;
+}
+
+void ContentStore::record(const Key& key, const Blob& blob) {
+	fprintf(this->index, "%016" PRIx64 " %" PRIu64 " %s %s\n", key.hash, key.size, blob.name.c_str(), blob.sha.empty() ? "-" : blob.sha.c_str());
+	fflush(this->index);
+}
+
+// Blobs are spread across subdirectories named with the first two hex digits of their hash
+std::wstring ContentStore::blobPath(const std::string& name) {
+	std::wstring dir = this->directory + PATH_SEP + fromUTF8(name.c_str(), 2);
+	if (this->dirs.insert(dir).second) { createDirectory(dir); }
+	return dir + PATH_SEP + fromUTF8(name.c_str(), name.size());
+}
+
+// Computes the SHA-256 of a blob that was stored without it
+static bool hashBlob(const std::wstring& path, std::string& digest) {
+	FILE* f = openFile(path, "rb");
+	if (!f) { return false; }
+	SHA256 sha;
+	char buf[65536];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) != 0) { sha.update(buf, n); }
+	bool ok = !ferror(f);
+	fclose(f);
+	if (!ok) { return false; }
+	digest = sha.hexdigest();
+	return true;
+}
+
+static std::string hashOutput(const DumpOutput& out) {
+	SHA256 sha;
+	out.stream([&sha](const void* data, size_t size) { sha.update(data, size); return true; });
+	return sha.hexdigest();
+}
+
+// The mutex is only held to look up and add blobs, all of the hashing and file I/O is done without it
+bool ContentStore::save(const std::wstring& path, const DumpOutput& out) {
+	XXH64 xxh;
+	out.stream([&xxh](const void* data, size_t size) { xxh.update(data, size); return true; });
+	Key key = { xxh.digest(), out.size() };
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+	std::deque<Blob>& candidates = this->blobs[key];
+	// the strong hash is only needed if something already has the same fast hash and size
+	std::string sha;
+	for (size_t i = 0; i < candidates.size(); i++) {
+		if (sha.empty()) { lock.unlock(); sha = hashOutput(out); lock.lock(); }
+		Blob& blob = candidates[i];
+		this->cv.wait(lock, [&blob] { return !blob.busy; });
+		if (blob.failed) { continue; }
+		if (blob.sha.empty()) {
+			// the first thread that needs the strong hash of the blob reads it back
+			std::wstring blob_path = this->blobPath(blob.name);
+			std::string blob_sha;
+			blob.busy = true;
+			lock.unlock();
+			bool ok = hashBlob(blob_path, blob_sha);
+			lock.lock();
+			blob.busy = false;
+			if (ok) { blob.sha = blob_sha; this->record(key, blob); }
+			else { blob.failed = true; }
+			this->cv.notify_all();
+			if (!ok) { continue; }
+		}
+		if (blob.sha == sha) {
+			std::wstring blob_path = this->blobPath(blob.name);
+			lock.unlock();
+			if (!linkFile(blob_path, path)) { return writeFile(path, out); }
+			lock.lock();
+			this->reused++;
+			this->saved += key.size;
+			return true;
+		}
+	}
+
+	// a new blob, named by the fast hash and size and numbered if those collide, which is busy until written
+	candidates.push_back(Blob());
+	Blob& blob = candidates.back();
+	blob.name = toHex(key.hash) + "-" + std::to_string(key.size);
+	if (candidates.size() > 1) { blob.name += "-" + std::to_string(candidates.size() - 1); }
+	blob.sha = sha;
+	blob.busy = true;
+	std::wstring blob_path = this->blobPath(blob.name);
+	lock.unlock();
+	bool ok = writeFile(blob_path, out);
+	lock.lock();
+	blob.busy = false;
+	blob.failed = !ok;
+	if (ok) { this->record(key, blob); this->added++; }
+	this->cv.notify_all();
+	lock.unlock();
+	if (ok && linkFile(blob_path, path)) { return true; }
+
+	// linking is not possible (such as a different volume), so the file is written on its own
+	return writeFile(path, out);
+}
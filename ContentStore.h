@@ -0,0 +1,82 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// A content-addressed store used to deduplicate dumped resources. Each unique output is stored once as a
+// blob and the dumped files are hard links to the blobs.
+//
+// Outputs are first looked up by their XXH64 hash and size. Only when that matches an existing blob is the
+// SHA-256 computed to confirm they are identical, so unique outputs never pay for the strong hash. The index
+// is an append-only text file in the store so it persists across runs.
+
+#pragma once
+
+#include "general.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+
+class ContentStore {
+public:
+	ContentStore();
+	~ContentStore();
+
+	// Opens (or creates) the store in the directory and loads its index
+	bool open(const std::wstring& directory);
+
+	// Saves the output to the path, either as a link to an existing identical blob or by adding a new blob
+	bool save(const std::wstring& path, const DumpOutput& out);
+
+	// Statistics
+	size_t blobsAdded() const { return this->added; }
+	size_t blobsReused() const { return this->reused; }
+	uint64_t bytesSaved() const { return this->saved; }
+
+private:
+	ContentStore(const ContentStore&) = delete;
+	ContentStore& operator=(const ContentStore&) = delete;
+
+	// Blobs are written and hashed without holding the mutex, while that happens the blob is busy and other
+	// threads that need it wait for it
+	struct Blob {
+		std::string name;
+		std::string sha; // empty until it is needed
+		bool busy = false;
+		bool failed = false; // it could not be written or read and is never used
+	};
+	struct Key {
+		uint64_t hash, size;
+		bool operator==(const Key& k) const { return this->hash == k.hash && this->size == k.size; }
+	};
+	struct KeyHash { size_t operator()(const Key& k) const { return (size_t)(k.hash ^ (k.size * 0x9E3779B97F4A7C15ULL)); } };
+
+	std::wstring blobPath(const std::string& name);
+	void record(const Key& key, const Blob& blob);
+
+	std::wstring directory;
+	std::unordered_map<Key, std::deque<Blob>, KeyHash> blobs; // a deque so blobs stay put while others are added
+	std::set<std::wstring> dirs;
+	FILE* index;
+	std::mutex mutex; // protects everything besides the contents of the blob files
+	std::condition_variable cv; // notified whenever a blob stops being busy
+	size_t added, reused;
+	uint64_t saved;
+};
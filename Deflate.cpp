@@ -0,0 +1,384 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "Deflate.h"
+
+#include <string.h>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static const int LITLEN_CODES = 286, DIST_CODES = 30, CODELEN_CODES = 19, MAX_BITS = 15, MAX_CODELEN_BITS = 7;
+static const size_t WINDOW = 32768, MIN_MATCH = 4, MAX_MATCH = 258;
+static const size_t BLOCK_SYMBOLS = 1 << 16; // symbols in each block, each block gets its own Huffman codes
+static const size_t STORED_MAX = 65535;
+
+static inline uint32_t read32(const uint8_t* p) { uint32_t x; memcpy(&x, p, 4); return x; } // assumes little-endian
+static inline uint64_t read64(const uint8_t* p) { uint64_t x; memcpy(&x, p, 8); return x; }
+static inline unsigned ctz64(uint64_t x) {
+#ifdef _MSC_VER
+	unsigned long i; _BitScanForward64(&i, x); return (unsigned)i;
+#else
+	return (unsigned)__builtin_ctzll(x);
+#endif
+}
+
+#pragma region Tables
+////////////////////////////////////////////////////////////////////////////////
+///// Tables
+////////////////////////////////////////////////////////////////////////////////
+static const uint16_t len_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t len_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const uint8_t codelen_order[CODELEN_CODES] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// Lookup tables for the length and distance codes of matches and the fixed Huffman code, built once
+struct Tables {
+	uint8_t len_code[MAX_MATCH + 1]; // the length code (0-28, 257 is added) for each match length
+	uint8_t dist_code[512]; // the distance code of dist-1 < 256 or at 256 + ((dist-1) >> 7) for the rest
+	uint8_t fixed_lit[288], fixed_dist[DIST_CODES];
+	Tables() {
+		for (int c = 0; c < 29; c++) {
+			for (int l = len_base[c]; l < len_base[c] + (1 << len_extra[c]) && l <= (int)MAX_MATCH; l++) { this->len_code[l] = (uint8_t)c; }
+		}
+		this->len_code[MAX_MATCH] = 28;
+		for (int c = 0; c < DIST_CODES; c++) {
+			for (int d = dist_base[c] - 1; d < dist_base[c] - 1 + (1 << dist_extra[c]); d++) {
+				if (d < 256) { this->dist_code[d] = (uint8_t)c; }
+				else { this->dist_code[256 + (d >> 7)] = (uint8_t)c; }
+			}
+		}
+		for (int i = 0; i < 288; i++) { this->fixed_lit[i] = i < 144 ? 8 : (i < 256 ? 9 : (i < 280 ? 7 : 8)); }
+		for (int i = 0; i < DIST_CODES; i++) { this->fixed_dist[i] = 5; }
+	}
+	unsigned distCode(unsigned dist) const { return dist <= 256 ? this->dist_code[dist - 1] : this->dist_code[256 + ((dist - 1) >> 7)]; }
+};
+static const Tables& tables() { static const Tables t; return t; }
+#pragma endregion
+
+#pragma region Huffman Codes
+////////////////////////////////////////////////////////////////////////////////
+///// Huffman Codes
+////////////////////////////////////////////////////////////////////////////////
+/* Computes the lengths of a minimum-redundancy code in place (Moffat and Katajainen), the frequencies must
+   be sorted in ascending order and are replaced by the code lengths */
+static void minimumRedundancy(uint32_t* A, int n) {
+	A[0] += A[1];
+	int root = 0, leaf = 2, next;
+	for (next = 1; next < n - 1; next++) {
+		if (leaf >= n || A[root] < A[leaf]) { A[next] = A[root]; A[root++] = next; }
+		else { A[next] = A[leaf++]; }
+		if (leaf >= n || (root < next && A[root] < A[leaf])) { A[next] += A[root]; A[root++] = next; }
+		else { A[next] += A[leaf++]; }
+	}
+	A[n - 2] = 0;
+	for (next = n - 3; next >= 0; next--) { A[next] = A[A[next]] + 1; }
+	int avbl = 1, used = 0, depth = 0;
+	root = n - 2; next = n - 1;
+	while (avbl > 0) {
+		while (root >= 0 && (int)A[root] == depth) { used++; root--; }
+		while (avbl > used) { A[next--] = depth; avbl--; }
+		avbl = 2 * used; depth++; used = 0;
+	}
+}
+
+/* Computes the code lengths for the frequencies of n symbols, limited to max_bits */
+static void buildLengths(const uint32_t* freq, int n, int max_bits, uint8_t* lens) {
+	struct Sym { uint32_t freq; uint16_t sym; };
+	Sym syms[LITLEN_CODES];
+	uint32_t A[LITLEN_CODES];
+	int count = 0;
+	memset(lens, 0, n);
+	for (int i = 0; i < n; i++) { if (freq[i]) { syms[count].freq = freq[i]; syms[count++].sym = (uint16_t)i; } }
+	if (count == 0) { return; }
+	// a single symbol gets a second, unused, code so the code is complete
+	if (count == 1) { lens[syms[0].sym] = 1; lens[syms[0].sym == 0 ? 1 : 0] = 1; return; }
+	std::sort(syms, syms + count, [](const Sym& a, const Sym& b) { return a.freq < b.freq || (a.freq == b.freq && a.sym < b.sym); });
+	for (int i = 0; i < count; i++) { A[i] = syms[i].freq; }
+	minimumRedundancy(A, count);
+
+	// Lengths that are too long are shortened, then codes are lengthened until the code is complete again
+	int num[MAX_BITS + 1] = { 0 };
+	for (int i = 0; i < count; i++) { num[std::min((int)A[i], max_bits)]++; }
+	uint32_t total = 0;
+	for (int i = max_bits; i > 0; i--) { total += (uint32_t)num[i] << (max_bits - i); }
+	while (total > (1u << max_bits)) {
+		num[max_bits]--;
+		for (int i = max_bits - 1; i > 0; i--) { if (num[i]) { num[i]--; num[i + 1] += 2; break; } }
+		total--;
+	}
+	// the longest codes go to the least frequent symbols
+	int k = 0;
+	for (int len = max_bits; len > 0; len--) {
+		for (int j = num[len]; j > 0; j--) { lens[syms[k++].sym] = (uint8_t)len; }
+	}
+}
+
+/* Assigns the canonical codes for the code lengths, bit-reversed since deflate writes them starting with
+   the most significant bit while everything else starts with the least */
+static void buildCodes(const uint8_t* lens, int n, uint16_t* codes) {
+	uint16_t count[MAX_BITS + 1] = { 0 }, next[MAX_BITS + 1];
+	for (int i = 0; i < n; i++) { count[lens[i]]++; }
+	count[0] = 0;
+	uint16_t code = 0;
+	for (int bits = 1; bits <= MAX_BITS; bits++) { code = (uint16_t)((code + count[bits - 1]) << 1); next[bits] = code; }
+	for (int i = 0; i < n; i++) {
+		if (!lens[i]) { continue; }
+		uint16_t c = next[lens[i]]++, r = 0;
+		for (int b = 0; b < lens[i]; b++) { r = (uint16_t)((r << 1) | (c & 1)); c >>= 1; }
+		codes[i] = r;
+	}
+}
+#pragma endregion
+
+#pragma region Blocks
+////////////////////////////////////////////////////////////////////////////////
+///// Blocks
+////////////////////////////////////////////////////////////////////////////////
+// Writes bits starting with the least significant bit, the buffer must be large enough for everything
+struct BitWriter {
+	uint8_t* p;
+	uint64_t bits;
+	unsigned count;
+	explicit BitWriter(uint8_t* p) : p(p), bits(0), count(0) { }
+	inline void put(uint32_t v, unsigned n) {
+		this->bits |= (uint64_t)v << this->count;
+		this->count += n;
+		if (this->count >= 32) {
+			uint32_t x = (uint32_t)this->bits;
+			memcpy(this->p, &x, 4);
+			this->p += 4; this->bits >>= 32; this->count -= 32;
+		}
+	}
+	// Pads to a whole byte and writes everything
+	void flush() {
+		for (; this->count > 0; this->count = this->count > 8 ? this->count - 8 : 0) { *this->p++ = (uint8_t)this->bits; this->bits >>= 8; }
+		this->bits = 0;
+	}
+};
+
+// A literal is just the byte, a match has the high bit set with the distance above the length - 3
+static inline uint32_t matchSymbol(size_t len, size_t dist) { return 0x80000000u | (uint32_t)(dist << 8) | (uint32_t)(len - 3); }
+
+/* Writes the symbols with a Huffman code */
+static void writeSymbols(BitWriter& w, const uint32_t* syms, size_t count, const uint8_t* lit_lens, const uint16_t* lit_codes, const uint8_t* dist_lens, const uint16_t* dist_codes) {
+	const Tables& t = tables();
+	for (size_t i = 0; i < count; i++) {
+		uint32_t s = syms[i];
+		if (!(s & 0x80000000u)) { w.put(lit_codes[s], lit_lens[s]); continue; }
+		unsigned len = (s & 0xFF) + 3, dist = (s >> 8) & 0xFFFF, lc = t.len_code[len], dc = t.distCode(dist);
+		w.put(lit_codes[257 + lc], lit_lens[257 + lc]);
+		if (len_extra[lc]) { w.put(len - len_base[lc], len_extra[lc]); }
+		w.put(dist_codes[dc], dist_lens[dc]);
+		if (dist_extra[dc]) { w.put(dist - dist_base[dc], dist_extra[dc]); }
+	}
+	w.put(lit_codes[256], lit_lens[256]);
+}
+
+/* Writes a block as the smallest of a dynamic Huffman, fixed Huffman, or stored block. The raw data is the
+   part of the input that the symbols encode. */
+static void writeBlock(BitWriter& w, const uint32_t* syms, size_t count, const uint8_t* raw, size_t raw_size, bool last) {
+	const Tables& t = tables();
+	uint32_t lit_freq[LITLEN_CODES] = { 0 }, dist_freq[DIST_CODES] = { 0 };
+	uint64_t extra_bits = 0;
+	for (size_t i = 0; i < count; i++) {
+		uint32_t s = syms[i];
+		if (!(s & 0x80000000u)) { lit_freq[s]++; continue; }
+		unsigned lc = t.len_code[(s & 0xFF) + 3], dc = t.distCode((s >> 8) & 0xFFFF);
+		lit_freq[257 + lc]++;
+		dist_freq[dc]++;
+		extra_bits += len_extra[lc] + dist_extra[dc];
+	}
+	lit_freq[256] = 1;
+
+	// Dynamic Huffman codes
+	uint8_t lit_lens[LITLEN_CODES], dist_lens[DIST_CODES];
+	buildLengths(lit_freq, LITLEN_CODES, MAX_BITS, lit_lens);
+	buildLengths(dist_freq, DIST_CODES, MAX_BITS, dist_lens);
+	int hlit = LITLEN_CODES, hdist = DIST_CODES;
+	while (hlit > 257 && !lit_lens[hlit - 1]) { hlit--; }
+	while (hdist > 1 && !dist_lens[hdist - 1]) { hdist--; }
+	if (!dist_lens[0] && hdist == 1) { dist_lens[0] = 1; } // at least one distance code is always given
+
+	// The code lengths of both codes are run-length encoded together
+	uint8_t all[LITLEN_CODES + DIST_CODES];
+	memcpy(all, lit_lens, hlit);
+	memcpy(all + hlit, dist_lens, hdist);
+	int total = hlit + hdist;
+	uint16_t rle[LITLEN_CODES + DIST_CODES]; // symbol in the low byte, the extra bits above it
+	int nrle = 0;
+	uint32_t cl_freq[CODELEN_CODES] = { 0 };
+	for (int i = 0; i < total; ) {
+		uint8_t v = all[i];
+		int run = 1;
+		while (i + run < total && all[i + run] == v) { run++; }
+		i += run;
+		if (v == 0) {
+			for (; run >= 11; ) { int r = std::min(run, 138); rle[nrle++] = (uint16_t)(18 | ((r - 11) << 8)); run -= r; }
+			if (run >= 3) { rle[nrle++] = (uint16_t)(17 | ((run - 3) << 8)); run = 0; }
+		}
+		else {
+			rle[nrle++] = v; run--;
+			for (; run >= 3; ) { int r = std::min(run, 6); rle[nrle++] = (uint16_t)(16 | ((r - 3) << 8)); run -= r; }
+		}
+		for (; run > 0; run--) { rle[nrle++] = v; }
+	}
+	for (int i = 0; i < nrle; i++) { cl_freq[rle[i] & 0xFF]++; }
+	uint8_t cl_lens[CODELEN_CODES];
+	buildLengths(cl_freq, CODELEN_CODES, MAX_CODELEN_BITS, cl_lens);
+	int hclen = CODELEN_CODES;
+	while (hclen > 4 && !cl_lens[codelen_order[hclen - 1]]) { hclen--; }
+
+	// The size of each kind of block
+	uint64_t dynamic_bits = 3 + 14 + 3 * hclen + extra_bits, fixed_bits = 3 + extra_bits;
+	for (int i = 0; i < nrle; i++) {
+		uint8_t s = rle[i] & 0xFF;
+		dynamic_bits += cl_lens[s] + (s == 16 ? 2 : (s == 17 ? 3 : (s == 18 ? 7 : 0)));
+	}
+	for (int i = 0; i < LITLEN_CODES; i++) { dynamic_bits += (uint64_t)lit_freq[i] * lit_lens[i]; fixed_bits += (uint64_t)lit_freq[i] * t.fixed_lit[i]; }
+	for (int i = 0; i < DIST_CODES; i++) { dynamic_bits += (uint64_t)dist_freq[i] * dist_lens[i]; fixed_bits += (uint64_t)dist_freq[i] * 5; }
+	uint64_t stored_bits = (raw_size + 5 * std::max<size_t>((raw_size + STORED_MAX - 1) / STORED_MAX, 1)) * 8 + 7;
+
+	if (stored_bits < dynamic_bits && stored_bits < fixed_bits) {
+		size_t off = 0;
+		do {
+			size_t n = std::min(raw_size - off, STORED_MAX);
+			w.put((last && off + n == raw_size) ? 1 : 0, 1);
+			w.put(0, 2);
+			w.flush();
+			uint8_t hdr[4] = { (uint8_t)n, (uint8_t)(n >> 8), (uint8_t)~n, (uint8_t)(~n >> 8) };
+			memcpy(w.p, hdr, 4);
+			memcpy(w.p + 4, raw + off, n);
+			w.p += 4 + n;
+			off += n;
+		} while (off < raw_size);
+	}
+	else if (fixed_bits <= dynamic_bits) {
+		uint16_t lit_codes[288], dist_codes[DIST_CODES];
+		buildCodes(t.fixed_lit, 288, lit_codes);
+		buildCodes(t.fixed_dist, DIST_CODES, dist_codes);
+		w.put(last ? 1 : 0, 1);
+		w.put(1, 2);
+		writeSymbols(w, syms, count, t.fixed_lit, lit_codes, t.fixed_dist, dist_codes);
+	}
+	else {
+		uint16_t lit_codes[LITLEN_CODES], dist_codes[DIST_CODES], cl_codes[CODELEN_CODES];
+		buildCodes(lit_lens, LITLEN_CODES, lit_codes);
+		buildCodes(dist_lens, DIST_CODES, dist_codes);
+		buildCodes(cl_lens, CODELEN_CODES, cl_codes);
+		w.put(last ? 1 : 0, 1);
+		w.put(2, 2);
+		w.put(hlit - 257, 5);
+		w.put(hdist - 1, 5);
+		w.put(hclen - 4, 4);
+		for (int i = 0; i < hclen; i++) { w.put(cl_lens[codelen_order[i]], 3); }
+		for (int i = 0; i < nrle; i++) {
+			uint8_t s = rle[i] & 0xFF;
+			w.put(cl_codes[s], cl_lens[s]);
+			if (s >= 16) { w.put(rle[i] >> 8, s == 16 ? 2 : (s == 17 ? 3 : 7)); }
+		}
+		writeSymbols(w, syms, count, lit_lens, lit_codes, dist_lens, dist_codes);
+	}
+}
+#pragma endregion
+
+/* Finds how many bytes match, up to max */
+static inline size_t matchLength(const uint8_t* a, const uint8_t* b, size_t max) {
+	size_t n = 0;
+	for (; n + 8 <= max; n += 8) {
+		uint64_t x = read64(a + n) ^ read64(b + n);
+		if (x) { return n + ctz64(x) / 8; }
+	}
+	while (n < max && a[n] == b[n]) { n++; }
+	return n;
+}
+
+size_t zlibBound(size_t size) {
+	// at worst everything is stored, each block can have one more stored chunk and there is at most one block
+	// for every STORED_MAX bytes plus the last
+	return 2 + size + 10 * (size / STORED_MAX + 2) + 4 + 16;
+}
+
+void zlibCompress(const void* data, size_t size, std::vector<uint8_t>& out) {
+	size_t start = out.size();
+	out.resize(start + zlibBound(size));
+	out.resize(start + zlibCompress(data, size, out.data() + start));
+}
+
+size_t zlibCompress(const void* data, size_t size, uint8_t* p) {
+	const uint8_t* in = (const uint8_t*)data;
+	p[0] = 0x78; p[1] = 0x01; // 32K window, fastest compression
+	BitWriter w(p + 2);
+
+	// The hash table has the last position (plus one) of each hash of 4 bytes, smaller inputs use smaller
+	// tables so they are quick to clear
+	unsigned bits = 10;
+	while (bits < 15 && ((size_t)1 << bits) < size) { bits++; }
+	static thread_local std::vector<uint32_t> head;
+	static thread_local std::vector<uint32_t> syms;
+	head.assign((size_t)1 << bits, 0);
+	syms.resize(BLOCK_SYMBOLS);
+	uint32_t* s = syms.data(), *s_end = s + BLOCK_SYMBOLS;
+
+	size_t i = 0, block_start = 0;
+	while (i < size) {
+		if (i + MIN_MATCH <= size) {
+			uint32_t cur = read32(in + i), h = (cur * 2654435761u) >> (32 - bits);
+			size_t cand = head[h];
+			head[h] = (uint32_t)(i + 1);
+			if (cand && i - (cand - 1) <= WINDOW && read32(in + cand - 1) == cur) {
+				size_t len = MIN_MATCH + matchLength(in + cand - 1 + MIN_MATCH, in + i + MIN_MATCH, std::min(MAX_MATCH, size - i) - MIN_MATCH);
+				*s++ = matchSymbol(len, i - (cand - 1));
+				i += len;
+			}
+			else { *s++ = in[i++]; }
+		}
+		else { *s++ = in[i++]; }
+		if (s == s_end) {
+			writeBlock(w, syms.data(), s - syms.data(), in + block_start, i - block_start, false);
+			s = syms.data();
+			block_start = i;
+		}
+	}
+	writeBlock(w, syms.data(), s - syms.data(), in + block_start, i - block_start, true);
+	w.flush();
+
+	uint32_t adler = adler32(1, data, size);
+	uint8_t trailer[4] = { (uint8_t)(adler >> 24), (uint8_t)(adler >> 16), (uint8_t)(adler >> 8), (uint8_t)adler };
+	memcpy(w.p, trailer, 4);
+	return w.p + 4 - p;
+}
+
+uint32_t adler32(uint32_t adler, const void* data, size_t size) {
+	const uint8_t* p = (const uint8_t*)data;
+	uint32_t a = adler & 0xFFFF, b = adler >> 16;
+	while (size) {
+		// the largest number of bytes that cannot overflow b
+		size_t n = std::min<size_t>(size, 5552);
+		size -= n;
+		for (; n >= 8; n -= 8, p += 8) {
+			a += p[0]; b += a; a += p[1]; b += a; a += p[2]; b += a; a += p[3]; b += a;
+			a += p[4]; b += a; a += p[5]; b += a; a += p[6]; b += a; a += p[7]; b += a;
+		}
+		for (; n; n--) { a += *p++; b += a; }
+		a %= 65521; b %= 65521;
+	}
+	return (b << 16) | a;
+}
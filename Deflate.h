@@ -0,0 +1,36 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// A fast deflate (RFC 1951) compressor for the PNG encoder, about as fast and as good as level 1 of zlib:
+// greedy matching with a single probe of a hash table and a dynamic Huffman code for each block (or a stored
+// block when that is smaller)
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Appends the zlib stream (RFC 1950) of the data to out
+void zlibCompress(const void* data, size_t size, std::vector<uint8_t>& out);
+// Writes the zlib stream of the data to out, which must have room for zlibBound(size) bytes, and returns
+// the size of the stream
+size_t zlibCompress(const void* data, size_t size, uint8_t* out);
+// The most that the zlib stream of data of the size can take
+size_t zlibBound(size_t size);
+// Updates an Adler-32 checksum (start with 1)
+uint32_t adler32(uint32_t adler, const void* data, size_t size);
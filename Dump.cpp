@@ -0,0 +1,497 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// The core of dumping: the dumpers that convert resources and the functions that find, convert, and save
+// the resources of a PE file
+
+#include "stdafx.h"
+#include "Dump.h"
+#include "Sniff.h"
+#include "Strings.h"
+#include "PNG.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <unordered_set>
+
+#pragma warning(push)
+#pragma warning(disable:4100) // unreferenced formal parameter
+
+/* Converts DIB image to BMP image by adding a BMP file header in front of the DIB data */
+bool dib2bmp(const void* data, size_t size, DumpOutput& out) {
+	if (size < sizeof(BITMAPCOREHEADER)) { return false; }
+	// Get the offset to the pixel data, need to get the size of the header plus the size of the palette
+	size_t off = ((const uint32_t*)data)[0];
+	if (off == sizeof(BITMAPCOREHEADER)) {
+		const BITMAPCOREHEADER* h = (const BITMAPCOREHEADER*)data;
+		if (h->bcBitCount < 16) { off += (1 << h->bcBitCount)*3; }
+	}
+	else {
+		if (size < sizeof(BITMAPINFOHEADER)) { return false; }
+		const BITMAPINFOHEADER* h = (const BITMAPINFOHEADER*)data;
+		if (off < 36) { if (h->biBitCount < 16) { off += (1 << h->biBitCount) * 3; } }
+		else if (h->biBitCount < 16) { off += ((h->biClrUsed == 0) ? (1 << h->biBitCount) : h->biClrUsed) * 4; }
+		else if (h->biBitCount == 16) { off += h->biClrUsed * 4; }
+		if (off == sizeof(BITMAPINFOHEADER)) {
+			if (h->biCompression == BI_BITFIELDS) { off += sizeof(DWORD) * 3; }
+			else if (h->biCompression == 6 /*BI_ALPHABITFIELDS*/) { off += sizeof(DWORD) * 4; }
+		}
+	}
+	// need to add bitmap header: type="BM", size and offset include header
+	BITMAPFILEHEADER bmp = { 0x4D42, (DWORD)(size + sizeof(BITMAPFILEHEADER)), 0, 0, (DWORD)(off + sizeof(BITMAPFILEHEADER)) };
+	void* d = out.addOwned(sizeof(BITMAPFILEHEADER));
+	if (!d) { return false; }
+	memcpy(d, &bmp, sizeof(BITMAPFILEHEADER));
+	out.add(data, size);
+	return true;
+}
+
+/* Dumps a RT_BITMAP (actually a DIB) to a BMP file */
+bool dump_bitmap(const DumpContext& ctx, resid type, resid name, uint16_t lang, const void* data, size_t size, DumpOutput& out) {
+	if (type != RT_BITMAP) { return false; }
+	out.ext = L"bmp";
+	return dib2bmp(data, size, out);
+}
+
+const ICOGroupIndex& DumpContext::icoGroups() const {
+	std::call_once(this->ico_once, [this] { this->ico_groups.reset(new ICOGroupIndex(this->rsrc)); });
+	return *this->ico_groups;
+}
+
+/* Dumps a RT_ICON, RT_CURSOR, RT_GROUP_ICON, or RT_GROUP_CURSOR to an ICO/CUR file */
+bool dump_ico(const DumpContext& ctx, resid type, resid name, uint16_t lang, const void* data, size_t size, DumpOutput& out) {
+	bool is_cursor = (type == RT_CURSOR || type == RT_GROUP_CURSOR);
+	out.ext = is_cursor ? L"cur" : L"ico";
+	if (type == RT_ICON || type == RT_CURSOR) { return extractICOIndividual(type, name, lang, data, size, out, ctx.icoGroups()); }
+	else if (type == RT_GROUP_ICON || type == RT_GROUP_CURSOR) { return extractICOGroup(type, name, lang, data, size, out, ctx.icoGroups()); }
+	return false;
+}
+
+/* Dumps a RT_BITMAP or a RT_ICON image to a PNG file (only used with --png), icon images that are already
+   PNG are dumped as they are */
+bool dump_png(const DumpContext& ctx, resid type, resid name, uint16_t lang, const void* data, size_t size, DumpOutput& out) {
+	if (type != RT_BITMAP && type != RT_ICON) { return false; }
+	out.ext = L"png";
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (type == RT_ICON && size >= 8 && memcmp(data, signature, 8) == 0) { out.add(data, size); return true; }
+	// the image is encoded straight into memory that the output takes
+	size_t png_size;
+	uint8_t* png = dib2png(data, size, type == RT_ICON, png_size);
+	if (!png) { return false; }
+	out.addOwned(png, png_size);
+	return true;
+}
+
+/* Dumps a RT_MANIFEST to an XML file */
+bool dump_manifest(const DumpContext& ctx, resid type, resid name, uint16_t lang, const void* data, size_t size, DumpOutput& out) {
+	if (type != RT_MANIFEST || size == 0 || ((const char*)data)[0] != '<') { return false; }
+	out.ext = L"xml";
+	out.add(data, size);
+	return true;
+}
+
+/* Dumps data in a format recognized from its first bytes (such as PNG, WAV, or TTF) without any conversion */
+bool dump_sniffed(const DumpContext& ctx, resid type, resid name, uint16_t lang, const void* data, size_t size, DumpOutput& out) {
+	const wchar_t* ext = sniffFormat(data, size);
+	if (!ext) { return false; }
+	out.ext = ext;
+	out.add(data, size);
+	return true;
+}
+
+/* Dumps data straight to a binary file without any conversion, used as a fallback */
+bool dump_binary(const DumpContext& ctx, resid type, resid name, uint16_t lang, const void* data, size_t size, DumpOutput& out) {
+	out.ext = L"bin";
+	out.add(data, size);
+	return true;
+}
+
+#pragma warning(pop)
+
+enum { DUMPER_BITMAP, DUMPER_ICO, DUMPER_PNG, DUMPER_MANIFEST, DUMPER_SNIFFED, DUMPER_BINARY, NO_DUMPER = 0xFF };
+const Dumper dumpers[] = {
+	{ dump_bitmap, "bitmap" }, { dump_ico, "ico" }, { dump_png, "png" }, { dump_manifest, "manifest" }, { dump_sniffed, "sniffed" },
+	{ dump_binary, "binary" }
+};
+const size_t dumper_count = ARRAYSIZE(dumpers);
+
+// The dumper for each integer resource type that has one
+static const uint8_t type_dumpers[] = {
+	NO_DUMPER, DUMPER_ICO /* CURSOR */, DUMPER_BITMAP /* BITMAP */, DUMPER_ICO /* ICON */, NO_DUMPER, NO_DUMPER, NO_DUMPER,
+	NO_DUMPER, NO_DUMPER, NO_DUMPER, NO_DUMPER, NO_DUMPER, DUMPER_ICO /* GROUP_CURSOR */, NO_DUMPER,
+	DUMPER_ICO /* GROUP_ICON */, NO_DUMPER, NO_DUMPER, NO_DUMPER, NO_DUMPER, NO_DUMPER, NO_DUMPER, NO_DUMPER, NO_DUMPER,
+	NO_DUMPER, DUMPER_MANIFEST /* MANIFEST */,
+};
+
+/* Finds all resources to dump and creates each directory needed for them exactly once (unless nothing is
+   written to the filesystem). Different names can have the same filename, such as the number 1 and the
+   string "1" or the strings "a:b" and "a?b" which are both sanitized to "a_b", so each one after the first
+   in a directory gets a numbered suffix in the order of the file and the output doesn't depend on which
+   thread writes first. */
+std::vector<DumpTask> enumerateResources(const PE::Rsrc * const rsrc, const std::wstring& directory, std::set<std::wstring>& dirs, const DumpOptions& opts) {
+	StatTimer timer(opts.stage(Stats::ENUMERATE));
+	const Sink& sink = opts.output();
+	bool create = sink.usesFiles(), first_only = sink.firstOnly();
+	std::vector<DumpTask> tasks;
+	for (const PE::ResourceType& rsrc_type : rsrc->types()) {
+		resid type = rsrc_type.getType();
+		if (!sink.wants(type)) { continue; }
+		// the types that go into the resource script only get directories when they are needed
+		bool create_type = create && !(opts.rc && isScriptType(type));
+		std::wstring dir(directory);
+		dir += PATH_SEP;
+		size_t type_start = dir.size();
+		appendTypeName(dir, type);
+		sanitizeFilename(dir, type_start);
+		if (create_type && !createDirectory(dir)) { ReportLastError(L"Cannot create directory '" + dir + L"'", true); continue; }
+		const std::wstring* dir_type = &*dirs.insert(dir).first;
+		std::wstring dl(dir);
+		dl += PATH_SEP;
+		size_t lang_start = dl.size();
+		// the filenames used in the directories of the type, with "/LANG" after those in the language directories
+		std::unordered_set<std::wstring> leaves;
+		std::wstring leaf;
+		for (const PE::ResourceName& rsrc_name : rsrc_type.names()) {
+			resid name = rsrc_name.getName();
+			bool save_lang = rsrc_name.langs().size() > 1;
+			for (const PE::ResourceLang& rsrc_lang : rsrc_name.langs()) {
+				uint16_t lang = rsrc_lang.getLang();
+				const std::wstring* dir_lang = dir_type;
+				if (save_lang) {
+					// the directory of a language is only built into a reused string to look it up
+					dl.resize(lang_start);
+					appendUInt(dl, lang);
+					auto itr = dirs.find(dl);
+					if (itr == dirs.end()) {
+						if (create_type && !createDirectory(dl)) { ReportLastError(L"Cannot create directory '" + dl + L"'", true); continue; }
+						itr = dirs.insert(dl).first;
+					}
+					dir_lang = &*itr;
+				}
+				unsigned int duplicate = 0;
+				if (create) {
+					// the extension depends on the dumper so it is left off, the '.' sanitizes reserved names like the path does
+					for (;; duplicate++) {
+						leaf.clear();
+						appendFileName(leaf, name, duplicate);
+						leaf += L'.';
+						sanitizeFilename(leaf, 0);
+						if (save_lang) { leaf += L'/'; appendUInt(leaf, lang); }
+						if (leaves.insert(leaf).second) { break; }
+					}
+					if (duplicate) {
+						std::lock_guard<std::mutex> lock(output_mutex);
+						std::wcerr << L"! Warning: " << *dir_lang << PATH_SEP << getName(name) << L" has the same filename as another resource, it is saved with the suffix ~" << duplicate << std::endl;
+					}
+				}
+				DumpTask task = { type, name, lang, &rsrc_lang, dir_lang, duplicate };
+				tasks.push_back(task);
+				if (first_only) { timer.stop(0, 0); return tasks; }
+			}
+		}
+	}
+	timer.stop(0, 0);
+	return tasks;
+}
+
+/* Runs the dumpers on a resource, the output references the resource data in the mapped PE file. The
+   dumper for the type of the resource is tried first (if there is one, with --png bitmaps and icon images
+   try the PNG dumper before that), then the format of the data is sniffed, and finally it is dumped as
+   binary. */
+bool convertResource(const DumpContext& ctx, const DumpTask& task, DumpOutput& out) {
+	const void* data = task.rsrc_lang->data();
+	size_t size = task.rsrc_lang->size();
+	size_t id = IS_INTRESOURCE(task.type) ? LOWORD((ULONG_PTR)task.type) : ARRAYSIZE(type_dumpers);
+	bool png = ctx.opts.png && (id == 2 /* BITMAP */ || id == 3 /* ICON */);
+	const uint8_t order[] = { png ? (uint8_t)DUMPER_PNG : (uint8_t)NO_DUMPER, id < ARRAYSIZE(type_dumpers) ? type_dumpers[id] : (uint8_t)NO_DUMPER, DUMPER_SNIFFED, DUMPER_BINARY };
+	StatTimer total(ctx.opts.stage(Stats::CONVERT));
+	// only the pages of mapped files can be released, in any other memory that would throw the data away
+	if (ctx.rsrc->isMapped()) { out.setSource(data, size); }
+	for (uint8_t i : order) {
+		if (i == NO_DUMPER) { continue; }
+		StatTimer timer(ctx.opts.stats ? &ctx.opts.stats->dumper(i) : nullptr);
+		if (dumpers[i].func(ctx, task.type, task.name, task.lang, data, size, out)) {
+			// only the dumper that converts the resource counts it, the time spent in the others is part of the total
+			timer.stop(size, out.size(), out.ownedCount(), out.ownedBytes());
+			total.stop(size, out.size(), out.ownedCount(), out.ownedBytes());
+			return true;
+		}
+		out.clear();
+	}
+	return false;
+}
+
+/* The sink resources are given to, when there isn't one they are written to files */
+Sink& DumpOptions::output() const {
+	static FileSink files;
+	return this->sink ? *this->sink : files;
+}
+
+/* Gives a converted resource to the sink, with the path of its file if the sink writes files */
+bool saveResource(const DumpContext& ctx, const DumpTask& task, DumpOutput& out) {
+	Sink& sink = ctx.opts.output();
+	bool files = sink.usesFiles();
+	StatTimer path_timer(ctx.opts.stage(Stats::PATH));
+	// the path is built into a reused string, the sink copies it if it needs it after saving
+	thread_local std::wstring path;
+	if (files) { buildPath(path, *task.directory, task.name, out.ext, task.duplicate); }
+	else { path.clear(); }
+	path_timer.stop(0, path.size() * sizeof(wchar_t));
+	if (ctx.opts.index) {
+		// embedded files are labeled with just the TYPE/NAME/LANG of each file they are in, the root is the path
+		ctx.opts.index->add(ctx.path, ctx.embedded(), task.type, task.name, task.lang, task.rsrc_lang->data(), task.rsrc_lang->size(), out);
+	}
+
+	StatTimer timer(ctx.opts.stage(Stats::WRITE));
+	size_t size = out.size(); // the sink may take the output
+	if (files && ctx.opts.manifest && ctx.opts.manifest->unchanged(ctx.root().file, path, task.rsrc_lang->rva(), task.rsrc_lang->size(), out)) {
+		timer.stop(size, 0);
+		return true;
+	}
+	// with a background writer only the time to hand it over is counted
+	bool ok = sink.save(ctx, task, path, out);
+	timer.stop(size, ok ? size : 0);
+	return ok;
+}
+
+void warnCannotSave(const DumpTask& task) {
+	std::lock_guard<std::mutex> lock(output_mutex);
+	std::wcerr << L"! Warning: Cannot save " << *task.directory << PATH_SEP << getName(task.name) << std::endl;
+}
+
+/* Decompiles a dialog, menu, accelerator table, or string table into the resource script of the file, if it
+   cannot be decompiled the directory it was left without is created */
+bool scriptResource(const DumpContext& ctx, const DumpTask& task) {
+	if (!ctx.script || !isScriptType(task.type)) { return false; }
+	StatTimer timer(ctx.opts.stage(Stats::SCRIPT));
+	size_t size = task.rsrc_lang->size();
+	if (ctx.script->add(task.type, task.name, task.lang, task.rsrc_lang->data(), size)) { timer.stop(size, 0); return true; }
+	// the directory is either TYPE or TYPE/LANG
+	const std::wstring& dir = *task.directory;
+	size_t sep = dir.rfind(PATH_SEP);
+	if (!createDirectory(dir) && !(sep != std::wstring::npos && createDirectory(dir.substr(0, sep)) && createDirectory(dir))) {
+		ReportLastError(L"Cannot create directory '" + dir + L"'", true);
+	}
+	return false;
+}
+
+/* Converts and saves a single resource, safe to call from multiple threads at once */
+void dumpResource(const DumpContext& ctx, const DumpTask& task, const std::shared_ptr<const void>& keep) {
+	if (scriptResource(ctx, task)) { return; }
+	DumpOutput out;
+	if (keep) { out.keepAlive(keep); }
+	if (!convertResource(ctx, task, out) || !saveResource(ctx, task, out)) { warnCannotSave(task); }
+	if (ctx.opts.recurse) { dumpNested(ctx, task, keep); }
+}
+
+/* Opens the resource of a task as an embedded PE file and enumerates its resources */
+std::shared_ptr<NestedFile> openNested(const DumpContext& ctx, const DumpTask& task, const std::shared_ptr<const void>& parent) {
+	if (ctx.depth >= ctx.opts.recurse) { return nullptr; }
+	const uint8_t* data = (const uint8_t*)task.rsrc_lang->data();
+	size_t size = task.rsrc_lang->size();
+	if (size < 0x40 || data[0] != 'M' || data[1] != 'Z') { return nullptr; }
+
+	// The same data can be used for more than one resource or even be one of the files it is embedded in, so
+	// each range of data is only dumped once
+	DumpContext::Nested& nested = ctx.root().nested;
+	{
+		std::lock_guard<std::mutex> lock(nested.mutex);
+		if (!nested.seen.insert(std::make_pair((const void*)data, size)).second) { return nullptr; }
+	}
+
+	StatTimer timer(ctx.opts.stage(Stats::OPEN));
+	std::shared_ptr<NestedFile> file = std::make_shared<NestedFile>();
+	file->parent = parent;
+	file->pe.reset(new PE::File(data, size, ctx.rsrc->isMapped()));
+	timer.stop(size, 0);
+	const PE::Rsrc* rsrc = file->pe->getResources();
+	if (!file->pe->isLoaded() || rsrc->isEmpty()) { return nullptr; }
+
+	// only PE files with resources count towards the limits, so data that just starts with MZ cannot use them up
+	{
+		std::lock_guard<std::mutex> lock(nested.mutex);
+		if (nested.count >= DumpContext::NESTED_MAX_FILES || nested.bytes + size > DumpContext::NESTED_MAX_BYTES) {
+			if (!nested.warned) {
+				nested.warned = true;
+				std::lock_guard<std::mutex> lock(output_mutex);
+				std::wcerr << L"! Warning: Too many embedded files in '" << ctx.root().path << L"', the rest are not dumped." << std::endl;
+			}
+			return nullptr;
+		}
+		nested.count++;
+		nested.bytes += size;
+	}
+
+	std::wstring name = getTypeName(task.type) + L"/" + getName(task.name) + L"/" + to_string(task.lang), dir;
+	if (!ctx.file.empty()) { name = ctx.file + L"/" + name; }
+	if (ctx.opts.output().usesFiles()) {
+		dir = *task.directory + PATH_SEP;
+		size_t start = dir.size();
+		appendFileName(dir, task.name, task.duplicate);
+		sanitizeFilename(dir, start);
+		if (!createDirectory(dir)) { ReportLastError(L"Cannot create directory '" + dir + L"'", true); return nullptr; }
+	}
+	file->ctx.reset(new DumpContext(ctx, rsrc, name));
+	if (ctx.script) { beginScript(*file->ctx, dir); }
+	file->tasks = enumerateResources(rsrc, dir, file->dirs, ctx.opts);
+	return file;
+}
+
+/* Dumps the resources of the resource of a task if it is an embedded PE file, on the thread pool of the
+   context if it has one */
+void dumpNested(const DumpContext& ctx, const DumpTask& task, const std::shared_ptr<const void>& parent) {
+	std::shared_ptr<NestedFile> file = openNested(ctx, task, parent);
+	if (!file) { return; }
+	for (const DumpTask& t : file->tasks) {
+		if (ctx.pool) {
+			const DumpTask* pt = &t;
+			ctx.pool->submit([file, pt] { dumpResource(*file->ctx, *pt, file); });
+		}
+		else { dumpResource(*file->ctx, t, file); }
+	}
+}
+
+/* Starts the resource script of a file, it is kept by the root file so it outlives the context of an embedded
+   file */
+void beginScript(DumpContext& ctx, const std::wstring& directory) {
+	std::unique_ptr<ResourceScript> script(new ResourceScript(directory));
+	ctx.script = script.get();
+	DumpContext::Nested& nested = ctx.root().nested;
+	std::lock_guard<std::mutex> lock(nested.mutex);
+	nested.scripts.push_back(std::move(script));
+}
+
+/* Writes the resource scripts of a file and all of the files embedded in it */
+bool writeScripts(const DumpContext& root) {
+	DumpContext::Nested& nested = root.nested;
+	std::lock_guard<std::mutex> lock(nested.mutex);
+	bool ok = true;
+	for (const std::unique_ptr<ResourceScript>& script : nested.scripts) {
+		if (!script->write()) { ReportLastError(L"Writing the resource scripts in '" + script->path() + L"'", true); ok = false; }
+	}
+	return ok;
+}
+
+/* Calls a function for every resource in the order of their types, names, and languages without reading
+   any of their data */
+void visitResources(const PE::Rsrc * const rsrc, const ResourceVisitor& visit) {
+	for (const PE::ResourceType& rsrc_type : rsrc->types()) {
+		for (const PE::ResourceName& rsrc_name : rsrc_type.names()) {
+			for (const PE::ResourceLang& rsrc_lang : rsrc_name.langs()) { visit(rsrc_type.getType(), rsrc_name.getName(), rsrc_lang.getLang(), &rsrc_lang); }
+		}
+	}
+}
+
+/* Appends text as a field of tab-separated values, escaping tabs, newlines, and backslashes */
+static void appendTSV(std::string& s, const std::string& text) {
+	for (char c : text) {
+		if (c == '\t') { s += "\\t"; }
+		else if (c == '\n') { s += "\\n"; }
+		else if (c == '\r') { s += "\\r"; }
+		else if (c == '\\') { s += "\\\\"; }
+		else { s += c; }
+	}
+}
+
+/* Lists every resource without converting it or reading more than the first bytes of it to recognize its
+   format */
+void listResources(const std::wstring& file, const PE::Rsrc * const rsrc, bool json, std::string& out) {
+	std::string f = toUTF8(file);
+	visitResources(rsrc, [&](resid type, resid name, uint16_t lang, const PE::ResourceLang* r) {
+		std::string t = toUTF8(getTypeName(type)), n = toUTF8(getName(name));
+		const wchar_t* format = sniffFormat(r->data(), std::min(r->size(), (size_t)SNIFF_PREFIX));
+		std::string fmt = format ? toUTF8(format) : std::string();
+		char nums[64];
+		if (json) {
+			out += "{\"file\":"; appendJSONString(out, f.data(), f.size());
+			out += ",\"type\":"; appendJSONString(out, t.data(), t.size());
+			out += ",\"name\":"; appendJSONString(out, n.data(), n.size());
+			snprintf(nums, sizeof(nums), ",\"lang\":%u,\"size\":%llu,\"rva\":%u,\"format\":", (unsigned)lang, (unsigned long long)r->size(), r->rva());
+			out += nums;
+			if (format) { appendJSONString(out, fmt.data(), fmt.size()); }
+			else { out += "null"; }
+			out += "}\n";
+		}
+		else {
+			appendTSV(out, f); out += '\t';
+			appendTSV(out, t); out += '\t';
+			appendTSV(out, n);
+			snprintf(nums, sizeof(nums), "\t%u\t%llu\t%08X\t", (unsigned)lang, (unsigned long long)r->size(), r->rva());
+			out += nums;
+			out += format ? fmt : "-";
+			out += '\n';
+		}
+	});
+}
+
+/* Opens a PE file and gets its resources, reporting any problems. Returns 0 on success, 1 if the file
+   cannot be opened, or 2 if it does not have any resources. */
+int openPE(const wchar_t* filename, PE::File*& pe, const PE::Rsrc*& rsrc, const DumpOptions& opts) {
+	StatTimer timer(opts.stage(Stats::OPEN));
+	pe = new PE::File(filename);
+	timer.stop(pe->size(), 0);
+	if (!pe->isLoaded()) { ReportLastError(std::wstring(L"Opening PE File '") + filename + L"'"); delete pe; pe = nullptr; return 1; }
+	rsrc = pe->getResources();
+	if (!rsrc || rsrc->isEmpty()) {
+		std::lock_guard<std::mutex> lock(output_mutex);
+		std::wcerr << L"! Error: The EXE/DLL file '" << filename << L"' does not have any resources." << std::endl;
+		delete pe; pe = nullptr;
+		return 2;
+	}
+	return 0;
+}
+
+/* Checks if a PE file is unchanged since the last incremental dump so it can be skipped */
+bool isUnchanged(const DumpOptions& opts, const std::wstring& name, const std::wstring& filename, const PE::File* pe) {
+	if (!opts.manifest) { return false; }
+	Manifest::FileInfo info;
+	info.path = filename;
+	info.checksum = pe->checksum();
+	if (!getFileInfo(filename, info.size, info.mtime)) { return false; }
+	return opts.manifest->begin(name, info);
+}
+
+/* Dumps all resources of a single PE file to the sink (creating the directory first if it writes files),
+   returns the same as openPE() or 1 if the directory cannot be created */
+int dumpFile(const std::wstring& filename, const std::wstring& directory, const DumpOptions& opts, const std::wstring& name) {
+	PE::File *pe = nullptr;
+	const PE::Rsrc* rsrc = nullptr;
+	int status = openPE(filename.c_str(), pe, rsrc, opts);
+	if (status != 0) { return status; }
+	std::unique_ptr<PE::File> pe_(pe);
+	if (opts.output().usesFiles() && !createDirectory(directory)) { ReportLastError(L"Cannot create directory '" + directory + L"'"); return 1; }
+	if (isUnchanged(opts, name, filename, pe)) { return 0; }
+	if (opts.index) { opts.index->begin(filename); }
+	std::unique_ptr<ThreadPool> pool(opts.jobs == 1 ? nullptr : new ThreadPool(opts.jobs));
+	DumpContext ctx(rsrc, opts, name, pool.get(), filename);
+	if (opts.rc && opts.output().usesFiles()) { beginScript(ctx, directory); }
+
+	// Find all resources and create their directories, then dump them (embedded files add more tasks)
+	std::set<std::wstring> dirs;
+	const std::vector<DumpTask> tasks = enumerateResources(rsrc, directory, dirs, opts);
+	if (!pool) {
+		for (const DumpTask& task : tasks) { dumpResource(ctx, task); }
+	}
+	else {
+		for (const DumpTask& task : tasks) { pool->submit([&ctx, &task] { dumpResource(ctx, task); }); }
+		pool->wait();
+	}
+	// the outputs reference the file and the tasks so they must be written before they are gone
+	opts.output().wait();
+	if (ctx.script) { writeScripts(ctx); }
+	return 0;
+}
@@ -0,0 +1,194 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// The core of dumping resources, used by the command line program and the benchmark
+
+#pragma once
+
+#include "general.h"
+#include "PEResources.h"
+#include "ICO_CUR.h"
+#include "ContentStore.h"
+#include "Archive.h"
+#include "Manifest.h"
+#include "Stats.h"
+#include "OutputWriter.h"
+#include "Export.h"
+#include "Sink.h"
+#include "SearchIndex.h"
+#include "ResourceScript.h"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+typedef PE::const_resid resid;
+
+class ThreadPool;
+
+// Options for how resources are dumped, shared by all files being dumped
+struct DumpOptions {
+	unsigned int jobs;
+	Sink* sink; // where the converted resources go, when NULL each is written to its own file
+	Manifest* manifest; // when not NULL only what changed since the last dump is written (only used with files)
+	Stats* stats; // when not NULL every stage and dumper is timed
+	unsigned int recurse; // how many levels of embedded PE files to also dump the resources of, 0 for none
+	bool png; // convert bitmaps and icon images to PNG instead of BMP and ICO
+	SearchIndexWriter* index; // when not NULL every resource is added to the search index
+	bool rc; // decompile dialogs, menus, accelerators, and string tables into resource scripts (only used with files)
+	DumpOptions() : jobs(1), sink(nullptr), manifest(nullptr), stats(nullptr), recurse(0), png(false), index(nullptr), rc(false) { }
+	Stats::Metric* stage(Stats::Stage s) const { return this->stats ? &this->stats->stage(s) : nullptr; }
+	Sink& output() const;
+};
+
+// Information about the PE file being dumped that is shared by all of the dumpers
+struct DumpContext {
+	// Limits on the embedded PE files dumped from a single PE file, see openNested()
+	static const size_t NESTED_MAX_FILES = 1024;
+	static const uint64_t NESTED_MAX_BYTES = (uint64_t)1 << 32;
+
+	const PE::Rsrc * const rsrc;
+	const DumpOptions& opts;
+	const std::wstring file; // the name of the PE file in the archive, export, or manifest
+	const DumpContext* const parent; // the file this one is embedded in, NULL if it is not embedded
+	const unsigned int depth; // how deeply this file is embedded
+	ThreadPool* const pool; // when not NULL the resources of embedded files are dumped on this pool
+	const std::wstring path; // the path of the PE file (or the file it is embedded in) in the search index and export
+	ResourceScript* script; // the resource script of the file with --rc, see beginScript()
+	DumpContext(const PE::Rsrc * const rsrc, const DumpOptions& opts, const std::wstring& file = std::wstring(), ThreadPool* pool = nullptr, const std::wstring& path = std::wstring()) :
+		rsrc(rsrc), opts(opts), file(file), parent(nullptr), depth(0), pool(pool), path(path), script(nullptr) { }
+	// The context of an embedded file
+	DumpContext(const DumpContext& parent, const PE::Rsrc * const rsrc, const std::wstring& file) :
+		rsrc(rsrc), opts(parent.opts), file(file), parent(&parent), depth(parent.depth + 1), pool(parent.pool), path(parent.path), script(nullptr) { }
+	// The icon and cursor groups of the file, found the first time an icon or cursor is converted so dumps
+	// that never convert any (such as --versions and the server for most files) do not read every group
+	const ICOGroupIndex& icoGroups() const;
+	// The context of the file that was opened, which all embedded files are in
+	const DumpContext& root() const { return this->parent ? this->parent->root() : *this; }
+	// The TYPE/NAME/LANG of each resource this file is embedded in, separated by /, empty for the root file
+	std::wstring embedded() const {
+		const std::wstring& root_file = this->root().file;
+		return this->depth == 0 ? std::wstring() : this->file.substr(root_file.empty() ? 0 : root_file.size() + 1);
+	}
+
+	// The embedded files already dumped from the root file, used to dump each once and to enforce the limits,
+	// and the resource scripts of the root file and all of its embedded files which outlive their contexts
+	struct Nested {
+		std::mutex mutex;
+		std::set<std::pair<const void*, size_t>> seen;
+		size_t count = 0;
+		uint64_t bytes = 0;
+		bool warned = false;
+		std::vector<std::unique_ptr<ResourceScript>> scripts;
+	};
+	mutable Nested nested;
+
+private:
+	mutable std::once_flag ico_once;
+	mutable std::unique_ptr<const ICOGroupIndex> ico_groups;
+};
+
+// Dumpers convert the resource data into the output, which should reference the data instead of copying it
+typedef bool(*dump_func)(const DumpContext& ctx, resid type, resid name, uint16_t lang, const void* data, size_t size, DumpOutput& out);
+
+// All of the dump functions, the names are used by --stats. Most are only used for certain resource types,
+// see convertResource() for the order they are tried in.
+struct Dumper {
+	dump_func func;
+	const char* name;
+};
+extern const Dumper dumpers[];
+extern const size_t dumper_count;
+
+// A single resource to dump, the directory for it has already been created
+struct DumpTask {
+	resid type, name;
+	uint16_t lang;
+	const PE::ResourceLang* rsrc_lang;
+	const std::wstring* directory; // points into the set of created directories
+	unsigned int duplicate; // the suffix of the file when another resource in the directory has the same filename, or 0
+};
+
+// Finds all resources to dump and creates each directory needed for them exactly once (unless nothing is
+// written to the filesystem)
+std::vector<DumpTask> enumerateResources(const PE::Rsrc * const rsrc, const std::wstring& directory, std::set<std::wstring>& dirs, const DumpOptions& opts);
+// Runs the dumpers on a resource, the output references the resource data in the mapped PE file
+bool convertResource(const DumpContext& ctx, const DumpTask& task, DumpOutput& out);
+// Gives a converted resource to the sink unless it is unchanged since the last incremental dump (and adds it to
+// the search index if there is one). The sink may
+// take the output and the task must stay valid until it is done with it (see Sink::save()).
+bool saveResource(const DumpContext& ctx, const DumpTask& task, DumpOutput& out);
+void warnCannotSave(const DumpTask& task);
+// Decompiles a dialog, menu, accelerator table, or string table into the resource script of the file instead
+// of converting and saving it on its own. Returns false if the file does not have a resource script or the
+// resource cannot be decompiled, then the directory for it is created so it can be dumped like any other.
+bool scriptResource(const DumpContext& ctx, const DumpTask& task);
+// Converts and saves a single resource, safe to call from multiple threads at once. Embedded PE files are
+// dumped as well (see dumpNested()), keep is what must stay alive while the outputs are being written.
+void dumpResource(const DumpContext& ctx, const DumpTask& task, const std::shared_ptr<const void>& keep = nullptr);
+
+// An embedded PE file found in the data of a resource, it is read in place without being copied
+struct NestedFile {
+	std::shared_ptr<const void> parent; // keeps the file that this is in alive
+	std::unique_ptr<PE::File> pe;
+	std::unique_ptr<DumpContext> ctx;
+	std::set<std::wstring> dirs;
+	std::vector<DumpTask> tasks;
+};
+// Opens the resource of a task as an embedded PE file and enumerates its resources. The resources go into a
+// directory named after the resource (without an extension) next to its output and are labeled in the archive
+// or export as FILE/TYPE/NAME/LANG. Returns NULL if it is not a PE file with resources, the files are already
+// nested as deep as the options allow, the same data was already dumped from this file, or the limits of the
+// root context are reached.
+std::shared_ptr<NestedFile> openNested(const DumpContext& ctx, const DumpTask& task, const std::shared_ptr<const void>& parent);
+// Dumps the resources of the resource of a task if it is an embedded PE file, on the thread pool of the
+// context if it has one
+void dumpNested(const DumpContext& ctx, const DumpTask& task, const std::shared_ptr<const void>& parent);
+
+// Starts the resource script of a file with --rc (when writing files), it goes into the directory of the file.
+// The resource types that go into it do not get directories unless one cannot be decompiled.
+void beginScript(DumpContext& ctx, const std::wstring& directory);
+// Writes the resource scripts of a file and all of the files embedded in it once all of their resources are
+// dumped, reporting any problems
+bool writeScripts(const DumpContext& root);
+
+// Calls a function for every resource without reading any of their data
+typedef std::function<void(resid type, resid name, uint16_t lang, const PE::ResourceLang* rsrc_lang)> ResourceVisitor;
+void visitResources(const PE::Rsrc * const rsrc, const ResourceVisitor& visit);
+
+// Lists every resource without converting it or reading more than the first bytes of it to recognize its
+// format. Each resource is appended to out as a line of tab-separated file, type, name, lang, size, RVA (in
+// hex), and format or as a line of JSON with the same fields.
+void listResources(const std::wstring& file, const PE::Rsrc * const rsrc, bool json, std::string& out);
+
+// Opens a PE file and gets its resources, reporting any problems. Returns 0 on success, 1 if the file
+// cannot be opened, or 2 if it does not have any resources.
+int openPE(const wchar_t* filename, PE::File*& pe, const PE::Rsrc*& rsrc, const DumpOptions& opts);
+// Checks if a PE file is unchanged since the last incremental dump so it can be skipped
+bool isUnchanged(const DumpOptions& opts, const std::wstring& name, const std::wstring& filename, const PE::File* pe);
+
+// Dumps all resources of a single PE file to the sink in the options, into the directory if the sink writes
+// files. The name labels the resources in an archive, export, or manifest. Returns the same as openPE() or 1
+// if the directory cannot be created.
+int dumpFile(const std::wstring& filename, const std::wstring& directory, const DumpOptions& opts, const std::wstring& name = std::wstring());
+// Dumps every file into its own subdirectory of the directory named after the file, with the files opened,
+// converted, and saved in a pipeline. Returns the number of files that failed.
+size_t dumpBatch(const std::vector<std::wstring>& files, const std::wstring& directory, const DumpOptions& opts);
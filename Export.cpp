@@ -0,0 +1,95 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "stdafx.h"
+#include "Export.h"
+#include "Strings.h"
+#include "Version.h"
+
+#include <vector>
+
+JSONExport::JSONExport(Kind kind) : _kind(kind), f(nullptr), records(0), failed(false) { }
+
+JSONExport::~JSONExport() {
+	if (this->f) { fclose(this->f); }
+}
+
+bool JSONExport::create(const std::wstring& path) {
+	this->f = openFile(path, "wb");
+	return this->f != nullptr;
+}
+
+bool JSONExport::exports(PE::const_resid type) const {
+	return this->_kind == STRINGS ? isStringType(type) : type == RT_VERSION;
+}
+
+bool JSONExport::add(const std::wstring& file, const std::wstring& embedded, PE::const_resid type, PE::const_resid name, uint16_t lang, const void* data, size_t size) {
+	std::vector<StringRecord> records;
+	VersionInfo info;
+	if (this->_kind == VERSIONS) {
+		if (type != RT_VERSION || !decodeVersionInfo(data, size, info)) { return false; }
+	}
+	else if (type == RT_STRING) {
+		if (!IS_INTRESOURCE(name) || !decodeStringTable(LOWORD((ULONG_PTR)name), lang, data, size, records)) { return false; }
+	}
+	else if (type != RT_MESSAGETABLE || !decodeMessageTable(lang, data, size, records)) { return false; }
+
+	// every record starts with the file (and embedded path and type) followed by its own fields
+	std::string prefix = "{\"file\":", f = toUTF8(file);
+	appendJSONString(prefix, f.data(), f.size());
+	if (!embedded.empty()) {
+		std::string e = toUTF8(embedded);
+		prefix += ",\"embedded\":";
+		appendJSONString(prefix, e.data(), e.size());
+	}
+	if (this->_kind == STRINGS) {
+		std::string t = toUTF8(getTypeName(type));
+		prefix += ",\"type\":";
+		appendJSONString(prefix, t.data(), t.size());
+	}
+	prefix += ',';
+	std::string lines;
+	size_t count = 0;
+	if (this->_kind == VERSIONS) {
+		lines += prefix;
+		appendVersionFields(lines, info, lang);
+		lines += "}\n";
+		count = 1;
+	}
+	else {
+		for (const StringRecord& r : records) {
+			lines += prefix;
+			appendJSONFields(lines, r);
+			lines += "}\n";
+		}
+		count = records.size();
+	}
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	if (this->failed) { return false; }
+	if (fwrite(lines.data(), 1, lines.size(), this->f) != lines.size()) { this->failed = true; return false; }
+	this->records += count;
+	return true;
+}
+
+bool JSONExport::close() {
+	if (!this->f) { return false; }
+	bool ok = !this->failed && !ferror(this->f);
+	ok = (fclose(this->f) == 0) && ok;
+	this->f = nullptr;
+	return ok;
+}
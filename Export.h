@@ -0,0 +1,64 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Exports records decoded from the resources of many PE files into a single JSON lines file, instead of
+// dumping each resource to its own file. The resources are decoded straight into records labeled with the
+// path of the PE file (and for strings the resource type): {"file":"dir/x.dll","type":"STRING","id":1,...}.
+// Records from embedded PE files also have the TYPE/NAME/LANG of each resource they are in as "embedded".
+
+#pragma once
+
+#include "general.h"
+
+#include <stdio.h>
+#include <string>
+#include <mutex>
+
+class JSONExport {
+public:
+	enum Kind {
+		STRINGS,  // every string of the string and message tables
+		VERSIONS, // one version info record for each PE file
+	};
+
+	explicit JSONExport(Kind kind);
+	~JSONExport();
+
+	bool create(const std::wstring& path);
+	// Decodes a resource and adds its records, safe to call from multiple threads at once. Fails if the
+	// resource cannot be decoded (such as a malformed table).
+	bool add(const std::wstring& file, const std::wstring& embedded, PE::const_resid type, PE::const_resid name, uint16_t lang, const void* data, size_t size);
+	bool close();
+
+	Kind kind() const { return this->_kind; }
+	// Checks if resources of a type are exported, no others are dumped
+	bool exports(PE::const_resid type) const;
+	// Checks if only the first resource of the exported types in each PE file is dumped
+	bool firstOnly() const { return this->_kind == VERSIONS; }
+	// The number of records (lines) exported
+	size_t count() const { return this->records; }
+
+private:
+	JSONExport(const JSONExport&) = delete;
+	JSONExport& operator=(const JSONExport&) = delete;
+
+	const Kind _kind;
+	FILE* f;
+	std::mutex mutex;
+	size_t records;
+	bool failed;
+};
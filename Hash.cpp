@@ -0,0 +1,174 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "Hash.h"
+
+#pragma region XXH64
+////////////////////////////////////////////////////////////////////////////////
+///// XXH64
+////////////////////////////////////////////////////////////////////////////////
+static const uint64_t P1 = 11400714785074694791ULL, P2 = 14029467366897019727ULL, P3 = 1609587929392839161ULL,
+	P4 = 9650029242287828579ULL, P5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+static inline uint64_t read64(const uint8_t* p) { uint64_t x; memcpy(&x, p, 8); return x; } // assumes little-endian
+static inline uint32_t read32(const uint8_t* p) { uint32_t x; memcpy(&x, p, 4); return x; }
+static inline uint64_t round64(uint64_t acc, uint64_t input) { return rotl64(acc + input * P2, 31) * P1; }
+static inline uint64_t merge64(uint64_t acc, uint64_t val) { return (acc ^ round64(0, val)) * P1 + P4; }
+
+XXH64::XXH64(uint64_t seed) : total(0), buf_size(0), seed(seed) {
+	this->v[0] = seed + P1 + P2;
+	this->v[1] = seed + P2;
+	this->v[2] = seed;
+	this->v[3] = seed - P1;
+}
+
+void XXH64::update(const void* data, size_t size) {
+	const uint8_t* p = (const uint8_t*)data, *end = p + size;
+	this->total += size;
+	if (this->buf_size + size < 32) {
+		memcpy(this->buf + this->buf_size, p, size);
+		this->buf_size += size;
+		return;
+	}
+	if (this->buf_size) {
+		size_t n = 32 - this->buf_size;
+		memcpy(this->buf + this->buf_size, p, n);
+		p += n;
+		for (int i = 0; i < 4; i++) { this->v[i] = round64(this->v[i], read64(this->buf + 8*i)); }
+		this->buf_size = 0;
+	}
+	uint64_t v0 = this->v[0], v1 = this->v[1], v2 = this->v[2], v3 = this->v[3];
+	for (; p + 32 <= end; p += 32) {
+		v0 = round64(v0, read64(p));
+		v1 = round64(v1, read64(p + 8));
+		v2 = round64(v2, read64(p + 16));
+		v3 = round64(v3, read64(p + 24));
+	}
+	this->v[0] = v0; this->v[1] = v1; this->v[2] = v2; this->v[3] = v3;
+	this->buf_size = end - p;
+	memcpy(this->buf, p, this->buf_size);
+}
+
+uint64_t XXH64::digest() const {
+	uint64_t h;
+	if (this->total >= 32) {
+		h = rotl64(this->v[0], 1) + rotl64(this->v[1], 7) + rotl64(this->v[2], 12) + rotl64(this->v[3], 18);
+		for (int i = 0; i < 4; i++) { h = merge64(h, this->v[i]); }
+	}
+	else { h = this->seed + P5; }
+	h += this->total;
+	const uint8_t* p = this->buf, *end = p + this->buf_size;
+	for (; p + 8 <= end; p += 8) { h = rotl64(h ^ round64(0, read64(p)), 27) * P1 + P4; }
+	if (p + 4 <= end) { h = rotl64(h ^ (read32(p) * P1), 23) * P2 + P3; p += 4; }
+	for (; p < end; p++) { h = rotl64(h ^ (*p * P5), 11) * P1; }
+	h ^= h >> 33; h *= P2;
+	h ^= h >> 29; h *= P3;
+	h ^= h >> 32;
+	return h;
+}
+#pragma endregion
+
+#pragma region SHA-256
+////////////////////////////////////////////////////////////////////////////////
+///// SHA-256
+////////////////////////////////////////////////////////////////////////////////
+static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr32(uint32_t x, int r) { return (x >> r) | (x << (32 - r)); }
+
+SHA256::SHA256() : total(0), buf_size(0) {
+	static const uint32_t init[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	memcpy(this->state, init, sizeof(init));
+}
+
+void SHA256::transform(const uint8_t* block) {
+	uint32_t w[64];
+	for (int i = 0; i < 16; i++) { w[i] = ((uint32_t)block[4*i] << 24) | ((uint32_t)block[4*i+1] << 16) | ((uint32_t)block[4*i+2] << 8) | block[4*i+3]; }
+	for (int i = 16; i < 64; i++) {
+		uint32_t s0 = rotr32(w[i-15], 7) ^ rotr32(w[i-15], 18) ^ (w[i-15] >> 3);
+		uint32_t s1 = rotr32(w[i-2], 17) ^ rotr32(w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+	uint32_t a = this->state[0], b = this->state[1], c = this->state[2], d = this->state[3];
+	uint32_t e = this->state[4], f = this->state[5], g = this->state[6], h = this->state[7];
+	for (int i = 0; i < 64; i++) {
+		uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+		uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+	}
+	this->state[0] += a; this->state[1] += b; this->state[2] += c; this->state[3] += d;
+	this->state[4] += e; this->state[5] += f; this->state[6] += g; this->state[7] += h;
+}
+
+void SHA256::update(const void* data, size_t size) {
+	const uint8_t* p = (const uint8_t*)data;
+	this->total += size;
+	if (this->buf_size) {
+		size_t n = std::min(size, 64 - this->buf_size);
+		memcpy(this->buf + this->buf_size, p, n);
+		this->buf_size += n; p += n; size -= n;
+		if (this->buf_size < 64) { return; }
+		this->transform(this->buf);
+		this->buf_size = 0;
+	}
+	for (; size >= 64; p += 64, size -= 64) { this->transform(p); }
+	memcpy(this->buf, p, size);
+	this->buf_size = size;
+}
+
+void SHA256::digest(uint8_t out[SIZE]) {
+	uint64_t bits = this->total * 8;
+	static const uint8_t pad[64] = { 0x80 };
+	this->update(pad, (this->buf_size < 56) ? (56 - this->buf_size) : (120 - this->buf_size));
+	uint8_t len[8];
+	for (int i = 0; i < 8; i++) { len[i] = (uint8_t)(bits >> (56 - 8*i)); }
+	this->update(len, 8);
+	for (int i = 0; i < 8; i++) {
+		out[4*i] = (uint8_t)(this->state[i] >> 24); out[4*i+1] = (uint8_t)(this->state[i] >> 16);
+		out[4*i+2] = (uint8_t)(this->state[i] >> 8); out[4*i+3] = (uint8_t)this->state[i];
+	}
+}
+
+std::string SHA256::hexdigest() {
+	uint8_t out[SIZE];
+	this->digest(out);
+	return toHex(out, SIZE);
+}
+#pragma endregion
+
+std::string toHex(const uint8_t* data, size_t size) {
+	static const char digits[] = "0123456789abcdef";
+	std::string s(size * 2, '0');
+	for (size_t i = 0; i < size; i++) { s[2*i] = digits[data[i] >> 4]; s[2*i+1] = digits[data[i] & 0xF]; }
+	return s;
+}
+
+std::string toHex(uint64_t x) {
+	uint8_t b[8];
+	for (int i = 0; i < 8; i++) { b[i] = (uint8_t)(x >> (56 - 8*i)); }
+	return toHex(b, 8);
+}
@@ -0,0 +1,60 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Streaming hashes of resource data: XXH64 as a fast non-cryptographic hash and SHA-256 as a strong hash
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+class XXH64 {
+public:
+	explicit XXH64(uint64_t seed = 0);
+	void update(const void* data, size_t size);
+	uint64_t digest() const;
+
+	static uint64_t hash(const void* data, size_t size, uint64_t seed = 0) { XXH64 h(seed); h.update(data, size); return h.digest(); }
+
+private:
+	uint64_t v[4], total;
+	uint8_t buf[32];
+	size_t buf_size;
+	uint64_t seed;
+};
+
+class SHA256 {
+public:
+	static const size_t SIZE = 32;
+
+	SHA256();
+	void update(const void* data, size_t size);
+	void digest(uint8_t out[SIZE]);
+	// Gets the digest as lowercase hex
+	std::string hexdigest();
+
+private:
+	void transform(const uint8_t* block);
+	uint32_t state[8];
+	uint64_t total;
+	uint8_t buf[64];
+	size_t buf_size;
+};
+
+// Formats bytes as lowercase hex
+std::string toHex(const uint8_t* data, size_t size);
+std::string toHex(uint64_t x);
@@ -17,8 +17,6 @@
 #include "stdafx.h"
 #include "ICO_CUR.h"
 
-#include <vector>
-
 #pragma region General Defines and Objects
 ////////////////////////////////////////////////////////////////////////////////
 ///// General Defines and Objects
@@ -26,7 +24,7 @@
 #define ICO_ID	1
 #define CUR_ID	2
 
-#include <pshpack2.h> //these require WORD alignment, not DWORD
+#pragma pack(push, 2) //these require WORD alignment, not DWORD
 struct ICO_CUR_HEADER {
 	WORD wReserved;  // Always 0
 	WORD wResID;     // ICO_ID or CUR_ID
@@ -50,7 +48,7 @@ struct ICO_CUR_RT_ENTRY {
 	DWORD dwSize;
 	WORD  wID;
 };
-#include <poppack.h>
+#pragma pack(pop)
 
 struct CUR_HOTSPOT {
 	WORD  wHotspotX;
@@ -73,35 +71,63 @@ struct ICO_CUR_ENTRY {
 };
 #pragma endregion
 
-#pragma region General Functions
+#pragma region Group Index
 ////////////////////////////////////////////////////////////////////////////////
-///// General Functions
+///// Group Index
 ////////////////////////////////////////////////////////////////////////////////
-// Finds the icon/cursor group that a particular icon/cursor belongs to.
-// IN		type must be RT_GROUP_CURSOR or RT_GROUP_ICON
-// IN		name/lang are for the icon or group
-// OUT		grpIndx is set to the group found
-// OUT		return value is the data for the found group
-// All of the OUT and IN_OUT parameters are OPTIONAL (you can provide NULL if you don't care about them). 
-LPVOID findICOGroup(LPCWSTR type, LPCWSTR name, WORD lang, const PE::Rsrc * const r, WORD *grpIndx) {
-	std::vector<LPCWSTR> names = r->getNames(type);
-	for (DWORD i = 0; i < names.size(); i++) {
-		size_t size = 0;
-		LPVOID gdata = r->get(type, names[i], lang, &size);
-		if (!gdata)
-			continue;
-		ICO_CUR_HEADER *header = (ICO_CUR_HEADER*)gdata;
-		ICO_CUR_RT_ENTRY *entries = (ICO_CUR_RT_ENTRY*)((LPBYTE)gdata+sizeof(ICO_CUR_HEADER));
-		for (WORD j = 0; j < header->wNumImages; j++) {
-			if (MAKEINTRESOURCE(entries[j].wID) == name) {
-				*grpIndx = j;
-				return gdata;
+static inline uint64_t makeKey(bool is_cursor, WORD id, WORD lang) {
+	return ((uint64_t)is_cursor << 32) | ((uint64_t)id << 16) | lang;
+}
+static inline bool isCursorType(LPCWSTR type) { return type == RT_GROUP_CURSOR || type == RT_CURSOR; }
+
+ICOGroupIndex::ICOGroupIndex(const PE::Rsrc * const r) {
+	for (const PE::ResourceType& t : r->types()) {
+		LPCWSTR type = t.getType();
+		if (type == RT_GROUP_ICON || type == RT_GROUP_CURSOR) { this->addGroups(t, type == RT_GROUP_CURSOR); }
+		else if (type == RT_ICON || type == RT_CURSOR) { this->addImages(t, type == RT_CURSOR); }
+	}
+}
+
+// Reads every group and records each of its entries. When an icon/cursor is in multiple groups the first
+// group (in name order) wins.
+void ICOGroupIndex::addGroups(const PE::ResourceType& groups, bool is_cursor) {
+	for (const PE::ResourceName& name : groups.names()) {
+		for (const PE::ResourceLang& group : name.langs()) {
+			size_t size = group.size();
+			if (size < sizeof(ICO_CUR_HEADER)) { continue; }
+			const ICO_CUR_HEADER *header = (const ICO_CUR_HEADER*)group.data();
+			const ICO_CUR_RT_ENTRY *entries = (const ICO_CUR_RT_ENTRY*)((const BYTE*)group.data()+sizeof(ICO_CUR_HEADER));
+			WORD n = (WORD)std::min<size_t>(header->wNumImages, (size-sizeof(ICO_CUR_HEADER))/sizeof(ICO_CUR_RT_ENTRY));
+			for (WORD j = 0; j < n; j++) {
+				Member& m = this->members[makeKey(is_cursor, entries[j].wID, group.getLang())];
+				if (!m.entry) { m.entry = entries+j; }
 			}
 		}
-		free(gdata);
 	}
-	SetLastError(ERROR_MOD_NOT_FOUND);
-	return NULL;
+}
+
+// Records every icon/cursor image that has an integer ID, the only ones groups can refer to
+void ICOGroupIndex::addImages(const PE::ResourceType& images, bool is_cursor) {
+	for (const PE::ResourceName& name : images.names()) {
+		if (!IS_INTRESOURCE(name.getName())) { continue; }
+		WORD id = LOWORD((ULONG_PTR)name.getName());
+		for (const PE::ResourceLang& image : name.langs()) {
+			Member& m = this->members[makeKey(is_cursor, id, image.getLang())];
+			if (!m.image) { m.image = &image; }
+		}
+	}
+}
+
+const ICO_CUR_RT_ENTRY* ICOGroupIndex::findEntry(LPCWSTR type, LPCWSTR name, WORD lang) const {
+	if (!IS_INTRESOURCE(name)) { SetLastError(ERROR_MOD_NOT_FOUND); return NULL; }
+	auto itr = this->members.find(makeKey(isCursorType(type), LOWORD((ULONG_PTR)name), lang));
+	if (itr == this->members.end() || !itr->second.entry) { SetLastError(ERROR_MOD_NOT_FOUND); return NULL; }
+	return itr->second.entry;
+}
+
+const PE::ResourceLang* ICOGroupIndex::findImage(LPCWSTR type, WORD id, WORD lang) const {
+	auto itr = this->members.find(makeKey(isCursorType(type), id, lang));
+	return itr == this->members.end() ? NULL : itr->second.image;
 }
 #pragma endregion
 
@@ -109,75 +135,83 @@ LPVOID findICOGroup(LPCWSTR type, LPCWSTR name, WORD lang, const PE::Rsrc * cons
 ////////////////////////////////////////////////////////////////////////////////
 ///// Extract Functions
 ////////////////////////////////////////////////////////////////////////////////
-bool extractICOIndividual(LPCWSTR type, LPCWSTR name, WORD lang, LPVOID *data, size_t *size, const PE::Rsrc * const r) {
+bool extractICOIndividual(LPCWSTR type, LPCWSTR name, WORD lang, const void *data, size_t size, DumpOutput& out, const ICOGroupIndex& idx) {
 	type = (type==RT_GROUP_CURSOR||type==RT_CURSOR)?RT_GROUP_CURSOR:RT_GROUP_ICON;
 
-	WORD grpIndx;
-	LPVOID gdata = findICOGroup(type, name, lang, r, &grpIndx);
-	if (!gdata)
+	const ICO_CUR_RT_ENTRY *rtEntry = idx.findEntry(type, name, lang);
+	if (!rtEntry)
 		return false;
 
-	ICO_CUR_RT_ENTRY *rtEntry = ((ICO_CUR_RT_ENTRY*)((LPBYTE)gdata+sizeof(ICO_CUR_HEADER)))+grpIndx;
-	ICO_CUR_ENTRY entry = *(ICO_CUR_ENTRY*)(rtEntry);
-	BYTE *bytes = (BYTE*)*data;
+	ICO_CUR_ENTRY entry;
+	memcpy(&entry, rtEntry, sizeof(ICO_CUR_RT_ENTRY));
+	const BYTE *bytes = (const BYTE*)data;
 
 	// some extra processing is required for cursors
 	if (type == RT_GROUP_CURSOR) {
+		if (size < sizeof(CUR_HOTSPOT))
+			return false;
 		if (entry.bWidth == 0 || entry.bHeight == 0) {
 			entry.bHeight = (BYTE)(rtEntry->CUR.wHeight / 2);
 			entry.bWidth = (BYTE)(rtEntry->CUR.wWidth);
 			entry.bColorCount = 0;
 			entry.bReserved = 0;
 		}
-		entry.CUR = *(CUR_HOTSPOT*)bytes;
+		entry.CUR = *(const CUR_HOTSPOT*)bytes;
 		bytes += sizeof(CUR_HOTSPOT);
+		size -= sizeof(CUR_HOTSPOT);
 		entry.dwSize -= sizeof(CUR_HOTSPOT); //!! is this really right?
 	}
+	if (entry.dwSize > size)
+		entry.dwSize = (DWORD)size;
 
 	entry.dwOffset = sizeof(ICO_CUR_HEADER)+sizeof(ICO_CUR_ENTRY);
 
-	free(gdata);
-
 	ICO_CUR_HEADER header = {0, (WORD)((type==RT_GROUP_CURSOR)?CUR_ID:ICO_ID), 1};
 
-	*size = sizeof(ICO_CUR_HEADER)+sizeof(ICO_CUR_ENTRY)+entry.dwSize;
-	BYTE *d = (BYTE*)malloc(*size);
+	// write the headers followed by the image data straight from the resource
+	BYTE *d = (BYTE*)out.addOwned(sizeof(ICO_CUR_HEADER)+sizeof(ICO_CUR_ENTRY));
+	if (!d)
+		return false;
 	memcpy(d, &header, sizeof(ICO_CUR_HEADER));
 	memcpy(d+sizeof(ICO_CUR_HEADER), &entry, sizeof(ICO_CUR_ENTRY));
-	memcpy(d+sizeof(ICO_CUR_HEADER)+sizeof(ICO_CUR_ENTRY), bytes, entry.dwSize);
-	free(*data);
-	*data = d;
+	out.add(bytes, entry.dwSize);
 	return true;
 }
 
-bool extractICOGroup(LPCWSTR type, LPCWSTR name, WORD lang, LPVOID *data, size_t *size, const PE::Rsrc * const r) {
+bool extractICOGroup(LPCWSTR type, LPCWSTR name, WORD lang, const void *data, size_t size, DumpOutput& out, const ICOGroupIndex& idx) {
 	UNREFERENCED_PARAMETER(name); // unreferenced parameter
 
 	type = (type==RT_GROUP_CURSOR||type==RT_CURSOR)?RT_CURSOR:RT_ICON;
 
-	BYTE *bytes = (BYTE*)*data;
+	const BYTE *bytes = (const BYTE*)data;
+	if (size < sizeof(ICO_CUR_HEADER))
+		return false;
 
 	// get the ICO/CUR header
-	ICO_CUR_HEADER *header = (ICO_CUR_HEADER*)bytes;
+	ICO_CUR_HEADER header = *(const ICO_CUR_HEADER*)bytes;
+	header.wNumImages = (WORD)std::min<size_t>(header.wNumImages, (size-sizeof(ICO_CUR_HEADER))/sizeof(ICO_CUR_RT_ENTRY));
 
 	// get all the RT entries
-	ICO_CUR_RT_ENTRY *entries = (ICO_CUR_RT_ENTRY*)(bytes+sizeof(ICO_CUR_HEADER));
+	const ICO_CUR_RT_ENTRY *entries = (const ICO_CUR_RT_ENTRY*)(bytes+sizeof(ICO_CUR_HEADER));
 
 	// calculate where the entries and img data start
 	DWORD entry_offset = sizeof(ICO_CUR_HEADER);
-	DWORD offset = entry_offset+sizeof(ICO_CUR_ENTRY)*header->wNumImages;
+	DWORD offset = entry_offset+sizeof(ICO_CUR_ENTRY)*header.wNumImages;
 
-	// write the header stuff
-	BYTE *d = (BYTE*)malloc(offset);
-	memcpy(d, header, sizeof(ICO_CUR_HEADER));
+	// write the header stuff, the image data is added as spans after it
+	BYTE *d = (BYTE*)out.addOwned(offset);
+	if (!d)
+		return false;
+	memcpy(d, &header, sizeof(ICO_CUR_HEADER));
 
-	for (DWORD i = 0; i < header->wNumImages; i++) {
+	for (DWORD i = 0; i < header.wNumImages; i++) {
 
 		// get the current entry and image data
-		ICO_CUR_ENTRY entry = *(ICO_CUR_ENTRY*)(entries+i);
-		size_t temp_size;
-		LPVOID img_orig = r->get(type, MAKEINTRESOURCE(entries[i].wID), lang, &temp_size), img = img_orig;
-		entry.dwSize = (DWORD)temp_size;
+		ICO_CUR_ENTRY entry;
+		memcpy(&entry, entries+i, sizeof(ICO_CUR_RT_ENTRY));
+		const PE::ResourceLang *rsrc_img = idx.findImage(type, entries[i].wID, lang);
+		const BYTE *img = rsrc_img ? (const BYTE*)rsrc_img->data() : NULL;
+		entry.dwSize = rsrc_img ? (DWORD)rsrc_img->size() : 0;
 
 		// some extra processing is required for cursors
 		if (type == RT_CURSOR) {
@@ -187,29 +221,23 @@ bool extractICOGroup(LPCWSTR type, LPCWSTR name, WORD lang, LPVOID *data, size_t
 				entry.bColorCount = 0;
 				entry.bReserved = 0;
 			}
-			entry.CUR = *(CUR_HOTSPOT*)img;
-			img = ((LPBYTE)img)+sizeof(CUR_HOTSPOT);
-			entry.dwSize -= sizeof(CUR_HOTSPOT);
+			if (entry.dwSize >= sizeof(CUR_HOTSPOT)) {
+				entry.CUR = *(const CUR_HOTSPOT*)img;
+				img += sizeof(CUR_HOTSPOT);
+				entry.dwSize -= sizeof(CUR_HOTSPOT);
+			}
 		}
 		entry.dwOffset = offset;
 
-		// write the data
-		d = (BYTE*)realloc(d, offset+entry.dwSize);
+		// write the entry and reference the data
 		memcpy(d+entry_offset, &entry, sizeof(ICO_CUR_ENTRY));
-		memcpy(d+offset, img, entry.dwSize);
+		out.add(img, entry.dwSize);
 
 		// update the offsets
 		entry_offset += sizeof(ICO_CUR_ENTRY);
 		offset += entry.dwSize; //entries[i].dwSize;
-
-		// cleanup
-		free(img_orig);
 	}
 
-	free(*data);
-	*data = d;
-	*size = offset;
-
 	return true;
 }
 #pragma endregion
@@ -20,11 +20,41 @@
 
 #pragma once
 
-#include "PE\PEFile.h"
+#include "PEResources.h"
+#include "general.h"
 
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
+#include <unordered_map>
 
-// Extract icons/cursors from a PE-resource
-bool extractICOIndividual(LPCWSTR type, LPCWSTR name, WORD lang, LPVOID *data, size_t *size, const PE::Rsrc * const r);
-bool extractICOGroup(LPCWSTR type, LPCWSTR name, WORD lang, LPVOID *data, size_t *size, const PE::Rsrc * const r);
+struct ICO_CUR_HEADER;
+struct ICO_CUR_RT_ENTRY;
+
+// Index of all icons/cursors and the groups they are in, built in a single pass over the resources of a PE
+// file and then used to find the group entry of any icon/cursor and the image of any group member in
+// constant time. The group data is parsed only while building.
+class ICOGroupIndex {
+public:
+	explicit ICOGroupIndex(const PE::Rsrc * const r);
+
+	// Finds the group entry for an icon/cursor, type may be the individual or group type
+	const ICO_CUR_RT_ENTRY* findEntry(LPCWSTR type, LPCWSTR name, WORD lang) const;
+	// Finds the icon/cursor image with an ID, type may be the individual or group type
+	const PE::ResourceLang* findImage(LPCWSTR type, WORD id, WORD lang) const;
+
+private:
+	ICOGroupIndex(const ICOGroupIndex&) = delete;
+	ICOGroupIndex& operator=(const ICOGroupIndex&) = delete;
+
+	struct Member {
+		const ICO_CUR_RT_ENTRY* entry = nullptr; // the entry in the first group it is in
+		const PE::ResourceLang* image = nullptr;
+	};
+	void addGroups(const PE::ResourceType& groups, bool is_cursor);
+	void addImages(const PE::ResourceType& images, bool is_cursor);
+
+	std::unordered_map<uint64_t, Member> members; // key is (is_cursor, id, lang)
+};
+
+// Extract icons/cursors from a PE-resource, the output references the resource data (and the icon/cursor
+// data for groups) so the PE file must stay open until the output is written
+bool extractICOIndividual(LPCWSTR type, LPCWSTR name, WORD lang, const void *data, size_t size, DumpOutput& out, const ICOGroupIndex& idx);
+bool extractICOGroup(LPCWSTR type, LPCWSTR name, WORD lang, const void *data, size_t size, DumpOutput& out, const ICOGroupIndex& idx);
@@ -0,0 +1,170 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "Manifest.h"
+#include "MappedFile.h"
+#include "Hash.h"
+
+#include <inttypes.h>
+
+static const wchar_t FILENAME[] = L"PEResourceDump.manifest";
+
+// Splits a line into tab-separated fields, the last field gets the rest of the line
+static bool split(const char* line, const char* end, const char** fields, size_t* lens, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		const char* tab = (i == n - 1) ? end : (const char*)memchr(line, '\t', end - line);
+		if (!tab) { return false; }
+		fields[i] = line; lens[i] = tab - line;
+		line = tab + 1;
+	}
+	return true;
+}
+
+static uint64_t parseNumber(const char* s, size_t len, int base) {
+	return strtoull(std::string(s, len).c_str(), nullptr, base);
+}
+
+// The manifest is UTF-8 text with a line for the options then a line for each PE file followed by a line for
+// each of its resources:
+//   O <options>
+//   F <dir> <size> <mtime> <checksum> <complete> <PE path>
+//   R <rva> <size> <xxh64> <output size> <path>
+// with the fields separated by tabs
+void Manifest::load(const std::wstring& directory, const std::string& options) {
+	this->directory = directory;
+	this->options = options;
+	MappedFile map;
+	if (!map.open((directory + PATH_SEP + FILENAME).c_str())) { return; }
+	const char* p = (const char*)map.data(), *end = p + map.size();
+	Entry* entry = nullptr;
+	while (p < end) {
+		const char* eol = (const char*)memchr(p, '\n', end - p);
+		if (!eol) { eol = end; }
+		const char* fields[7];
+		size_t lens[7];
+		if (*p == 'O' && split(p, eol, fields, lens, 2)) {
+			this->same_options = std::string(fields[1], lens[1]) == options;
+		}
+		else if (*p == 'F' && split(p, eol, fields, lens, 7)) {
+			entry = &this->previous[fromUTF8(fields[1], lens[1])];
+			entry->info.size = parseNumber(fields[2], lens[2], 10);
+			entry->info.mtime = parseNumber(fields[3], lens[3], 10);
+			entry->info.checksum = (uint32_t)parseNumber(fields[4], lens[4], 16);
+			entry->complete = parseNumber(fields[5], lens[5], 10) != 0;
+			entry->info.path = fromUTF8(fields[6], lens[6]);
+		}
+		else if (*p == 'R' && entry && split(p, eol, fields, lens, 6)) {
+			Resource& r = entry->resources[fromUTF8(fields[5], lens[5])];
+			r.rva = (uint32_t)parseNumber(fields[1], lens[1], 16);
+			r.size = parseNumber(fields[2], lens[2], 10);
+			r.hash = parseNumber(fields[3], lens[3], 16);
+			r.output_size = parseNumber(fields[4], lens[4], 10);
+		}
+		p = eol + 1;
+	}
+}
+
+bool Manifest::begin(const std::wstring& dir, const FileInfo& info) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	auto itr = this->previous.find(dir);
+	if (this->same_options && itr != this->previous.end() && itr->second.complete && itr->second.info == info) {
+		// the outputs may have been removed or modified since the last dump
+		bool present = true;
+		for (auto& r : itr->second.resources) {
+			uint64_t file_size, mtime;
+			if (!getFileInfo(this->directory + PATH_SEP + r.first, file_size, mtime) || file_size != r.second.output_size) { present = false; break; }
+		}
+		if (present) {
+			this->current[dir] = itr->second;
+			this->files_skipped++;
+			return true;
+		}
+	}
+	Entry& entry = this->current[dir];
+	entry.info = info;
+	entry.resources.clear();
+	entry.pending.clear();
+	return false;
+}
+
+bool Manifest::unchanged(const std::wstring& dir, const std::wstring& path, uint32_t rva, uint64_t size, const DumpOutput& out) {
+	XXH64 xxh;
+	out.stream([&xxh](const void* data, size_t size) { xxh.update(data, size); return true; });
+	Resource r = { rva, size, xxh.digest(), out.size() };
+	std::wstring rel = path.substr(this->directory.size() + 1);
+
+	bool same = false;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto itr = this->previous.find(dir);
+		if (this->same_options && itr != this->previous.end()) {
+			auto res = itr->second.resources.find(rel);
+			same = res != itr->second.resources.end() && res->second == r;
+		}
+		// the output is only recorded as is once it is written, or here if it is already there
+		this->current[dir].pending[rel] = r;
+	}
+	// the output may have been removed or modified since the last dump
+	uint64_t file_size, mtime;
+	if (!same || !getFileInfo(path, file_size, mtime) || file_size != out.size()) { return false; }
+	this->saved(dir, path);
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->resources_skipped++;
+	return true;
+}
+
+void Manifest::saved(const std::wstring& dir, const std::wstring& path) {
+	std::wstring rel = path.substr(this->directory.size() + 1);
+	std::lock_guard<std::mutex> lock(this->mutex);
+	Entry& entry = this->current[dir];
+	auto itr = entry.pending.find(rel);
+	if (itr == entry.pending.end()) { return; }
+	entry.resources[rel] = itr->second;
+	entry.pending.erase(itr);
+}
+
+bool Manifest::finish() {
+	for (auto& c : this->current) {
+		auto p = this->previous.find(c.first);
+		if (p == this->previous.end()) { continue; }
+		for (auto& r : p->second.resources) {
+			// outputs that failed to be written are not deleted, they are not recorded so they are written next time
+			if (c.second.resources.count(r.first) || c.second.pending.count(r.first)) { continue; }
+			if (removeFile(this->directory + PATH_SEP + r.first)) { this->removed++; }
+		}
+	}
+	// a file with outputs that were not written is dumped again next time
+	for (auto& c : this->current) { c.second.complete = c.second.pending.empty(); }
+	// files that were not dumped this time (such as ones that cannot be opened) keep what they had, unless it
+	// was dumped with different options
+	if (this->same_options) {
+		for (auto& p : this->previous) { this->current.insert(p); }
+	}
+
+	FILE* f = openFile(this->directory + PATH_SEP + FILENAME, "wb");
+	if (!f) { return false; }
+	fprintf(f, "O\t%s\n", this->options.c_str());
+	for (auto& c : this->current) {
+		const FileInfo& info = c.second.info;
+		fprintf(f, "F\t%s\t%" PRIu64 "\t%" PRIu64 "\t%08" PRIx32 "\t%d\t%s\n", toUTF8(c.first).c_str(), info.size, info.mtime, info.checksum, c.second.complete ? 1 : 0, toUTF8(info.path).c_str());
+		for (auto& r : c.second.resources) {
+			fprintf(f, "R\t%08" PRIx32 "\t%" PRIu64 "\t%016" PRIx64 "\t%" PRIu64 "\t%s\n", r.second.rva, r.second.size, r.second.hash, r.second.output_size, toUTF8(r.first).c_str());
+		}
+	}
+	bool ok = !ferror(f);
+	return (fclose(f) == 0) && ok;
+}
@@ -0,0 +1,93 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// The manifest of an incremental dump, kept in the output directory. It records the fingerprint of each PE
+// file (its size, modification time, and header checksum) and of each resource dumped from it (the RVA and
+// size of the data and the XXH64 of the output). When dumping again unchanged PE files are skipped, only
+// the resources whose fingerprint changed are rewritten, and the outputs of resources that are gone are
+// deleted.
+//
+// PE files are identified by the subdirectory they are dumped into (which is empty when dumping a single
+// file) and resources by their path relative to the output directory, which includes the type, name, and
+// language. A resource is only recorded once its output is written. The manifest also records the options
+// that change the outputs, when they are different nothing is skipped and the old outputs that are not
+// dumped again are deleted.
+
+#pragma once
+
+#include "general.h"
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <mutex>
+
+class Manifest {
+public:
+	// The fingerprint of a PE file
+	struct FileInfo {
+		std::wstring path;
+		uint64_t size, mtime;
+		uint32_t checksum;
+		bool operator==(const FileInfo& f) const { return this->path == f.path && this->size == f.size && this->mtime == f.mtime && this->checksum == f.checksum; }
+	};
+
+	Manifest() : same_options(false), files_skipped(0), resources_skipped(0), removed(0) { }
+
+	// Loads the manifest from the output directory, a missing or unreadable manifest is the same as an empty one.
+	// The options are a description of everything that changes the outputs.
+	void load(const std::wstring& directory, const std::string& options);
+
+	// Starts dumping a PE file into a subdirectory of the output directory. Returns true if the file has not
+	// changed since it was last dumped and all of its outputs are still there, in which case it should be skipped.
+	bool begin(const std::wstring& dir, const FileInfo& info);
+
+	// Checks an output of the PE file begun with dir. Returns true if it is the same as the last dump and the
+	// file is still there so it does not need to be written. Otherwise the output must be written and then
+	// given to saved(). Safe to call from multiple threads at once.
+	bool unchanged(const std::wstring& dir, const std::wstring& path, uint32_t rva, uint64_t size, const DumpOutput& out);
+	// Records an output that was checked with unchanged() once it is written. Outputs that are never saved are
+	// written again next time. Safe to call from multiple threads at once.
+	void saved(const std::wstring& dir, const std::wstring& path);
+
+	// Deletes the outputs that were not dumped again from the files that changed and saves the manifest
+	bool finish();
+
+	// Statistics
+	size_t filesSkipped() const { return this->files_skipped; }
+	size_t resourcesSkipped() const { return this->resources_skipped; }
+	size_t filesRemoved() const { return this->removed; }
+
+private:
+	struct Resource {
+		uint32_t rva;
+		uint64_t size, hash, output_size;
+		bool operator==(const Resource& r) const { return this->rva == r.rva && this->size == r.size && this->hash == r.hash && this->output_size == r.output_size; }
+	};
+	struct Entry {
+		FileInfo info;
+		std::map<std::wstring, Resource> resources;
+		std::map<std::wstring, Resource> pending; // checked but not written yet
+		bool complete = false; // if every output was written
+	};
+
+	std::wstring directory;
+	std::string options;
+	bool same_options; // if the previous dump had the same options, otherwise nothing is unchanged
+	std::map<std::wstring, Entry> previous, current;
+	std::mutex mutex;
+	size_t files_skipped, resources_skipped, removed;
+};
@@ -0,0 +1,84 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "MappedFile.h"
+#include "general.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : base(NULL), _size(0), mapping(NULL) { }
+
+bool MappedFile::open(const wchar_t* filename) {
+	this->close();
+	HANDLE file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) { return false; }
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || (uint64_t)size.QuadPart > SIZE_MAX) { CloseHandle(file); SetLastError(ERROR_BAD_FORMAT); return false; }
+	this->mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!this->mapping) { return false; }
+	this->base = (const uint8_t*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!this->base) { CloseHandle(this->mapping); this->mapping = NULL; return false; }
+	this->_size = (size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::close() {
+	if (this->base) { UnmapViewOfFile(this->base); CloseHandle(this->mapping); }
+	this->base = NULL; this->_size = 0; this->mapping = NULL;
+}
+
+void MappedFile::release(const void* data, size_t size) {
+	// unlocking pages that are not locked removes them from the working set
+	if (size) { VirtualUnlock((LPVOID)data, size); }
+}
+#else
+MappedFile::MappedFile() : base(NULL), _size(0) { }
+
+bool MappedFile::open(const wchar_t* filename) {
+	this->close();
+	int fd = ::open(toUTF8(filename).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) { return false; }
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || (uint64_t)st.st_size > SIZE_MAX) { ::close(fd); SetLastError(ERROR_BAD_FORMAT); return false; }
+	void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int err = errno;
+	::close(fd);
+	if (p == MAP_FAILED) { SetLastError(err); return false; }
+	this->base = (const uint8_t*)p;
+	this->_size = (size_t)st.st_size;
+	return true;
+}
+
+void MappedFile::close() {
+	if (this->base) { munmap((void*)this->base, this->_size); }
+	this->base = NULL; this->_size = 0;
+}
+
+void MappedFile::release(const void* data, size_t size) {
+	// partial pages at either end are kept since they may hold data that is still being used
+	static const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t start = ((uintptr_t)data + page - 1) & ~(page - 1), end = ((uintptr_t)data + size) & ~(page - 1);
+	if (start < end) { madvise((void*)start, end - start, MADV_DONTNEED); }
+}
+#endif
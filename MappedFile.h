@@ -0,0 +1,48 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// A read-only memory mapping of a whole file
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+class MappedFile {
+	const uint8_t* base;
+	size_t _size;
+#ifdef _WIN32
+	void* mapping;
+#endif
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+public:
+	MappedFile();
+	~MappedFile() { this->close(); }
+
+	// Maps the file, an empty file cannot be mapped and fails with ERROR_BAD_FORMAT
+	bool open(const wchar_t* filename);
+	void close();
+
+	bool isOpen() const { return this->base != nullptr; }
+	const uint8_t* data() const { return this->base; }
+	size_t size() const { return this->_size; }
+
+	// Releases the whole pages within a part of a mapping that has been read so they no longer count
+	// against the memory of the process, they are read again (normally from the file cache) if accessed
+	static void release(const void* data, size_t size);
+};
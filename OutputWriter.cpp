@@ -0,0 +1,388 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "stdafx.h"
+#include "OutputWriter.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <string.h>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <unordered_set>
+#endif
+
+// The number of writes that can be waiting for each one in progress before write() blocks
+#define MAX_WAITING 4
+// The most files that can be written at once
+#define MAX_DEPTH 4096
+
+void OutputWriter::write(const std::wstring& path, DumpOutput& out, Callback done) {
+	if (out.isStreamed()) { done(writeFile(path, out)); return; }
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->cv.wait(lock, [this] { return this->outstanding < (size_t)MAX_WAITING * this->_depth; });
+		++this->outstanding;
+	}
+	this->submit(std::unique_ptr<Request>(new Request(path, out, std::move(done))));
+}
+
+void OutputWriter::wait() {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->cv.wait(lock, [this] { return this->outstanding == 0; });
+}
+
+void OutputWriter::finish(std::unique_ptr<Request> req, bool ok) {
+	req->done(ok);
+	req.reset();
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		--this->outstanding;
+	}
+	this->cv.notify_all();
+}
+
+void OutputWriter::writeOn(ThreadPool& pool, std::unique_ptr<Request> req) {
+	// the pool only takes copyable tasks so the request is released to it and taken back when done
+	Request* r = req.release();
+	pool.submit([this, r] {
+		bool ok = writeFile(r->path, r->out);
+		this->finish(std::unique_ptr<Request>(r), ok);
+	});
+}
+
+#pragma region Threads
+////////////////////////////////////////////////////////////////////////////////
+///// Threads
+////////////////////////////////////////////////////////////////////////////////
+// Does the normal blocking writes with one thread for each file being written at once
+class ThreadWriter : public OutputWriter {
+public:
+	explicit ThreadWriter(unsigned int depth) : OutputWriter(depth), pool(depth) { }
+	const char* name() const override { return "threads"; }
+
+protected:
+	void submit(std::unique_ptr<Request> req) override { this->writeOn(this->pool, std::move(req)); }
+
+private:
+	ThreadPool pool;
+};
+#pragma endregion
+
+#ifdef HAVE_IO_URING
+#pragma region io_uring
+////////////////////////////////////////////////////////////////////////////////
+///// io_uring
+////////////////////////////////////////////////////////////////////////////////
+// Uses the system calls directly instead of liburing. A single thread owns the ring: it starts the files
+// that are waiting (up to the depth), submits everything queued with one io_uring_enter() that also waits
+// for a completion, then moves each completed file on to its next operation. If the ring stops working the
+// files in it fail and everything else is written on threads instead.
+class UringWriter : public OutputWriter {
+public:
+	explicit UringWriter(unsigned int depth);
+	~UringWriter();
+	bool isOpen() const { return this->thread.joinable(); }
+	const char* name() const override { return "uring"; }
+
+protected:
+	void submit(std::unique_ptr<Request> req) override;
+
+private:
+	// A file being written, it has exactly one operation in the ring at a time so the ring never fills up
+	struct Op {
+		enum State { UNLINK, OPEN, WRITE, CLOSE } state;
+		std::unique_ptr<Request> req;
+		std::string path;
+		std::vector<struct iovec> iov;
+		size_t next; // the first iovec that is not completely written
+		uint64_t offset;
+		int fd;
+		bool failed;
+	};
+
+	bool setup(unsigned int entries);
+	void run();
+	void fail();
+	void queue(Op* op);
+	void complete(Op* op, int res);
+	void done(Op* op, bool ok);
+
+	int ring;
+	unsigned *sq_tail, *sq_mask, *sq_array, *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	void *sq_ptr, *cq_ptr;
+	size_t sq_size, cq_size, sqes_size;
+	unsigned int to_submit; // only used by the ring thread
+	std::unordered_set<Op*> in_flight; // only used by the ring thread
+	bool has_unlink; // if the old files can be unlinked in the ring, otherwise it is done by the ring thread
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<std::unique_ptr<Request>> pending; // protected by mutex
+	std::unique_ptr<ThreadPool> fallback; // once the ring fails, protected by mutex
+	bool stopping;
+};
+
+UringWriter::UringWriter(unsigned int depth) : OutputWriter(depth), ring(-1), sqes(nullptr), cqes(nullptr),
+	sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED), sq_size(0), cq_size(0), sqes_size(0), to_submit(0), has_unlink(false), stopping(false) {
+	if (this->setup(depth)) { this->thread = std::thread(&UringWriter::run, this); }
+}
+
+UringWriter::~UringWriter() {
+	if (this->thread.joinable()) {
+		this->wait();
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->stopping = true;
+		}
+		this->cv.notify_all();
+		this->thread.join();
+	}
+	if (this->sqes) { munmap(this->sqes, this->sqes_size); }
+	if (this->cq_ptr != MAP_FAILED) { munmap(this->cq_ptr, this->cq_size); }
+	if (this->sq_ptr != MAP_FAILED) { munmap(this->sq_ptr, this->sq_size); }
+	if (this->ring >= 0) { close(this->ring); }
+}
+
+/* Creates the ring and maps its queues, fails if io_uring or any of the operations needed are not supported */
+bool UringWriter::setup(unsigned int entries) {
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (fd < 0) { return false; }
+	this->ring = fd;
+
+	// openat and close need the probe to be checked for (both were added at the same time as it)
+	std::vector<uint8_t> buf(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+	struct io_uring_probe* probe = (struct io_uring_probe*)buf.data();
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0) { return false; }
+	const uint8_t ops[] = { IORING_OP_OPENAT, IORING_OP_WRITEV, IORING_OP_CLOSE };
+	for (uint8_t op : ops) {
+		if (op >= probe->ops_len || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) { return false; }
+	}
+#ifdef IORING_OP_UNLINKAT
+	this->has_unlink = IORING_OP_UNLINKAT < probe->ops_len && (probe->ops[IORING_OP_UNLINKAT].flags & IO_URING_OP_SUPPORTED);
+#endif
+
+	// the queues are mapped separately, which works even when the kernel could put them in a single mapping
+	this->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	this->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	this->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	this->sq_ptr = mmap(NULL, this->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (this->sq_ptr == MAP_FAILED) { return false; }
+	this->cq_ptr = mmap(NULL, this->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	if (this->cq_ptr == MAP_FAILED) { return false; }
+	void* sqes = mmap(NULL, this->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) { return false; }
+	this->sqes = (struct io_uring_sqe*)sqes;
+
+	uint8_t* sq = (uint8_t*)this->sq_ptr, *cq = (uint8_t*)this->cq_ptr;
+	this->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+	this->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+	this->sq_array = (unsigned*)(sq + p.sq_off.array);
+	this->cq_head = (unsigned*)(cq + p.cq_off.head);
+	this->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	this->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+	this->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	return true;
+}
+
+void UringWriter::submit(std::unique_ptr<Request> req) {
+	ThreadPool* fallback;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		fallback = this->fallback.get();
+		if (!fallback) { this->pending.push_back(std::move(req)); }
+	}
+	if (fallback) { this->writeOn(*fallback, std::move(req)); }
+	else { this->cv.notify_one(); }
+}
+
+void UringWriter::run() {
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->cv.wait(lock, [this] { return !this->in_flight.empty() || !this->pending.empty() || this->stopping; });
+			if (this->stopping && this->in_flight.empty() && this->pending.empty()) { break; }
+			while (!this->pending.empty() && this->in_flight.size() < this->depth()) {
+				// the old file is unlinked instead of truncated since it may be a hard link, the same as writeFile()
+				Op* op = new Op();
+				op->req = std::move(this->pending.front());
+				op->path = toUTF8(op->req->path);
+				op->state = this->has_unlink ? Op::UNLINK : Op::OPEN;
+				if (!this->has_unlink) { unlink(op->path.c_str()); }
+				for (const DataSpan& span : op->req->out.spans()) {
+					struct iovec v = { (void*)span.data, span.size };
+					op->iov.push_back(v);
+				}
+				op->next = 0;
+				op->offset = 0;
+				op->fd = -1;
+				op->failed = false;
+				this->pending.pop_front();
+				this->queue(op);
+				this->in_flight.insert(op);
+			}
+		}
+
+		// submit everything that is queued and wait for at least one operation to complete
+		int n = (int)syscall(__NR_io_uring_enter, this->ring, this->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) { continue; }
+			ReportLastError(L"Writing with io_uring, the rest of the files are written with threads", true);
+			this->fail();
+			return;
+		}
+		this->to_submit -= (unsigned int)n;
+
+		unsigned head = *this->cq_head, tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			const struct io_uring_cqe& cqe = this->cqes[head & *this->cq_mask];
+			Op* op = (Op*)(uintptr_t)cqe.user_data;
+			int res = cqe.res;
+			__atomic_store_n(this->cq_head, head + 1, __ATOMIC_RELEASE);
+			this->complete(op, res);
+		}
+	}
+}
+
+/* Adds the current operation of a file to the submission queue */
+void UringWriter::queue(Op* op) {
+	unsigned tail = *this->sq_tail, idx = tail & *this->sq_mask;
+	struct io_uring_sqe* sqe = &this->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = (uint64_t)(uintptr_t)op;
+	switch (op->state) {
+	case Op::UNLINK:
+#ifdef IORING_OP_UNLINKAT
+		sqe->opcode = IORING_OP_UNLINKAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uint64_t)(uintptr_t)op->path.c_str();
+#endif
+		break;
+	case Op::OPEN:
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uint64_t)(uintptr_t)op->path.c_str();
+		sqe->len = 0666;
+		sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+		break;
+	case Op::WRITE:
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->fd = op->fd;
+		sqe->addr = (uint64_t)(uintptr_t)&op->iov[op->next];
+		sqe->len = (unsigned)std::min<size_t>(op->iov.size() - op->next, IOV_MAX);
+		sqe->off = op->offset;
+		break;
+	case Op::CLOSE:
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = op->fd;
+		break;
+	}
+	this->sq_array[idx] = idx;
+	__atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	++this->to_submit;
+}
+
+/* Moves a file on to its next operation once the current one completes */
+void UringWriter::complete(Op* op, int res) {
+	switch (op->state) {
+	case Op::UNLINK:
+		// a file that does not exist or cannot be unlinked is left for the open to report
+		op->state = Op::OPEN;
+		break;
+	case Op::OPEN:
+		if (res < 0) { this->done(op, false); return; }
+		op->fd = res;
+		op->state = op->iov.empty() ? Op::CLOSE : Op::WRITE;
+		break;
+	case Op::WRITE:
+		if (res == -EINTR || res == -EAGAIN) { break; }
+		if (res <= 0) { op->failed = true; op->state = Op::CLOSE; break; }
+		{
+			// continue after partial writes, the same as writeFile()
+			size_t w = (size_t)res;
+			op->offset += w;
+			while (op->next < op->iov.size() && w >= op->iov[op->next].iov_len) { w -= op->iov[op->next++].iov_len; }
+			if (w) { op->iov[op->next].iov_base = (char*)op->iov[op->next].iov_base + w; op->iov[op->next].iov_len -= w; }
+			if (op->next == op->iov.size()) { op->state = Op::CLOSE; }
+		}
+		break;
+	case Op::CLOSE:
+		this->done(op, !op->failed && res >= 0);
+		return;
+	}
+	this->queue(op);
+}
+
+void UringWriter::done(Op* op, bool ok) {
+	std::unique_ptr<Request> req = std::move(op->req);
+	this->in_flight.erase(op);
+	delete op;
+	this->finish(std::move(req), ok);
+}
+
+/* Called on the ring thread when the ring cannot be used anymore. The files in the ring can never complete
+   so they fail, and the files that are waiting (and all new ones) are written on a pool of threads. */
+void UringWriter::fail() {
+	std::deque<std::unique_ptr<Request>> waiting;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->fallback.reset(new ThreadPool(this->depth()));
+		waiting.swap(this->pending);
+	}
+	while (!this->in_flight.empty()) {
+		Op* op = *this->in_flight.begin();
+		if (op->state == Op::WRITE) { close(op->fd); } // a file being closed may already be
+		this->done(op, false);
+	}
+	for (std::unique_ptr<Request>& req : waiting) { this->writeOn(*this->fallback, std::move(req)); }
+}
+#pragma endregion
+#endif
+
+OutputWriter* OutputWriter::create(const std::wstring& backend, unsigned int depth) {
+	depth = std::min(std::max(depth, 1u), (unsigned int)MAX_DEPTH);
+#ifdef HAVE_IO_URING
+	if (backend == L"uring" || backend == L"auto") {
+		std::unique_ptr<UringWriter> writer(new UringWriter(depth));
+		if (writer->isOpen()) { return writer.release(); }
+		if (backend == L"uring") { return nullptr; }
+	}
+#endif
+	if (backend == L"threads" || backend == L"auto") { return new ThreadWriter(depth); }
+	return nullptr;
+}
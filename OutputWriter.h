@@ -0,0 +1,83 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Backends that write outputs to files in the background so that dumping is not held up by a series of
+// blocking open, write, and close calls for every resource. Each write takes the output and calls back once
+// the file is written or has failed.
+//
+// The io_uring backend (Linux only) keeps many files in flight at once from a single thread, each moving from
+// openat to writev to close through the ring, so the system calls are batched instead of made one at a time.
+// The thread backend works everywhere and does the blocking writes on a pool of threads.
+
+#pragma once
+
+#include "general.h"
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+class ThreadPool;
+
+class OutputWriter {
+public:
+	typedef std::function<void(bool ok)> Callback;
+
+	virtual ~OutputWriter() { }
+
+	// Creates a backend by name: "uring", "threads", or "auto" for io_uring when the system supports it and
+	// threads otherwise. The depth is the number of files being written at once. Returns NULL if the
+	// backend is unknown or is not supported.
+	static OutputWriter* create(const std::wstring& backend, unsigned int depth);
+
+	// Writes the output to a file in the background, the output is moved out of the argument. The callback is
+	// called with whether it was written, on any thread and before the output is freed. Blocks while too many
+	// writes are waiting. Streamed outputs are written right away to keep the memory they use bounded.
+	void write(const std::wstring& path, DumpOutput& out, Callback done);
+	// Waits until every write is done
+	void wait();
+
+	virtual const char* name() const = 0;
+	unsigned int depth() const { return this->_depth; }
+
+protected:
+	struct Request {
+		std::wstring path;
+		DumpOutput out;
+		Callback done;
+		Request(const std::wstring& path, DumpOutput& out, Callback done) : path(path), out(std::move(out)), done(std::move(done)) { }
+	};
+
+	explicit OutputWriter(unsigned int depth) : _depth(depth), outstanding(0) { }
+
+	// Starts writing the file, the backend calls finish() once it is done
+	virtual void submit(std::unique_ptr<Request> req) = 0;
+	void finish(std::unique_ptr<Request> req, bool ok);
+	// Writes the file with a blocking write on a thread of the pool, then finishes it
+	void writeOn(ThreadPool& pool, std::unique_ptr<Request> req);
+
+private:
+	OutputWriter(const OutputWriter&) = delete;
+	OutputWriter& operator=(const OutputWriter&) = delete;
+
+	const unsigned int _depth;
+	std::mutex mutex;
+	std::condition_variable cv;
+	size_t outstanding; // writes submitted but not finished, protected by mutex
+};
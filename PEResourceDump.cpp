@@ -18,115 +18,188 @@
 
 #include "stdafx.h"
 
-#include "general.h"
-#define EXPOSE_DIRECT_RESOURCES
-#include "PE/PEFile.h"
-#include "ICO_CUR.h"
-
-typedef PE::const_resid resid;
+#include "Dump.h"
+#include "ThreadPool.h"
+#include "Hash.h"
+#include "PHash.h"
+#include "Server.h"
 
 #include <string>
 #include <iostream>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <atomic>
 
-#pragma warning(push)
-#pragma warning(disable:4100) // unreferenced formal parameter
+#pragma region Archives
+////////////////////////////////////////////////////////////////////////////////
+///// Archives
+////////////////////////////////////////////////////////////////////////////////
+/* Lists the entries of an archive to stdout, one per line with tab-separated file, type, name, lang,
+   extension, size, and hash */
+int listArchive(const wchar_t* path) {
+	ArchiveReader archive;
+	if (!archive.open(path)) { ReportLastError(std::wstring(L"Opening archive '") + path + L"'"); return 1; }
+	for (size_t i = 0; i < archive.count(); i++) {
+		ArchiveReader::Entry e = archive[i];
+		std::wcout << fromUTF8(e.file, strlen(e.file)) << L'\t' << fromUTF8(e.type, strlen(e.type)) << L'\t' <<
+			fromUTF8(e.name, strlen(e.name)) << L'\t' << e.lang << L'\t' << fromUTF8(e.ext, strlen(e.ext)) << L'\t' <<
+			e.size << L'\t' << fromUTF8(toHex(e.hash).c_str(), 16) << L'\n';
+	}
+	std::wcout.flush();
+	return 0;
+}
 
-typedef bool(*dump_func)(const PE::Rsrc * const rsrc, resid type, resid name, uint16_t lang, const std::wstring &directory, void* data, size_t size);
+/* Extracts a single entry of an archive to a file */
+int extractArchive(const wchar_t* path, const wchar_t* type, const wchar_t* name, const wchar_t* lang, const wchar_t* output, const wchar_t* file) {
+	ArchiveReader archive;
+	if (!archive.open(path)) { ReportLastError(std::wstring(L"Opening archive '") + path + L"'"); return 1; }
+	ArchiveReader::Entry e;
+	if (!archive.find(toUTF8(file).c_str(), toUTF8(type).c_str(), toUTF8(name).c_str(), (uint16_t)wcstoul(lang, nullptr, 10), e)) {
+		std::wcerr << L"! Error: The archive does not have the resource " << type << L' ' << name << L' ' << lang << L'.' << std::endl;
+		return 2;
+	}
+	if (!writeFile(output, e.data, (size_t)e.size)) { ReportLastError(std::wstring(L"Writing '") + output + L"'"); return 1; }
+	return 0;
+}
 
-/* Converts DIB image to BMP image */
-bool dib2bmp(LPVOID *data, size_t *size) {
-	// Get the offset to the pixel data, need to get the size of the header plus the size of the palette
-	size_t off = ((uint32_t*)*data)[0];
-	if (off == sizeof(BITMAPCOREHEADER)) {
-		BITMAPCOREHEADER* h = (BITMAPCOREHEADER*)*data;
-		if (h->bcBitCount < 16) { off += (1 << h->bcBitCount)*3; }
+#pragma endregion
+
+#pragma region Search Index
+////////////////////////////////////////////////////////////////////////////////
+///// Search Index
+////////////////////////////////////////////////////////////////////////////////
+/* Parses a hash given in hex, reporting if it is not one */
+static bool parseHash(const wchar_t* s, uint64_t& hash) {
+	wchar_t* end;
+	hash = wcstoull(s, &end, 16);
+	if (*s == 0 || *end != 0) { std::wcerr << L"! Error: '" << s << L"' is not a hash." << std::endl; return false; }
+	return true;
+}
+
+/* Looks up resources in a search index and lists them to stdout, one per line with tab-separated file,
+   embedded file, type, name, lang, extension, size, and hash. The query is a file whose contents are
+   matched against the outputs (like a dumped icon), the hash of an output in hex, or text where every word
+   must be in the resource. Similar images are found from an image file (BMP, ICO, or CUR) or a perceptual
+   hash in hex within the distance (10 bits by default) and also list their perceptual hash and distance,
+   closest first. Returns 2 if nothing is found. */
+int lookupIndex(const wchar_t* path, const wchar_t* kind, const wchar_t* query, const wchar_t* distance) {
+	SearchIndexReader index;
+	if (!index.open(path)) { ReportLastError(std::wstring(L"Opening search index '") + path + L"'"); return 1; }
+	bool file = wcscmp(kind, L"file") == 0 || wcscmp(kind, L"similar") == 0, similar = wcscmp(kind, L"similar") == 0 || wcscmp(kind, L"phash") == 0;
+	if (!similar && distance) { std::wcerr << L"! Error: Only similar and phash lookups take a distance." << std::endl; return 1; }
+	uint64_t hash = 0;
+	if (file) {
+		MappedFile f;
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+		if (f.open(query)) { data = f.data(); size = f.size(); }
+		else if (GetLastError() != ERROR_BAD_FORMAT) { ReportLastError(std::wstring(L"Reading '") + query + L"'"); return 1; } // empty files cannot be mapped
+		if (!similar) { hash = XXH64::hash(data, size); }
+		else if (!perceptualHashFile(data, size, hash)) { std::wcerr << L"! Error: '" << query << L"' is not a BMP, ICO, or CUR image that can be decoded." << std::endl; return 1; }
+	}
+	else if ((wcscmp(kind, L"hash") == 0 || wcscmp(kind, L"phash") == 0) && !parseHash(query, hash)) { return 1; }
+	else if (wcscmp(kind, L"text") != 0 && wcscmp(kind, L"hash") != 0 && wcscmp(kind, L"phash") != 0) {
+		std::wcerr << L"! Error: Unknown lookup '" << kind << L"', it must be file, hash, text, similar, or phash." << std::endl;
+		return 1;
 	}
+
+	std::vector<SearchIndexReader::Match> found;
+	if (similar) { index.findSimilar(hash, distance ? (unsigned)wcstoul(distance, nullptr, 10) : 10, found); }
 	else {
-		BITMAPINFOHEADER* h = (BITMAPINFOHEADER*)*data;
-		if (off < 36) { if (h->biBitCount < 16) { off += (1 << h->biBitCount) * 3; } }
-		else if (h->biBitCount < 16) { off += ((h->biClrUsed == 0) ? (1 << h->biBitCount) : h->biClrUsed) * 4; }
-		else if (h->biBitCount == 16) { off += h->biClrUsed * 4; }
-		if (off == sizeof(BITMAPINFOHEADER)) {
-			if (h->biCompression == BI_BITFIELDS) { off += sizeof(DWORD) * 3; }
-			else if (h->biCompression == 6 /*BI_ALPHABITFIELDS*/) { off += sizeof(DWORD) * 4; }
-		}
+		std::vector<size_t> records;
+		if (wcscmp(kind, L"text") == 0) { index.findText(toUTF8(query).c_str(), records); }
+		else { index.findHash(hash, records); }
+		for (size_t i : records) { found.push_back(SearchIndexReader::Match{ i, 0 }); }
 	}
-	BYTE *d = (BYTE*)realloc(*data, *size + sizeof(BITMAPFILEHEADER));
-	if (!d) { return false; }
-	memmove(d + sizeof(BITMAPFILEHEADER), *data = d, *size);
-	// need to add bitmap header: type="BM", size and offset now include header
-	*size += sizeof(BITMAPFILEHEADER); off += sizeof(BITMAPFILEHEADER);
-	BITMAPFILEHEADER bmp = { 0x4D42, (DWORD)*size, 0, 0, (DWORD)off };
-	memcpy(d, &bmp, sizeof(BITMAPFILEHEADER));
-	return true;
+	for (const SearchIndexReader::Match& m : found) {
+		SearchIndexReader::Entry e = index[m.record];
+		std::wcout << fromUTF8(e.file, strlen(e.file)) << L'\t' << fromUTF8(e.embedded, strlen(e.embedded)) << L'\t' <<
+			fromUTF8(e.type, strlen(e.type)) << L'\t' << fromUTF8(e.name, strlen(e.name)) << L'\t' << e.lang << L'\t' <<
+			fromUTF8(e.ext, strlen(e.ext)) << L'\t' << e.size << L'\t' << fromUTF8(toHex(e.hash).c_str(), 16);
+		if (similar) { std::wcout << L'\t' << fromUTF8(toHex(e.phash).c_str(), 16) << L'\t' << m.distance; }
+		std::wcout << L'\n';
+	}
+	std::wcout.flush();
+	return found.empty() ? 2 : 0;
 }
 
-/* Dumps a RT_BITMAP (actually a DIB) to a BMP file */
-bool dump_bitmap(const PE::Rsrc * const rsrc, resid type, resid name, uint16_t lang, const std::wstring &directory, void* data, size_t size) {
-	return (type == RT_BITMAP) && dib2bmp(&data, &size) && writeFile(getPath(directory, name, L"bmp"), data, size);
-}
+#pragma endregion
 
-/* Dumps a RT_ICON, RT_CURSOR, RT_GROUP_ICON, or RT_GROUP_CURSOR to an ICO/CUR file */
-bool dump_ico(const PE::Rsrc * const rsrc, resid type, resid name, uint16_t lang, const std::wstring &directory, void* data, size_t size) {
-	bool retval = false;
-	bool is_cursor = (type == RT_CURSOR || type == RT_GROUP_CURSOR);
-	if (type == RT_ICON || type == RT_CURSOR) { retval = extractICOIndividual(type, name, lang, &data, &size, rsrc); }
-	else if (type == RT_GROUP_ICON || type == RT_GROUP_CURSOR) { retval = extractICOGroup(type, name, lang, &data, &size, rsrc); }
-	return retval && writeFile(getPath(directory, name, (is_cursor ? L"cur" : L"ico")), data, size);
+#pragma region Listing
+////////////////////////////////////////////////////////////////////////////////
+///// Listing
+////////////////////////////////////////////////////////////////////////////////
+/* Lists the resources of a single PE file to stdout, returns the same as openPE() */
+int listFile(const std::wstring& filename, const DumpOptions& opts, bool json, std::mutex& mutex) {
+	PE::File* pe = nullptr;
+	const PE::Rsrc* rsrc = nullptr;
+	int status = openPE(filename.c_str(), pe, rsrc, opts);
+	if (status != 0) { return status; }
+	std::string out;
+	listResources(filename, rsrc, json, out);
+	delete pe;
+	std::lock_guard<std::mutex> lock(mutex);
+	fwrite(out.data(), 1, out.size(), stdout);
+	return 0;
 }
 
-/* Dumps a RT_MANIFEST to an XML file */
-bool dump_manifest(const PE::Rsrc * const rsrc, resid type, resid name, uint16_t lang, const std::wstring &directory, void* data, size_t size) {
-	if (type != RT_MANIFEST || ((char*)data)[0] != '<') { return false; }
-	return writeFile(getPath(directory, name, L"xml"), data, size);
+/* Lists the resources of many PE files to stdout, with more than one job the files are listed in parallel
+   and the order of the files is not kept. Returns the number of files that could not be opened. */
+size_t listBatch(const std::vector<std::wstring>& files, const DumpOptions& opts, bool json) {
+	std::mutex mutex;
+	std::atomic<size_t> failed(0);
+	if (opts.jobs == 1) {
+		for (const std::wstring& file : files) { if (listFile(file, opts, json, mutex) == 1) { ++failed; } }
+	}
+	else {
+		ThreadPool pool(opts.jobs);
+		for (const std::wstring& file : files) { pool.submit([&, file] { if (listFile(file, opts, json, mutex) == 1) { ++failed; } }); }
+		pool.wait();
+	}
+	fflush(stdout);
+	return failed;
 }
+#pragma endregion
 
-/* Dumps PNG, JPEG, or GIF images */
-bool dump_image(const PE::Rsrc * const rsrc, resid type, resid name, uint16_t lang, const std::wstring &directory, void* data, size_t size) {
-	static const uint8_t PNG_HEADER[] = { 0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A };
-	static const uint8_t GIF_HEADER_START[] = { 0x47, 0x49, 0x46, 0x38 };
-	static const uint8_t GIF_87_HEADER[] = { 0x37, 0x61 };
-	static const uint8_t GIF_89_HEADER[] = { 0x39, 0x61 };
-	static const uint8_t JPEG_HEADER_START[] = { 0xFF, 0xD8, 0xFF };
-	static const uint8_t JPEG_1_HEADER = 0xD8;
-	static const uint8_t JPEG_2_HEADER[] = { 0xE0, 0x00, 0x10, 0x4A, 0x46, 0x49, 0x46, 0x00, 0x01 };
-	static const uint8_t JPEG_3_HEADER = 0xEE;
-	static const uint8_t JPEG_4_HEADER_START = 0xE1;
-	static const uint8_t JPEG_4_HEADER_END[] = { 0x45, 0x78, 0x69, 0x66, 0x00, 0x00 };
-	static const size_t JPEG_4_HEADER_GAP = sizeof(JPEG_HEADER_START) + 1 + 4;
-
-	uint8_t* d = (uint8_t*)data;
-	wchar_t* ext = nullptr;
-	if (memcmp(d, PNG_HEADER, sizeof(PNG_HEADER)) == 0) { ext = L"png"; }
-	else if (memcmp(d, GIF_HEADER_START, sizeof(GIF_HEADER_START)) == 0 && (
-		memcmp(d + sizeof(GIF_HEADER_START), GIF_87_HEADER, sizeof(GIF_87_HEADER)) == 0 ||
-		memcmp(d + sizeof(GIF_HEADER_START), GIF_89_HEADER, sizeof(GIF_89_HEADER)) == 0)) {
-		ext = L"gif";
-	}
-	else if (memcmp(d, JPEG_HEADER_START, sizeof(JPEG_HEADER_START)) == 0 && (
-		d[sizeof(JPEG_HEADER_START)] == JPEG_1_HEADER || d[sizeof(JPEG_HEADER_START)] == JPEG_3_HEADER ||
-		memcmp(d + sizeof(JPEG_HEADER_START), JPEG_2_HEADER, sizeof(JPEG_2_HEADER)) == 0) ||
-		(d[sizeof(JPEG_HEADER_START)] == JPEG_4_HEADER_START &&
-			memcmp(d + JPEG_4_HEADER_GAP, JPEG_4_HEADER_END, sizeof(JPEG_4_HEADER_END)) == 0)) {
-		ext = L"jpg";
-	}
-	return ext != nullptr && writeFile(getPath(directory, name, ext), data, size);
+#pragma region Server
+////////////////////////////////////////////////////////////////////////////////
+///// Server
+////////////////////////////////////////////////////////////////////////////////
+/* Serves requests for single resources on a socket until the program is stopped */
+int serveRequests(const wchar_t* socket, const DumpOptions& opts, size_t cache_files, uint64_t cache_mb) {
+	DumpServer server(opts, cache_files, cache_mb << 20);
+	if (!server.listen(socket)) { ReportLastError(std::wstring(L"Listening on '") + socket + L"'"); return 1; }
+	std::wcerr << L"Serving requests on '" << socket << L"'" << std::endl;
+	if (!server.run()) { ReportLastError(L"Accepting connections"); return 1; }
+	return 0;
 }
+#pragma endregion
 
-/* Dumps data straight to a binary file without any conversion, used as a fallback */
-bool dump_binary(const PE::Rsrc * const rsrc, resid type, resid name, uint16_t lang, const std::wstring &directory, void* data, size_t size) {
-	return writeFile(getPath(directory, name, L"bin"), data, size);
+/* Removes what is gone since the last incremental dump and saves the manifest */
+bool finishManifest(const DumpOptions& opts, const std::wstring& directory) {
+	if (!opts.manifest->finish()) { ReportLastError(L"Saving the manifest in '" + directory + L"'"); return false; }
+	std::wcerr << L"Incremental: " << opts.manifest->filesSkipped() << L" files and " << opts.manifest->resourcesSkipped() <<
+		L" resources unchanged, " << opts.manifest->filesRemoved() << L" outputs removed" << std::endl;
+	return true;
 }
 
-#pragma warning(pop)
-
-// Dump functions are tried in this order
-dump_func dumpers[] = {
-	dump_bitmap, dump_ico, dump_manifest, dump_binary
-};
-
-
-
+/* Finishes the dump once every resource is done, returns false if something could not be saved */
+bool finishDump(const DumpOptions& opts, const std::wstring& directory, const wchar_t* stats_json) {
+	Sink& sink = opts.output();
+	if (!sink.finish()) { ReportLastError(L"Writing '" + directory + L"'"); return false; }
+	sink.report(std::wcerr);
+	if (opts.index) {
+		if (!opts.index->save()) { ReportLastError(L"Saving the search index"); return false; }
+		std::wcerr << L"Search index: " << opts.index->count() << L" resources" << std::endl;
+	}
+	if (opts.manifest && !finishManifest(opts, directory)) { return false; }
+	if (opts.stats) {
+		opts.stats->report(std::wcerr);
+		if (stats_json && !opts.stats->writeJSON(stats_json)) { ReportLastError(std::wstring(L"Writing '") + stats_json + L"'"); return false; }
+	}
+	return true;
+}
 
 int wmain(int argc, const wchar_t *argv[]) {
 	std::wcerr << L"PEResourceDump Copyright (C) 2019  Jeffrey Bush <jeff@coderforlife.com>" << std::endl;
@@ -136,38 +209,167 @@ int wmain(int argc, const wchar_t *argv[]) {
 	std::wcerr << L"See http://www.gnu.org/licenses/gpl.html for more details." << std::endl;
 	std::wcerr << std::endl;
 
-	// Check arguments and open them
-	if (argc != 3) { std::wcerr << L"You must supply an EXE/DLL file and the output directory on the command line." << std::endl; return 1; }
-	const wchar_t *filename = argv[1];
-	const std::wstring directory = argv[2];
-	PE::File *pe = new PE::File(filename, true);
-	if (!pe->isLoaded()) { ReportLastError(L"Opening PE File"); delete pe; return 1; }
-	const PE::Rsrc * const rsrc = pe->getResources();
-	if (!rsrc || rsrc->isEmpty()) { std::wcerr << L"! Error: The EXE/DLL file does not have any resources." << std::endl; return 2; }
-	if (!createDirectory(directory)) { ReportLastError(L"Cannot create directory '" + directory + L"'"); return 1; }
-
-	// Loop through all resources and dump them
-	for (resid type : rsrc->getTypes()) {
-		const PE::ResourceType* rsrc_type = rsrc->operator[](type);
-		std::wstring type_name = getTypeName(type), dir = directory + L"\\" + sanitizeFilename(type_name);
-		if (!createDirectory(dir)) { ReportLastError(L"Cannot create directory '" + dir + L"'", true); continue; }
-		for (resid name : rsrc_type->getNames()) {
-			const PE::ResourceName* rsrc_name = rsrc_type->operator[](name);
-			bool save_lang = rsrc_name->getLangs().size() > 1;
-			std::wstring dir_lang = dir;
-			for (uint16_t lang : rsrc_name->getLangs()) {
-				const PE::ResourceLang* rsrc_lang = rsrc_name->operator[](lang);
-				if (save_lang) {
-					dir_lang = dir + L"\\" + to_string(lang);
-					if (!createDirectory(dir_lang)) { ReportLastError(L"Cannot create directory '" + dir_lang + L"'", true); continue; }
-				}
-				size_t size, i;
-				void* data = rsrc_lang->get(&size);
-				for (i = 0; i < ARRAYSIZE(dumpers) && !dumpers[i](rsrc, type, name, lang, dir_lang, data, size); i++);
-				if (i == ARRAYSIZE(dumpers)) { std::wcerr << L"! Warning: Cannot save " << dir_lang << L"\\" << getName(name) << std::endl; }
-			}
+	// Check options
+	DumpOptions opts;
+	bool batch = false, archive = false, incremental = false, stats = false, strings = false, versions = false, list = false, list_json = false;
+	const wchar_t* store_dir = nullptr, *stats_json = nullptr, *io = nullptr, *index_path = nullptr, *serve = nullptr;
+	unsigned int io_depth = 64;
+	size_t cache_files = 64;
+	uint64_t cache_mb = 256;
+	int argi = 1;
+	for (; argi < argc && wcsncmp(argv[argi], L"--", 2) == 0; argi++) {
+		if (wcscmp(argv[argi], L"--jobs") == 0 && argi + 1 < argc) { opts.jobs = (unsigned int)wcstoul(argv[++argi], nullptr, 10); }
+		else if (wcscmp(argv[argi], L"--batch") == 0) { batch = true; }
+		else if (wcscmp(argv[argi], L"--dedup") == 0 && argi + 1 < argc) { store_dir = argv[++argi]; }
+		else if (wcscmp(argv[argi], L"--archive") == 0) { archive = true; }
+		else if (wcscmp(argv[argi], L"--incremental") == 0) { incremental = true; }
+		else if (wcscmp(argv[argi], L"--strings") == 0) { strings = true; }
+		else if (wcscmp(argv[argi], L"--versions") == 0) { versions = true; }
+		else if (wcscmp(argv[argi], L"--list") == 0) { list = true; }
+		else if (wcscmp(argv[argi], L"--list-json") == 0) { list = list_json = true; }
+		else if (wcscmp(argv[argi], L"--stats") == 0) { stats = true; }
+		else if (wcscmp(argv[argi], L"--stats-json") == 0 && argi + 1 < argc) { stats = true; stats_json = argv[++argi]; }
+		else if (wcscmp(argv[argi], L"--io") == 0 && argi + 1 < argc) { io = argv[++argi]; }
+		else if (wcscmp(argv[argi], L"--io-depth") == 0 && argi + 1 < argc) { io_depth = (unsigned int)wcstoul(argv[++argi], nullptr, 10); }
+		else if (wcscmp(argv[argi], L"--recurse") == 0 && argi + 1 < argc) { opts.recurse = (unsigned int)wcstoul(argv[++argi], nullptr, 10); }
+		else if (wcscmp(argv[argi], L"--png") == 0) { opts.png = true; }
+		else if (wcscmp(argv[argi], L"--rc") == 0) { opts.rc = true; }
+		else if (wcscmp(argv[argi], L"--serve") == 0 && argi + 1 < argc) { serve = argv[++argi]; }
+		else if (wcscmp(argv[argi], L"--cache-files") == 0 && argi + 1 < argc) { cache_files = (size_t)wcstoul(argv[++argi], nullptr, 10); }
+		else if (wcscmp(argv[argi], L"--cache-mb") == 0 && argi + 1 < argc) { cache_mb = wcstoull(argv[++argi], nullptr, 10); }
+		else if (wcscmp(argv[argi], L"--index") == 0 && argi + 1 < argc) { index_path = argv[++argi]; }
+		else if (wcscmp(argv[argi], L"--index-lookup") == 0 && (argc - argi == 4 || argc - argi == 5)) {
+			return lookupIndex(argv[argi+1], argv[argi+2], argv[argi+3], argc - argi == 5 ? argv[argi+4] : nullptr);
+		}
+		else if (wcscmp(argv[argi], L"--archive-list") == 0 && argc - argi == 2) { return listArchive(argv[argi+1]); }
+		else if (wcscmp(argv[argi], L"--archive-extract") == 0 && (argc - argi == 6 || argc - argi == 7)) {
+			return extractArchive(argv[argi+1], argv[argi+2], argv[argi+3], argv[argi+4], argv[argi+5], argc - argi == 7 ? argv[argi+6] : L"");
 		}
+		else { std::wcerr << L"! Error: Unknown option '" << argv[argi] << L"'." << std::endl; return 1; }
+	}
+	if (serve) {
+		if (argi != argc || batch || archive || store_dir || incremental || strings || versions || list || stats || io || opts.recurse || index_path || opts.rc) {
+			std::wcerr << L"! Error: --serve SOCKET only takes --png, --cache-files, and --cache-mb." << std::endl;
+			return 1;
+		}
+		return serveRequests(serve, opts, cache_files, cache_mb);
+	}
+	if (archive && store_dir) { std::wcerr << L"! Error: --dedup cannot be used with --archive." << std::endl; return 1; }
+	if (archive && incremental) { std::wcerr << L"! Error: --incremental cannot be used with --archive." << std::endl; return 1; }
+	if (opts.rc && (archive || strings || versions || list)) {
+		std::wcerr << L"! Error: --rc cannot be used with --archive, --list, --strings, or --versions." << std::endl;
+		return 1;
+	}
+	if (list && (archive || store_dir || incremental || io || strings || versions || opts.recurse || index_path)) {
+		std::wcerr << L"! Error: --list cannot be used with --archive, --dedup, --incremental, --index, --io, --recurse, --strings, or --versions." << std::endl;
+		return 1;
+	}
+	if (list) {
+		if (argc - argi != 1) { std::wcerr << L"! Error: --list takes just the EXE/DLL file (or the files with --batch)." << std::endl; return 1; }
+		if (!batch) { std::mutex mutex; int status = listFile(argv[argi], opts, list_json, mutex); fflush(stdout); return status; }
+		std::vector<std::wstring> files;
+		if (!listFiles(argv[argi], files)) { ReportLastError(std::wstring(L"Listing files from '") + argv[argi] + L"'"); return 1; }
+		return listBatch(files, opts, list_json) ? 3 : 0;
+	}
+	if (strings && versions) { std::wcerr << L"! Error: --strings cannot be used with --versions." << std::endl; return 1; }
+	if ((strings || versions) && (archive || store_dir || incremental || io || opts.recurse || index_path)) {
+		std::wcerr << L"! Error: " << (strings ? L"--strings" : L"--versions") << L" cannot be used with --archive, --dedup, --incremental, --index, --io, or --recurse." << std::endl;
+		return 1;
 	}
+	if (io && (archive || store_dir)) { std::wcerr << L"! Error: --io cannot be used with --archive or --dedup." << std::endl; return 1; }
 
-	return 0;
+	// Check arguments and open them
+	if (argc - argi != 2) {
+		std::wcerr << L"You must supply an EXE/DLL file and the output directory on the command line." << std::endl;
+		std::wcerr << L"Use --jobs N before them to dump with N threads (0 for one per CPU)." << std::endl;
+		std::wcerr << L"Use --batch to dump many files, then instead of the EXE/DLL file give a wildcard pattern," << std::endl;
+		std::wcerr << L"a directory, or a text file listing one file per line." << std::endl;
+		std::wcerr << L"Use --dedup STORE to store each unique output once in STORE and hard link to it." << std::endl;
+		std::wcerr << L"Use --archive to write everything into a single archive file instead of a directory." << std::endl;
+		std::wcerr << L"Use --strings to export all string and message tables to a single JSON lines file instead of a directory." << std::endl;
+		std::wcerr << L"Use --versions to export the version info of each file to a single JSON lines file instead of a directory." << std::endl;
+		std::wcerr << L"Use --incremental to only write what changed since the last dump to the output directory." << std::endl;
+		std::wcerr << L"Use --io BACKEND to write files in the background with uring (Linux only), threads, or auto, and" << std::endl;
+		std::wcerr << L"--io-depth N to write up to N files at once (64 by default)." << std::endl;
+		std::wcerr << L"Use --recurse N to also dump the resources of PE files embedded in resources, up to N levels deep." << std::endl;
+		std::wcerr << L"Use --png to convert bitmaps and icon images to PNG instead of BMP and ICO." << std::endl;
+		std::wcerr << L"Use --rc to decompile the dialogs, menus, accelerators, and string tables of each file into a resource" << std::endl;
+		std::wcerr << L"script for each language (resources_LANG.rc) instead of dumping them on their own." << std::endl;
+		std::wcerr << L"Use --index INDEX to add every resource to the search index file INDEX (created or updated) and" << std::endl;
+		std::wcerr << L"--index-lookup INDEX file|hash|text QUERY to find the resources with the same output as a file, with" << std::endl;
+		std::wcerr << L"an output hash, or with all of the words of the text in their manifests, strings, or version info, or" << std::endl;
+		std::wcerr << L"--index-lookup INDEX similar|phash QUERY [DISTANCE] to find the icons and bitmaps that look like an image" << std::endl;
+		std::wcerr << L"file or are within DISTANCE bits (10 by default) of a perceptual hash." << std::endl;
+		std::wcerr << L"Use --serve SOCKET to serve requests for single resources on a Unix domain socket, keeping up to" << std::endl;
+		std::wcerr << L"--cache-files N files (64 by default) and --cache-mb N MB of converted resources (256 by default) cached." << std::endl;
+		std::wcerr << L"Use --stats to report the time spent in each stage and dumper, or --stats-json FILE to save it as JSON." << std::endl;
+		std::wcerr << L"Use --list FILE or --list-json FILE to list the type, name, lang, size, RVA, and format of each resource" << std::endl;
+		std::wcerr << L"as tab-separated values or JSON lines on stdout without dumping anything (works with --batch)." << std::endl;
+		std::wcerr << L"Use --archive-list ARCHIVE to list an archive or" << std::endl;
+		std::wcerr << L"--archive-extract ARCHIVE TYPE NAME LANG OUTPUT [FILE] to extract a single resource." << std::endl;
+		return 1;
+	}
+	const std::wstring directory = argv[argi+1];
+	ContentStore store;
+	if (store_dir && !store.open(store_dir)) { ReportLastError(std::wstring(L"Opening content store '") + store_dir + L"'"); return 1; }
+	ArchiveWriter writer;
+	if (archive && !writer.create(directory)) { ReportLastError(L"Creating archive '" + directory + L"'"); return 1; }
+	JSONExport exporter(strings ? JSONExport::STRINGS : JSONExport::VERSIONS);
+	bool exporting = strings || versions;
+	if (exporting && !exporter.create(directory)) { ReportLastError(L"Creating '" + directory + L"'"); return 1; }
+	Manifest manifest;
+	if (incremental) {
+		// the options that change the outputs, when they change everything is dumped again
+		std::string options = "png=" + std::to_string(opts.png) + " rc=" + std::to_string(opts.rc) + " recurse=" + std::to_string(opts.recurse);
+		manifest.load(directory, options);
+		opts.manifest = &manifest;
+	}
+	SearchIndexWriter index;
+	if (index_path) {
+		index.load(index_path);
+		opts.index = &index;
+	}
+	std::vector<const char*> dumper_names;
+	for (size_t i = 0; i < dumper_count; i++) { dumper_names.push_back(dumpers[i].name); }
+	Stats stats_data(dumper_names);
+	if (stats) { opts.stats = &stats_data; }
+	std::unique_ptr<OutputWriter> io_writer;
+	if (io && wcscmp(io, L"sync") != 0) {
+		io_writer.reset(OutputWriter::create(io, io_depth));
+		if (!io_writer) { std::wcerr << L"! Error: The output backend '" << io << L"' is unknown or not supported on this system." << std::endl; return 1; }
+	}
+
+	// Everything converted goes to the sink
+	std::unique_ptr<Sink> sink;
+	if (archive) { sink.reset(new ArchiveSink(writer)); }
+	else if (exporting) { sink.reset(new ExportSink(exporter)); }
+	else { sink.reset(new FileSink(store_dir ? &store : nullptr, io_writer.get())); }
+	opts.sink = sink.get();
+
+	if (batch) {
+		std::vector<std::wstring> files;
+		if (!listFiles(argv[argi], files)) { ReportLastError(std::wstring(L"Listing files from '") + argv[argi] + L"'"); return 1; }
+		if (sink->usesFiles() && !createDirectory(directory)) { ReportLastError(L"Cannot create directory '" + directory + L"'"); return 1; }
+		size_t failed = dumpBatch(files, directory, opts);
+		std::wcerr << L"Dumped " << (files.size() - failed) << L" of " << files.size() << L" files." << std::endl;
+		if (!finishDump(opts, directory, stats_json)) { return 1; }
+		return failed ? 3 : 0;
+	}
+
+	// exported records are labeled with the PE file they came from
+	int status = dumpFile(argv[argi], directory, opts, exporting ? getBaseName(argv[argi]) : std::wstring());
+	if (status != 0) { return status; }
+	return finishDump(opts, directory, stats_json) ? 0 : 1;
+}
+
+#ifndef _WIN32
+// Everywhere besides Windows the arguments are converted from UTF-8
+int main(int argc, char *argv[]) {
+	setlocale(LC_ALL, "");
+	std::vector<std::wstring> args;
+	std::vector<const wchar_t*> wargv;
+	for (int i = 0; i < argc; i++) { args.push_back(fromUTF8(argv[i], strlen(argv[i]))); }
+	for (int i = 0; i < argc; i++) { wargv.push_back(args[i].c_str()); }
+	return wmain(argc, wargv.data());
 }
+#endif
@@ -0,0 +1,234 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "PEResources.h"
+#include "general.h"
+
+using namespace PE;
+
+#pragma region Structures
+////////////////////////////////////////////////////////////////////////////////
+///// Structures
+////////////////////////////////////////////////////////////////////////////////
+// All values in a PE file are little-endian and may not be aligned
+static inline uint16_t read16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t read32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+#define DOS_SIGNATURE     0x5A4D     // MZ
+#define NT_SIGNATURE      0x00004550 // PE\0\0
+#define OPT_MAGIC_32      0x10B
+#define OPT_MAGIC_64      0x20B
+#define OPT_CHECKSUM      64  // offset of the checksum in the optional header, same for PE32 and PE32+
+#define DIR_ENTRY_RESOURCE 2
+
+#define FILE_HEADER_SIZE    20
+#define SECTION_HEADER_SIZE 40
+#define RSRC_DIR_SIZE       16
+#define RSRC_DIR_ENTRY_SIZE 8
+#define RSRC_DATA_SIZE      16
+#define HIGH_BIT            0x80000000
+#pragma endregion
+
+#pragma region Tree Access
+////////////////////////////////////////////////////////////////////////////////
+///// Tree Access
+////////////////////////////////////////////////////////////////////////////////
+bool PE::residEquals(const_resid a, const_resid b) {
+	if (IS_INTRESOURCE(a) || IS_INTRESOURCE(b)) { return a == b; }
+	return wcscmp(a, b) == 0;
+}
+bool PE::residLess(const_resid a, const_resid b) {
+	bool int_a = IS_INTRESOURCE(a), int_b = IS_INTRESOURCE(b);
+	if (int_a != int_b) { return int_b; }
+	if (int_a) { return (ULONG_PTR)a < (ULONG_PTR)b; }
+	return wcscmp(a, b) < 0;
+}
+
+static inline uint16_t keyOf(const ResourceLang& l) { return l.getLang(); }
+static inline const_resid keyOf(const ResourceName& n) { return n.getName(); }
+static inline const_resid keyOf(const ResourceType& t) { return t.getType(); }
+static inline bool keyLess(uint16_t a, uint16_t b) { return a < b; }
+static inline bool keyLess(const_resid a, const_resid b) { return residLess(a, b); }
+
+// Sorts the indices of the items by their keys, unless the items are already sorted. The sort is stable
+// so duplicates are found in the order of the file.
+template<class T>
+static void sortIndices(const std::vector<T>& items, std::vector<uint32_t>& order) {
+	order.clear();
+	if (std::is_sorted(items.begin(), items.end(), [](const T& a, const T& b) { return keyLess(keyOf(a), keyOf(b)); })) { return; }
+	order.resize(items.size());
+	for (uint32_t i = 0; i < (uint32_t)items.size(); i++) { order[i] = i; }
+	std::stable_sort(order.begin(), order.end(), [&items](uint32_t a, uint32_t b) { return keyLess(keyOf(items[a]), keyOf(items[b])); });
+}
+
+// Finds the first item with a key using binary search
+template<class T, class K>
+static const T* findSorted(const std::vector<T>& items, const std::vector<uint32_t>& order, K key) {
+	if (order.empty()) {
+		auto itr = std::lower_bound(items.begin(), items.end(), key, [](const T& a, K k) { return keyLess(keyOf(a), k); });
+		return itr != items.end() && !keyLess(key, keyOf(*itr)) ? &*itr : NULL;
+	}
+	auto itr = std::lower_bound(order.begin(), order.end(), key, [&items](uint32_t a, K k) { return keyLess(keyOf(items[a]), k); });
+	return itr != order.end() && !keyLess(key, keyOf(items[*itr])) ? &items[*itr] : NULL;
+}
+
+const ResourceLang* ResourceName::operator[](uint16_t lang) const { return findSorted(this->_langs, this->order, lang); }
+const ResourceName* ResourceType::operator[](const_resid name) const { return findSorted(this->_names, this->order, name); }
+const ResourceType* Rsrc::operator[](const_resid type) const { return findSorted(this->_types, this->order, type); }
+const ResourceLang* Rsrc::find(const_resid type, const_resid name, uint16_t lang) const {
+	const ResourceType* t = (*this)[type];
+	const ResourceName* n = t ? (*t)[name] : NULL;
+	return n ? (*n)[lang] : NULL;
+}
+#pragma endregion
+
+#pragma region Loading
+////////////////////////////////////////////////////////////////////////////////
+///// Loading
+////////////////////////////////////////////////////////////////////////////////
+// Reads the ID of a directory entry, string names are stored in the string storage
+const_resid Rsrc::readResid(const uint8_t* base, size_t size, uint32_t entry_name) {
+	if (!(entry_name & HIGH_BIT)) { return MAKEINTRESOURCE(entry_name & 0xFFFF); }
+	size_t off = entry_name & ~HIGH_BIT;
+	if (off + 2 > size) { return NULL; }
+	size_t len = read16(base + off);
+	if (off + 2 + len * 2 > size) { return NULL; }
+	this->strings.push_back(fromUTF16((const uint16_t*)(base + off + 2), len));
+	return this->strings.back().c_str();
+}
+
+// Gets the entries of a resource directory, or 0 if the directory is not within the resource section
+static size_t readDirectory(const uint8_t* base, size_t size, uint32_t off, const uint8_t*& entries) {
+	if ((size_t)off + RSRC_DIR_SIZE > size) { return 0; }
+	size_t n = (size_t)read16(base + off + 12) + read16(base + off + 14);
+	if ((size_t)off + RSRC_DIR_SIZE + n * RSRC_DIR_ENTRY_SIZE > size) { return 0; }
+	entries = base + off + RSRC_DIR_SIZE;
+	return n;
+}
+
+// Loads the three levels of the resource tree (type, name, and language), skipping anything malformed.
+// Since the depth is fixed, loops in the directory structure cannot cause problems.
+bool Rsrc::load(const uint8_t* base, size_t size, const File& f) {
+	const uint8_t *types, *names, *langs;
+	size_t ntypes = readDirectory(base, size, 0, types);
+	for (size_t i = 0; i < ntypes; i++, types += RSRC_DIR_ENTRY_SIZE) {
+		uint32_t type_off = read32(types + 4);
+		if (!(type_off & HIGH_BIT)) { continue; }
+		ResourceType t;
+		if ((t.type = this->readResid(base, size, read32(types))) == NULL) { continue; }
+		size_t nnames = readDirectory(base, size, type_off & ~HIGH_BIT, names);
+		for (size_t j = 0; j < nnames; j++, names += RSRC_DIR_ENTRY_SIZE) {
+			uint32_t name_off = read32(names + 4);
+			if (!(name_off & HIGH_BIT)) { continue; }
+			ResourceName n;
+			if ((n.name = this->readResid(base, size, read32(names))) == NULL) { continue; }
+			size_t nlangs = readDirectory(base, size, name_off & ~HIGH_BIT, langs);
+			for (size_t k = 0; k < nlangs; k++, langs += RSRC_DIR_ENTRY_SIZE) {
+				uint32_t data_off = read32(langs + 4);
+				if ((data_off & HIGH_BIT) || (size_t)data_off + RSRC_DATA_SIZE > size) { continue; }
+				ResourceLang l;
+				l.lang = (uint16_t)read32(langs);
+				l._rva = read32(base + data_off);
+				l._size = read32(base + data_off + 4);
+				l._data = f.rvaToPtr(l._rva, (uint32_t)l._size);
+				if (l._data == NULL) { continue; }
+				n._langs.push_back(l);
+			}
+			if (n._langs.empty()) { continue; }
+			sortIndices(n._langs, n.order);
+			t._names.push_back(std::move(n));
+		}
+		if (t._names.empty()) { continue; }
+		sortIndices(t._names, t.order);
+		this->_types.push_back(std::move(t));
+	}
+	sortIndices(this->_types, this->order);
+	return true;
+}
+
+const uint8_t* File::rvaToPtr(uint32_t rva, uint32_t size) const {
+	for (const Section& s : this->sections) {
+		uint32_t vsize = std::max(s.vsize, s.raw_size);
+		if (rva < s.va || rva - s.va >= vsize) { continue; }
+		uint64_t off = (uint64_t)rva - s.va;
+		if (off + size > s.raw_size) { return NULL; } // not backed by data in the file
+		off += s.raw_offset;
+		if (off + size > this->_size) { return NULL; }
+		return this->base + off;
+	}
+	return NULL;
+}
+
+// Reads the headers and section table then loads the resource directory
+bool File::parse() {
+	const uint8_t* b = this->base;
+	size_t size = this->_size;
+	if (size < 0x40 || read16(b) != DOS_SIGNATURE) { return false; }
+	size_t nt = read32(b + 0x3C);
+	if (nt + 4 + FILE_HEADER_SIZE > size || read32(b + nt) != NT_SIGNATURE) { return false; }
+	const uint8_t* fh = b + nt + 4;
+	size_t nsections = read16(fh + 2), opt_size = read16(fh + 16);
+	const uint8_t* opt = fh + FILE_HEADER_SIZE;
+	if ((size_t)(opt - b) + opt_size > size || opt_size < 2) { return false; }
+
+	uint16_t magic = read16(opt);
+	size_t dirs_off;
+	if (magic == OPT_MAGIC_32) { dirs_off = 96; }
+	else if (magic == OPT_MAGIC_64) { dirs_off = 112; }
+	else { return false; }
+	if (opt_size < dirs_off) { return false; }
+	this->_checksum = read32(opt + OPT_CHECKSUM);
+	size_t ndirs = read32(opt + dirs_off - 4);
+	uint32_t rsrc_rva = 0, rsrc_size = 0;
+	if (ndirs > DIR_ENTRY_RESOURCE && dirs_off + (DIR_ENTRY_RESOURCE + 1) * 8 <= opt_size) {
+		rsrc_rva = read32(opt + dirs_off + DIR_ENTRY_RESOURCE * 8);
+		rsrc_size = read32(opt + dirs_off + DIR_ENTRY_RESOURCE * 8 + 4);
+	}
+
+	const uint8_t* sh = opt + opt_size;
+	if ((size_t)(sh - b) + nsections * SECTION_HEADER_SIZE > size) { return false; }
+	for (size_t i = 0; i < nsections; i++, sh += SECTION_HEADER_SIZE) {
+		Section s = { read32(sh + 12), read32(sh + 8), read32(sh + 20), read32(sh + 16) };
+		this->sections.push_back(s);
+	}
+
+	// A file without resources is still a valid PE file
+	if (rsrc_rva == 0 || rsrc_size == 0) { return true; }
+	// The size in the data directory is sometimes wrong so the rest of the section is made available
+	for (const Section& s : this->sections) {
+		if (rsrc_rva < s.va || rsrc_rva - s.va >= s.raw_size) { continue; }
+		uint64_t off = (uint64_t)s.raw_offset + (rsrc_rva - s.va);
+		if (off >= size) { break; }
+		size_t avail = (size_t)std::min<uint64_t>(s.raw_size - (rsrc_rva - s.va), size - off);
+		return this->rsrc.load(b + off, avail, *this);
+	}
+	return true;
+}
+
+File::File(const wchar_t* filename) : base(NULL), _size(0), _checksum(0), loaded(false) {
+	if (!this->map.open(filename)) { return; }
+	this->base = this->map.data();
+	this->_size = this->map.size();
+	this->rsrc.mapped = true;
+	if (!(this->loaded = this->parse())) { SetLastError(ERROR_BAD_FORMAT); }
+}
+
+File::File(const void* data, size_t size, bool mapped) : base((const uint8_t*)data), _size(size), _checksum(0), loaded(false) {
+	this->rsrc.mapped = mapped;
+	if (!(this->loaded = this->parse())) { SetLastError(ERROR_BAD_FORMAT); }
+}
+#pragma endregion
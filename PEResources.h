@@ -0,0 +1,133 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// A read-only reader for the resources of a PE file. The file is memory mapped and the resource data is
+// exposed as views directly into the mapping, nothing is copied.
+
+#pragma once
+
+#include "compat.h"
+#include "MappedFile.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+
+namespace PE {
+	// A resource type or name, either an integer made with MAKEINTRESOURCE or a null-terminated string
+	typedef LPCWSTR const_resid;
+
+	class ResourceLang {
+		friend class Rsrc;
+		friend class ResourceName;
+		uint16_t lang;
+		uint32_t _rva;
+		const uint8_t* _data;
+		size_t _size;
+	public:
+		uint16_t getLang() const { return this->lang; }
+		// The data is a view into the mapped file and is valid as long as the File is
+		const void* data() const { return this->_data; }
+		size_t size() const { return this->_size; }
+		uint32_t rva() const { return this->_rva; }
+	};
+
+	// Each level of the tree keeps its children in the order of the file. Lookups use binary search, over
+	// the children themselves when the file has them sorted (which it should) or over a sorted list of their
+	// indices otherwise.
+	class ResourceName {
+		friend class Rsrc;
+		friend class ResourceType;
+		const_resid name;
+		std::vector<ResourceLang> _langs;
+		std::vector<uint32_t> order; // empty when the langs are already sorted
+	public:
+		const_resid getName() const { return this->name; }
+		const std::vector<ResourceLang>& langs() const { return this->_langs; }
+		const ResourceLang* operator[](uint16_t lang) const;
+	};
+
+	class ResourceType {
+		friend class Rsrc;
+		const_resid type;
+		std::vector<ResourceName> _names;
+		std::vector<uint32_t> order; // empty when the names are already sorted
+	public:
+		const_resid getType() const { return this->type; }
+		const std::vector<ResourceName>& names() const { return this->_names; }
+		const ResourceName* operator[](const_resid name) const;
+	};
+
+	// Compares resource IDs, either both integers or both strings with the same contents
+	bool residEquals(const_resid a, const_resid b);
+	// Orders resource IDs like the directories of a PE file: strings first then integers
+	bool residLess(const_resid a, const_resid b);
+
+	// The resource directory tree of a PE file
+	class Rsrc {
+		friend class File;
+		std::vector<ResourceType> _types;
+		std::vector<uint32_t> order; // empty when the types are already sorted
+		std::deque<std::wstring> strings; // storage for string names, a deque so the pointers stay valid
+		bool mapped = false;
+
+		bool load(const uint8_t* base, size_t size, const class File& f);
+		const_resid readResid(const uint8_t* base, size_t size, uint32_t entry_name);
+	public:
+		bool isEmpty() const { return this->_types.empty(); }
+		// Checks if the resource data is in a file mapping, only then can its pages be released once they are
+		// read (see MappedFile::release()). Data in memory of the caller must never be released.
+		bool isMapped() const { return this->mapped; }
+		const std::vector<ResourceType>& types() const { return this->_types; }
+		const ResourceType* operator[](const_resid type) const;
+		// Finds a single resource, or NULL if it does not exist
+		const ResourceLang* find(const_resid type, const_resid name, uint16_t lang) const;
+	};
+
+	// A memory-mapped PE file, or one that is already in memory such as the data of another resource
+	class File {
+		const uint8_t* base;
+		size_t _size;
+		MappedFile map;
+		uint32_t _checksum;
+		bool loaded;
+		Rsrc rsrc;
+
+		struct Section { uint32_t va, vsize, raw_offset, raw_size; };
+		std::vector<Section> sections;
+
+		bool parse();
+	public:
+		explicit File(const wchar_t* filename);
+		// Reads a PE file in memory without copying it, the data must stay valid as long as this is used. Mapped
+		// is true when the data is part of a file mapping, such as a PE file embedded in a mapped file.
+		File(const void* data, size_t size, bool mapped = false);
+
+		bool isLoaded() const { return this->loaded; }
+		const Rsrc* getResources() const { return &this->rsrc; }
+		size_t size() const { return this->_size; }
+		// The checksum from the optional header, many files leave it 0
+		uint32_t checksum() const { return this->_checksum; }
+
+		// Gets a pointer to the data at the RVA in the file, or NULL if the whole range is not in the file
+		const uint8_t* rvaToPtr(uint32_t rva, uint32_t size) const;
+
+	private:
+		File(const File&) = delete;
+		File& operator=(const File&) = delete;
+	};
+}
@@ -0,0 +1,199 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "PHash.h"
+#include "PNG.h"
+#include "SIMD.h"
+
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+static const unsigned HASH_W = 9, HASH_H = 8; // the size the image is shrunk to
+static const size_t ROW_SLACK = 32;
+
+static inline uint16_t read16(const uint8_t* p) { uint16_t x; memcpy(&x, p, 2); return x; } // assumes little-endian
+static inline uint32_t read32(const uint8_t* p) { uint32_t x; memcpy(&x, p, 4); return x; }
+
+#pragma region Kernels
+////////////////////////////////////////////////////////////////////////////////
+///// Kernels
+////////////////////////////////////////////////////////////////////////////////
+// Converts RGBA pixels to grayscale on a white background. The luma is (77R + 150G + 29B + 128) / 256 and is
+// blended with white by the alpha, dividing by 255 with rounding. Every step fits in 16 bits so the SIMD
+// versions give exactly the same results.
+static void gray_scalar(const uint8_t* rgba, uint8_t* gray, size_t n) {
+	for (size_t i = 0; i < n; i++, rgba += 4) {
+		unsigned y = (77 * rgba[0] + 150 * rgba[1] + 29 * rgba[2] + 128) >> 8, a = rgba[3];
+		unsigned t = y * a + 255 * (255 - a) + 128;
+		gray[i] = (uint8_t)((t + (t >> 8)) >> 8);
+	}
+}
+// Sums bytes
+static uint64_t sum_scalar(const uint8_t* p, size_t n) {
+	uint64_t s = 0;
+	for (size_t i = 0; i < n; i++) { s += p[i]; }
+	return s;
+}
+
+#ifdef PIXEL_X86
+TARGET_SSE2 static void gray_sse2(const uint8_t* rgba, uint8_t* gray, size_t n) {
+	const __m128i m = _mm_set1_epi32(0xFF), c77 = _mm_set1_epi16(77), c150 = _mm_set1_epi16(150), c29 = _mm_set1_epi16(29);
+	const __m128i c128 = _mm_set1_epi16(128), c255 = _mm_set1_epi16(255);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(rgba + 4*i)), b = _mm_loadu_si128((const __m128i*)(rgba + 4*i + 16));
+		__m128i r = _mm_packs_epi32(_mm_and_si128(a, m), _mm_and_si128(b, m));
+		__m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), m), _mm_and_si128(_mm_srli_epi32(b, 8), m));
+		__m128i bl = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 16), m), _mm_and_si128(_mm_srli_epi32(b, 16), m));
+		__m128i al = _mm_packs_epi32(_mm_srli_epi32(a, 24), _mm_srli_epi32(b, 24));
+		__m128i y = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, c77), _mm_mullo_epi16(g, c150)), _mm_add_epi16(_mm_mullo_epi16(bl, c29), c128));
+		y = _mm_srli_epi16(y, 8);
+		__m128i t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(y, al), _mm_mullo_epi16(c255, _mm_sub_epi16(c255, al))), c128);
+		t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+		_mm_storel_epi64((__m128i*)(gray + i), _mm_packus_epi16(t, t));
+	}
+	gray_scalar(rgba + 4*i, gray + i, n - i);
+}
+TARGET_SSE2 static uint64_t sum_sse2(const uint8_t* p, size_t n) {
+	__m128i acc = _mm_setzero_si128(), zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) { acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(p + i)), zero)); }
+	return (uint64_t)_mm_cvtsi128_si32(acc) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8)) + sum_scalar(p + i, n - i);
+}
+
+TARGET_AVX2 static void gray_avx2(const uint8_t* rgba, uint8_t* gray, size_t n) {
+	const __m256i m = _mm256_set1_epi32(0xFF), c77 = _mm256_set1_epi16(77), c150 = _mm256_set1_epi16(150), c29 = _mm256_set1_epi16(29);
+	const __m256i c128 = _mm256_set1_epi16(128), c255 = _mm256_set1_epi16(255);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		// packing works within each 128-bit lane so the 16-bit values are in the order 0-3, 8-11, 4-7, 12-15
+		__m256i a = _mm256_loadu_si256((const __m256i*)(rgba + 4*i)), b = _mm256_loadu_si256((const __m256i*)(rgba + 4*i + 32));
+		__m256i r = _mm256_packs_epi32(_mm256_and_si256(a, m), _mm256_and_si256(b, m));
+		__m256i g = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(a, 8), m), _mm256_and_si256(_mm256_srli_epi32(b, 8), m));
+		__m256i bl = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(a, 16), m), _mm256_and_si256(_mm256_srli_epi32(b, 16), m));
+		__m256i al = _mm256_packs_epi32(_mm256_srli_epi32(a, 24), _mm256_srli_epi32(b, 24));
+		__m256i y = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r, c77), _mm256_mullo_epi16(g, c150)), _mm256_add_epi16(_mm256_mullo_epi16(bl, c29), c128));
+		y = _mm256_srli_epi16(y, 8);
+		__m256i t = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(y, al), _mm256_mullo_epi16(c255, _mm256_sub_epi16(c255, al))), c128);
+		t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+		t = _mm256_permute4x64_epi64(t, 0xD8); // back in order
+		t = _mm256_permute4x64_epi64(_mm256_packus_epi16(t, _mm256_setzero_si256()), 0x08);
+		_mm_storeu_si128((__m128i*)(gray + i), _mm256_castsi256_si128(t));
+	}
+	gray_sse2(rgba + 4*i, gray + i, n - i);
+}
+TARGET_AVX2 static uint64_t sum_avx2(const uint8_t* p, size_t n) {
+	__m256i acc = _mm256_setzero_si256(), zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) { acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(p + i)), zero)); }
+	__m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	return (uint64_t)_mm_cvtsi128_si32(s) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(s, 8)) + sum_sse2(p + i, n - i);
+}
+#endif
+
+// The kernels for one instruction set
+struct Kernels {
+	void(*gray)(const uint8_t* rgba, uint8_t* gray, size_t n);
+	uint64_t(*sum)(const uint8_t* p, size_t n);
+};
+static const Kernels kernels[] = {
+	{ gray_scalar, sum_scalar },
+#ifdef PIXEL_X86
+	{ gray_sse2, sum_sse2 },
+	{ gray_avx2, sum_avx2 },
+#endif
+};
+#pragma endregion
+
+#pragma region Hashing
+////////////////////////////////////////////////////////////////////////////////
+///// Hashing
+////////////////////////////////////////////////////////////////////////////////
+/* Computes the dHash of a DIB. Each of the 9x8 cells averages a block of the image (blocks overlap when the
+   image is smaller than 9x8). The rows are shrunk as they are decoded so the image is never held whole. */
+static bool dhash(const void* data, size_t size, bool icon, uint64_t& hash) {
+	const Kernels& k = kernels[pixelSIMD()];
+	static thread_local std::vector<uint8_t> gray;
+	uint64_t sums[HASH_H][HASH_W] = {};
+	uint32_t x0[HASH_W], x1[HASH_W], y0[HASH_H], y1[HASH_H];
+	uint32_t w = 0, h = 0, y = 0;
+	bool ok = decodeDIB(data, size, icon, w, h, [&](const uint8_t* rgba) {
+		if (y == 0) {
+			for (uint32_t i = 0; i < HASH_W; i++) { x0[i] = (uint32_t)((uint64_t)i * w / HASH_W); x1[i] = std::max(x0[i] + 1, (uint32_t)((uint64_t)(i + 1) * w / HASH_W)); }
+			for (uint32_t i = 0; i < HASH_H; i++) { y0[i] = (uint32_t)((uint64_t)i * h / HASH_H); y1[i] = std::max(y0[i] + 1, (uint32_t)((uint64_t)(i + 1) * h / HASH_H)); }
+			gray.resize(w + ROW_SLACK);
+		}
+		k.gray(rgba, gray.data(), w);
+		uint64_t cols[HASH_W];
+		for (uint32_t i = 0; i < HASH_W; i++) { cols[i] = k.sum(gray.data() + x0[i], x1[i] - x0[i]); }
+		for (uint32_t j = 0; j < HASH_H; j++) {
+			if (y >= y0[j] && y < y1[j]) { for (uint32_t i = 0; i < HASH_W; i++) { sums[j][i] += cols[i]; } }
+		}
+		y++;
+	});
+	if (!ok) { return false; }
+	hash = 0;
+	for (uint32_t j = 0; j < HASH_H; j++) {
+		uint64_t prev = (sums[j][0] << 8) / ((uint64_t)(x1[0] - x0[0]) * (y1[j] - y0[j]));
+		for (uint32_t i = 1; i < HASH_W; i++) {
+			uint64_t cur = (sums[j][i] << 8) / ((uint64_t)(x1[i] - x0[i]) * (y1[j] - y0[j]));
+			hash = (hash << 1) | (prev > cur ? 1 : 0);
+			prev = cur;
+		}
+	}
+	return true;
+}
+
+static bool isPNG(const void* data, size_t size) {
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	return size >= 8 && memcmp(data, signature, 8) == 0;
+}
+
+bool perceptualHash(PE::const_resid type, const void* data, size_t size, uint64_t& hash) {
+	if (type == RT_BITMAP) { return dhash(data, size, false, hash); }
+	if (type == RT_ICON) { return !isPNG(data, size) && dhash(data, size, true, hash); }
+	if (type == RT_CURSOR) { return size > 4 && !isPNG((const uint8_t*)data + 4, size - 4) && dhash((const uint8_t*)data + 4, size - 4, true, hash); } // starts with the hotspot
+	return false;
+}
+
+bool perceptualHashFile(const void* data, size_t size, uint64_t& hash) {
+	const uint8_t* d = (const uint8_t*)data;
+	if (size > 14 && d[0] == 'B' && d[1] == 'M') { return dhash(d + 14, size - 14, false, hash); }
+	if (size < 6 || read16(d) != 0 || (read16(d + 2) != 1 && read16(d + 2) != 2)) { return false; }
+	// the largest image of the ICO or CUR file that is not PNG
+	size_t count = read16(d + 4), best = SIZE_MAX, best_pixels = 0;
+	if (6 + count * 16 > size) { return false; }
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t* e = d + 6 + i * 16;
+		size_t w = e[0] ? e[0] : 256, h = e[1] ? e[1] : 256, sz = read32(e + 8), off = read32(e + 12);
+		if (off > size || sz > size - off || isPNG(d + off, sz)) { continue; }
+		if (w * h > best_pixels) { best = i; best_pixels = w * h; }
+	}
+	if (best == SIZE_MAX) { return false; }
+	const uint8_t* e = d + 6 + best * 16;
+	return dhash(d + read32(e + 12), read32(e + 8), true, hash);
+}
+
+unsigned hammingDistance(uint64_t a, uint64_t b) {
+	uint64_t x = a ^ b;
+	x = x - ((x >> 1) & 0x5555555555555555ull);
+	x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return (unsigned)((x * 0x0101010101010101ull) >> 56);
+}
+#pragma endregion
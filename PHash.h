@@ -0,0 +1,35 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Perceptual hashes of icons and bitmaps, so images that look the same are found even when they have been
+// re-encoded or slightly changed. The hash is a 64-bit dHash: the image is put on a white background, turned
+// to grayscale, and shrunk to 9x8 by averaging, then each bit is set if a pixel is brighter than the one to
+// its right. Images that look alike have hashes that differ in only a few bits.
+
+#pragma once
+
+#include "general.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Hashes the image of a RT_BITMAP, RT_ICON, or RT_CURSOR resource. Returns false for other types and images
+// that cannot be decoded (see decodeDIB()), which includes icons stored as PNG.
+bool perceptualHash(PE::const_resid type, const void* data, size_t size, uint64_t& hash);
+// Hashes the image in a BMP, ICO, or CUR file (the largest image of an ICO or CUR file)
+bool perceptualHashFile(const void* data, size_t size, uint64_t& hash);
+// The number of bits that differ between two hashes
+unsigned hammingDistance(uint64_t a, uint64_t b);
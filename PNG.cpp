@@ -0,0 +1,445 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "PNG.h"
+#include "Deflate.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+static const uint64_t MAX_PIXELS = 1 << 26; // larger images are left as they are
+static const size_t ROW_SLACK = 32; // the kernels may write this many bytes past the end of a row
+
+static inline uint16_t read16(const uint8_t* p) { uint16_t x; memcpy(&x, p, 2); return x; } // assumes little-endian
+static inline uint32_t read32(const uint8_t* p) { uint32_t x; memcpy(&x, p, 4); return x; }
+static inline void write32be(uint8_t* p, uint32_t x) { p[0] = (uint8_t)(x >> 24); p[1] = (uint8_t)(x >> 16); p[2] = (uint8_t)(x >> 8); p[3] = (uint8_t)x; }
+
+#pragma region Pixel Kernels
+////////////////////////////////////////////////////////////////////////////////
+///// Pixel Kernels
+////////////////////////////////////////////////////////////////////////////////
+// Every kernel converts n pixels of a row. The scalar versions are the reference, the others handle as many
+// pixels as they can at once then leave the rest to the scalar version.
+
+// BGRA to RGBA
+static void swizzle32_scalar(const uint8_t* src, uint8_t* dst, size_t n) {
+	for (size_t i = 0; i < n; i++, src += 4, dst += 4) { dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0]; dst[3] = src[3]; }
+}
+// BGRX to RGB
+static void swizzle32to24_scalar(const uint8_t* src, uint8_t* dst, size_t n) {
+	for (size_t i = 0; i < n; i++, src += 4, dst += 3) { dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0]; }
+}
+// BGR to RGB
+static void swizzle24_scalar(const uint8_t* src, uint8_t* dst, size_t n) {
+	for (size_t i = 0; i < n; i++, src += 3, dst += 3) { dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0]; }
+}
+// Sets the alpha of RGBA pixels from the bits of an AND mask, a set bit is transparent
+static void foldMask_scalar(const uint8_t* mask, uint8_t* rgba, size_t n) {
+	for (size_t i = 0; i < n; i++) { rgba[4*i + 3] = ((mask[i >> 3] >> (7 - (i & 7))) & 1) ? 0 : 0xFF; }
+}
+// The PNG Up filter: each byte minus the byte above it
+static void filterUp_scalar(const uint8_t* cur, const uint8_t* prev, uint8_t* dst, size_t n) {
+	for (size_t i = 0; i < n; i++) { dst[i] = (uint8_t)(cur[i] - prev[i]); }
+}
+// Checks if any BGRA pixel has a non-zero alpha
+static bool anyAlpha_scalar(const uint8_t* bgra, size_t n) {
+	for (size_t i = 0; i < n; i++) { if (bgra[4*i + 3]) { return true; } }
+	return false;
+}
+
+#ifdef PIXEL_X86
+TARGET_SSE2 static void swizzle32_sse2(const uint8_t* src, uint8_t* dst, size_t n) {
+	const __m128i ga = _mm_set1_epi32((int)0xFF00FF00), rb = _mm_set1_epi32(0x00FF00FF);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(src + 4*i)), y = _mm_and_si128(x, rb);
+		y = _mm_or_si128(_mm_slli_epi32(y, 16), _mm_srli_epi32(y, 16));
+		_mm_storeu_si128((__m128i*)(dst + 4*i), _mm_or_si128(_mm_and_si128(x, ga), y));
+	}
+	swizzle32_scalar(src + 4*i, dst + 4*i, n - i);
+}
+TARGET_SSE2 static void foldMask_sse2(const uint8_t* mask, uint8_t* rgba, size_t n) {
+	const __m128i bits_lo = _mm_set_epi32(0x10, 0x20, 0x40, 0x80), bits_hi = _mm_set_epi32(0x01, 0x02, 0x04, 0x08);
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000), rgb = _mm_set1_epi32(0x00FFFFFF);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i m = _mm_set1_epi32(mask[i >> 3]);
+		__m128i t_lo = _mm_cmpeq_epi32(_mm_and_si128(m, bits_lo), bits_lo), t_hi = _mm_cmpeq_epi32(_mm_and_si128(m, bits_hi), bits_hi);
+		__m128i* p = (__m128i*)(rgba + 4*i);
+		_mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(p), rgb), _mm_andnot_si128(t_lo, alpha)));
+		_mm_storeu_si128(p + 1, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(p + 1), rgb), _mm_andnot_si128(t_hi, alpha)));
+	}
+	for (; i < n; i++) { rgba[4*i + 3] = ((mask[i >> 3] >> (7 - (i & 7))) & 1) ? 0 : 0xFF; }
+}
+TARGET_SSE2 static void filterUp_sse2(const uint8_t* cur, const uint8_t* prev, uint8_t* dst, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(cur + i)), b = _mm_loadu_si128((const __m128i*)(prev + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(a, b));
+	}
+	filterUp_scalar(cur + i, prev + i, dst + i, n - i);
+}
+TARGET_SSE2 static bool anyAlpha_sse2(const uint8_t* bgra, size_t n) {
+	__m128i acc = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) { acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i*)(bgra + 4*i))); }
+	acc = _mm_and_si128(acc, _mm_set1_epi32((int)0xFF000000));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) { return true; }
+	return anyAlpha_scalar(bgra + 4*i, n - i);
+}
+
+TARGET_AVX2 static void swizzle32_avx2(const uint8_t* src, uint8_t* dst, size_t n) {
+	const __m256i shuf = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(src + 4*i));
+		_mm256_storeu_si256((__m256i*)(dst + 4*i), _mm256_shuffle_epi8(x, shuf));
+	}
+	swizzle32_scalar(src + 4*i, dst + 4*i, n - i);
+}
+TARGET_AVX2 static void swizzle32to24_avx2(const uint8_t* src, uint8_t* dst, size_t n) {
+	// each lane packs its 4 pixels into the low 12 bytes, then the lanes are joined into 24 bytes
+	const __m256i shuf = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + 4*i)), shuf);
+		_mm256_storeu_si256((__m256i*)(dst + 3*i), _mm256_permutevar8x32_epi32(x, join)); // writes 8 bytes of slack
+	}
+	swizzle32to24_scalar(src + 4*i, dst + 3*i, n - i);
+}
+TARGET_AVX2 static void swizzle24_avx2(const uint8_t* src, uint8_t* dst, size_t n) {
+	// the 24 bytes of 8 pixels are split into the low 12 bytes of each lane, swizzled, and joined again
+	const __m256i split = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0), join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	const __m256i shuf = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, -1, -1, -1, -1, 2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, -1, -1, -1, -1);
+	size_t i = 0;
+	for (; i + 11 <= n; i += 8) { // 32 bytes are read so 8 past the pixels must be in the row
+		__m256i x = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(src + 3*i)), split);
+		_mm256_storeu_si256((__m256i*)(dst + 3*i), _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(x, shuf), join));
+	}
+	swizzle24_scalar(src + 3*i, dst + 3*i, n - i);
+}
+TARGET_AVX2 static void foldMask_avx2(const uint8_t* mask, uint8_t* rgba, size_t n) {
+	const __m256i bits = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+	const __m256i alpha = _mm256_set1_epi32((int)0xFF000000), rgb = _mm256_set1_epi32(0x00FFFFFF);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i t = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(mask[i >> 3]), bits), bits);
+		__m256i* p = (__m256i*)(rgba + 4*i);
+		_mm256_storeu_si256(p, _mm256_or_si256(_mm256_and_si256(_mm256_loadu_si256(p), rgb), _mm256_andnot_si256(t, alpha)));
+	}
+	for (; i < n; i++) { rgba[4*i + 3] = ((mask[i >> 3] >> (7 - (i & 7))) & 1) ? 0 : 0xFF; }
+}
+TARGET_AVX2 static void filterUp_avx2(const uint8_t* cur, const uint8_t* prev, uint8_t* dst, size_t n) {
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(cur + i)), b = _mm256_loadu_si256((const __m256i*)(prev + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_sub_epi8(a, b));
+	}
+	filterUp_scalar(cur + i, prev + i, dst + i, n - i);
+}
+TARGET_AVX2 static bool anyAlpha_avx2(const uint8_t* bgra, size_t n) {
+	__m256i acc = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) { acc = _mm256_or_si256(acc, _mm256_loadu_si256((const __m256i*)(bgra + 4*i))); }
+	if (!_mm256_testz_si256(acc, _mm256_set1_epi32((int)0xFF000000))) { return true; }
+	return anyAlpha_scalar(bgra + 4*i, n - i);
+}
+#endif
+
+// The kernels for one instruction set
+struct Kernels {
+	void(*swizzle32)(const uint8_t* src, uint8_t* dst, size_t n);
+	void(*swizzle32to24)(const uint8_t* src, uint8_t* dst, size_t n);
+	void(*swizzle24)(const uint8_t* src, uint8_t* dst, size_t n);
+	void(*foldMask)(const uint8_t* mask, uint8_t* rgba, size_t n);
+	void(*filterUp)(const uint8_t* cur, const uint8_t* prev, uint8_t* dst, size_t n);
+	bool(*anyAlpha)(const uint8_t* bgra, size_t n);
+};
+static const Kernels kernels[] = {
+	{ swizzle32_scalar, swizzle32to24_scalar, swizzle24_scalar, foldMask_scalar, filterUp_scalar, anyAlpha_scalar },
+#ifdef PIXEL_X86
+	// SSE2 cannot shuffle bytes so 24-bit pixels are left to the scalar versions
+	{ swizzle32_sse2, swizzle32to24_scalar, swizzle24_scalar, foldMask_sse2, filterUp_sse2, anyAlpha_sse2 },
+	{ swizzle32_avx2, swizzle32to24_avx2, swizzle24_avx2, foldMask_avx2, filterUp_avx2, anyAlpha_avx2 },
+#endif
+};
+
+#pragma endregion
+
+#pragma region DIB
+////////////////////////////////////////////////////////////////////////////////
+///// DIB
+////////////////////////////////////////////////////////////////////////////////
+// A bitfield of 16 or 32 bit pixels scaled to 8 bits
+struct Channel {
+	uint32_t mask;
+	unsigned shift, bits;
+	uint32_t mul; // 16.16 fixed point multiplier for fields shorter than 8 bits
+	void set(uint32_t m) {
+		this->mask = m; this->shift = 0; this->bits = 0;
+		if (!m) { this->mul = 0; return; }
+		while (!((m >> this->shift) & 1)) { this->shift++; }
+		while (this->shift + this->bits < 32 && ((m >> (this->shift + this->bits)) & 1)) { this->bits++; }
+		this->mul = this->bits < 8 ? (uint32_t)((255u << 16) / ((1u << this->bits) - 1)) : 0;
+	}
+	inline uint8_t get(uint32_t px) const {
+		uint32_t v = (px & this->mask) >> this->shift;
+		return (uint8_t)(this->bits >= 8 ? v >> (this->bits - 8) : (v * this->mul + 0x8000) >> 16);
+	}
+};
+
+// The parsed header of a DIB
+struct DIB {
+	uint32_t width, height; // the height of the image (for icons without the mask)
+	bool top_down;
+	unsigned bpp;
+	const uint8_t* pixels;
+	size_t stride;
+	const uint8_t* mask; // the AND mask of an icon, NULL if there isn't one
+	size_t mask_stride;
+	bool bitfields; // 16 or 32 bit pixels that are not in the standard BGRX byte order
+	Channel r, g, b, a;
+	uint32_t palette[256]; // RGBA for up to 8 bit pixels
+};
+
+/* Parses the header, bitfields, and palette of a DIB and finds the pixels and mask */
+static bool parseDIB(const uint8_t* data, size_t size, bool icon, DIB& dib) {
+	if (size < 12) { return false; }
+	uint32_t hsize = read32(data), compression = BI_RGB, colors = 0;
+	int64_t w, h;
+	size_t entry;
+	if (hsize == 12) { w = read16(data + 4); h = (int16_t)read16(data + 6); dib.bpp = read16(data + 10); entry = 3; }
+	else if (hsize >= 40 && hsize <= size) {
+		w = (int32_t)read32(data + 4); h = (int32_t)read32(data + 8); dib.bpp = read16(data + 14);
+		compression = read32(data + 16); colors = read32(data + 32); entry = 4;
+	}
+	else { return false; }
+	size_t off = hsize;
+
+	uint32_t masks[4] = { 0, 0, 0, 0 };
+	dib.bitfields = false;
+	if (compression == BI_BITFIELDS || compression == 6 /*BI_ALPHABITFIELDS*/) {
+		if (dib.bpp != 16 && dib.bpp != 32) { return false; }
+		size_t n = compression == 6 ? 4 : 3;
+		if (hsize >= 52) {
+			for (size_t i = 0; i < 3; i++) { masks[i] = read32(data + 40 + 4*i); }
+			if (hsize >= 56) { masks[3] = read32(data + 52); }
+		}
+		else {
+			if (off + 4*n > size) { return false; }
+			for (size_t i = 0; i < n; i++) { masks[i] = read32(data + off + 4*i); }
+			off += 4*n;
+		}
+		dib.bitfields = dib.bpp == 16 || masks[0] != 0xFF0000 || masks[1] != 0xFF00 || masks[2] != 0xFF || (masks[3] && masks[3] != 0xFF000000);
+	}
+	else if (compression != BI_RGB) { return false; }
+	else if (dib.bpp == 16) { masks[0] = 0x7C00; masks[1] = 0x03E0; masks[2] = 0x001F; dib.bitfields = true; }
+	dib.r.set(masks[0]); dib.g.set(masks[1]); dib.b.set(masks[2]); dib.a.set(masks[3]);
+
+	if (w <= 0 || h == 0 || (dib.bpp != 1 && dib.bpp != 2 && dib.bpp != 4 && dib.bpp != 8 && dib.bpp != 16 && dib.bpp != 24 && dib.bpp != 32)) { return false; }
+	dib.top_down = h < 0;
+	if (h < 0) { h = -h; }
+	if (icon) { h /= 2; dib.top_down = false; }
+	if (h == 0 || (uint64_t)w * h > MAX_PIXELS) { return false; }
+	dib.width = (uint32_t)w; dib.height = (uint32_t)h;
+
+	if (dib.bpp <= 8) {
+		size_t n = colors ? colors : ((size_t)1 << dib.bpp);
+		if (hsize == 12) { n = (size_t)1 << dib.bpp; }
+		if (off + n * entry > size) { return false; }
+		for (size_t i = 0; i < 256; i++) {
+			const uint8_t* c = data + off + i * entry;
+			dib.palette[i] = i < n ? (c[2] | (c[1] << 8) | (c[0] << 16) | 0xFF000000u) : 0xFF000000u;
+		}
+		off += n * entry;
+	}
+	else { off += (size_t)colors * 4; } // a palette for optimizing the display of the image
+
+	dib.stride = (size_t)(((uint64_t)dib.width * dib.bpp + 31) / 32 * 4);
+	if (off > size || (uint64_t)dib.stride * dib.height > size - off) { return false; }
+	dib.pixels = data + off;
+	dib.mask = nullptr;
+	dib.mask_stride = (dib.width + 31) / 32 * 4;
+	if (icon && (uint64_t)dib.mask_stride * dib.height <= size - off - dib.stride * dib.height) { dib.mask = dib.pixels + dib.stride * dib.height; }
+	return true;
+}
+
+/* Checks if an AND mask makes any pixel transparent, the padding at the end of each row is ignored */
+static bool anyMasked(const DIB& dib) {
+	size_t full = dib.width / 8;
+	uint8_t last = (uint8_t)(0xFF00 >> (dib.width & 7));
+	for (uint32_t y = 0; y < dib.height; y++) {
+		const uint8_t* m = dib.mask + y * dib.mask_stride;
+		for (size_t x = 0; x < full; x++) { if (m[x]) { return true; } }
+		if (last && (m[full] & last)) { return true; }
+	}
+	return false;
+}
+
+/* Converts a row of pixels to RGB or RGBA (with the alpha set to opaque or from the alpha channel) */
+static void convertRow(const DIB& dib, const Kernels& k, const uint8_t* src, bool rgba, bool alpha, uint8_t* dst) {
+	size_t n = dib.width;
+	if (dib.bpp == 32 && !dib.bitfields) {
+		if (!rgba) { k.swizzle32to24(src, dst, n); }
+		else {
+			k.swizzle32(src, dst, n);
+			if (!alpha) { for (size_t i = 0; i < n; i++) { dst[4*i + 3] = 0xFF; } }
+		}
+	}
+	else if (dib.bpp == 24) {
+		if (!rgba) { k.swizzle24(src, dst, n); }
+		else { for (size_t i = 0; i < n; i++, src += 3, dst += 4) { dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0]; dst[3] = 0xFF; } }
+	}
+	else if (dib.bpp >= 16) {
+		for (size_t i = 0; i < n; i++) {
+			uint32_t px = dib.bpp == 16 ? read16(src + 2*i) : read32(src + 4*i);
+			*dst++ = dib.r.get(px); *dst++ = dib.g.get(px); *dst++ = dib.b.get(px);
+			if (rgba) { *dst++ = alpha ? dib.a.get(px) : 0xFF; }
+		}
+	}
+	else {
+		unsigned bpp = dib.bpp, per_byte = 8 / bpp, mask = (1 << bpp) - 1;
+		for (size_t i = 0; i < n; i++) {
+			unsigned idx = bpp == 8 ? src[i] : (src[i / per_byte] >> ((per_byte - 1 - i % per_byte) * bpp)) & mask;
+			uint32_t c = dib.palette[idx];
+			if (rgba) { memcpy(dst, &c, 4); dst += 4; }
+			else { dst[0] = (uint8_t)c; dst[1] = (uint8_t)(c >> 8); dst[2] = (uint8_t)(c >> 16); dst += 3; }
+		}
+	}
+}
+#pragma endregion
+
+#pragma region PNG
+////////////////////////////////////////////////////////////////////////////////
+///// PNG
+////////////////////////////////////////////////////////////////////////////////
+// CRC-32 of PNG chunks, computed 8 bytes at a time (slicing-by-8)
+struct CRCTables {
+	uint32_t t[8][256];
+	CRCTables() {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++) { c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1; }
+			this->t[0][i] = c;
+		}
+		for (uint32_t i = 0; i < 256; i++) {
+			for (int s = 1; s < 8; s++) { this->t[s][i] = (this->t[s - 1][i] >> 8) ^ this->t[0][this->t[s - 1][i] & 0xFF]; }
+		}
+	}
+};
+static uint32_t crc32(const uint8_t* p, size_t size) {
+	static const CRCTables tables;
+	const uint32_t (*t)[256] = tables.t;
+	uint32_t c = 0xFFFFFFFFu;
+	for (; size >= 8; size -= 8, p += 8) {
+		uint32_t a = read32(p) ^ c, b = read32(p + 4);
+		c = t[7][a & 0xFF] ^ t[6][(a >> 8) & 0xFF] ^ t[5][(a >> 16) & 0xFF] ^ t[4][a >> 24] ^
+			t[3][b & 0xFF] ^ t[2][(b >> 8) & 0xFF] ^ t[1][(b >> 16) & 0xFF] ^ t[0][b >> 24];
+	}
+	for (; size; size--) { c = t[0][(c ^ *p++) & 0xFF] ^ (c >> 8); }
+	return c ^ 0xFFFFFFFFu;
+}
+
+/* Starts a chunk at p, its length is set when it is finished, returns where its data goes */
+static uint8_t* beginChunk(uint8_t* p, const char type[4]) {
+	memcpy(p + 4, type, 4);
+	return p + 8;
+}
+/* Finishes a chunk that starts at start and has data up to end by setting the length and adding the CRC,
+   returns the end of the chunk */
+static uint8_t* endChunk(uint8_t* start, uint8_t* end) {
+	size_t len = end - start - 8;
+	write32be(start, (uint32_t)len);
+	write32be(end, crc32(start + 4, len + 4));
+	return end + 4;
+}
+
+/* Finds where the transparency of a DIB comes from: the alpha channel if any pixel uses it, otherwise the mask
+   of an icon if it makes any pixel transparent */
+static void findAlpha(const DIB& dib, const Kernels& k, bool& alpha, bool& masked) {
+	alpha = false;
+	if (dib.bpp == 32 && !dib.bitfields) {
+		for (uint32_t y = 0; y < dib.height && !alpha; y++) { alpha = k.anyAlpha(dib.pixels + y * dib.stride, dib.width); }
+	}
+	else if (dib.bpp == 32 && dib.a.mask) { alpha = true; }
+	masked = !alpha && dib.mask && anyMasked(dib);
+}
+
+bool decodeDIB(const void* data, size_t size, bool icon, uint32_t& width, uint32_t& height, const std::function<void(const uint8_t* rgba)>& row) {
+	DIB dib;
+	if (!parseDIB((const uint8_t*)data, size, icon, dib)) { return false; }
+	const Kernels& k = kernels[pixelSIMD()];
+	bool alpha, masked;
+	findAlpha(dib, k, alpha, masked);
+	width = dib.width;
+	height = dib.height;
+	static thread_local std::vector<uint8_t> buf;
+	buf.resize(dib.width * 4 + ROW_SLACK);
+	for (uint32_t y = 0; y < dib.height; y++) {
+		uint32_t src_y = dib.top_down ? y : dib.height - 1 - y;
+		convertRow(dib, k, dib.pixels + src_y * dib.stride, true, alpha, buf.data());
+		if (masked) { k.foldMask(dib.mask + src_y * dib.mask_stride, buf.data(), dib.width); }
+		row(buf.data());
+	}
+	return true;
+}
+
+uint8_t* dib2png(const void* data, size_t size, bool icon, size_t& png_size) {
+	DIB dib;
+	if (!parseDIB((const uint8_t*)data, size, icon, dib)) { return nullptr; }
+	const Kernels& k = kernels[pixelSIMD()];
+	bool alpha, masked;
+	findAlpha(dib, k, alpha, masked);
+	bool rgba = alpha || masked;
+	size_t channels = rgba ? 4 : 3, row = dib.width * channels;
+
+	// Each row is converted, has the Up filter applied, and is added to the raw image data to compress
+	static thread_local std::vector<uint8_t> raw, rows;
+	raw.resize(dib.height * (row + 1));
+	rows.assign(2 * (row + ROW_SLACK), 0);
+	uint8_t* cur = rows.data(), *prev = cur + row + ROW_SLACK, *out = raw.data();
+	for (uint32_t y = 0; y < dib.height; y++, out += row + 1) {
+		uint32_t src_y = dib.top_down ? y : dib.height - 1 - y;
+		convertRow(dib, k, dib.pixels + src_y * dib.stride, rgba, alpha, cur);
+		if (masked) { k.foldMask(dib.mask + src_y * dib.mask_stride, cur, dib.width); }
+		out[0] = 2; // Up
+		k.filterUp(cur, prev, out + 1, row);
+		std::swap(cur, prev);
+	}
+
+	// The image is written straight into the memory that is returned: the signature, the IHDR chunk, the
+	// compressed data as a single IDAT chunk, and the IEND chunk. It is allocated for the most the data could
+	// compress to and then shrunk to fit, which allocators do in place instead of copying it.
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	uint8_t* png = (uint8_t*)malloc(8 + (12 + 13) + 12 + zlibBound(raw.size()) + 12);
+	if (!png) { return nullptr; }
+	memcpy(png, signature, 8);
+	uint8_t* p = png + 8, *ihdr = beginChunk(p, "IHDR");
+	write32be(ihdr, dib.width);
+	write32be(ihdr + 4, dib.height);
+	ihdr[8] = 8; ihdr[9] = rgba ? 6 : 2; ihdr[10] = ihdr[11] = ihdr[12] = 0; // 8-bit RGBA or RGB, not interlaced
+	p = endChunk(p, ihdr + 13);
+	uint8_t* idat = beginChunk(p, "IDAT");
+	p = endChunk(p, idat + zlibCompress(raw.data(), raw.size(), idat));
+	p = endChunk(p, beginChunk(p, "IEND"));
+	png_size = p - png;
+	uint8_t* shrunk = (uint8_t*)realloc(png, png_size);
+	return shrunk ? shrunk : png;
+}
+#pragma endregion
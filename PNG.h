@@ -0,0 +1,41 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Decodes the DIB images of RT_BITMAP and RT_ICON resources and transcodes them to PNG images. The pixels are
+// converted with SSE2 or AVX2 kernels when the CPU has them (with scalar versions for everything else) and
+// compressed with the fast deflate in Deflate.cpp.
+
+#pragma once
+
+#include "SIMD.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <functional>
+
+// Decodes a DIB (without a file header) to 8-bit RGBA, calling row for each row from the top down with the
+// same transparency as dib2png() gives (opaque when there is none). The width and height are set before the
+// first row. Returns false for the same DIBs that dib2png() does not convert.
+bool decodeDIB(const void* data, size_t size, bool icon, uint32_t& width, uint32_t& height, const std::function<void(const uint8_t* rgba)>& row);
+
+// Converts a DIB (without a file header) to a PNG image. The DIB of an icon has
+// twice the height with the AND mask after the pixels, the mask becomes the alpha channel unless the image
+// already has one. Images without any transparency are saved as RGB and the others as RGBA. The image is in
+// memory from malloc that the caller frees, its size is set in png_size. Returns NULL for compressed DIBs
+// (RLE, JPEG, or PNG) and invalid or huge ones.
+uint8_t* dib2png(const void* data, size_t size, bool icon, size_t& png_size);
@@ -0,0 +1,523 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "stdafx.h"
+#include "ResourceScript.h"
+#include "Strings.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <algorithm>
+
+static inline uint16_t read16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t read32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+static inline const uint8_t* align4(const uint8_t* base, const uint8_t* p) { return base + ((p - base + 3) & ~(size_t)3); }
+
+// Styles the resource compiler adds on its own, when a resource does not have them they are removed with NOT
+#define STYLE_CHILD     0x40000000
+#define STYLE_VISIBLE   0x10000000
+#define STYLE_CAPTION   0x00C00000
+// Dialogs with this style have a font after their title
+#define STYLE_SETFONT   0x40
+
+// Menu item flags
+#define MENU_POPUP      0x10
+#define MENU_END        0x80
+#define MENUEX_POPUP    0x01
+#define MENUEX_END      0x80
+// Menus are nested at most this deep (menus themselves do not have a limit)
+#define MENU_MAX_DEPTH  32
+
+// Accelerator flags
+#define ACCEL_VIRTKEY   0x01
+#define ACCEL_END       0x80
+
+bool isScriptType(PE::const_resid type) { return type == RT_DIALOG || type == RT_MENU || type == RT_ACCELERATOR || type == RT_STRING; }
+
+#pragma region Text
+///////////////////////////////////////////////////////////////////////////////
+///// Text
+///////////////////////////////////////////////////////////////////////////////
+void appendScriptString(std::string& s, const char* text, size_t len) {
+	s += '"';
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)text[i];
+		switch (c) {
+		case '"': s += "\"\""; break;
+		case '\\': s += "\\\\"; break;
+		case '\n': s += "\\n"; break;
+		case '\r': s += "\\r"; break;
+		case '\t': s += "\\t"; break;
+		default:
+			if (c < 0x20 || c == 0x7F) { char buf[8]; snprintf(buf, sizeof(buf), "\\%03o", c); s += buf; }
+			else { s += (char)c; }
+		}
+	}
+	s += '"';
+}
+
+/* Appends UTF-16 text from the resource data as a quoted string */
+static void appendText(std::string& s, const uint8_t* text, size_t len) {
+	thread_local std::string utf8;
+	utf8.clear();
+	appendUTF16(utf8, text, len);
+	appendScriptString(s, utf8.data(), utf8.size());
+}
+
+static void appendHex(std::string& s, uint32_t x, int digits) {
+	char buf[16];
+	snprintf(buf, sizeof(buf), "0x%0*X", digits, x);
+	s += buf;
+}
+
+/* Appends the name of a resource, names that are not identifiers are quoted */
+static void appendScriptName(std::string& s, PE::const_resid name) {
+	if (IS_INTRESOURCE(name)) { s += std::to_string(LOWORD((ULONG_PTR)name)); return; }
+	std::string n = toUTF8(name);
+	bool identifier = !n.empty() && !isdigit((unsigned char)n[0]);
+	for (char c : n) { if (!isalnum((unsigned char)c) && c != '_') { identifier = false; break; } }
+	if (identifier) { s += n; }
+	else { appendScriptString(s, n.data(), n.size()); }
+}
+
+/* Appends the style bits the resource compiler adds on its own that a style does not have as NOT */
+static void appendStyleNot(std::string& s, uint32_t style, uint32_t added) {
+	uint32_t missing = added & ~style;
+	for (uint32_t bit : { (uint32_t)STYLE_CHILD, (uint32_t)STYLE_VISIBLE, (uint32_t)STYLE_CAPTION }) {
+		if (missing & bit) { s += " | NOT "; appendHex(s, missing & bit, 8); }
+	}
+}
+
+/* Reads null-terminated text at p and moves past it, fails if it does not end before end */
+static bool readText(const uint8_t*& p, const uint8_t* end, const uint8_t*& text, size_t& len) {
+	const uint8_t* q = p;
+	while (end - q >= 2 && read16(q) != 0) { q += 2; }
+	if (end - q < 2) { return false; }
+	text = p;
+	len = (q - p) / 2;
+	p = q + 2;
+	return true;
+}
+
+// Text or an ordinal in its place: 0xFFFF followed by the ordinal, otherwise null-terminated text
+struct TextOrOrdinal {
+	const uint8_t* text;
+	size_t len;
+	int ordinal; // -1 for text
+	bool empty() const { return this->ordinal < 0 && this->len == 0; }
+};
+static bool readTextOrOrdinal(const uint8_t*& p, const uint8_t* end, TextOrOrdinal& x) {
+	if (end - p < 2) { return false; }
+	if (read16(p) == 0xFFFF) {
+		if (end - p < 4) { return false; }
+		x.text = nullptr; x.len = 0; x.ordinal = read16(p + 2);
+		p += 4;
+		return true;
+	}
+	x.ordinal = -1;
+	return readText(p, end, x.text, x.len);
+}
+static void appendTextOrOrdinal(std::string& s, const TextOrOrdinal& x) {
+	if (x.ordinal >= 0) { s += std::to_string(x.ordinal); }
+	else { appendText(s, x.text, x.len); }
+}
+#pragma endregion
+
+#pragma region Dialogs
+///////////////////////////////////////////////////////////////////////////////
+///// Dialogs
+///////////////////////////////////////////////////////////////////////////////
+// The classes of controls that are given as ordinals, starting at 0x80
+static const char* const control_classes[] = { "Button", "Edit", "Static", "ListBox", "ScrollBar", "ComboBox" };
+
+/* Appends the creation data of a control in an extended dialog as a block of words */
+static void appendCreationData(std::string& s, const uint8_t* data, size_t size) {
+	s += "    BEGIN\n        ";
+	for (size_t i = 0; i + 1 < size; i += 2) {
+		if (i) { s += (i % 16) ? ", " : ",\n        "; }
+		appendHex(s, read16(data + i), 4);
+	}
+	if (size & 1) {
+		// a string adds its bytes without a terminator
+		if (size > 1) { s += ", "; }
+		char buf[8];
+		snprintf(buf, sizeof(buf), "\"\\%03o\"", data[size - 1]);
+		s += buf;
+	}
+	s += "\n    END\n";
+}
+
+/* Appends a dialog as a DIALOG or DIALOGEX (with each control as a generic CONTROL statement) */
+bool appendDialogScript(std::string& s, PE::const_resid name, const void* data, size_t size) {
+	// DLGTEMPLATE: style, extended style, number of controls, x, y, width, and height
+	// DLGTEMPLATEEX: version (1), signature (0xFFFF), help id, extended style, style, then the same
+	const uint8_t* base = (const uint8_t*)data, *p = base, *end = base + size;
+	if (size < 18) { return false; }
+	bool ex = read16(p) == 1 && read16(p + 2) == 0xFFFF;
+	uint32_t help = 0, style, exstyle;
+	if (ex) {
+		if (size < 26) { return false; }
+		help = read32(p + 4); exstyle = read32(p + 8); style = read32(p + 12);
+		p += 16;
+	}
+	else {
+		style = read32(p); exstyle = read32(p + 4);
+		p += 8;
+	}
+	size_t count = read16(p);
+	int16_t x = (int16_t)read16(p + 2), y = (int16_t)read16(p + 4), cx = (int16_t)read16(p + 6), cy = (int16_t)read16(p + 8);
+	p += 10;
+
+	// then the menu, the class, the title, and the font if the style has DS_SETFONT
+	TextOrOrdinal menu, cls;
+	const uint8_t* title, *face = nullptr;
+	size_t title_len, face_len = 0;
+	uint16_t points = 0, weight = 0;
+	uint8_t italic = 0, charset = 0;
+	if (!readTextOrOrdinal(p, end, menu) || !readTextOrOrdinal(p, end, cls) || !readText(p, end, title, title_len)) { return false; }
+	if (style & STYLE_SETFONT) {
+		if (end - p < (ex ? 6 : 2)) { return false; }
+		points = read16(p);
+		if (ex) { weight = read16(p + 2); italic = p[4]; charset = p[5]; }
+		p += ex ? 6 : 2;
+		if (!readText(p, end, face, face_len)) { return false; }
+	}
+
+	size_t start = s.size();
+	appendScriptName(s, name);
+	s += ex ? " DIALOGEX " : " DIALOG ";
+	s += std::to_string(x); s += ", "; s += std::to_string(y); s += ", "; s += std::to_string(cx); s += ", "; s += std::to_string(cy);
+	if (help) { s += ", "; s += std::to_string(help); }
+	s += "\nSTYLE ";
+	appendHex(s, style, 8);
+	if (title_len) { appendStyleNot(s, style, STYLE_CAPTION); }
+	s += '\n';
+	if (exstyle) { s += "EXSTYLE "; appendHex(s, exstyle, 8); s += '\n'; }
+	if (title_len) { s += "CAPTION "; appendText(s, title, title_len); s += '\n'; }
+	if (!menu.empty()) {
+		s += "MENU ";
+		if (menu.ordinal >= 0) { s += std::to_string(menu.ordinal); }
+		else { std::wstring n = fromUTF16(menu.text, menu.len); appendScriptName(s, n.c_str()); }
+		s += '\n';
+	}
+	if (!cls.empty()) { s += "CLASS "; appendTextOrOrdinal(s, cls); s += '\n'; }
+	if (face) {
+		s += "FONT "; s += std::to_string(points); s += ", "; appendText(s, face, face_len);
+		if (ex) { s += ", "; s += std::to_string(weight); s += ", "; s += std::to_string(italic); s += ", "; appendHex(s, charset, 2); }
+		s += '\n';
+	}
+	s += "BEGIN\n";
+
+	// DLGITEMTEMPLATE: style, extended style, x, y, width, height, and id (16-bit)
+	// DLGITEMTEMPLATEEX: help id, extended style, style, x, y, width, height, and id (32-bit)
+	// Each is aligned to 4 bytes and followed by its class, text, and creation data.
+	for (size_t i = 0; i < count; i++) {
+		p = align4(base, p);
+		if (end - p < (ex ? 24 : 18)) { s.resize(start); return false; }
+		uint32_t item_help = 0, item_style, item_exstyle, id;
+		if (ex) {
+			item_help = read32(p); item_exstyle = read32(p + 4); item_style = read32(p + 8);
+			id = read32(p + 20);
+		}
+		else {
+			item_style = read32(p); item_exstyle = read32(p + 4);
+			id = read16(p + 16);
+			if (id == 0xFFFF) { id = 0xFFFFFFFF; }
+		}
+		const uint8_t* pos = p + (ex ? 12 : 8);
+		x = (int16_t)read16(pos); y = (int16_t)read16(pos + 2); cx = (int16_t)read16(pos + 4); cy = (int16_t)read16(pos + 6);
+		p += ex ? 24 : 18;
+		TextOrOrdinal item_cls, text;
+		if (!readTextOrOrdinal(p, end, item_cls) || !readTextOrOrdinal(p, end, text) || end - p < 2) { s.resize(start); return false; }
+		size_t extra = read16(p);
+		p += 2;
+		if ((size_t)(end - p) < extra) { s.resize(start); return false; }
+
+		s += "    CONTROL ";
+		appendTextOrOrdinal(s, text);
+		s += ", ";
+		s += id == 0xFFFFFFFF ? std::string("-1") : std::to_string(id);
+		s += ", ";
+		if (item_cls.ordinal >= 0x80 && item_cls.ordinal < 0x80 + (int)ARRAYSIZE(control_classes)) {
+			s += '"'; s += control_classes[item_cls.ordinal - 0x80]; s += '"';
+		}
+		else { appendTextOrOrdinal(s, item_cls); }
+		s += ", ";
+		appendHex(s, item_style, 8);
+		appendStyleNot(s, item_style, STYLE_CHILD | STYLE_VISIBLE);
+		s += ", "; s += std::to_string(x); s += ", "; s += std::to_string(y); s += ", "; s += std::to_string(cx); s += ", "; s += std::to_string(cy);
+		if (item_exstyle || item_help) { s += ", "; appendHex(s, item_exstyle, 8); }
+		if (item_help) { s += ", "; s += std::to_string(item_help); }
+		s += '\n';
+		if (extra) {
+			// only extended dialogs can have creation data in a resource script
+			if (ex) { appendCreationData(s, p, extra); }
+			else { s += "    // "; s += std::to_string(extra); s += " bytes of creation data cannot be given in a DIALOG\n"; }
+		}
+		p += extra;
+	}
+	s += "END\n\n";
+	return true;
+}
+#pragma endregion
+
+#pragma region Menus
+///////////////////////////////////////////////////////////////////////////////
+///// Menus
+///////////////////////////////////////////////////////////////////////////////
+struct MenuOption {
+	uint16_t flag;
+	const char* name;
+};
+static const MenuOption menu_options[] = {
+	{ 0x0001, "GRAYED" }, { 0x0002, "INACTIVE" }, { 0x0008, "CHECKED" }, { 0x0020, "MENUBARBREAK" }, { 0x0040, "MENUBREAK" }, { 0x4000, "HELP" },
+};
+
+/* Appends the items of a menu until the one flagged as the last, each popup is followed by its own items */
+static bool appendMenuItems(std::string& s, const uint8_t*& p, const uint8_t* end, unsigned int depth) {
+	if (depth > MENU_MAX_DEPTH) { return false; }
+	for (;;) {
+		// the flags, the id (except for popups), and the text
+		if (end - p < 2) { return false; }
+		uint16_t flags = read16(p), id = 0;
+		p += 2;
+		bool popup = (flags & MENU_POPUP) != 0;
+		if (!popup) {
+			if (end - p < 2) { return false; }
+			id = read16(p);
+			p += 2;
+		}
+		const uint8_t* text;
+		size_t len;
+		if (!readText(p, end, text, len)) { return false; }
+
+		s.append(4 * depth, ' ');
+		if (!popup && (flags & ~MENU_END) == 0 && id == 0 && len == 0) { s += "MENUITEM SEPARATOR\n"; }
+		else {
+			s += popup ? "POPUP " : "MENUITEM ";
+			appendText(s, text, len);
+			if (!popup) { s += ", "; s += std::to_string(id); }
+			for (const MenuOption& o : menu_options) {
+				if (flags & o.flag) { s += ", "; s += o.name; }
+			}
+			s += '\n';
+		}
+		if (popup) {
+			s.append(4 * depth, ' '); s += "BEGIN\n";
+			if (!appendMenuItems(s, p, end, depth + 1)) { return false; }
+			s.append(4 * depth, ' '); s += "END\n";
+		}
+		if (flags & MENU_END) { return true; }
+	}
+}
+
+/* Appends the items of an extended menu until the one flagged as the last, each popup is followed by its help
+   id and its own items */
+static bool appendMenuExItems(std::string& s, const uint8_t* base, const uint8_t*& p, const uint8_t* end, unsigned int depth) {
+	if (depth > MENU_MAX_DEPTH) { return false; }
+	for (;;) {
+		// MENUEX_TEMPLATE_ITEM: type, state, id, flags (16-bit), and the text, aligned to 4 bytes
+		p = align4(base, p);
+		if (end - p < 14) { return false; }
+		uint32_t values[4] = { read32(p + 8), read32(p), read32(p + 4), 0 }; // id, type, state, help id
+		uint16_t flags = read16(p + 12);
+		p += 14;
+		const uint8_t* text;
+		size_t len;
+		if (!readText(p, end, text, len)) { return false; }
+		bool popup = (flags & MENUEX_POPUP) != 0;
+		if (popup) {
+			p = align4(base, p);
+			if (end - p < 4) { return false; }
+			values[3] = read32(p);
+			p += 4;
+		}
+
+		// values that are 0 at the end are left out
+		size_t n = popup ? 4 : 3;
+		while (n && values[n - 1] == 0) { --n; }
+		s.append(4 * depth, ' ');
+		s += popup ? "POPUP " : "MENUITEM ";
+		appendText(s, text, len);
+		for (size_t i = 0; i < n; i++) {
+			s += ", ";
+			if (i == 1 || i == 2) { appendHex(s, values[i], 1); }
+			else { s += std::to_string(values[i]); }
+		}
+		s += '\n';
+		if (popup) {
+			s.append(4 * depth, ' '); s += "BEGIN\n";
+			if (!appendMenuExItems(s, base, p, end, depth + 1)) { return false; }
+			s.append(4 * depth, ' '); s += "END\n";
+		}
+		if (flags & MENUEX_END) { return true; }
+	}
+}
+
+/* Appends a menu as a MENU or a MENUEX */
+bool appendMenuScript(std::string& s, PE::const_resid name, const void* data, size_t size) {
+	// the header is the version (0 or 1 for MENUEX) and the size of the rest of the header
+	const uint8_t* base = (const uint8_t*)data, *p = base, *end = base + size;
+	if (size < 4) { return false; }
+	uint16_t version = read16(p), header = read16(p + 2);
+	if (version > 1 || header > size - 4) { return false; }
+	p += 4 + header;
+	size_t start = s.size();
+	appendScriptName(s, name);
+	s += version ? " MENUEX\nBEGIN\n" : " MENU\nBEGIN\n";
+	if (!(version ? appendMenuExItems(s, base, p, end, 1) : appendMenuItems(s, p, end, 1))) { s.resize(start); return false; }
+	s += "END\n\n";
+	return true;
+}
+#pragma endregion
+
+#pragma region Accelerators and Strings
+///////////////////////////////////////////////////////////////////////////////
+///// Accelerators and Strings
+///////////////////////////////////////////////////////////////////////////////
+struct AccelOption {
+	uint16_t flag;
+	const char* name;
+};
+static const AccelOption accel_options[] = { { 0x02, "NOINVERT" }, { 0x04, "SHIFT" }, { 0x08, "CONTROL" }, { 0x10, "ALT" } };
+
+/* Appends an accelerator table as ACCELERATORS */
+bool appendAcceleratorScript(std::string& s, PE::const_resid name, const void* data, size_t size) {
+	// each entry is the flags, the key, the id, and padding (all 16-bit), the last one is flagged
+	const uint8_t* p = (const uint8_t*)data;
+	size_t count = size / 8;
+	if (count == 0) { return false; }
+	appendScriptName(s, name);
+	s += " ACCELERATORS\nBEGIN\n";
+	for (size_t i = 0; i < count; i++, p += 8) {
+		uint16_t flags = read16(p), key = read16(p + 2), id = read16(p + 4);
+		bool virtkey = (flags & ACCEL_VIRTKEY) != 0;
+		s += "    ";
+		if (virtkey ? ((key >= 'A' && key <= 'Z') || (key >= '0' && key <= '9')) : (key > ' ' && key < 0x7F && key != '"' && key != '^')) {
+			s += '"'; s += (char)key; s += '"';
+		}
+		else if (!virtkey && key >= 1 && key <= 26) { s += "\"^"; s += (char)('A' + key - 1); s += '"'; }
+		else { appendHex(s, key, 2); }
+		s += ", ";
+		s += std::to_string(id);
+		s += virtkey ? ", VIRTKEY" : ", ASCII";
+		for (const AccelOption& o : accel_options) {
+			if (flags & o.flag) { s += ", "; s += o.name; }
+		}
+		s += '\n';
+		if (flags & ACCEL_END) { break; }
+	}
+	s += "END\n\n";
+	return true;
+}
+
+/* Appends the strings of a string table as lines of STRINGTABLE */
+bool appendStringTableScript(std::string& s, uint16_t bundle, const void* data, size_t size) {
+	// 16 strings, each is its length then the text (not null-terminated), empty strings are not in the table
+	if (bundle == 0 || bundle > 4096) { return false; }
+	const uint8_t* p = (const uint8_t*)data, *end = p + size;
+	size_t start = s.size();
+	for (uint32_t i = 0; i < 16; i++) {
+		if (end - p < 2) { s.resize(start); return false; }
+		size_t len = read16(p);
+		p += 2;
+		if ((size_t)(end - p) < 2*len) { s.resize(start); return false; }
+		if (len) {
+			s += "    ";
+			s += std::to_string(((uint32_t)bundle - 1) * 16 + i);
+			s += ", ";
+			appendText(s, p, len);
+			s += '\n';
+		}
+		p += 2*len;
+	}
+	return true;
+}
+#pragma endregion
+
+#pragma region Resource Script
+///////////////////////////////////////////////////////////////////////////////
+///// Resource Script
+///////////////////////////////////////////////////////////////////////////////
+bool ResourceScript::add(PE::const_resid type, PE::const_resid name, uint16_t lang, const void* data, size_t size) {
+	if (!isScriptType(type)) { return false; }
+	Entry e;
+	e.lang = lang;
+	e.type = LOWORD((ULONG_PTR)type);
+	e.id = IS_INTRESOURCE(name) ? LOWORD((ULONG_PTR)name) : 0;
+	if (!IS_INTRESOURCE(name)) { e.name = name; }
+	bool ok;
+	if (type == RT_DIALOG) { ok = appendDialogScript(e.text, name, data, size); }
+	else if (type == RT_MENU) { ok = appendMenuScript(e.text, name, data, size); }
+	else if (type == RT_ACCELERATOR) { ok = appendAcceleratorScript(e.text, name, data, size); }
+	else { ok = IS_INTRESOURCE(name) && appendStringTableScript(e.text, e.id, data, size); }
+	if (!ok) { return false; }
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->entries.push_back(std::move(e));
+	return true;
+}
+
+/* Orders resources like the resource directory: by language, type, then names before ids */
+bool ResourceScript::before(const Entry* a, const Entry* b) {
+	if (a->lang != b->lang) { return a->lang < b->lang; }
+	if (a->type != b->type) { return a->type < b->type; }
+	if (a->name.empty() != b->name.empty()) { return !a->name.empty(); }
+	return a->name.empty() ? a->id < b->id : a->name < b->name;
+}
+
+bool ResourceScript::write() const {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	std::vector<const Entry*> sorted;
+	sorted.reserve(this->entries.size());
+	for (const Entry& e : this->entries) { sorted.push_back(&e); }
+	std::sort(sorted.begin(), sorted.end(), before);
+
+	// each language is built into a single buffer and written at once, the strings of all string tables
+	// are in a single STRINGTABLE
+	std::string text;
+	std::wstring path;
+	for (size_t i = 0; i < sorted.size(); ) {
+		uint16_t lang = sorted[i]->lang;
+		text.clear();
+		char buf[64];
+		snprintf(buf, sizeof(buf), "LANGUAGE 0x%02X, 0x%02X\n\n", lang & 0x3FF, lang >> 10);
+		text += "// Resource script decompiled by PEResourceDump\n\n#pragma code_page(65001)\n\n";
+		text += buf;
+		bool strings = false;
+		for (; i < sorted.size() && sorted[i]->lang == lang; i++) {
+			const Entry& e = *sorted[i];
+			if ((e.type == 6 /* STRING */) != strings) {
+				text += strings ? "END\n\n" : "STRINGTABLE\nBEGIN\n";
+				strings = !strings;
+			}
+			text += e.text;
+		}
+		if (strings) { text += "END\n"; }
+		path.assign(this->directory);
+		path += PATH_SEP L"resources_";
+		appendUInt(path, lang);
+		path += L".rc";
+		if (!writeFile(path, text.data(), text.size())) { return false; }
+	}
+	return true;
+}
+
+size_t ResourceScript::count() const {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->entries.size();
+}
+#pragma endregion
@@ -0,0 +1,74 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+// Decompilers for dialogs (RT_DIALOG), menus (RT_MENU), accelerator tables (RT_ACCELERATOR), and string tables
+// (RT_STRING) that turn them into resource script (.rc) text. They read the resource data in place and write
+// the text as they go. All of these resources of a PE file are collected into a resource script for each
+// language so they can be rebuilt with a resource compiler.
+
+#pragma once
+
+#include "general.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <mutex>
+
+// Checks if the type is RT_DIALOG, RT_MENU, RT_ACCELERATOR, or RT_STRING
+bool isScriptType(PE::const_resid type);
+
+// Appends a resource as resource script (UTF-8), nothing is appended if it is not valid. The name of a string
+// table is its bundle number and only its strings are appended, they go inside a STRINGTABLE block.
+bool appendDialogScript(std::string& s, PE::const_resid name, const void* data, size_t size);
+bool appendMenuScript(std::string& s, PE::const_resid name, const void* data, size_t size);
+bool appendAcceleratorScript(std::string& s, PE::const_resid name, const void* data, size_t size);
+bool appendStringTableScript(std::string& s, uint16_t bundle, const void* data, size_t size);
+// Appends a quoted and escaped resource script string
+void appendScriptString(std::string& s, const char* text, size_t len);
+
+// The resource scripts of a PE file, one for each language. Resources can be added from multiple threads at
+// once and are written in the order of their types, names, and languages no matter what order they are added in.
+class ResourceScript {
+public:
+	explicit ResourceScript(const std::wstring& directory) : directory(directory) { }
+
+	// Decompiles a resource into the script of its language, returns false if it cannot be decompiled
+	bool add(PE::const_resid type, PE::const_resid name, uint16_t lang, const void* data, size_t size);
+	// Writes the script of each language into the directory as resources_LANG.rc
+	bool write() const;
+
+	const std::wstring& path() const { return this->directory; }
+	size_t count() const;
+
+private:
+	ResourceScript(const ResourceScript&) = delete;
+	ResourceScript& operator=(const ResourceScript&) = delete;
+
+	struct Entry {
+		uint16_t lang, type, id; // id is 0 for named resources
+		std::wstring name;
+		std::string text;
+	};
+	static bool before(const Entry* a, const Entry* b);
+
+	std::wstring directory;
+	mutable std::mutex mutex;
+	std::vector<Entry> entries;
+};
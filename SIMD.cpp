@@ -0,0 +1,57 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "SIMD.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(PIXEL_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/* Finds the best instruction set the CPU has */
+static PixelSIMD detectSIMD() {
+#ifdef PIXEL_X86
+#ifdef _MSC_VER
+	int r[4];
+	__cpuid(r, 0);
+	int max = r[0];
+	__cpuid(r, 1);
+	bool sse2 = ((r[3] >> 26) & 1) != 0, avx = ((r[2] >> 28) & 1) != 0, osxsave = ((r[2] >> 27) & 1) != 0;
+	if (max >= 7 && avx && osxsave && (_xgetbv(0) & 6) == 6) {
+		__cpuidex(r, 7, 0);
+		if ((r[1] >> 5) & 1) { return SIMD_AVX2; }
+	}
+	if (sse2) { return SIMD_SSE2; }
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) { return SIMD_AVX2; }
+	if (__builtin_cpu_supports("sse2")) { return SIMD_SSE2; }
+#endif
+#endif
+	return SIMD_SCALAR;
+}
+static PixelSIMD bestSIMD() { static const PixelSIMD best = detectSIMD(); return best; }
+static std::atomic<int> current_simd(-1);
+
+PixelSIMD pixelSIMD() {
+	int s = current_simd.load(std::memory_order_relaxed);
+	return s < 0 ? bestSIMD() : (PixelSIMD)s;
+}
+void setPixelSIMD(PixelSIMD simd) { current_simd = std::min(simd, bestSIMD()); }
+const wchar_t* pixelSIMDName(PixelSIMD simd) { return simd == SIMD_AVX2 ? L"avx2" : (simd == SIMD_SSE2 ? L"sse2" : L"scalar"); }
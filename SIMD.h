@@ -0,0 +1,41 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Picking the instruction set of the pixel kernels (see PNG.cpp and PHash.cpp) at run time. The kernels are
+// compiled for SSE2 and AVX2 with the TARGET_ macros so the rest of the program does not need them.
+
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// The instruction sets that the pixel kernels can use
+enum PixelSIMD { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+// Gets the instruction set the pixel kernels use, by default the best one the CPU has
+PixelSIMD pixelSIMD();
+// Sets the instruction set the pixel kernels use (never more than the CPU has), such as to compare them
+void setPixelSIMD(PixelSIMD simd);
+// Gets the name of an instruction set ("scalar", "sse2", or "avx2")
+const wchar_t* pixelSIMDName(PixelSIMD simd);
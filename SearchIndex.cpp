@@ -0,0 +1,447 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "SearchIndex.h"
+#include "Hash.h"
+#include "Strings.h"
+#include "Version.h"
+#include "PHash.h"
+
+#include <iostream>
+#include <algorithm>
+
+static const char MAGIC[8] = { 'P', 'E', 'R', 'D', 'I', 'D', 'X', '2' };
+static const size_t RECORD_SIZE = 48, HASH_SIZE = 12, TOKEN_SIZE = 16, FOOTER_SIZE = 48;
+static const size_t TOKEN_MIN = 2, TOKEN_MAX = 64;
+static const unsigned CHUNKS = 4, CHUNK_BITS = 16; // the perceptual hashes are split into chunks for finding similar images
+static const size_t BUCKETS = (size_t)1 << CHUNK_BITS;
+
+// Record offsets: XXH64 (8), output size (8), string offsets of the file, embedded file, type, name, and
+// extension (4 each), lang (2), flags (2), and perceptual hash (8)
+#define RECORD_HASH     0
+#define RECORD_LENGTH   8
+#define RECORD_FILE     16
+#define RECORD_EMBEDDED 20
+#define RECORD_TYPE     24
+#define RECORD_NAME     28
+#define RECORD_EXT      32
+#define RECORD_LANG     36
+#define RECORD_FLAGS    38
+#define RECORD_PHASH    40
+#define FLAG_PHASH      1 // the record has a perceptual hash
+// Token offsets: string offset (4), posting count (4), first posting (8)
+#define TOKEN_STRING 0
+#define TOKEN_COUNT  4
+#define TOKEN_FIRST  8
+
+static inline void write16(uint8_t* p, uint16_t x) { p[0] = (uint8_t)x; p[1] = (uint8_t)(x >> 8); }
+static inline void write32(uint8_t* p, uint32_t x) { for (int i = 0; i < 4; i++) { p[i] = (uint8_t)(x >> (8*i)); } }
+static inline void write64(uint8_t* p, uint64_t x) { for (int i = 0; i < 8; i++) { p[i] = (uint8_t)(x >> (8*i)); } }
+static inline uint16_t read16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t read32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+static inline uint64_t read64(const uint8_t* p) { return (uint64_t)read32(p) | ((uint64_t)read32(p + 4) << 32); }
+
+void tokenize(const char* text, size_t len, std::vector<std::string>& tokens) {
+	size_t first = tokens.size();
+	std::string token;
+	for (size_t i = 0; i <= len; i++) {
+		unsigned char c = i < len ? (unsigned char)text[i] : 0;
+		if (c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')) { token += (char)c; }
+		else if (c >= 'A' && c <= 'Z') { token += (char)(c - 'A' + 'a'); }
+		else if (!token.empty()) {
+			if (token.size() >= TOKEN_MIN && token.size() <= TOKEN_MAX) { tokens.push_back(token); }
+			token.clear();
+		}
+	}
+	std::sort(tokens.begin() + first, tokens.end());
+	tokens.erase(std::unique(tokens.begin() + first, tokens.end()), tokens.end());
+}
+
+/* Gets the tokens of the text in a resource: manifests are tokenized as they are, the others are decoded
+   first so only their text is tokenized */
+static void tokenizeResource(PE::const_resid type, PE::const_resid name, uint16_t lang, const void* data, size_t size, std::vector<std::string>& tokens) {
+	if (type == RT_MANIFEST) { tokenize((const char*)data, size, tokens); }
+	else if (type == RT_STRING || type == RT_MESSAGETABLE) {
+		std::vector<StringRecord> records;
+		if (type == RT_STRING) {
+			if (!IS_INTRESOURCE(name) || !decodeStringTable(LOWORD((ULONG_PTR)name), lang, data, size, records)) { return; }
+		}
+		else if (!decodeMessageTable(lang, data, size, records)) { return; }
+		for (const StringRecord& r : records) { tokenize(r.text.data(), r.text.size(), tokens); }
+	}
+	else if (type == RT_VERSION) {
+		VersionInfo info;
+		if (!decodeVersionInfo(data, size, info)) { return; }
+		std::string text;
+		for (const VersionInfo::Table& table : info.tables) {
+			for (const VersionInfo::String& s : table.strings) { appendUTF16(text, s.value.data, s.value.len); text += ' '; }
+		}
+		tokenize(text.data(), text.size(), tokens);
+	}
+	else { return; }
+	// each decoded string was tokenized on its own so the same token may be given more than once
+	std::sort(tokens.begin(), tokens.end());
+	tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+}
+
+#pragma region Writer
+////////////////////////////////////////////////////////////////////////////////
+///// Writer
+////////////////////////////////////////////////////////////////////////////////
+uint32_t SearchIndexWriter::intern(const std::string& s) {
+	auto itr = this->string_ids.find(s);
+	if (itr != this->string_ids.end()) { return itr->second; }
+	uint32_t id = (uint32_t)this->strings.size();
+	this->strings.push_back(s);
+	this->string_ids.emplace(s, id);
+	return id;
+}
+
+void SearchIndexWriter::load(const std::wstring& path) {
+	this->path = path;
+	uint64_t size, mtime;
+	if (!getFileInfo(path, size, mtime)) { return; }
+	SearchIndexReader reader;
+	if (!reader.open(path.c_str())) { ReportLastError(L"Reading the search index '" + path + L"', it will be replaced", true); return; }
+	for (size_t i = 0; i < reader.count(); i++) {
+		SearchIndexReader::Entry e = reader[i];
+		Record r;
+		r.file = this->intern(e.file);
+		r.embedded = this->intern(e.embedded);
+		r.type = this->intern(e.type);
+		r.name = this->intern(e.name);
+		r.ext = this->intern(e.ext);
+		r.lang = e.lang;
+		r.has_phash = e.has_phash;
+		r.size = e.size;
+		r.hash = e.hash;
+		r.phash = e.phash;
+		this->records.push_back(r);
+	}
+	this->loaded = this->records.size();
+	reader.forEachToken([this](const char* token, const uint8_t* postings, size_t count) {
+		std::vector<uint32_t>& ids = this->tokens[token];
+		for (size_t i = 0; i < count; i++) {
+			uint32_t id = read32(postings + 4*i);
+			if (id < this->loaded) { ids.push_back(id); }
+		}
+	});
+}
+
+void SearchIndexWriter::begin(const std::wstring& file) {
+	std::string f = toUTF8(file);
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->begun.insert(this->intern(f));
+}
+
+void SearchIndexWriter::add(const std::wstring& file, const std::wstring& embedded, PE::const_resid type, PE::const_resid name, uint16_t lang,
+		const void* data, size_t size, const DumpOutput& out) {
+	XXH64 xxh;
+	out.stream([&xxh](const void* data, size_t size) { xxh.update(data, size); return true; });
+	std::vector<std::string> toks;
+	tokenizeResource(type, name, lang, data, size, toks);
+	uint64_t phash = 0;
+	bool has_phash = perceptualHash(type, data, size, phash);
+	std::string f = toUTF8(file), e = toUTF8(embedded), t = toUTF8(getTypeName(type)), n = toUTF8(getName(name)), x = toUTF8(out.ext);
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	Record r;
+	r.file = this->intern(f);
+	r.embedded = this->intern(e);
+	r.type = this->intern(t);
+	r.name = this->intern(n);
+	r.ext = this->intern(x);
+	r.lang = lang;
+	r.has_phash = has_phash;
+	r.size = out.size();
+	r.hash = xxh.digest();
+	r.phash = phash;
+	uint32_t id = (uint32_t)this->records.size();
+	this->records.push_back(r);
+	this->begun.insert(r.file); // in case the file was not begun, its old entries are still replaced
+	for (const std::string& token : toks) { this->tokens[token].push_back(id); }
+}
+
+bool SearchIndexWriter::save() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	// Drop the loaded records of the files that were indexed again and sort the rest, numbers maps the
+	// position of each record to its number in the index (or UINT32_MAX if it was dropped)
+	std::vector<uint32_t> order;
+	for (uint32_t i = 0; i < this->records.size(); i++) {
+		if (i >= this->loaded || !this->begun.count(this->records[i].file)) { order.push_back(i); }
+	}
+	const std::vector<std::string>& strs = this->strings;
+	std::sort(order.begin(), order.end(), [&strs, this](uint32_t a, uint32_t b) {
+		const Record &x = this->records[a], &y = this->records[b];
+		int c;
+		if ((c = strs[x.file].compare(strs[y.file])) != 0) { return c < 0; }
+		if ((c = strs[x.embedded].compare(strs[y.embedded])) != 0) { return c < 0; }
+		if ((c = strs[x.type].compare(strs[y.type])) != 0) { return c < 0; }
+		if ((c = strs[x.name].compare(strs[y.name])) != 0) { return c < 0; }
+		return x.lang < y.lang;
+	});
+	this->saved = order.size();
+	std::vector<uint32_t> numbers(this->records.size(), UINT32_MAX);
+	for (uint32_t i = 0; i < order.size(); i++) { numbers[order[i]] = i; }
+
+	// the same strings are used by many records (every type and file name) so each is stored once
+	std::string pool(1, '\0'); // the strings are never empty, which the reader relies on
+	std::vector<uint32_t> string_offs(strs.size(), UINT32_MAX);
+	auto addString = [&](uint32_t id) {
+		if (string_offs[id] == UINT32_MAX) {
+			if (strs[id].empty()) { string_offs[id] = 0; }
+			else { string_offs[id] = (uint32_t)pool.size(); pool.append(strs[id].c_str(), strs[id].size() + 1); }
+		}
+		return string_offs[id];
+	};
+	std::vector<uint8_t> recs(order.size() * RECORD_SIZE, 0), hashes(order.size() * HASH_SIZE);
+	std::vector<std::pair<uint64_t, uint32_t>> by_hash;
+	by_hash.reserve(order.size());
+	uint8_t* p = recs.data();
+	for (uint32_t i = 0; i < order.size(); i++, p += RECORD_SIZE) {
+		const Record& r = this->records[order[i]];
+		write64(p + RECORD_HASH, r.hash);
+		write64(p + RECORD_LENGTH, r.size);
+		write32(p + RECORD_FILE, addString(r.file));
+		write32(p + RECORD_EMBEDDED, addString(r.embedded));
+		write32(p + RECORD_TYPE, addString(r.type));
+		write32(p + RECORD_NAME, addString(r.name));
+		write32(p + RECORD_EXT, addString(r.ext));
+		write16(p + RECORD_LANG, r.lang);
+		write16(p + RECORD_FLAGS, r.has_phash ? FLAG_PHASH : 0);
+		write64(p + RECORD_PHASH, r.phash);
+		by_hash.emplace_back(r.hash, i);
+	}
+	std::sort(by_hash.begin(), by_hash.end());
+	p = hashes.data();
+	for (const auto& h : by_hash) { write64(p, h.first); write32(p + 8, h.second); p += HASH_SIZE; }
+
+	// the postings of each token are renumbered and the tokens without any records left are dropped
+	std::vector<std::pair<const std::string*, std::vector<uint32_t>>> toks;
+	for (const auto& t : this->tokens) {
+		std::vector<uint32_t> ids;
+		for (uint32_t id : t.second) { if (numbers[id] != UINT32_MAX) { ids.push_back(numbers[id]); } }
+		if (ids.empty()) { continue; }
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+		toks.emplace_back(&t.first, std::move(ids));
+	}
+	std::sort(toks.begin(), toks.end(), [](const std::pair<const std::string*, std::vector<uint32_t>>& a, const std::pair<const std::string*, std::vector<uint32_t>>& b) { return *a.first < *b.first; });
+	std::vector<uint8_t> token_index(toks.size() * TOKEN_SIZE), postings;
+	p = token_index.data();
+	uint64_t first = 0;
+	for (const auto& t : toks) {
+		write32(p + TOKEN_STRING, (uint32_t)pool.size());
+		pool.append(t.first->c_str(), t.first->size() + 1);
+		write32(p + TOKEN_COUNT, (uint32_t)t.second.size());
+		write64(p + TOKEN_FIRST, first);
+		for (uint32_t id : t.second) { uint8_t b[4]; write32(b, id); postings.insert(postings.end(), b, b + 4); }
+		first += t.second.size();
+		p += TOKEN_SIZE;
+	}
+	// the records with a perceptual hash are bucketed by each chunk of it, in order within each bucket
+	std::vector<uint32_t> with_phash;
+	for (uint32_t i = 0; i < order.size(); i++) { if (this->records[order[i]].has_phash) { with_phash.push_back(i); } }
+	std::vector<uint8_t> similar;
+	if (!with_phash.empty()) {
+		similar.resize(CHUNKS * ((BUCKETS + 1) + with_phash.size()) * 4);
+		uint8_t* dir = similar.data();
+		for (unsigned c = 0; c < CHUNKS; c++) {
+			uint8_t* recs_out = dir + (BUCKETS + 1) * 4;
+			std::vector<uint32_t> starts(BUCKETS + 1, 0);
+			for (uint32_t i : with_phash) { starts[((this->records[order[i]].phash >> (c * CHUNK_BITS)) & (BUCKETS - 1)) + 1]++; }
+			for (size_t b = 0; b < BUCKETS; b++) { starts[b + 1] += starts[b]; }
+			for (size_t b = 0; b <= BUCKETS; b++) { write32(dir + b * 4, starts[b]); }
+			for (uint32_t i : with_phash) { write32(recs_out + 4 * starts[(this->records[order[i]].phash >> (c * CHUNK_BITS)) & (BUCKETS - 1)]++, i); }
+			dir = recs_out + with_phash.size() * 4;
+		}
+	}
+
+	uint8_t footer[FOOTER_SIZE];
+	write64(footer, order.size());
+	write64(footer + 8, toks.size());
+	write64(footer + 16, first);
+	write64(footer + 24, with_phash.size());
+	write64(footer + 32, pool.size());
+	memcpy(footer + 40, MAGIC, sizeof(MAGIC));
+
+	FILE* f = openFile(this->path, "wb");
+	if (!f) { return false; }
+	bool ok =
+		fwrite(recs.data(), 1, recs.size(), f) == recs.size() &&
+		fwrite(hashes.data(), 1, hashes.size(), f) == hashes.size() &&
+		fwrite(token_index.data(), 1, token_index.size(), f) == token_index.size() &&
+		fwrite(postings.data(), 1, postings.size(), f) == postings.size() &&
+		fwrite(similar.data(), 1, similar.size(), f) == similar.size() &&
+		fwrite(pool.data(), 1, pool.size(), f) == pool.size() &&
+		fwrite(footer, 1, FOOTER_SIZE, f) == FOOTER_SIZE;
+	return (fclose(f) == 0) && ok;
+}
+#pragma endregion
+
+#pragma region Reader
+////////////////////////////////////////////////////////////////////////////////
+///// Reader
+////////////////////////////////////////////////////////////////////////////////
+bool SearchIndexReader::open(const wchar_t* path) {
+	if (!this->map.open(path)) { return false; }
+	const uint8_t* base = this->map.data();
+	size_t size = this->map.size();
+	if (size < FOOTER_SIZE || memcmp(base + size - sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0) { SetLastError(ERROR_BAD_FORMAT); return false; }
+	const uint8_t* footer = base + size - FOOTER_SIZE;
+	uint64_t count = read64(footer), token_count = read64(footer + 8), posting_count = read64(footer + 16), phash_count = read64(footer + 24), strings_size = read64(footer + 32);
+	uint64_t avail = size - FOOTER_SIZE;
+	if (count > avail / (RECORD_SIZE + HASH_SIZE) || token_count > avail / TOKEN_SIZE || posting_count > avail / 4 || phash_count > count) {
+		SetLastError(ERROR_BAD_FORMAT);
+		return false;
+	}
+	uint64_t similar_size = phash_count ? CHUNKS * ((BUCKETS + 1) + phash_count) * 4 : 0;
+	uint64_t used = count * (RECORD_SIZE + HASH_SIZE) + token_count * TOKEN_SIZE + posting_count * 4 + similar_size;
+	if (used > avail || strings_size != avail - used || strings_size == 0 || base[avail - 1] != 0) {
+		SetLastError(ERROR_BAD_FORMAT);
+		return false;
+	}
+	this->records = base;
+	this->hashes = this->records + count * RECORD_SIZE;
+	this->tokens = this->hashes + count * HASH_SIZE;
+	this->postings = this->tokens + token_count * TOKEN_SIZE;
+	this->similar = this->postings + posting_count * 4;
+	this->strings = (const char*)(this->similar + similar_size);
+	this->_count = (size_t)count;
+	this->token_count = (size_t)token_count;
+	this->posting_count = (size_t)posting_count;
+	this->phash_count = (size_t)phash_count;
+	this->strings_size = (size_t)strings_size;
+	return true;
+}
+
+SearchIndexReader::Entry SearchIndexReader::operator[](size_t i) const {
+	const uint8_t* p = this->records + i * RECORD_SIZE;
+	Entry e;
+	e.file = this->string(read32(p + RECORD_FILE));
+	e.embedded = this->string(read32(p + RECORD_EMBEDDED));
+	e.type = this->string(read32(p + RECORD_TYPE));
+	e.name = this->string(read32(p + RECORD_NAME));
+	e.ext = this->string(read32(p + RECORD_EXT));
+	e.lang = read16(p + RECORD_LANG);
+	e.has_phash = (read16(p + RECORD_FLAGS) & FLAG_PHASH) != 0;
+	e.size = read64(p + RECORD_LENGTH);
+	e.hash = read64(p + RECORD_HASH);
+	e.phash = read64(p + RECORD_PHASH);
+	return e;
+}
+
+void SearchIndexReader::findHash(uint64_t hash, std::vector<size_t>& found) const {
+	size_t lo = 0, hi = this->_count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (read64(this->hashes + mid * HASH_SIZE) < hash) { lo = mid + 1; } else { hi = mid; }
+	}
+	for (; lo < this->_count && read64(this->hashes + lo * HASH_SIZE) == hash; lo++) {
+		uint32_t id = read32(this->hashes + lo * HASH_SIZE + 8);
+		if (id < this->_count) { found.push_back(id); }
+	}
+}
+
+bool SearchIndexReader::findToken(const std::string& token, const uint8_t*& postings, size_t& count) const {
+	size_t lo = 0, hi = this->token_count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const uint8_t* p = this->tokens + mid * TOKEN_SIZE;
+		int c = strcmp(this->string(read32(p + TOKEN_STRING)), token.c_str());
+		if (c == 0) {
+			uint64_t first = read64(p + TOKEN_FIRST);
+			count = read32(p + TOKEN_COUNT);
+			if (first > this->posting_count || count > this->posting_count - first) { return false; }
+			postings = this->postings + first * 4;
+			return true;
+		}
+		if (c < 0) { lo = mid + 1; } else { hi = mid; }
+	}
+	return false;
+}
+
+void SearchIndexReader::findText(const char* text, std::vector<size_t>& found) const {
+	std::vector<std::string> toks;
+	tokenize(text, strlen(text), toks);
+	if (toks.empty()) { return; }
+
+	// the postings are intersected starting with the shortest so the result only gets smaller
+	std::vector<std::pair<const uint8_t*, size_t>> lists;
+	for (const std::string& token : toks) {
+		const uint8_t* postings;
+		size_t count;
+		if (!this->findToken(token, postings, count)) { return; }
+		lists.emplace_back(postings, count);
+	}
+	std::sort(lists.begin(), lists.end(), [](const std::pair<const uint8_t*, size_t>& a, const std::pair<const uint8_t*, size_t>& b) { return a.second < b.second; });
+	std::vector<uint32_t> ids;
+	for (size_t i = 0; i < lists[0].second; i++) { ids.push_back(read32(lists[0].first + 4*i)); }
+	for (size_t l = 1; l < lists.size() && !ids.empty(); l++) {
+		const uint8_t* postings = lists[l].first;
+		size_t count = lists[l].second, j = 0, n = 0;
+		for (uint32_t id : ids) {
+			while (j < count && read32(postings + 4*j) < id) { j++; }
+			if (j < count && read32(postings + 4*j) == id) { ids[n++] = id; }
+		}
+		ids.resize(n);
+	}
+	for (uint32_t id : ids) { if (id < this->_count) { found.push_back(id); } }
+}
+
+/* Calls a function with every value within a Hamming distance of a chunk value, changing the bits from the
+   first one given on */
+static void forEachNear(uint32_t value, unsigned distance, unsigned first_bit, const std::function<void(uint32_t)>& f) {
+	f(value);
+	if (distance == 0) { return; }
+	for (unsigned b = first_bit; b < CHUNK_BITS; b++) { forEachNear(value ^ (1u << b), distance - 1, b + 1, f); }
+}
+
+void SearchIndexReader::findSimilar(uint64_t phash, unsigned distance, std::vector<Match>& found) const {
+	if (!this->phash_count) { return; }
+	std::vector<uint32_t> candidates;
+	const uint8_t* dir = this->similar;
+	for (unsigned c = 0; c < CHUNKS; c++) {
+		const uint8_t* recs = dir + (BUCKETS + 1) * 4;
+		forEachNear((phash >> (c * CHUNK_BITS)) & (BUCKETS - 1), std::min(distance / CHUNKS, CHUNK_BITS), 0, [&](uint32_t value) {
+			size_t start = read32(dir + value * 4), end = std::min((size_t)read32(dir + (value + 1) * 4), this->phash_count);
+			for (size_t i = start; i < end; i++) { candidates.push_back(read32(recs + i * 4)); }
+		});
+		dir = recs + this->phash_count * 4;
+	}
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+	for (uint32_t id : candidates) {
+		if (id >= this->_count) { continue; }
+		const uint8_t* p = this->records + id * RECORD_SIZE;
+		unsigned d = hammingDistance(read64(p + RECORD_PHASH), phash);
+		if ((read16(p + RECORD_FLAGS) & FLAG_PHASH) && d <= distance) { found.push_back(Match{ id, d }); }
+	}
+	std::stable_sort(found.begin(), found.end(), [](const Match& a, const Match& b) { return a.distance < b.distance; });
+}
+
+void SearchIndexReader::forEachToken(const std::function<void(const char* token, const uint8_t* postings, size_t count)>& f) const {
+	for (size_t i = 0; i < this->token_count; i++) {
+		const uint8_t* p = this->tokens + i * TOKEN_SIZE;
+		uint64_t first = read64(p + TOKEN_FIRST);
+		size_t count = read32(p + TOKEN_COUNT);
+		if (first > this->posting_count || count > this->posting_count - first) { continue; }
+		f(this->string(read32(p + TOKEN_STRING)), this->postings + first * 4, count);
+	}
+}
+#pragma endregion
@@ -0,0 +1,146 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// A search index of dumped resources across any number of PE files, so finding which files have a given
+// resource (by the hash of its output), a word in their manifests, strings, or version info, or an icon or
+// bitmap that looks like another (by its perceptual hash, see PHash.h) does not need to search the dumped
+// files.
+//
+// The index is built while dumping and kept in a single file. Each dump adds to it: the entries of the files
+// that were dumped again are replaced and the rest are kept, so a collection can be indexed in many runs. The
+// reader maps the file and answers with binary searches, nothing is read besides what is needed.
+//
+// Similar images are found with multi-index hashing: the 64-bit perceptual hashes are split into 4 chunks of
+// 16 bits and each chunk has a table of the records by its value. Two hashes within a distance of d have at
+// least one chunk within d/4, so only the buckets of the values that close to the chunks of the query need to
+// be checked.
+//
+// Layout (all integers are little-endian):
+//   records   one 48 byte record per resource, sorted by (file, embedded, type, name, lang)
+//   hashes    one 12 byte entry per record, XXH64 of the output (8) and record number (4), sorted by hash
+//   tokens    one 16 byte entry per token, sorted by the token
+//   postings  the record numbers of each token (4 each), sorted
+//   similar   for each chunk, the start of each of the 65536 buckets and the end of the last (4 each), then
+//             the record numbers of the records with a perceptual hash in each bucket (4 each)
+//   strings   the UTF-8 strings of the records and tokens, each null-terminated
+//   footer    record count (8), token count (8), posting count (8), perceptual hash count (8), size of the
+//             strings (8), and "PERDIDX2" (8)
+
+#pragma once
+
+#include "general.h"
+#include "MappedFile.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+
+// Splits text into the tokens that are indexed: runs of ASCII letters and digits (lowercased) and any
+// non-ASCII UTF-8 characters, 2 to 64 bytes long. Each token is only given once.
+void tokenize(const char* text, size_t len, std::vector<std::string>& tokens);
+
+class SearchIndexWriter {
+public:
+	SearchIndexWriter() { }
+
+	// Loads the existing index at the path if there is one, a missing index is the same as an empty one and
+	// an unreadable one is reported and replaced
+	void load(const std::wstring& path);
+
+	// Starts indexing a PE file, dropping all of its entries (and those of the files embedded in it) from the
+	// loaded index. Files that are not begun keep their entries.
+	void begin(const std::wstring& file);
+
+	// Adds a resource, file is the path of the PE file and embedded is the TYPE/NAME/LANG of the embedded file
+	// the resource is in (empty if it is not in one). The output is hashed and the text of manifests, string
+	// and message tables, and version info is tokenized and the images are given a perceptual hash from the
+	// resource data. Safe to call from multiple threads at once.
+	void add(const std::wstring& file, const std::wstring& embedded, PE::const_resid type, PE::const_resid name, uint16_t lang,
+		const void* data, size_t size, const DumpOutput& out);
+
+	// Writes the index to the path it was loaded from
+	bool save();
+
+	// The number of resources in the index once it is saved
+	size_t count() const { return this->saved; }
+
+private:
+	SearchIndexWriter(const SearchIndexWriter&) = delete;
+	SearchIndexWriter& operator=(const SearchIndexWriter&) = delete;
+
+	struct Record {
+		uint32_t file, embedded, type, name, ext; // in strings
+		uint16_t lang;
+		bool has_phash;
+		uint64_t size, hash, phash;
+	};
+	uint32_t intern(const std::string& s);
+
+	std::wstring path;
+	std::vector<std::string> strings;
+	std::unordered_map<std::string, uint32_t> string_ids;
+	std::vector<Record> records;
+	std::unordered_map<std::string, std::vector<uint32_t>> tokens; // record numbers of each token
+	size_t loaded = 0; // the records from the loaded index are first
+	std::set<uint32_t> begun; // the files (in strings) whose loaded records are dropped
+	size_t saved = 0;
+	std::mutex mutex;
+};
+
+class SearchIndexReader {
+public:
+	// A resource in the index, the strings point into the mapped index
+	struct Entry {
+		const char *file, *embedded, *type, *name, *ext;
+		uint16_t lang;
+		bool has_phash;
+		uint64_t size, hash, phash;
+	};
+	// A resource found by findSimilar() and the distance of its perceptual hash
+	struct Match {
+		size_t record;
+		unsigned distance;
+	};
+
+	// Maps the index and checks its layout, fails with ERROR_BAD_FORMAT if it is not a valid index. The
+	// records are not checked until they are used so opening takes the same time no matter how large it is.
+	bool open(const wchar_t* path);
+
+	size_t count() const { return this->_count; }
+	Entry operator[](size_t i) const;
+	// Finds every resource with an output with the hash
+	void findHash(uint64_t hash, std::vector<size_t>& found) const;
+	// Finds every resource that has all of the tokens of the text
+	void findText(const char* text, std::vector<size_t>& found) const;
+	// Finds every image with a perceptual hash within a Hamming distance of the hash, closest first
+	void findSimilar(uint64_t phash, unsigned distance, std::vector<Match>& found) const;
+	// Calls a function with every token and its postings (the little-endian record numbers)
+	void forEachToken(const std::function<void(const char* token, const uint8_t* postings, size_t count)>& f) const;
+
+private:
+	const char* string(uint32_t off) const { return off < this->strings_size ? this->strings + off : this->strings + this->strings_size - 1; }
+	// Gets the postings of a token, returns false if it is not in the index
+	bool findToken(const std::string& token, const uint8_t*& postings, size_t& count) const;
+
+	MappedFile map;
+	const uint8_t *records = nullptr, *hashes = nullptr, *tokens = nullptr, *postings = nullptr, *similar = nullptr;
+	const char* strings = nullptr;
+	size_t _count = 0, token_count = 0, posting_count = 0, phash_count = 0, strings_size = 0;
+};
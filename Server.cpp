@@ -0,0 +1,402 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "stdafx.h"
+#include "Server.h"
+
+#include <vector>
+#include <thread>
+#include <system_error>
+#include <exception>
+#include <iostream>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SIGPIPE is ignored instead
+#endif
+#endif
+
+// Requests longer than this close the connection
+#define MAX_REQUEST (64 << 10)
+// Connections served at once, more wait to be accepted until one closes
+#define MAX_CONNECTIONS 64
+
+// The data of a resource in the cache is its output, which references the file it came from
+struct DumpServer::CachedOutput {
+	DumpOutput out;
+	bool ok;
+};
+
+// A file in the cache, with every resource converted from it so far
+struct DumpServer::CachedFile {
+	std::wstring path;
+	uint64_t serial;
+	std::unique_ptr<PE::File> pe;
+	std::unique_ptr<DumpContext> ctx;
+	std::mutex mutex; // protects the outputs
+	std::unordered_map<const PE::ResourceLang*, std::shared_future<std::shared_ptr<const CachedOutput>>> outputs;
+};
+
+DumpServer::DumpServer(const DumpOptions& opts, size_t max_files, uint64_t max_bytes) : opts(opts), max_files(max_files ? max_files : 1), max_bytes(max_bytes), fd(-1), connections(0),
+	bytes(0), next_serial(0), requests(0), file_hits(0), file_misses(0), output_hits(0), output_misses(0), evictions(0) { }
+
+#pragma region Cache
+///////////////////////////////////////////////////////////////////////////////
+///// Cache
+///////////////////////////////////////////////////////////////////////////////
+/* Gets a file from the cache, opening it if it is not there or has changed. Returns NULL if it cannot be
+   opened, which is not cached so it is tried again next time. */
+std::shared_ptr<DumpServer::CachedFile> DumpServer::getFile(const std::wstring& path) {
+	uint64_t size, mtime;
+	if (!getFileInfo(path, size, mtime)) { return nullptr; }
+	std::promise<std::shared_ptr<CachedFile>> promise;
+	std::shared_future<std::shared_ptr<CachedFile>> future;
+	uint64_t serial = 0;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto itr = this->files.find(path);
+		if (itr != this->files.end() && itr->second.size == size && itr->second.mtime == mtime) {
+			this->lru.splice(this->lru.begin(), this->lru, itr->second.lru);
+			++this->file_hits;
+			future = itr->second.file;
+		}
+		else {
+			// a file that changed is replaced, anyone still using the old one keeps it until they are done
+			if (itr != this->files.end()) {
+				this->bytes -= itr->second.bytes;
+				this->lru.erase(itr->second.lru);
+				this->files.erase(itr);
+			}
+			++this->file_misses;
+			serial = ++this->next_serial;
+			future = promise.get_future().share();
+			this->lru.push_front(path);
+			Slot slot = { size, mtime, serial, future, this->lru.begin(), 0 };
+			this->files.emplace(path, slot);
+			this->evict();
+		}
+	}
+	if (!serial) { return future.get(); }
+
+	// this request opens the file, any others for it wait for it
+	std::shared_ptr<CachedFile> file = std::make_shared<CachedFile>();
+	file->path = path;
+	file->serial = serial;
+	PE::File* pe = nullptr;
+	const PE::Rsrc* rsrc = nullptr;
+	// a crafted file can make opening it throw (such as bad_alloc), then only the requests for it fail and the
+	// ones waiting for it get NULL like any other file that cannot be opened
+	try {
+		if (openPE(path.c_str(), pe, rsrc, this->opts) == 0) {
+			file->pe.reset(pe);
+			file->ctx.reset(new DumpContext(rsrc, this->opts, path));
+		}
+		else { file.reset(); }
+	}
+	catch (const std::exception&) { file.reset(); }
+	if (!file) { this->removeFile(path, serial); }
+	promise.set_value(file);
+	return file;
+}
+
+/* Gets a converted resource from the cache, converting it if it is not there */
+std::shared_ptr<const DumpServer::CachedOutput> DumpServer::getOutput(const std::shared_ptr<CachedFile>& file, PE::const_resid type, PE::const_resid name, uint16_t lang, const PE::ResourceLang* rsrc_lang) {
+	std::promise<std::shared_ptr<const CachedOutput>> promise;
+	std::shared_future<std::shared_ptr<const CachedOutput>> future;
+	bool convert = false;
+	{
+		std::lock_guard<std::mutex> lock(file->mutex);
+		auto itr = file->outputs.find(rsrc_lang);
+		if (itr != file->outputs.end()) { ++this->output_hits; future = itr->second; }
+		else {
+			++this->output_misses;
+			future = promise.get_future().share();
+			file->outputs.emplace(rsrc_lang, future);
+			convert = true;
+		}
+	}
+	if (!convert) { return future.get(); }
+
+	// this request converts the resource, any others for it wait for it
+	static const std::wstring no_directory;
+	DumpTask task = { type, name, lang, rsrc_lang, &no_directory, 0 };
+	std::shared_ptr<CachedOutput> output = std::make_shared<CachedOutput>();
+	bool thrown = false;
+	try { output->ok = convertResource(*file->ctx, task, output->out); }
+	catch (const std::exception&) { output->out.clear(); output->ok = false; thrown = true; }
+	promise.set_value(output);
+	if (thrown) {
+		// the ones already waiting get the failure but it is not kept, the next request tries again
+		std::lock_guard<std::mutex> lock(file->mutex);
+		file->outputs.erase(rsrc_lang);
+		return output;
+	}
+	this->addBytes(*file, output->out.ownedBytes());
+	return output;
+}
+
+/* Removes a file from the cache if it has not already been replaced */
+void DumpServer::removeFile(const std::wstring& path, uint64_t serial) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	auto itr = this->files.find(path);
+	if (itr == this->files.end() || itr->second.serial != serial) { return; }
+	this->bytes -= itr->second.bytes;
+	this->lru.erase(itr->second.lru);
+	this->files.erase(itr);
+}
+
+/* Counts the memory allocated for a resource converted from a file against the limit of the cache */
+void DumpServer::addBytes(const CachedFile& file, uint64_t n) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	auto itr = this->files.find(file.path);
+	if (itr == this->files.end() || itr->second.serial != file.serial) { return; } // already evicted
+	itr->second.bytes += n;
+	this->bytes += n;
+	this->evict();
+}
+
+/* Evicts the least recently used files until the cache is within its limits, the most recently used file is
+   always kept. The mutex must be locked. */
+void DumpServer::evict() {
+	while ((this->files.size() > this->max_files || this->bytes > this->max_bytes) && this->files.size() > 1) {
+		auto itr = this->files.find(this->lru.back());
+		this->bytes -= itr->second.bytes;
+		this->files.erase(itr);
+		this->lru.pop_back();
+		++this->evictions;
+	}
+}
+#pragma endregion
+
+#pragma region Requests
+///////////////////////////////////////////////////////////////////////////////
+///// Requests
+///////////////////////////////////////////////////////////////////////////////
+/* Splits a request into its tab-separated fields */
+static void splitFields(const std::string& s, std::vector<std::wstring>& fields) {
+	size_t start = 0;
+	for (;;) {
+		size_t end = s.find('\t', start);
+		if (end == std::string::npos) { end = s.size(); }
+		fields.push_back(fromUTF8(s.data() + start, end - start));
+		if (end == s.size()) { break; }
+		start = end + 1;
+	}
+}
+
+/* Finds a resource by the type and name as given by getTypeName() and getName() and the lang (the first one
+   if not given). The type and name are parsed into ids and looked up with binary searches, a type or name
+   that could be an integer or a string (like "1") is an integer unless the file only has the string. */
+static const PE::ResourceLang* findResource(const PE::Rsrc* rsrc, const std::wstring& type_name, const std::wstring& name_str, const std::wstring* lang_str,
+	PE::const_resid& type, PE::const_resid& name, uint16_t& lang) {
+	uint16_t id;
+	const PE::ResourceType* rsrc_type = parseTypeName(type_name, id) ? (*rsrc)[MAKEINTRESOURCE(id)] : nullptr;
+	if (!rsrc_type) { rsrc_type = (*rsrc)[type_name.c_str()]; }
+	if (!rsrc_type) { return nullptr; }
+	const PE::ResourceName* rsrc_name = parseName(name_str, id) ? (*rsrc_type)[MAKEINTRESOURCE(id)] : nullptr;
+	if (!rsrc_name) { rsrc_name = (*rsrc_type)[name_str.c_str()]; }
+	if (!rsrc_name || rsrc_name->langs().empty()) { return nullptr; }
+	if (lang_str) {
+		wchar_t* end;
+		unsigned long l = wcstoul(lang_str->c_str(), &end, 10);
+		if (lang_str->empty() || *end != 0 || l > 0xFFFF) { return nullptr; }
+		lang = (uint16_t)l;
+	}
+	else { lang = rsrc_name->langs()[0].getLang(); }
+	type = rsrc_type->getType();
+	name = rsrc_name->getName();
+	return (*rsrc_name)[lang];
+}
+
+void DumpServer::handle(const std::string& request, Response& r) {
+	++this->requests;
+	std::vector<std::wstring> fields;
+	splitFields(request, fields);
+	const std::wstring& command = fields[0];
+	if ((command == L"GET" && (fields.size() == 4 || fields.size() == 5)) || (command == L"LIST" && fields.size() == 2)) {
+		std::shared_ptr<CachedFile> file = this->getFile(fields[1]);
+		if (!file) { r.line = "ERR\tcannot open the file or it does not have any resources\n"; return; }
+		if (command == L"LIST") {
+			listResources(fields[1], file->ctx->rsrc, false, r.text);
+			r.line = "OK\t" + std::to_string(r.text.size()) + "\n";
+			return;
+		}
+		PE::const_resid type, name;
+		uint16_t lang;
+		const PE::ResourceLang* rsrc_lang = findResource(file->ctx->rsrc, fields[2], fields[3], fields.size() == 5 ? &fields[4] : nullptr, type, name, lang);
+		if (!rsrc_lang) { r.line = "ERR\tno such resource\n"; return; }
+		std::shared_ptr<const CachedOutput> output = this->getOutput(file, type, name, lang, rsrc_lang);
+		if (!output->ok) { r.line = "ERR\tcannot convert the resource\n"; return; }
+		r.line = "OK\t" + std::to_string(output->out.size()) + "\t" + toUTF8(output->out.ext ? output->out.ext : L"") + "\n";
+		r.out = &output->out;
+		// the output references the file, both stay alive until it is sent even if they are evicted
+		r.keep = std::shared_ptr<const void>(std::make_shared<std::pair<std::shared_ptr<CachedFile>, std::shared_ptr<const CachedOutput>>>(file, output));
+	}
+	else if (command == L"STATS" && fields.size() == 1) {
+		size_t count;
+		uint64_t cached;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			count = this->files.size();
+			cached = this->bytes;
+		}
+		r.text = "requests\t" + std::to_string(this->requests) + "\nfile_hits\t" + std::to_string(this->file_hits) + "\nfile_misses\t" + std::to_string(this->file_misses) +
+			"\noutput_hits\t" + std::to_string(this->output_hits) + "\noutput_misses\t" + std::to_string(this->output_misses) +
+			"\nevictions\t" + std::to_string(this->evictions) + "\nfiles\t" + std::to_string(count) + "\nbytes\t" + std::to_string(cached) + "\n";
+		r.line = "OK\t" + std::to_string(r.text.size()) + "\n";
+	}
+	else { r.line = "ERR\tbad request\n"; }
+}
+#pragma endregion
+
+#pragma region Sockets
+///////////////////////////////////////////////////////////////////////////////
+///// Sockets
+///////////////////////////////////////////////////////////////////////////////
+#ifdef _WIN32
+DumpServer::~DumpServer() { }
+bool DumpServer::listen(const std::wstring& path) { SetLastError(ERROR_NOT_SUPPORTED); return false; }
+bool DumpServer::run() { SetLastError(ERROR_NOT_SUPPORTED); return false; }
+void DumpServer::serve(int fd) { }
+#else
+DumpServer::~DumpServer() {
+	if (this->fd >= 0) { close(this->fd); }
+}
+
+bool DumpServer::listen(const std::wstring& path) {
+	std::string p = toUTF8(path);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (p.size() >= sizeof(addr.sun_path)) { errno = ENAMETOOLONG; return false; }
+	memcpy(addr.sun_path, p.c_str(), p.size() + 1);
+	// only a socket is removed, never another kind of file
+	struct stat st;
+	if (lstat(p.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) { unlink(p.c_str()); }
+	this->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (this->fd < 0) { return false; }
+	// only the user running the server can connect since requests can name any file the server can read, the
+	// socket is created without access for anyone else so there is no moment where others can connect
+	mode_t mask = umask(077);
+	int bound = bind(this->fd, (struct sockaddr*)&addr, sizeof(addr));
+	umask(mask);
+	if (bound != 0 || chmod(p.c_str(), 0600) != 0 || ::listen(this->fd, SOMAXCONN) != 0) {
+		int err = errno;
+		close(this->fd);
+		this->fd = -1;
+		errno = err;
+		return false;
+	}
+	// a client that goes away while its response is sent must not stop the server
+	signal(SIGPIPE, SIG_IGN);
+	return true;
+}
+
+bool DumpServer::run() {
+	for (;;) {
+		{
+			// a connection is only accepted once there is room for it, the others wait in the backlog
+			std::unique_lock<std::mutex> lock(this->connections_mutex);
+			this->connections_cv.wait(lock, [this] { return this->connections < MAX_CONNECTIONS; });
+		}
+		int client = accept(this->fd, nullptr, nullptr);
+		if (client < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) { continue; }
+			return false;
+		}
+		// each connection is served until the client closes it, the server never stops them
+		{
+			std::lock_guard<std::mutex> lock(this->connections_mutex);
+			++this->connections;
+		}
+		try { std::thread(&DumpServer::serve, this, client).detach(); }
+		catch (const std::system_error&) {
+			close(client);
+			std::lock_guard<std::mutex> lock(this->connections_mutex);
+			--this->connections;
+		}
+	}
+}
+
+/* Sends all of the buffers, returns false if the connection is closed */
+static bool sendAll(int fd, struct iovec* iov, size_t count) {
+	while (count) {
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count > IOV_MAX ? IOV_MAX : count;
+		ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) { continue; }
+			return false;
+		}
+		// skip what was sent
+		while (count && (size_t)n >= iov->iov_len) { n -= iov->iov_len; iov++; count--; }
+		if (count) { iov->iov_base = (uint8_t*)iov->iov_base + n; iov->iov_len -= n; }
+	}
+	return true;
+}
+
+/* Serves the requests of a connection in order until it is closed */
+void DumpServer::serve(int client) {
+	std::string buffer;
+	std::vector<struct iovec> iov;
+	char chunk[64 << 10];
+	bool open = true;
+	while (open) {
+		ssize_t n = recv(client, chunk, sizeof(chunk), 0);
+		if (n < 0 && errno == EINTR) { continue; }
+		if (n <= 0) { break; }
+		buffer.append(chunk, (size_t)n);
+		// every complete line is a request
+		size_t start = 0, end;
+		while (open && (end = buffer.find('\n', start)) != std::string::npos) {
+			size_t len = end - start;
+			if (len && buffer[end - 1] == '\r') { --len; }
+			Response r;
+			try { this->handle(buffer.substr(start, len), r); }
+			catch (const std::exception&) { r = Response(); r.line = "ERR\tcannot handle the request\n"; }
+			start = end + 1;
+			// the line and the data are sent together, except for outputs large enough to be streamed
+			iov.clear();
+			iov.push_back({ (void*)r.line.data(), r.line.size() });
+			if (!r.text.empty()) { iov.push_back({ (void*)r.text.data(), r.text.size() }); }
+			if (r.out && !r.out->isStreamed()) {
+				for (const DataSpan& s : r.out->spans()) { iov.push_back({ (void*)s.data, s.size }); }
+			}
+			open = sendAll(client, iov.data(), iov.size());
+			if (open && r.out && r.out->isStreamed()) {
+				open = r.out->stream([client](const void* data, size_t size) { struct iovec v = { (void*)data, size }; return sendAll(client, &v, 1); });
+			}
+		}
+		buffer.erase(0, start);
+		if (buffer.size() > MAX_REQUEST) { break; }
+	}
+	close(client);
+	std::lock_guard<std::mutex> lock(this->connections_mutex);
+	--this->connections;
+	this->connections_cv.notify_one();
+}
+#endif
+#pragma endregion
@@ -0,0 +1,108 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+// A server that dumps single resources on request (--serve), for programs that want a few resources from
+// each of many files. Instead of starting a process and opening and parsing the file for every request, the
+// parsed files are kept open in an LRU cache along with the resources converted from them, so a request for a
+// resource that was already converted only has to check that the file has not changed (by its size and
+// modification time) and send it. Concurrent requests for a file that is not in the cache wait for a single
+// open, and concurrent requests for the same resource wait for a single conversion.
+//
+// Clients connect to a Unix domain socket (not supported on Windows) and send requests as lines of
+// tab-separated UTF-8 fields. Any number of requests can be sent on a connection without waiting for the
+// responses, which come back in the same order. Each response is a line of tab-separated fields, either OK
+// and the size of the data that follows the line or ERR and the problem:
+//   GET FILE TYPE NAME [LANG]  the converted resource, like it would be dumped (the first language if LANG is
+//                              not given, TYPE and NAME are as in the dumped paths), then also the extension
+//   LIST FILE                  the resources of the file as tab-separated values like --list
+//   STATS                      the counters of the cache as lines of tab-separated name and value
+
+#pragma once
+
+#include "Dump.h"
+
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+
+class DumpServer {
+public:
+	// The options convert the resources (such as with --png). The cache keeps at most max_files files open and
+	// at most max_bytes of memory allocated for converted resources (most reference the mapped files instead).
+	DumpServer(const DumpOptions& opts, size_t max_files, uint64_t max_bytes);
+	~DumpServer();
+
+	// Creates the socket and starts listening, a socket already at the path (left by an earlier server) is
+	// replaced. Only the user running the server can connect to it.
+	bool listen(const std::wstring& path);
+	// Accepts connections and serves each on its own thread, at most 64 at once (the rest wait to be accepted),
+	// only returns if accepting fails
+	bool run();
+
+	// A response to a request: the line, then either text or a converted resource that is kept alive by keep
+	struct Response {
+		std::string line, text;
+		const DumpOutput* out = nullptr;
+		std::shared_ptr<const void> keep;
+	};
+	// Handles a single request (a line without the newline), used by the connections
+	void handle(const std::string& request, Response& response);
+
+private:
+	DumpServer(const DumpServer&) = delete;
+	DumpServer& operator=(const DumpServer&) = delete;
+
+	struct CachedOutput;
+	struct CachedFile;
+	// A file in the cache, the file is shared by everyone that asks for it while it is opened
+	struct Slot {
+		uint64_t size, mtime, serial;
+		std::shared_future<std::shared_ptr<CachedFile>> file;
+		std::list<std::wstring>::iterator lru;
+		uint64_t bytes;
+	};
+
+	std::shared_ptr<CachedFile> getFile(const std::wstring& path);
+	std::shared_ptr<const CachedOutput> getOutput(const std::shared_ptr<CachedFile>& file, PE::const_resid type, PE::const_resid name, uint16_t lang, const PE::ResourceLang* rsrc_lang);
+	void removeFile(const std::wstring& path, uint64_t serial);
+	void addBytes(const CachedFile& file, uint64_t bytes);
+	void evict();
+	void serve(int fd);
+
+	const DumpOptions opts;
+	const size_t max_files;
+	const uint64_t max_bytes;
+	int fd;
+
+	std::mutex connections_mutex; // protects the number of connections being served
+	std::condition_variable connections_cv;
+	size_t connections;
+
+	std::mutex mutex; // protects the cache
+	std::unordered_map<std::wstring, Slot> files;
+	std::list<std::wstring> lru; // most recently used first
+	uint64_t bytes, next_serial;
+
+	std::atomic<uint64_t> requests, file_hits, file_misses, output_hits, output_misses, evictions;
+};
@@ -0,0 +1,94 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "stdafx.h"
+#include "Sink.h"
+#include "Dump.h"
+
+#include <iostream>
+
+#pragma warning(push)
+#pragma warning(disable:4100) // unreferenced formal parameter
+
+// With an incremental dump each output is only recorded in the manifest once it is written
+bool FileSink::save(const DumpContext& ctx, const DumpTask& task, const std::wstring& path, DumpOutput& out) {
+	Manifest* manifest = ctx.opts.manifest;
+	if (this->writer && !this->store) {
+		// problems are reported once it is written
+		const DumpTask* t = &task;
+		std::wstring dir = manifest ? ctx.root().file : std::wstring(), p = manifest ? path : std::wstring();
+		this->writer->write(path, out, [t, manifest, dir, p](bool written) {
+			if (!written) { warnCannotSave(*t); }
+			else if (manifest) { manifest->saved(dir, p); }
+		});
+		return true;
+	}
+	bool ok = this->store ? this->store->save(path, out) : writeFile(path, out);
+	if (ok && manifest) { manifest->saved(ctx.root().file, path); }
+	return ok;
+}
+
+void FileSink::wait() {
+	if (this->writer) { this->writer->wait(); }
+}
+
+void FileSink::report(std::wostream& out) const {
+	if (!this->store) { return; }
+	out << L"Content store: " << this->store->blobsAdded() << L" new, " << this->store->blobsReused() << L" reused (" <<
+		this->store->bytesSaved() << L" bytes saved)" << std::endl;
+}
+
+bool ArchiveSink::save(const DumpContext& ctx, const DumpTask& task, const std::wstring& path, DumpOutput& out) {
+	return this->archive.add(ctx.file, task.type, task.name, task.lang, out);
+}
+
+bool ArchiveSink::finish() { return this->archive.close(); }
+
+void ArchiveSink::report(std::wostream& out) const {
+	out << L"Wrote " << this->archive.count() << L" resources to the archive." << std::endl;
+}
+
+bool ExportSink::wants(PE::const_resid type) const { return this->exporter.exports(type); }
+bool ExportSink::firstOnly() const { return this->exporter.firstOnly(); }
+
+bool ExportSink::save(const DumpContext& ctx, const DumpTask& task, const std::wstring& path, DumpOutput& out) {
+	// the resource is decoded from its data, the output of the dumpers is not used
+	return this->exporter.add(ctx.path, ctx.embedded(), task.type, task.name, task.lang, task.rsrc_lang->data(), task.rsrc_lang->size());
+}
+
+bool ExportSink::finish() { return this->exporter.close(); }
+
+void ExportSink::report(std::wostream& out) const {
+	out << L"Exported " << this->exporter.count() << (this->exporter.kind() == JSONExport::STRINGS ? L" strings." : L" version records.") << std::endl;
+}
+
+bool MemorySink::save(const DumpContext& ctx, const DumpTask& task, const std::wstring& path, DumpOutput& out) {
+	Item item;
+	item.file = ctx.file;
+	item.type = getTypeName(task.type);
+	item.name = getName(task.name);
+	item.ext = out.ext ? out.ext : L"";
+	item.lang = task.lang;
+	item.data.resize(out.size());
+	uint8_t* p = item.data.data();
+	out.stream([&p](const void* data, size_t size) { memcpy(p, data, size); p += size; return true; }, true);
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->_items.push_back(std::move(item));
+	return true;
+}
+
+#pragma warning(pop)
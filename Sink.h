@@ -0,0 +1,128 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Sinks are where converted resources go. The dumping code hands every converted resource to the sink in the
+// options: files in directories, an archive, an export of decoded records, memory, or a callback. Other
+// programs can implement their own sink to take the resources straight from the dumpers.
+
+#pragma once
+
+#include "general.h"
+#include "PEResources.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <iosfwd>
+
+struct DumpContext;
+struct DumpTask;
+class ContentStore;
+class OutputWriter;
+class ArchiveWriter;
+class JSONExport;
+
+class Sink {
+public:
+	virtual ~Sink() { }
+
+	// Checks if the sink writes files, then the directories for the resources are created while they are
+	// enumerated and the path of each resource is given to save()
+	virtual bool usesFiles() const { return false; }
+	// Checks if resources of a type are wanted, no others are converted
+	virtual bool wants(PE::const_resid type) const { return true; }
+	// Checks if only the first wanted resource of each PE file is wanted
+	virtual bool firstOnly() const { return false; }
+
+	// Saves a converted resource, the path is empty unless usesFiles(). This is called from multiple threads at
+	// once. The output may be taken (moved out), and if it is used after this returns the task must stay valid
+	// until then (see DumpOutput::keepAlive()). Sinks that write files record each file in the manifest of an
+	// incremental dump once it is written (see Manifest::saved()).
+	virtual bool save(const DumpContext& ctx, const DumpTask& task, const std::wstring& path, DumpOutput& out) = 0;
+	// Waits until the sink is done with every output and task it was given
+	virtual void wait() { }
+	// Called once everything is dumped to finish writing
+	virtual bool finish() { this->wait(); return true; }
+	// Outputs a summary of what was saved
+	virtual void report(std::wostream& out) const { }
+};
+
+// Writes each resource to its own file, optionally deduplicated through a content store or written in the
+// background
+class FileSink : public Sink {
+public:
+	explicit FileSink(ContentStore* store = nullptr, OutputWriter* writer = nullptr) : store(store), writer(writer) { }
+	bool usesFiles() const override { return true; }
+	bool save(const DumpContext& ctx, const DumpTask& task, const std::wstring& path, DumpOutput& out) override;
+	void wait() override;
+	void report(std::wostream& out) const override;
+private:
+	ContentStore* store;
+	OutputWriter* writer;
+};
+
+// Adds every resource to an archive, finishing closes it
+class ArchiveSink : public Sink {
+public:
+	explicit ArchiveSink(ArchiveWriter& archive) : archive(archive) { }
+	bool save(const DumpContext& ctx, const DumpTask& task, const std::wstring& path, DumpOutput& out) override;
+	bool finish() override;
+	void report(std::wostream& out) const override;
+private:
+	ArchiveWriter& archive;
+};
+
+// Exports the records decoded from resources to a JSON lines file, finishing closes it
+class ExportSink : public Sink {
+public:
+	explicit ExportSink(JSONExport& exporter) : exporter(exporter) { }
+	bool wants(PE::const_resid type) const override;
+	bool firstOnly() const override;
+	bool save(const DumpContext& ctx, const DumpTask& task, const std::wstring& path, DumpOutput& out) override;
+	bool finish() override;
+	void report(std::wostream& out) const override;
+private:
+	JSONExport& exporter;
+};
+
+// Keeps a copy of every resource in memory
+class MemorySink : public Sink {
+public:
+	struct Item {
+		std::wstring file, type, name, ext; // the type and name are as given by getTypeName() and getName()
+		uint16_t lang;
+		std::vector<uint8_t> data;
+	};
+	bool save(const DumpContext& ctx, const DumpTask& task, const std::wstring& path, DumpOutput& out) override;
+	// The resources in the order they were saved, only safe to use once dumping is done
+	const std::vector<Item>& items() const { return this->_items; }
+private:
+	std::mutex mutex;
+	std::vector<Item> _items;
+};
+
+// Gives every resource to a function, the output only references the resource data so nothing is copied
+class CallbackSink : public Sink {
+public:
+	typedef std::function<bool(const DumpContext& ctx, const DumpTask& task, const DumpOutput& out)> Callback;
+	explicit CallbackSink(Callback callback) : callback(std::move(callback)) { }
+	bool save(const DumpContext& ctx, const DumpTask& task, const std::wstring& path, DumpOutput& out) override { return this->callback(ctx, task, out); }
+private:
+	Callback callback;
+};
@@ -0,0 +1,125 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "Sniff.h"
+
+// A signature is a prefix of the data where each byte is compared after being masked with the mask (if
+// there is one). A mask byte of 0x00 matches anything and 0xDF matches ASCII letters in either case. The
+// first byte must not be masked. Signatures with the same first byte are tried in the order of the table
+// so more specific signatures must come first. The optional refine function can check more of the data,
+// it returns the extension to use or NULL if the data does not match after all.
+struct Signature {
+	const char* bytes;
+	const char* mask;
+	size_t size;
+	const wchar_t* ext;
+	const wchar_t* (*refine)(const uint8_t* data, size_t size);
+};
+
+#define SIG(bytes, ext) { bytes, nullptr, sizeof(bytes) - 1, ext, nullptr }
+#define SIG_MASK(bytes, mask, ext) { bytes, mask, sizeof(bytes) - 1, ext, nullptr }
+#define SIG_REFINE(bytes, refine) { bytes, nullptr, sizeof(bytes) - 1, nullptr, refine }
+
+static inline uint32_t read32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+/* An embedded PE file (EXE or DLL) */
+static const wchar_t* refinePE(const uint8_t* data, size_t size) {
+	if (size < 0x40) { return nullptr; }
+	size_t nt = read32(data + 0x3C);
+	if (nt > size || size - nt < 24 || memcmp(data + nt, "PE\0\0", 4) != 0) { return nullptr; }
+	uint16_t characteristics = (uint16_t)(data[nt + 22] | (data[nt + 23] << 8));
+	return (characteristics & 0x2000) ? L"dll" : L"exe";
+}
+
+static const Signature signatures[] = {
+	// Images
+	SIG("\x89PNG\r\n\x1A\n", L"png"),
+	SIG("GIF87a", L"gif"),
+	SIG("GIF89a", L"gif"),
+	SIG("\xFF\xD8\xFF\xD8", L"jpg"),
+	SIG("\xFF\xD8\xFF\xEE", L"jpg"),
+	SIG("\xFF\xD8\xFF\xE0\x00\x10JFIF\x00\x01", L"jpg"),
+	SIG_MASK("\xFF\xD8\xFF\xE1\x00\x00" "Exif\x00\x00", "\xFF\xFF\xFF\xFF\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF", L"jpg"),
+	// RIFF containers
+	SIG_MASK("RIFF\x00\x00\x00\x00WAVE", "\xFF\xFF\xFF\xFF\x00\x00\x00\x00\xFF\xFF\xFF\xFF", L"wav"),
+	SIG_MASK("RIFF\x00\x00\x00\x00" "AVI ", "\xFF\xFF\xFF\xFF\x00\x00\x00\x00\xFF\xFF\xFF\xFF", L"avi"),
+	SIG_MASK("RIFF\x00\x00\x00\x00" "ACON", "\xFF\xFF\xFF\xFF\x00\x00\x00\x00\xFF\xFF\xFF\xFF", L"ani"),
+	SIG_MASK("RIFF\x00\x00\x00\x00WEBP", "\xFF\xFF\xFF\xFF\x00\x00\x00\x00\xFF\xFF\xFF\xFF", L"webp"),
+	// Fonts
+	SIG("\x00\x01\x00\x00", L"ttf"),
+	SIG("true", L"ttf"),
+	SIG("OTTO", L"otf"),
+	SIG("ttcf", L"ttc"),
+	// Archives and executables
+	SIG("PK\x03\x04", L"zip"),
+	SIG("PK\x05\x06", L"zip"),
+	SIG("MSCF\x00\x00\x00\x00", L"cab"),
+	SIG("\x1F\x8B\x08", L"gz"),
+	SIG("7z\xBC\xAF\x27\x1C", L"7z"),
+	SIG_REFINE("MZ", refinePE),
+	// Markup and text, UTF-8 with and without a BOM and UTF-16
+	SIG("<?xml", L"xml"),
+	SIG("\xEF\xBB\xBF<?xml", L"xml"),
+	SIG("<\x00?\x00x\x00m\x00l\x00", L"xml"),
+	SIG("\xFF\xFE<\x00?\x00x\x00m\x00l\x00", L"xml"),
+	SIG_MASK("<!DOCTYPE HTML", "\xFF\xFF\xDF\xDF\xDF\xDF\xDF\xDF\xDF\xFF\xDF\xDF\xDF\xDF", L"html"),
+	SIG_MASK("<HTML", "\xFF\xDF\xDF\xDF\xDF", L"html"),
+	SIG_MASK("\xEF\xBB\xBF<!DOCTYPE HTML", "\xFF\xFF\xFF\xFF\xFF\xDF\xDF\xDF\xDF\xDF\xDF\xDF\xFF\xDF\xDF\xDF\xDF", L"html"),
+	SIG_MASK("\xEF\xBB\xBF<HTML", "\xFF\xFF\xFF\xFF\xDF\xDF\xDF\xDF", L"html"),
+	SIG("%PDF-", L"pdf"),
+	SIG("{\\rtf", L"rtf"),
+	SIG("\xFF\xFE", L"txt"),
+};
+
+// For each first byte the range of the signatures (in order) that start with it
+struct SignatureIndex {
+	uint8_t order[ARRAYSIZE(signatures)];
+	uint8_t start[257];
+	SignatureIndex() {
+		size_t n = 0;
+		for (int b = 0; b < 256; b++) {
+			this->start[b] = (uint8_t)n;
+			for (size_t i = 0; i < ARRAYSIZE(signatures); i++) {
+				if ((uint8_t)signatures[i].bytes[0] == b) { this->order[n++] = (uint8_t)i; }
+			}
+		}
+		this->start[256] = (uint8_t)n;
+	}
+};
+static const SignatureIndex signature_index;
+
+static bool matches(const Signature& sig, const uint8_t* data, size_t size) {
+	if (size < sig.size) { return false; }
+	if (!sig.mask) { return memcmp(data, sig.bytes, sig.size) == 0; }
+	for (size_t i = 0; i < sig.size; i++) {
+		if ((data[i] & (uint8_t)sig.mask[i]) != ((uint8_t)sig.bytes[i] & (uint8_t)sig.mask[i])) { return false; }
+	}
+	return true;
+}
+
+const wchar_t* sniffFormat(const void* data, size_t size) {
+	if (size == 0) { return nullptr; }
+	const uint8_t* d = (const uint8_t*)data;
+	for (size_t i = signature_index.start[d[0]], end = signature_index.start[d[0] + 1]; i < end; i++) {
+		const Signature& sig = signatures[signature_index.order[i]];
+		if (!matches(sig, d, size)) { continue; }
+		if (!sig.refine) { return sig.ext; }
+		const wchar_t* ext = sig.refine(d, size);
+		if (ext) { return ext; }
+	}
+	return nullptr;
+}
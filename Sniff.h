@@ -0,0 +1,30 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Recognizes the format of resource data from its first bytes. The signatures are kept in a table indexed
+// by their first byte so the data is only looked at once and each resource is only compared against the
+// few signatures that could match, no matter how many formats there are.
+
+#pragma once
+
+#include <stddef.h>
+
+// The most bytes that need to be given to sniffFormat() to recognize every format, an embedded PE file can
+// need more if its PE header is far from the start
+#define SNIFF_PREFIX 4096
+
+// Gets the file extension for the format of the data, or NULL if it is not recognized
+const wchar_t* sniffFormat(const void* data, size_t size);
@@ -0,0 +1,106 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "Stats.h"
+#include "general.h"
+
+#include <chrono>
+#include <iomanip>
+#include <inttypes.h>
+
+static const char* const STAGE_NAMES[Stats::STAGE_COUNT] = { "open", "enumerate", "convert", "script", "path", "write" };
+
+// Buckets 0-15 are exact, after that each power of two is split into 16 buckets
+static size_t bucketOf(uint64_t ns) {
+	if (ns < 16) { return (size_t)ns; }
+	int msb = 4;
+	while (ns >> msb >> 1) { msb++; }
+	return (size_t)(msb - 3) * 16 + (size_t)((ns >> (msb - 4)) & 15);
+}
+static uint64_t bucketValue(size_t b) {
+	if (b < 16) { return b; }
+	int msb = (int)(b / 16) + 3;
+	return (uint64_t)(16 + b % 16) << (msb - 4);
+}
+
+Stats::Metric::Metric() : _count(0), total_ns(0), max_ns(0), bytes_in(0), bytes_out(0), allocs(0), copied(0) {
+	for (size_t i = 0; i < BUCKETS; i++) { this->histogram[i] = 0; }
+}
+
+void Stats::Metric::add(uint64_t ns, uint64_t bytes_in, uint64_t bytes_out, uint64_t allocs, uint64_t copied) {
+	this->_count.fetch_add(1, std::memory_order_relaxed);
+	this->total_ns.fetch_add(ns, std::memory_order_relaxed);
+	this->bytes_in.fetch_add(bytes_in, std::memory_order_relaxed);
+	this->bytes_out.fetch_add(bytes_out, std::memory_order_relaxed);
+	this->allocs.fetch_add(allocs, std::memory_order_relaxed);
+	this->copied.fetch_add(copied, std::memory_order_relaxed);
+	this->histogram[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+	uint64_t max = this->max_ns.load(std::memory_order_relaxed);
+	while (ns > max && !this->max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) { }
+}
+
+uint64_t Stats::Metric::percentileNs(double p) const {
+	uint64_t n = this->_count, target = (uint64_t)(p * n + 0.5), seen = 0;
+	if (n == 0) { return 0; }
+	if (target < 1) { target = 1; }
+	for (size_t i = 0; i < BUCKETS; i++) {
+		seen += this->histogram[i];
+		if (seen >= target) { return std::min(bucketValue(i), (uint64_t)this->max_ns); }
+	}
+	return this->max_ns;
+}
+
+Stats::Stats(const std::vector<const char*>& dumper_names) : dumpers(new Metric[dumper_names.size()]), dumper_names(dumper_names) { }
+
+uint64_t Stats::now() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void reportMetric(std::wostream& out, const char* name, const Stats::Metric& m) {
+	out << std::left << std::setw(12) << fromUTF8(name, strlen(name)) << std::right << std::setw(9) << m.count() <<
+		std::fixed << std::setprecision(3) << std::setw(11) << m.totalNs() / 1e6 << std::setprecision(1) <<
+		std::setw(9) << m.percentileNs(0.5) / 1e3 << std::setw(9) << m.percentileNs(0.9) / 1e3 <<
+		std::setw(9) << m.percentileNs(0.99) / 1e3 << std::setw(10) << m.maxNs() / 1e3 <<
+		std::setw(13) << m.bytesIn() << std::setw(13) << m.bytesOut() << std::setw(9) << m.allocations() <<
+		std::setw(11) << m.bytesCopied() << std::endl;
+}
+
+void Stats::report(std::wostream& out) const {
+	out << L"Stage/dumper    count   total ms   p50 us   p90 us   p99 us    max us     bytes in    bytes out   allocs     copied" << std::endl;
+	for (size_t i = 0; i < STAGE_COUNT; i++) { reportMetric(out, STAGE_NAMES[i], this->stages[i]); }
+	for (size_t i = 0; i < this->dumper_names.size(); i++) { reportMetric(out, this->dumper_names[i], this->dumpers[i]); }
+}
+
+static void writeMetric(FILE* f, const char* name, const Stats::Metric& m, bool last) {
+	fprintf(f, "    \"%s\": {\"count\": %" PRIu64 ", \"total_ns\": %" PRIu64 ", \"p50_ns\": %" PRIu64 ", \"p90_ns\": %" PRIu64
+		", \"p99_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 ", \"bytes_in\": %" PRIu64 ", \"bytes_out\": %" PRIu64
+		", \"allocations\": %" PRIu64 ", \"bytes_copied\": %" PRIu64 "}%s\n",
+		name, m.count(), m.totalNs(), m.percentileNs(0.5), m.percentileNs(0.9), m.percentileNs(0.99), m.maxNs(),
+		m.bytesIn(), m.bytesOut(), m.allocations(), m.bytesCopied(), last ? "" : ",");
+}
+
+bool Stats::writeJSON(const std::wstring& path) const {
+	FILE* f = openFile(path, "wb");
+	if (!f) { return false; }
+	fprintf(f, "{\n  \"stages\": {\n");
+	for (size_t i = 0; i < STAGE_COUNT; i++) { writeMetric(f, STAGE_NAMES[i], this->stages[i], i == STAGE_COUNT - 1); }
+	fprintf(f, "  },\n  \"dumpers\": {\n");
+	for (size_t i = 0; i < this->dumper_names.size(); i++) { writeMetric(f, this->dumper_names[i], this->dumpers[i], i == this->dumper_names.size() - 1); }
+	fprintf(f, "  }\n}\n");
+	bool ok = !ferror(f);
+	return (fclose(f) == 0) && ok;
+}
@@ -0,0 +1,89 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Instrumentation of the dump enabled with --stats. Each stage of the dump and each dumper has a metric
+// with the count, total and percentile latencies, bytes in and out, and the allocations and bytes copied
+// into them. Metrics only use atomics so they can be updated from any thread without locking, latencies are
+// kept in a histogram with logarithmic buckets (about 6% apart) so the percentiles are approximate.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ostream>
+
+class Stats {
+public:
+	class Metric {
+	public:
+		Metric();
+		void add(uint64_t ns, uint64_t bytes_in, uint64_t bytes_out, uint64_t allocs = 0, uint64_t copied = 0);
+
+		uint64_t count() const { return this->_count; }
+		uint64_t totalNs() const { return this->total_ns; }
+		uint64_t maxNs() const { return this->max_ns; }
+		// Gets the latency that p (from 0 to 1) of the samples are at or below
+		uint64_t percentileNs(double p) const;
+		uint64_t bytesIn() const { return this->bytes_in; }
+		uint64_t bytesOut() const { return this->bytes_out; }
+		uint64_t allocations() const { return this->allocs; }
+		uint64_t bytesCopied() const { return this->copied; }
+
+	private:
+		Metric(const Metric&) = delete;
+		Metric& operator=(const Metric&) = delete;
+
+		static const size_t BUCKETS = 64 * 16;
+		std::atomic<uint64_t> _count, total_ns, max_ns, bytes_in, bytes_out, allocs, copied;
+		std::atomic<uint64_t> histogram[BUCKETS];
+	};
+
+	enum Stage { OPEN, ENUMERATE, CONVERT, SCRIPT, PATH, WRITE, STAGE_COUNT };
+
+	// The names of the dumpers are used in the report and must stay valid
+	explicit Stats(const std::vector<const char*>& dumper_names);
+
+	Metric& stage(Stage s) { return this->stages[s]; }
+	Metric& dumper(size_t i) { return this->dumpers[i]; }
+
+	// Writes a table of all of the metrics
+	void report(std::wostream& out) const;
+	// Writes all of the metrics as a JSON object
+	bool writeJSON(const std::wstring& path) const;
+
+	// A monotonic clock in nanoseconds
+	static uint64_t now();
+
+private:
+	Metric stages[STAGE_COUNT];
+	std::unique_ptr<Metric[]> dumpers;
+	std::vector<const char*> dumper_names;
+};
+
+// Times something and adds it to a metric, does nothing (not even reading the clock) when the metric is NULL
+class StatTimer {
+	Stats::Metric* metric;
+	uint64_t start;
+public:
+	explicit StatTimer(Stats::Metric* metric) : metric(metric), start(metric ? Stats::now() : 0) { }
+	void stop(uint64_t bytes_in, uint64_t bytes_out, uint64_t allocs = 0, uint64_t copied = 0) {
+		if (this->metric) { this->metric->add(Stats::now() - this->start, bytes_in, bytes_out, allocs, copied); this->metric = nullptr; }
+	}
+};
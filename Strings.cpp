@@ -0,0 +1,149 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "stdafx.h"
+#include "Strings.h"
+
+#include <iterator>
+
+static inline uint16_t read16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t read32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+// Message table entries are flagged with how their text is encoded
+#define MESSAGE_ANSI    0
+#define MESSAGE_UNICODE 1
+#define MESSAGE_UTF8    2
+
+bool isStringType(PE::const_resid type) { return type == RT_STRING || type == RT_MESSAGETABLE; }
+
+static void appendCodePoint(std::string& s, unsigned int c) {
+	if (c < 0x80) { s += (char)c; }
+	else if (c < 0x800) { s += (char)(0xC0 | (c >> 6)); s += (char)(0x80 | (c & 0x3F)); }
+	else if (c < 0x10000) { s += (char)(0xE0 | (c >> 12)); s += (char)(0x80 | ((c >> 6) & 0x3F)); s += (char)(0x80 | (c & 0x3F)); }
+	else { s += (char)(0xF0 | (c >> 18)); s += (char)(0x80 | ((c >> 12) & 0x3F)); s += (char)(0x80 | ((c >> 6) & 0x3F)); s += (char)(0x80 | (c & 0x3F)); }
+}
+
+void appendUTF16(std::string& s, const void* text, size_t len) {
+	const uint8_t* p = (const uint8_t*)text;
+	s.reserve(s.size() + len);
+	for (size_t i = 0; i < len; i++) {
+		unsigned int c = read16(p + 2*i);
+		if (c >= 0xD800 && c < 0xE000) {
+			unsigned int c2 = i + 1 < len ? read16(p + 2*i + 2) : 0;
+			if (c < 0xDC00 && c2 >= 0xDC00 && c2 < 0xE000) { c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00); i++; }
+			else { c = 0xFFFD; }
+		}
+		appendCodePoint(s, c);
+	}
+}
+
+bool decodeStringTable(uint16_t bundle, uint16_t lang, const void* data, size_t size, std::vector<StringRecord>& records) {
+	if (bundle == 0 || bundle > 4096) { return false; }
+	const uint8_t* p = (const uint8_t*)data, *end = p + size;
+	std::vector<StringRecord> strings;
+	for (uint32_t i = 0; i < 16; i++) {
+		if (end - p < 2) { return false; }
+		size_t len = read16(p);
+		p += 2;
+		if ((size_t)(end - p) < 2*len) { return false; }
+		if (len) {
+			StringRecord r = { ((uint32_t)bundle - 1) * 16 + i, lang, std::string() };
+			appendUTF16(r.text, p, len);
+			strings.push_back(std::move(r));
+		}
+		p += 2*len;
+	}
+	records.insert(records.end(), std::make_move_iterator(strings.begin()), std::make_move_iterator(strings.end()));
+	return true;
+}
+
+bool decodeMessageTable(uint16_t lang, const void* data, size_t size, std::vector<StringRecord>& records) {
+	// MESSAGE_RESOURCE_DATA: the number of blocks then each block has the low id, high id, and offset to
+	// its entries. Each entry has its length (including the 4 byte header), flags, then the text.
+	const uint8_t* p = (const uint8_t*)data;
+	if (size < 4) { return false; }
+	uint32_t nblocks = read32(p);
+	if (nblocks > (size - 4) / 12) { return false; }
+	// blocks could share their entries, so all of the entries together may not be larger than the table which
+	// keeps a crafted table from giving more records (or text) than it has bytes
+	std::vector<StringRecord> messages;
+	size_t total = 0;
+	for (uint32_t b = 0; b < nblocks; b++) {
+		const uint8_t* block = p + 4 + 12*b;
+		uint32_t low = read32(block), high = read32(block + 4), offset = read32(block + 8);
+		if (low > high || offset > size || (uint64_t)high - low >= (size - offset) / 4) { return false; }
+		size_t pos = offset;
+		for (uint64_t id = low; id <= high; id++) {
+			if (size - pos < 4) { return false; }
+			size_t len = read16(p + pos);
+			uint16_t flags = read16(p + pos + 2);
+			if (len < 4 || len > size - pos || (total += len) > size) { return false; }
+			const uint8_t* text = p + pos + 4;
+			size_t n = len - 4;
+			StringRecord r = { (uint32_t)id, lang, std::string() };
+			// the text is null-terminated and padded to a multiple of 4 bytes
+			if (flags == MESSAGE_UNICODE) {
+				n /= 2;
+				while (n && read16(text + 2*(n-1)) == 0) { --n; }
+				appendUTF16(r.text, text, n);
+			}
+			else {
+				while (n && text[n-1] == 0) { --n; }
+				if (flags == MESSAGE_UTF8) { r.text = toUTF8(fromUTF8((const char*)text, n)); }
+				else { for (size_t i = 0; i < n; i++) { appendCodePoint(r.text, text[i]); } }
+			}
+			messages.push_back(std::move(r));
+			pos += len;
+		}
+	}
+	records.insert(records.end(), std::make_move_iterator(messages.begin()), std::make_move_iterator(messages.end()));
+	return true;
+}
+
+void appendJSONString(std::string& s, const char* text, size_t len) {
+	static const char hex[] = "0123456789abcdef";
+	s += '"';
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)text[i];
+		switch (c) {
+		case '"': s += "\\\""; break;
+		case '\\': s += "\\\\"; break;
+		case '\n': s += "\\n"; break;
+		case '\r': s += "\\r"; break;
+		case '\t': s += "\\t"; break;
+		default:
+			if (c < 0x20) { s += "\\u00"; s += hex[c >> 4]; s += hex[c & 0xF]; }
+			else { s += (char)c; }
+		}
+	}
+	s += '"';
+}
+
+void appendJSONFields(std::string& s, const StringRecord& r) {
+	s += "\"id\":";
+	s += std::to_string(r.id);
+	s += ",\"lang\":";
+	s += std::to_string(r.lang);
+	s += ",\"text\":";
+	appendJSONString(s, r.text.data(), r.text.size());
+}
+
+void appendJSONLine(std::string& s, const StringRecord& r) {
+	s += '{';
+	appendJSONFields(s, r);
+	s += "}\n";
+}
@@ -0,0 +1,52 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Decoders for string tables (RT_STRING) and message tables (RT_MESSAGETABLE) that turn them into flat
+// records of id, language, and UTF-8 text, along with the UTF-8 and JSON helpers for decoded text.
+
+#pragma once
+
+#include "general.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct StringRecord {
+	uint32_t id;
+	uint16_t lang;
+	std::string text; // UTF-8
+};
+
+// Checks if the type is RT_STRING or RT_MESSAGETABLE
+bool isStringType(PE::const_resid type);
+
+// Decodes a string table, which is a bundle of 16 strings. The name of the resource is the bundle number, the
+// strings in it have the ids (bundle - 1) * 16 to (bundle - 1) * 16 + 15. Empty strings are not part of the
+// table so they are skipped.
+bool decodeStringTable(uint16_t bundle, uint16_t lang, const void* data, size_t size, std::vector<StringRecord>& records);
+// Decodes a message table. The code page of ANSI messages is not recorded so they are decoded as Latin-1.
+bool decodeMessageTable(uint16_t lang, const void* data, size_t size, std::vector<StringRecord>& records);
+
+// Converts little-endian UTF-16 text (which may be unaligned) to UTF-8, unpaired surrogates become U+FFFD
+void appendUTF16(std::string& s, const void* text, size_t len);
+// Appends a record as a line of JSON: {"id":1,"lang":1033,"text":"..."}
+void appendJSONLine(std::string& s, const StringRecord& r);
+// Appends the fields of a record without the braces or newline, for adding them to other fields
+void appendJSONFields(std::string& s, const StringRecord& r);
+// Appends a quoted and escaped JSON string
+void appendJSONString(std::string& s, const char* text, size_t len);
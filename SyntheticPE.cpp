@@ -0,0 +1,271 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "SyntheticPE.h"
+
+#pragma region Building
+////////////////////////////////////////////////////////////////////////////////
+///// Building
+////////////////////////////////////////////////////////////////////////////////
+static inline void write16(uint8_t* p, uint16_t x) { p[0] = (uint8_t)x; p[1] = (uint8_t)(x >> 8); }
+static inline void write32(uint8_t* p, uint32_t x) { for (int i = 0; i < 4; i++) { p[i] = (uint8_t)(x >> (8*i)); } }
+static inline void write64(uint8_t* p, uint64_t x) { for (int i = 0; i < 8; i++) { p[i] = (uint8_t)(x >> (8*i)); } }
+static inline size_t align(size_t x, size_t a) { return (x + a - 1) & ~(a - 1); }
+
+#define HIGH_BIT          0x80000000
+#define RSRC_DIR_SIZE     16
+#define RSRC_ENTRY_SIZE   8
+#define RSRC_DATA_SIZE    16
+#define NT_OFFSET         0x40
+#define OPT_OFFSET        (NT_OFFSET + 4 + 20)
+#define OPT_SIZE          240 // PE32+ with all 16 data directories
+#define SECTION_OFFSET    (OPT_OFFSET + OPT_SIZE)
+#define HEADERS_SIZE      0x200
+#define FILE_ALIGNMENT    0x200
+#define SECTION_ALIGNMENT 0x1000
+#define RSRC_RVA          0x1000
+
+void SyntheticPE::add(PE::const_resid type, PE::const_resid name, uint16_t lang, std::vector<uint8_t> data) {
+	std::vector<uint8_t>& d = this->types[type][name][lang];
+	if (d.empty()) { this->_count++; }
+	d = std::move(data);
+}
+
+// Writes a directory header, the entries follow it
+static uint8_t* writeDirectory(uint8_t* p, size_t named, size_t ids) {
+	memset(p, 0, RSRC_DIR_SIZE);
+	write16(p + 12, (uint16_t)named);
+	write16(p + 14, (uint16_t)ids);
+	return p + RSRC_DIR_SIZE;
+}
+
+// The standard PE checksum: a 16-bit one's complement sum of the file (without the checksum) plus its length
+static uint32_t checksum(const std::vector<uint8_t>& file) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i + 1 < file.size(); i += 2) {
+		if (i == OPT_OFFSET + 64 || i == OPT_OFFSET + 66) { continue; }
+		sum += file[i] | (file[i+1] << 8);
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+	if (file.size() & 1) { sum += file.back(); sum = (sum & 0xFFFF) + (sum >> 16); }
+	return (uint32_t)((sum & 0xFFFF) + file.size());
+}
+
+std::vector<uint8_t> SyntheticPE::build() const {
+	// Layout of the resource section: all of the directories, the data entries, the strings, then the data
+	size_t off = RSRC_DIR_SIZE + this->types.size() * RSRC_ENTRY_SIZE;
+	std::map<const Names*, size_t> name_dirs;
+	std::map<const Langs*, size_t> lang_dirs;
+	for (auto& t : this->types) { name_dirs[&t.second] = off; off += RSRC_DIR_SIZE + t.second.size() * RSRC_ENTRY_SIZE; }
+	for (auto& t : this->types) {
+		for (auto& n : t.second) { lang_dirs[&n.second] = off; off += RSRC_DIR_SIZE + n.second.size() * RSRC_ENTRY_SIZE; }
+	}
+	size_t data_entries = off;
+	off += this->_count * RSRC_DATA_SIZE;
+	std::map<std::wstring, size_t> strings;
+	for (auto& t : this->types) {
+		if (t.first.isString() && !strings.count(t.first.str)) { strings[t.first.str] = off; off += 2 + t.first.str.size() * 2; }
+		for (auto& n : t.second) {
+			if (n.first.isString() && !strings.count(n.first.str)) { strings[n.first.str] = off; off += 2 + n.first.str.size() * 2; }
+		}
+	}
+	size_t data_start = off = align(off, 8);
+	for (auto& t : this->types) { for (auto& n : t.second) { for (auto& l : n.second) { off = align(off + l.second.size(), 8); } } }
+	size_t rsrc_size = off, raw_size = align(rsrc_size, FILE_ALIGNMENT);
+
+	std::vector<uint8_t> file(HEADERS_SIZE + raw_size, 0);
+	uint8_t* rsrc = file.data() + HEADERS_SIZE;
+	for (auto& s : strings) {
+		uint8_t* p = rsrc + s.second;
+		write16(p, (uint16_t)s.first.size());
+		for (size_t i = 0; i < s.first.size(); i++) { write16(p + 2 + 2*i, (uint16_t)s.first[i]); }
+	}
+	auto entryName = [&](const Id& id) { return id.isString() ? (uint32_t)(HIGH_BIT | strings[id.str]) : id.id; };
+	auto countNamed = [](const std::map<Id, Names>& m) { size_t n = 0; for (auto& x : m) { n += x.first.isString(); } return n; };
+
+	uint8_t* p = writeDirectory(rsrc, countNamed(this->types), this->types.size() - countNamed(this->types));
+	size_t data_entry = data_entries, data_off = data_start;
+	for (auto& t : this->types) {
+		write32(p, entryName(t.first)); write32(p + 4, (uint32_t)(HIGH_BIT | name_dirs[&t.second])); p += RSRC_ENTRY_SIZE;
+		size_t named = 0;
+		for (auto& n : t.second) { named += n.first.isString(); }
+		uint8_t* q = writeDirectory(rsrc + name_dirs[&t.second], named, t.second.size() - named);
+		for (auto& n : t.second) {
+			write32(q, entryName(n.first)); write32(q + 4, (uint32_t)(HIGH_BIT | lang_dirs[&n.second])); q += RSRC_ENTRY_SIZE;
+			uint8_t* r = writeDirectory(rsrc + lang_dirs[&n.second], 0, n.second.size());
+			for (auto& l : n.second) {
+				write32(r, l.first); write32(r + 4, (uint32_t)data_entry); r += RSRC_ENTRY_SIZE;
+				uint8_t* e = rsrc + data_entry;
+				write32(e, (uint32_t)(RSRC_RVA + data_off));
+				write32(e + 4, (uint32_t)l.second.size());
+				if (!l.second.empty()) { memcpy(rsrc + data_off, l.second.data(), l.second.size()); }
+				data_entry += RSRC_DATA_SIZE;
+				data_off = align(data_off + l.second.size(), 8);
+			}
+		}
+	}
+
+	// DOS header, NT signature, and file header
+	uint8_t* h = file.data();
+	h[0] = 'M'; h[1] = 'Z';
+	write32(h + 0x3C, NT_OFFSET);
+	memcpy(h + NT_OFFSET, "PE\0\0", 4);
+	write16(h + NT_OFFSET + 4, 0x8664); // AMD64
+	write16(h + NT_OFFSET + 6, 1); // sections
+	write16(h + NT_OFFSET + 20, OPT_SIZE);
+	write16(h + NT_OFFSET + 22, 0x2022); // DLL, large address aware, executable
+	// optional header
+	uint8_t* opt = h + OPT_OFFSET;
+	write16(opt, 0x20B);
+	write64(opt + 24, 0x180000000ULL); // image base
+	write32(opt + 32, SECTION_ALIGNMENT);
+	write32(opt + 36, FILE_ALIGNMENT);
+	write16(opt + 40, 6); write16(opt + 48, 6); // OS and subsystem versions
+	write32(opt + 56, (uint32_t)(RSRC_RVA + align(rsrc_size, SECTION_ALIGNMENT))); // size of image
+	write32(opt + 60, HEADERS_SIZE);
+	write16(opt + 68, 2); // Windows GUI
+	write16(opt + 70, 0x0160); // high entropy VA, dynamic base, NX compatible
+	write64(opt + 72, 0x100000); write64(opt + 80, 0x1000); write64(opt + 88, 0x100000); write64(opt + 96, 0x1000);
+	write32(opt + 108, 16); // data directories
+	write32(opt + 112 + 2*8, RSRC_RVA); write32(opt + 112 + 2*8 + 4, (uint32_t)rsrc_size);
+	// section header
+	uint8_t* sh = h + SECTION_OFFSET;
+	memcpy(sh, ".rsrc\0\0\0", 8);
+	write32(sh + 8, (uint32_t)rsrc_size);
+	write32(sh + 12, RSRC_RVA);
+	write32(sh + 16, (uint32_t)raw_size);
+	write32(sh + 20, HEADERS_SIZE);
+	write32(sh + 36, 0x40000040); // initialized data, readable
+
+	write32(opt + 64, checksum(file));
+	return file;
+}
+#pragma endregion
+
+#pragma region Generating
+////////////////////////////////////////////////////////////////////////////////
+///// Generating
+////////////////////////////////////////////////////////////////////////////////
+const CorpusProfile corpus_profiles[] = {
+	//  name         icons       bitmaps  langs    named    rcdata
+	{ "icons",     250, 8, 64,   0, 0,    0, 0,    0, 0,    0, 0 },
+	{ "bitmaps",   0, 0, 0,      8, 1024, 0, 0,    0, 0,    0, 0 },
+	{ "languages", 0, 0, 0,      0, 0,    200, 20, 0, 0,    0, 0 },
+	{ "named",     0, 0, 0,      0, 0,    0, 0,    20, 100, 0, 0 },
+	{ "rcdata",    0, 0, 0,      0, 0,    0, 0,    0, 0,    4, 16 << 20 },
+	{ "mixed",     40, 6, 256,   4, 512,  50, 8,   5, 40,   2, 4 << 20 },
+};
+const size_t corpus_profile_count = ARRAYSIZE(corpus_profiles);
+
+// A small fast generator so the same seed always gives the same files (xorshift32)
+class Random {
+	uint32_t state;
+public:
+	explicit Random(uint32_t seed) : state(seed ? seed : 0x9E3779B9) { }
+	uint32_t next() { uint32_t x = this->state; x ^= x << 13; x ^= x >> 17; x ^= x << 5; return this->state = x; }
+	uint32_t below(uint32_t n) { return this->next() % n; }
+	void fill(uint8_t* p, size_t size) {
+		for (; size >= 4; p += 4, size -= 4) { uint32_t x = this->next(); memcpy(p, &x, 4); }
+		if (size) { uint32_t x = this->next(); memcpy(p, &x, size); }
+	}
+};
+
+// A DIB with a BITMAPINFOHEADER, for icons the height is doubled and a 1-bit AND mask follows the pixels
+static std::vector<uint8_t> makeDIB(Random& rnd, uint32_t width, uint32_t height, uint16_t bpp, bool icon) {
+	size_t stride = align((size_t)width * bpp / 8, 4), pixels = stride * height;
+	size_t mask = icon ? align((width + 7) / 8, 4) * height : 0;
+	std::vector<uint8_t> dib(sizeof(BITMAPINFOHEADER) + pixels + mask, 0);
+	BITMAPINFOHEADER h = {};
+	h.biSize = sizeof(BITMAPINFOHEADER);
+	h.biWidth = (LONG)width;
+	h.biHeight = (LONG)(icon ? height * 2 : height);
+	h.biPlanes = 1;
+	h.biBitCount = bpp;
+	h.biCompression = BI_RGB;
+	h.biSizeImage = (DWORD)(pixels + mask);
+	memcpy(dib.data(), &h, sizeof(h));
+	rnd.fill(dib.data() + sizeof(BITMAPINFOHEADER), pixels);
+	return dib;
+}
+
+static std::vector<uint8_t> makeText(Random& rnd, const std::string& head, size_t size) {
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyz     ";
+	std::string s = head;
+	while (s.size() < size) { s += chars[rnd.below(sizeof(chars) - 1)]; }
+	return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+static const uint16_t LANGS[] = { 1033, 1031, 1036, 1040, 1041, 1042, 2052, 1028, 1049, 1046, 3082, 1043, 1053, 1044, 1030, 1035, 1045, 1029, 1038, 1055 };
+
+std::vector<uint8_t> generatePE(const CorpusProfile& profile, uint32_t seed) {
+	static const uint32_t ICON_SIZES[] = { 16, 20, 24, 32, 40, 48, 64, 96, 128, 256 };
+	std::vector<uint32_t> icon_sizes;
+	for (uint32_t size : ICON_SIZES) { if (size <= profile.max_icon_size) { icon_sizes.push_back(size); } }
+	if (icon_sizes.empty()) { icon_sizes.push_back(ICON_SIZES[0]); }
+	Random rnd(seed);
+	SyntheticPE pe;
+
+	uint16_t icon_id = 1;
+	for (unsigned int g = 0; g < profile.icon_groups; g++) {
+		// the group is a header and a 14 byte entry for each icon
+		std::vector<uint8_t> group(6 + 14 * profile.icons_per_group, 0);
+		write16(&group[2], 1);
+		write16(&group[4], (uint16_t)profile.icons_per_group);
+		for (unsigned int i = 0; i < profile.icons_per_group; i++) {
+			uint32_t size = icon_sizes[i % icon_sizes.size()];
+			std::vector<uint8_t> icon = makeDIB(rnd, size, size, 32, true);
+			uint8_t* e = &group[6 + 14 * i];
+			e[0] = (uint8_t)size; e[1] = (uint8_t)size; // 256 wraps to 0 as it should
+			write16(e + 4, 1);
+			write16(e + 6, 32);
+			write32(e + 8, (uint32_t)icon.size());
+			write16(e + 12, icon_id);
+			pe.add(RT_ICON, MAKEINTRESOURCE(icon_id), 1033, std::move(icon));
+			icon_id++;
+		}
+		pe.add(RT_GROUP_ICON, MAKEINTRESOURCE(g + 1), 1033, std::move(group));
+	}
+	for (unsigned int i = 0; i < profile.bitmaps; i++) {
+		pe.add(RT_BITMAP, MAKEINTRESOURCE(i + 1), 1033, makeDIB(rnd, profile.bitmap_size, profile.bitmap_size, 24, false));
+	}
+	for (unsigned int i = 0; i < profile.lang_names; i++) {
+		for (unsigned int l = 0; l < profile.langs_per_name; l++) {
+			uint16_t lang = l < ARRAYSIZE(LANGS) ? LANGS[l] : (uint16_t)(0x0400 + l);
+			std::string head = "<html><body>" + std::to_string(i) + " " + std::to_string(lang) + " ";
+			pe.add(MAKEINTRESOURCE(23) /* RT_HTML */, MAKEINTRESOURCE(i + 1), lang, makeText(rnd, head, 256 + rnd.below(768)));
+		}
+	}
+	for (unsigned int t = 0; t < profile.named_types; t++) {
+		std::wstring type = L"CUSTOM_TYPE_" + std::to_wstring(t);
+		for (unsigned int n = 0; n < profile.names_per_type; n++) {
+			std::wstring name = L"ITEM_" + std::to_wstring(n);
+			std::vector<uint8_t> data(1024 + rnd.below(3072));
+			rnd.fill(data.data(), data.size());
+			pe.add(type.c_str(), name.c_str(), 1033, std::move(data));
+		}
+	}
+	for (unsigned int i = 0; i < profile.rcdata; i++) {
+		std::vector<uint8_t> data(profile.rcdata_size);
+		rnd.fill(data.data(), data.size());
+		pe.add(RT_RCDATA, MAKEINTRESOURCE(i + 1), 1033, std::move(data));
+	}
+	static const char manifest[] = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\r\n"
+		"<assembly xmlns=\"urn:schemas-microsoft-com:asm.v1\" manifestVersion=\"1.0\"></assembly>\r\n";
+	pe.add(RT_MANIFEST, MAKEINTRESOURCE(2), 1033, std::vector<uint8_t>(manifest, manifest + sizeof(manifest) - 1));
+	return pe.build();
+}
+#pragma endregion
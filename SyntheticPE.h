@@ -0,0 +1,65 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Builds PE files with any mix of resources so the dumpers can be benchmarked (and tried out) without real
+// Windows binaries. The files are valid PE32+ images with only a .rsrc section.
+
+#pragma once
+
+#include "PEResources.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+class SyntheticPE {
+public:
+	// Adds a resource, the type and name are either made with MAKEINTRESOURCE or strings
+	void add(PE::const_resid type, PE::const_resid name, uint16_t lang, std::vector<uint8_t> data);
+	size_t count() const { return this->_count; }
+	// Builds the entire PE file
+	std::vector<uint8_t> build() const;
+
+private:
+	// A type or name, strings come before integers as they do in a resource directory
+	struct Id {
+		std::wstring str;
+		uint16_t id;
+		Id(PE::const_resid rid) : str(IS_INTRESOURCE(rid) ? L"" : rid), id(IS_INTRESOURCE(rid) ? LOWORD((ULONG_PTR)rid) : 0) { }
+		bool isString() const { return !this->str.empty(); }
+		bool operator<(const Id& b) const { return this->isString() != b.isString() ? this->isString() : (this->isString() ? this->str < b.str : this->id < b.id); }
+	};
+	typedef std::map<uint16_t, std::vector<uint8_t>> Langs;
+	typedef std::map<Id, Langs> Names;
+	std::map<Id, Names> types;
+	size_t _count = 0;
+};
+
+// The mix of resources in a generated PE file
+struct CorpusProfile {
+	const char* name;
+	unsigned int icon_groups, icons_per_group, max_icon_size; // 32-bit icons, sizes cycle from 16 up to the max
+	unsigned int bitmaps, bitmap_size;    // square 24-bit bitmaps
+	unsigned int lang_names, langs_per_name; // small HTML resources each in many languages
+	unsigned int named_types, names_per_type; // types and names that are strings, with 1-4 KB of data
+	unsigned int rcdata, rcdata_size;     // RCDATA blobs of random bytes
+};
+extern const CorpusProfile corpus_profiles[];
+extern const size_t corpus_profile_count;
+
+// Generates a PE file with a mix of resources, the same profile and seed always give the same file
+std::vector<uint8_t> generatePE(const CorpusProfile& profile, uint32_t seed);
@@ -0,0 +1,967 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// The tests: synthetic PE files are dumped into memory and checked against the outputs they must give, and
+// each decoder is given known resources along with malformed ones that it must reject. Files for the archive
+// and search index are written into test_output in the working directory. Returns the number of failures.
+
+#include "stdafx.h"
+
+#include "Dump.h"
+#include "SyntheticPE.h"
+#include "Strings.h"
+#include "Version.h"
+#include "PNG.h"
+#include "Deflate.h"
+#include "Hash.h"
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+static unsigned int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::wcerr << __FILE__ << L":" << __LINE__ << L": " << #cond << std::endl; failures++; } } while (0)
+
+#pragma region Building
+///////////////////////////////////////////////////////////////////////////////
+///// Building
+///////////////////////////////////////////////////////////////////////////////
+typedef std::vector<uint8_t> Bytes;
+static void put16(Bytes& b, uint16_t x) { b.push_back((uint8_t)x); b.push_back((uint8_t)(x >> 8)); }
+static void put32(Bytes& b, uint32_t x) { put16(b, (uint16_t)x); put16(b, (uint16_t)(x >> 16)); }
+static void putBytes(Bytes& b, const void* data, size_t size) { b.insert(b.end(), (const uint8_t*)data, (const uint8_t*)data + size); }
+/* Appends null-terminated UTF-16 text */
+static void putText(Bytes& b, const char16_t* s) { while (*s) { put16(b, *s++); } put16(b, 0); }
+/* Appends UTF-16 text with its length in front (like in a string table) */
+static void putCounted(Bytes& b, const char16_t* s) { size_t n = std::char_traits<char16_t>::length(s); put16(b, (uint16_t)n); while (*s) { put16(b, *s++); } }
+static void align4(Bytes& b) { while (b.size() % 4) { b.push_back(0); } }
+static inline uint16_t read16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t read32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+static inline uint32_t read32be(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]; }
+
+/* Makes a DIB with a BITMAPINFOHEADER, the pixels are given bottom-up with each row already padded. The
+   height of an icon is doubled to include the AND mask which must be in the pixels. */
+static Bytes makeDIB(int32_t width, int32_t height, uint16_t bits, uint32_t compression, const Bytes& palette, const Bytes& pixels) {
+	Bytes b;
+	put32(b, 40); put32(b, (uint32_t)width); put32(b, (uint32_t)height); put16(b, 1); put16(b, bits);
+	put32(b, compression); put32(b, (uint32_t)pixels.size()); put32(b, 0); put32(b, 0);
+	put32(b, (uint32_t)(palette.size() / 4)); put32(b, 0);
+	putBytes(b, palette.data(), palette.size());
+	putBytes(b, pixels.data(), pixels.size());
+	return b;
+}
+
+/* Makes a 2x2 32-bit icon image where every pixel is the color (BGRA) and the mask is empty */
+static Bytes makeIcon(uint32_t bgra) {
+	Bytes pixels;
+	for (int i = 0; i < 4; i++) { put32(pixels, bgra); }
+	for (int i = 0; i < 2; i++) { put32(pixels, 0); } // AND mask rows are padded to 4 bytes
+	return makeDIB(2, 4, 32, 0, Bytes(), pixels);
+}
+
+/* A block of version info: length, value length, type, key, value, then children, each aligned to 4 bytes */
+static Bytes versionBlock(const char16_t* key, uint16_t type, const Bytes& value, uint16_t value_len, const std::vector<Bytes>& children) {
+	Bytes b;
+	put16(b, 0); put16(b, value_len); put16(b, type);
+	putText(b, key);
+	align4(b);
+	putBytes(b, value.data(), value.size());
+	for (const Bytes& c : children) { align4(b); putBytes(b, c.data(), c.size()); }
+	b[0] = (uint8_t)b.size(); b[1] = (uint8_t)(b.size() >> 8);
+	return b;
+}
+static Bytes versionString(const char16_t* key, const char16_t* value) {
+	Bytes v;
+	putText(v, value);
+	return versionBlock(key, 1, v, (uint16_t)(v.size() / 2), std::vector<Bytes>());
+}
+#pragma endregion
+
+#pragma region Inflating
+///////////////////////////////////////////////////////////////////////////////
+///// Inflating
+///////////////////////////////////////////////////////////////////////////////
+// A small and slow inflate (RFC 1951) to check what the compressor gives, it is independent of Deflate.cpp
+class Inflater {
+public:
+	Inflater(const uint8_t* data, size_t size, Bytes& out) : in(data), size(size), pos(0), bitbuf(0), bitcnt(0), bad(false), out(out) { }
+	/* Inflates all of the blocks, returns false if the stream is invalid */
+	bool inflate() {
+		bool last;
+		do {
+			last = this->bits(1) != 0;
+			uint32_t type = this->bits(2);
+			if (type == 0) { this->stored(); }
+			else if (type == 1) { this->fixed(); }
+			else if (type == 2) { this->dynamic(); }
+			else { this->bad = true; }
+		} while (!last && !this->bad);
+		return !this->bad;
+	}
+	size_t used() const { return this->pos; }
+
+private:
+	struct Huffman {
+		uint16_t count[16];
+		uint16_t symbol[320];
+	};
+	const uint8_t* in;
+	size_t size, pos;
+	uint32_t bitbuf;
+	int bitcnt;
+	bool bad;
+	Bytes& out;
+
+	uint32_t bits(int n) {
+		while (this->bitcnt < n) {
+			if (this->pos >= this->size) { this->bad = true; return 0; }
+			this->bitbuf |= (uint32_t)this->in[this->pos++] << this->bitcnt;
+			this->bitcnt += 8;
+		}
+		uint32_t x = this->bitbuf & ((1u << n) - 1);
+		this->bitbuf >>= n;
+		this->bitcnt -= n;
+		return x;
+	}
+	void stored() {
+		this->bitbuf = 0; this->bitcnt = 0;
+		if (this->size - this->pos < 4) { this->bad = true; return; }
+		uint16_t len = read16(this->in + this->pos), nlen = read16(this->in + this->pos + 2);
+		this->pos += 4;
+		if (len != (uint16_t)~nlen || this->size - this->pos < len) { this->bad = true; return; }
+		putBytes(this->out, this->in + this->pos, len);
+		this->pos += len;
+	}
+	static bool build(Huffman& h, const uint8_t* lengths, int n) {
+		memset(h.count, 0, sizeof(h.count));
+		for (int i = 0; i < n; i++) { h.count[lengths[i]]++; }
+		int left = 1;
+		for (int len = 1; len < 16; len++) { left = (left << 1) - h.count[len]; if (left < 0) { return false; } }
+		uint16_t offs[16] = { 0, 0 };
+		for (int len = 1; len < 15; len++) { offs[len + 1] = offs[len] + h.count[len]; }
+		for (int i = 0; i < n; i++) { if (lengths[i]) { h.symbol[offs[lengths[i]]++] = (uint16_t)i; } }
+		return true;
+	}
+	int decode(const Huffman& h) {
+		int code = 0, first = 0, index = 0;
+		for (int len = 1; len < 16; len++) {
+			code |= (int)this->bits(1);
+			int count = h.count[len];
+			if (code - count < first) { return h.symbol[index + (code - first)]; }
+			index += count; first += count;
+			first <<= 1; code <<= 1;
+			if (this->bad) { break; }
+		}
+		this->bad = true;
+		return -1;
+	}
+	void codes(const Huffman& lens, const Huffman& dists) {
+		static const uint16_t len_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const uint8_t len_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const uint16_t dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const uint8_t dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+		for (;;) {
+			int sym = this->decode(lens);
+			if (this->bad) { return; }
+			if (sym < 256) { this->out.push_back((uint8_t)sym); continue; }
+			if (sym == 256) { return; }
+			sym -= 257;
+			if (sym >= 29) { this->bad = true; return; }
+			size_t len = len_base[sym] + this->bits(len_extra[sym]);
+			int d = this->decode(dists);
+			if (this->bad || d >= 30) { this->bad = true; return; }
+			size_t dist = dist_base[d] + this->bits(dist_extra[d]);
+			if (dist > this->out.size()) { this->bad = true; return; }
+			for (size_t i = 0; i < len; i++) { this->out.push_back(this->out[this->out.size() - dist]); }
+		}
+	}
+	void fixed() {
+		uint8_t lengths[320];
+		int i = 0;
+		for (; i < 144; i++) { lengths[i] = 8; }
+		for (; i < 256; i++) { lengths[i] = 9; }
+		for (; i < 280; i++) { lengths[i] = 7; }
+		for (; i < 288; i++) { lengths[i] = 8; }
+		for (; i < 318; i++) { lengths[i] = 5; }
+		Huffman lens, dists;
+		build(lens, lengths, 288);
+		build(dists, lengths + 288, 30);
+		this->codes(lens, dists);
+	}
+	void dynamic() {
+		static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+		int nlen = (int)this->bits(5) + 257, ndist = (int)this->bits(5) + 1, ncode = (int)this->bits(4) + 4;
+		if (nlen > 286 || ndist > 30) { this->bad = true; return; }
+		uint8_t lengths[320] = { 0 };
+		for (int i = 0; i < ncode; i++) { lengths[order[i]] = (uint8_t)this->bits(3); }
+		Huffman lencode, distcode;
+		if (!build(lencode, lengths, 19)) { this->bad = true; return; }
+		int i = 0;
+		while (i < nlen + ndist && !this->bad) {
+			int sym = this->decode(lencode);
+			if (sym < 16) { lengths[i++] = (uint8_t)sym; continue; }
+			uint8_t len = 0;
+			int repeat;
+			if (sym == 16) { if (i == 0) { this->bad = true; return; } len = lengths[i - 1]; repeat = 3 + (int)this->bits(2); }
+			else if (sym == 17) { repeat = 3 + (int)this->bits(3); }
+			else { repeat = 11 + (int)this->bits(7); }
+			if (i + repeat > nlen + ndist) { this->bad = true; return; }
+			while (repeat--) { lengths[i++] = len; }
+		}
+		if (this->bad || lengths[256] == 0) { this->bad = true; return; }
+		if (!build(lencode, lengths, nlen) || !build(distcode, lengths + nlen, ndist)) { this->bad = true; return; }
+		this->codes(lencode, distcode);
+	}
+};
+
+/* Inflates a zlib stream (RFC 1950) and checks its header and Adler-32 checksum */
+static bool zlibDecompress(const uint8_t* data, size_t size, Bytes& out) {
+	if (size < 6 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20)) { return false; }
+	size_t start = out.size();
+	Inflater inf(data + 2, size - 2, out);
+	if (!inf.inflate() || size - 2 - inf.used() != 4) { return false; }
+	return read32be(data + 2 + inf.used()) == adler32(1, out.data() + start, out.size() - start);
+}
+
+/* Calculates the CRC-32 of PNG chunks */
+static uint32_t crc32(const uint8_t* data, size_t size) {
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < size; i++) {
+		crc ^= data[i];
+		for (int k = 0; k < 8; k++) { crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1))); }
+	}
+	return ~crc;
+}
+
+/* Decodes a PNG image with 8-bit RGB or RGBA pixels (the only ones the encoder writes) to RGBA, checking
+   the CRC of every chunk */
+static bool decodePNG(const Bytes& png, uint32_t& width, uint32_t& height, Bytes& rgba) {
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (png.size() < 8 || memcmp(png.data(), signature, 8) != 0) { return false; }
+	Bytes idat;
+	uint8_t color = 0;
+	bool ended = false;
+	for (size_t pos = 8; pos < png.size() && !ended; ) {
+		if (png.size() - pos < 12) { return false; }
+		uint32_t len = read32be(&png[pos]);
+		if (png.size() - pos - 12 < len) { return false; }
+		const uint8_t* type = &png[pos + 4], *data = type + 4;
+		if (crc32(type, len + 4) != read32be(data + len)) { return false; }
+		if (memcmp(type, "IHDR", 4) == 0) {
+			if (len != 13 || data[8] != 8 || (data[9] != 2 && data[9] != 6) || data[12] != 0) { return false; }
+			width = read32be(data); height = read32be(data + 4); color = data[9];
+		}
+		else if (memcmp(type, "IDAT", 4) == 0) { putBytes(idat, data, len); }
+		else if (memcmp(type, "IEND", 4) == 0) { ended = true; }
+		pos += 12 + len;
+	}
+	if (!ended || !color) { return false; }
+	Bytes raw;
+	if (!zlibDecompress(idat.data(), idat.size(), raw)) { return false; }
+	size_t bpp = color == 6 ? 4 : 3, stride = bpp * width;
+	if (raw.size() != (stride + 1) * height) { return false; }
+	Bytes prev(stride, 0), row(stride);
+	rgba.clear();
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t* line = &raw[y * (stride + 1)];
+		uint8_t filter = line[0];
+		for (size_t x = 0; x < stride; x++) {
+			int a = x >= bpp ? row[x - bpp] : 0, b = prev[x], c = x >= bpp ? prev[x - bpp] : 0;
+			int pred;
+			switch (filter) {
+			case 0: pred = 0; break;
+			case 1: pred = a; break;
+			case 2: pred = b; break;
+			case 3: pred = (a + b) / 2; break;
+			case 4: {
+				int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+				pred = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+				break;
+			}
+			default: return false;
+			}
+			row[x] = (uint8_t)(line[1 + x] + pred);
+		}
+		for (uint32_t x = 0; x < width; x++) {
+			putBytes(rgba, &row[x * bpp], 3);
+			rgba.push_back(bpp == 4 ? row[x * bpp + 3] : 0xFF);
+		}
+		prev = row;
+	}
+	return true;
+}
+#pragma endregion
+
+#pragma region Dumping
+///////////////////////////////////////////////////////////////////////////////
+///// Dumping
+///////////////////////////////////////////////////////////////////////////////
+/* Dumps every resource of a PE file in memory into a memory sink */
+static bool dumpToMemory(const Bytes& file, bool png, MemorySink& sink) {
+	PE::File pe(file.data(), file.size());
+	const PE::Rsrc* rsrc = pe.getResources();
+	if (!pe.isLoaded() || rsrc->isEmpty()) { return false; }
+	DumpOptions opts;
+	opts.sink = &sink;
+	opts.png = png;
+	const DumpContext ctx(rsrc, opts);
+	std::set<std::wstring> dirs;
+	for (const DumpTask& task : enumerateResources(rsrc, L"", dirs, opts)) { dumpResource(ctx, task); }
+	return true;
+}
+
+/* Finds a dumped resource, returns NULL if it was not dumped */
+static const MemorySink::Item* findItem(const MemorySink& sink, const wchar_t* type, const wchar_t* name, uint16_t lang) {
+	for (const MemorySink::Item& item : sink.items()) {
+		if (item.type == type && item.name == name && item.lang == lang) { return &item; }
+	}
+	return nullptr;
+}
+
+/* Every profile of the benchmark corpus is dumped and each output is checked against the resource it came
+   from: bitmaps get a file header, icon images an ICO header, groups all of their images, and everything
+   else is the same as the resource */
+static void testCorpus() {
+	for (size_t p = 0; p < corpus_profile_count; p++) {
+		Bytes file = generatePE(corpus_profiles[p], 1);
+		PE::File pe(file.data(), file.size());
+		CHECK(pe.isLoaded());
+		if (!pe.isLoaded()) { continue; }
+		const PE::Rsrc* rsrc = pe.getResources();
+		size_t expected = 0;
+		visitResources(rsrc, [&expected](resid, resid, uint16_t, const PE::ResourceLang*) { expected++; });
+		for (int png = 0; png < 2; png++) {
+			size_t dumped = 0, wrong = 0;
+			CallbackSink sink([&](const DumpContext&, const DumpTask& task, const DumpOutput& out) {
+				dumped++;
+				Bytes data;
+				for (const DataSpan& s : out.spans()) { putBytes(data, s.data, s.size); }
+				const uint8_t* src = (const uint8_t*)task.rsrc_lang->data();
+				size_t size = task.rsrc_lang->size();
+				std::wstring ext = out.ext;
+				bool ok;
+				if (ext == L"png") {
+					uint32_t w, h;
+					Bytes rgba;
+					ok = decodePNG(data, w, h, rgba) && w * h * 4 == rgba.size();
+				}
+				else if (ext == L"bmp") { ok = data.size() == size + 14 && memcmp(&data[14], src, size) == 0; }
+				else if (ext == L"ico" && task.type == RT_ICON) { ok = data.size() == size + 22 && memcmp(&data[22], src, size) == 0; }
+				else if (ext == L"ico") { ok = data.size() > 6 && read16(&data[4]) == read16(src + 4); }
+				else { ok = data.size() == size && memcmp(data.data(), src, size) == 0; }
+				if (!ok) { wrong++; }
+				return true;
+			});
+			DumpOptions opts;
+			opts.sink = &sink;
+			opts.png = png != 0;
+			const DumpContext ctx(rsrc, opts);
+			std::set<std::wstring> dirs;
+			for (const DumpTask& task : enumerateResources(rsrc, L"", dirs, opts)) { dumpResource(ctx, task); }
+			CHECK(dumped == expected);
+			CHECK(wrong == 0);
+		}
+	}
+}
+
+/* A small PE file with one of each kind of resource is dumped and the outputs are checked byte for byte */
+static void testKnownOutputs() {
+	SyntheticPE syn;
+	// a 2x2 24-bit bitmap, each row is padded to 8 bytes
+	const uint8_t pixels[16] = { 0, 0, 255, 0, 255, 0, 0, 0, 255, 0, 0, 255, 255, 255, 0, 0 };
+	Bytes bitmap = makeDIB(2, 2, 24, 0, Bytes(), Bytes(pixels, pixels + 16));
+	syn.add(RT_BITMAP, MAKEINTRESOURCE(1), 1033, bitmap);
+	// two icons in a group
+	Bytes red = makeIcon(0xFFFF0000), blue = makeIcon(0x800000FF);
+	syn.add(RT_ICON, MAKEINTRESOURCE(1), 1033, red);
+	syn.add(RT_ICON, MAKEINTRESOURCE(2), 1033, blue);
+	Bytes group;
+	put16(group, 0); put16(group, 1); put16(group, 2);
+	for (uint16_t id = 1; id <= 2; id++) {
+		group.push_back(2); group.push_back(2); group.push_back(0); group.push_back(0);
+		put16(group, 1); put16(group, 32); put32(group, (uint32_t)red.size()); put16(group, id);
+	}
+	syn.add(RT_GROUP_ICON, L"MAIN", 1033, group);
+	const char manifest[] = "<assembly/>";
+	syn.add(RT_MANIFEST, MAKEINTRESOURCE(1), 1033, Bytes(manifest, manifest + sizeof(manifest) - 1));
+	syn.add(RT_RCDATA, MAKEINTRESOURCE(7), 1033, Bytes{ 1, 2, 3 });
+	syn.add(L"CUSTOM", L"DATA", 1031, Bytes{ 4, 5 });
+	syn.add(L"CUSTOM", L"DATA", 1033, Bytes{ 6 });
+	// a manifest that is not XML is dumped as binary
+	syn.add(RT_MANIFEST, MAKEINTRESOURCE(2), 1033, Bytes{ 'x' });
+	Bytes file = syn.build();
+
+	MemorySink sink;
+	CHECK(dumpToMemory(file, false, sink));
+	CHECK(sink.items().size() == syn.count());
+
+	const MemorySink::Item* item = findItem(sink, L"BITMAP", L"1", 1033);
+	CHECK(item && item->ext == L"bmp");
+	if (item) {
+		Bytes expected;
+		put16(expected, 0x4D42); put32(expected, (uint32_t)(bitmap.size() + 14)); put32(expected, 0); put32(expected, 14 + 40);
+		putBytes(expected, bitmap.data(), bitmap.size());
+		CHECK(item->data == expected);
+	}
+
+	item = findItem(sink, L"ICON", L"2", 1033);
+	CHECK(item && item->ext == L"ico");
+	if (item) {
+		Bytes expected;
+		put16(expected, 0); put16(expected, 1); put16(expected, 1);
+		expected.push_back(2); expected.push_back(2); expected.push_back(0); expected.push_back(0);
+		put16(expected, 1); put16(expected, 32); put32(expected, (uint32_t)blue.size()); put32(expected, 22);
+		putBytes(expected, blue.data(), blue.size());
+		CHECK(item->data == expected);
+	}
+
+	item = findItem(sink, L"GROUP_ICON", L"MAIN", 1033);
+	CHECK(item && item->ext == L"ico");
+	if (item) {
+		Bytes expected;
+		put16(expected, 0); put16(expected, 1); put16(expected, 2);
+		for (uint32_t i = 0; i < 2; i++) {
+			expected.push_back(2); expected.push_back(2); expected.push_back(0); expected.push_back(0);
+			put16(expected, 1); put16(expected, 32); put32(expected, (uint32_t)red.size()); put32(expected, 6 + 2*16 + i * (uint32_t)red.size());
+		}
+		putBytes(expected, red.data(), red.size());
+		putBytes(expected, blue.data(), blue.size());
+		CHECK(item->data == expected);
+	}
+
+	item = findItem(sink, L"MANIFEST", L"1", 1033);
+	CHECK(item && item->ext == L"xml" && item->data == Bytes(manifest, manifest + sizeof(manifest) - 1));
+	item = findItem(sink, L"MANIFEST", L"2", 1033);
+	CHECK(item && item->ext == L"bin" && item->data == Bytes{ 'x' });
+	item = findItem(sink, L"RCDATA", L"7", 1033);
+	CHECK(item && item->ext == L"bin" && item->data == (Bytes{ 1, 2, 3 }));
+	item = findItem(sink, L"CUSTOM", L"DATA", 1031);
+	CHECK(item && item->data == (Bytes{ 4, 5 }));
+	item = findItem(sink, L"CUSTOM", L"DATA", 1033);
+	CHECK(item && item->data == Bytes{ 6 });
+
+	// with --png the bitmap and icon images become PNG images with the same pixels
+	MemorySink png_sink;
+	CHECK(dumpToMemory(file, true, png_sink));
+	item = findItem(png_sink, L"BITMAP", L"1", 1033);
+	CHECK(item && item->ext == L"png");
+	uint32_t w = 0, h = 0;
+	Bytes rgba;
+	CHECK(item && decodePNG(item->data, w, h, rgba));
+	const uint8_t top_down[16] = { 0, 0, 255, 255, 255, 255, 255, 255, 255, 0, 0, 255, 0, 255, 0, 255 };
+	CHECK(w == 2 && h == 2 && rgba == Bytes(top_down, top_down + 16));
+	item = findItem(png_sink, L"ICON", L"2", 1033);
+	CHECK(item && item->ext == L"png" && decodePNG(item->data, w, h, rgba));
+	CHECK(w == 2 && h == 2 && rgba.size() == 16 && rgba[0] == 0 && rgba[1] == 0 && rgba[2] == 0xFF && rgba[3] == 0x80);
+}
+
+/* The directories of a PE file do not have to be sorted, lookups must still find every resource */
+static void testUnsortedDirectory() {
+	SyntheticPE syn;
+	syn.add(RT_RCDATA, MAKEINTRESOURCE(1), 1033, Bytes{ 1 });
+	syn.add(RT_RCDATA, MAKEINTRESOURCE(2), 1033, Bytes{ 2 });
+	syn.add(RT_MANIFEST, MAKEINTRESOURCE(1), 1033, Bytes{ 3 });
+	Bytes file = syn.build();
+	// swap the two entries of the root directory, which is at the start of the only section
+	uint32_t nt = read32(&file[0x3C]);
+	uint32_t section = nt + 24 + read16(&file[nt + 20]);
+	uint32_t root = read32(&file[section + 20]);
+	CHECK(read16(&file[root + 14]) == 2);
+	std::swap_ranges(file.begin() + root + 16, file.begin() + root + 24, file.begin() + root + 24);
+
+	PE::File pe(file.data(), file.size());
+	CHECK(pe.isLoaded());
+	const PE::Rsrc* rsrc = pe.getResources();
+	CHECK(rsrc->types().size() == 2 && rsrc->types()[0].getType() == RT_MANIFEST);
+	const PE::ResourceLang* r = rsrc->find(RT_RCDATA, MAKEINTRESOURCE(2), 1033);
+	CHECK(r && r->size() == 1 && *(const uint8_t*)r->data() == 2);
+	r = rsrc->find(RT_MANIFEST, MAKEINTRESOURCE(1), 1033);
+	CHECK(r && *(const uint8_t*)r->data() == 3);
+	CHECK(rsrc->find(RT_RCDATA, MAKEINTRESOURCE(3), 1033) == nullptr);
+	CHECK(rsrc->find(RT_BITMAP, MAKEINTRESOURCE(1), 1033) == nullptr);
+
+	// data that is not a PE file is not loaded
+	Bytes junk(4096, 0);
+	junk[0] = 'M'; junk[1] = 'Z';
+	PE::File bad(junk.data(), junk.size());
+	CHECK(!bad.isLoaded() || bad.getResources()->isEmpty());
+}
+#pragma endregion
+
+#pragma region Decoders
+///////////////////////////////////////////////////////////////////////////////
+///// Decoders
+///////////////////////////////////////////////////////////////////////////////
+static void testStrings() {
+	Bytes table;
+	for (int i = 0; i < 16; i++) { putCounted(table, i == 0 ? u"Hello" : i == 3 ? u"Tab\t\"q\" é" : i == 15 ? u"\U0001F600" : u""); }
+	std::vector<StringRecord> records;
+	CHECK(decodeStringTable(2, 1033, table.data(), table.size(), records));
+	CHECK(records.size() == 3);
+	if (records.size() == 3) {
+		CHECK(records[0].id == 16 && records[0].lang == 1033 && records[0].text == "Hello");
+		CHECK(records[1].id == 19 && records[1].text == "Tab\t\"q\" \xC3\xA9");
+		CHECK(records[2].id == 31 && records[2].text == "\xF0\x9F\x98\x80");
+		std::string json;
+		appendJSONLine(json, records[1]);
+		CHECK(json == "{\"id\":19,\"lang\":1033,\"text\":\"Tab\\t\\\"q\\\" \xC3\xA9\"}\n");
+	}
+	// truncated tables, bundle 0, and an unpaired surrogate
+	records.clear();
+	CHECK(!decodeStringTable(1, 1033, table.data(), table.size() - 2, records));
+	CHECK(!decodeStringTable(0, 1033, table.data(), table.size(), records));
+	CHECK(records.empty());
+	std::string s;
+	const uint8_t lone[2] = { 0x00, 0xD8 };
+	appendUTF16(s, lone, 1);
+	CHECK(s == "\xEF\xBF\xBD");
+
+	// a message table with one block of an ANSI and a Unicode message and a block of a UTF-8 message
+	Bytes entries1, entries2;
+	put16(entries1, 12); put16(entries1, 0); putBytes(entries1, "Caf\xE9\0\0\0\0", 8);
+	put16(entries1, 16); put16(entries1, 1); putText(entries1, u"Uni"); put32(entries1, 0);
+	put16(entries2, 12); put16(entries2, 2); putBytes(entries2, "\xE2\x82\xAC!\0\0\0\0", 8);
+	Bytes mt;
+	put32(mt, 2);
+	put32(mt, 100); put32(mt, 101); put32(mt, 28);
+	put32(mt, 0x200); put32(mt, 0x200); put32(mt, 28 + (uint32_t)entries1.size());
+	putBytes(mt, entries1.data(), entries1.size());
+	putBytes(mt, entries2.data(), entries2.size());
+	records.clear();
+	CHECK(decodeMessageTable(1033, mt.data(), mt.size(), records));
+	CHECK(records.size() == 3);
+	if (records.size() == 3) {
+		CHECK(records[0].id == 100 && records[0].text == "Caf\xC3\xA9");
+		CHECK(records[1].id == 101 && records[1].text == "Uni");
+		CHECK(records[2].id == 0x200 && records[2].text == "\xE2\x82\xAC!");
+	}
+	// an entry that goes past the end, too many blocks, and blocks that all point at the same entries
+	records.clear();
+	CHECK(!decodeMessageTable(1033, mt.data(), mt.size() - 4, records));
+	Bytes many(mt);
+	many[0] = 0xFF;
+	CHECK(!decodeMessageTable(1033, many.data(), many.size(), records));
+	Bytes overlap;
+	const uint32_t blocks = 64;
+	put32(overlap, blocks);
+	for (uint32_t b = 0; b < blocks; b++) { put32(overlap, 1); put32(overlap, 2); put32(overlap, 4 + 12 * blocks); }
+	putBytes(overlap, entries1.data(), entries1.size());
+	CHECK(!decodeMessageTable(1033, overlap.data(), overlap.size(), records));
+	// a huge range of ids with only a few bytes of entries
+	Bytes range;
+	put32(range, 1); put32(range, 0); put32(range, 0xFFFFFFFF); put32(range, 16);
+	putBytes(range, entries1.data(), entries1.size());
+	CHECK(!decodeMessageTable(1033, range.data(), range.size(), records));
+	CHECK(records.empty());
+}
+
+static void testVersion() {
+	Bytes fixed;
+	const uint32_t values[13] = { 0xFEEF04BD, 0x00010000, 0x00020003, 0x00040005, 0x00020003, 0x00040005, 0x3F, 0, 0x40004, 2, 0, 0, 0 };
+	for (uint32_t v : values) { put32(fixed, v); }
+	Bytes translation;
+	put16(translation, 1033); put16(translation, 1200);
+	Bytes info = versionBlock(u"VS_VERSION_INFO", 0, fixed, (uint16_t)fixed.size(), {
+		versionBlock(u"StringFileInfo", 1, Bytes(), 0, {
+			versionBlock(u"040904B0", 1, Bytes(), 0, { versionString(u"CompanyName", u"Contoso \"Ltd\""), versionString(u"FileVersion", u"2.3.4.5") })
+		}),
+		versionBlock(u"VarFileInfo", 1, Bytes(), 0, { versionBlock(u"Translation", 0, translation, 4, std::vector<Bytes>()) })
+	});
+	VersionInfo v;
+	CHECK(decodeVersionInfo(info.data(), info.size(), v));
+	CHECK(v.has_fixed && v.file_version_ms == 0x00020003 && v.file_version_ls == 0x00040005 && v.type == 2);
+	CHECK(v.tables.size() == 1 && v.tables[0].key.len == 8 && v.tables[0].strings.size() == 2);
+	CHECK(v.translations.size() == 1 && v.translations[0] == (1033 | (1200u << 16)));
+	if (v.tables.size() == 1 && v.tables[0].strings.size() == 2) {
+		const VersionInfo::String& str = v.tables[0].strings[0];
+		CHECK(fromUTF16(str.key.data, str.key.len) == L"CompanyName" && fromUTF16(str.value.data, str.value.len) == L"Contoso \"Ltd\"");
+	}
+	std::string json;
+	appendVersionJSON(json, v, 1033);
+	CHECK(json.find("\"CompanyName\":\"Contoso \\\"Ltd\\\"\"") != std::string::npos);
+	CHECK(json.find("2.3.4.5") != std::string::npos);
+	CHECK(json.back() == '\n');
+
+	// truncated info, a block longer than the resource, and a block without the end of its key
+	CHECK(!decodeVersionInfo(info.data(), 4, v));
+	Bytes longer(info);
+	longer[0] = 0xFF; longer[1] = 0x7F;
+	CHECK(!decodeVersionInfo(longer.data(), longer.size(), v));
+	Bytes unterminated;
+	put16(unterminated, 10); put16(unterminated, 0); put16(unterminated, 0); put16(unterminated, 'V'); put16(unterminated, 'S');
+	CHECK(!decodeVersionInfo(unterminated.data(), unterminated.size(), v));
+}
+
+static void testResourceScript() {
+	Bytes menu;
+	put16(menu, 0); put16(menu, 0);
+	put16(menu, 0x10 | 0x80); putText(menu, u"&File");
+	put16(menu, 0); put16(menu, 100); putText(menu, u"&Open\tCtrl+O");
+	put16(menu, 0); put16(menu, 0); putText(menu, u"");
+	put16(menu, 0x80); put16(menu, 101); putText(menu, u"E&xit \"now\"");
+	std::string s;
+	CHECK(appendMenuScript(s, MAKEINTRESOURCE(1), menu.data(), menu.size()));
+	CHECK(s ==
+		"1 MENU\n"
+		"BEGIN\n"
+		"    POPUP \"&File\"\n"
+		"    BEGIN\n"
+		"        MENUITEM \"&Open\\tCtrl+O\", 100\n"
+		"        MENUITEM SEPARATOR\n"
+		"        MENUITEM \"E&xit \"\"now\"\"\", 101\n"
+		"    END\n"
+		"END\n\n");
+
+	Bytes accel;
+	put16(accel, 1 | 8); put16(accel, 'O'); put16(accel, 100); put16(accel, 0);
+	put16(accel, 0x80); put16(accel, 'a'); put16(accel, 101); put16(accel, 0);
+	s.clear();
+	CHECK(appendAcceleratorScript(s, L"KEYS", accel.data(), accel.size()));
+	CHECK(s ==
+		"KEYS ACCELERATORS\n"
+		"BEGIN\n"
+		"    \"O\", 100, VIRTKEY, CONTROL\n"
+		"    \"a\", 101, ASCII\n"
+		"END\n\n");
+
+	Bytes table;
+	for (int i = 0; i < 16; i++) { putCounted(table, i == 1 ? u"Second \"one\"" : u""); }
+	s.clear();
+	CHECK(appendStringTableScript(s, 3, table.data(), table.size()));
+	CHECK(s == "    33, \"Second \"\"one\"\"\"\n");
+
+	Bytes dialog;
+	put32(dialog, 0x80C80000); put32(dialog, 0); put16(dialog, 1);
+	put16(dialog, 10); put16(dialog, 20); put16(dialog, 200); put16(dialog, 100);
+	put16(dialog, 0); put16(dialog, 0); putText(dialog, u"About");
+	align4(dialog);
+	put32(dialog, 0x50010001); put32(dialog, 0);
+	put16(dialog, 5); put16(dialog, 6); put16(dialog, 50); put16(dialog, 14); put16(dialog, 1);
+	put16(dialog, 0xFFFF); put16(dialog, 0x80); putText(dialog, u"OK"); put16(dialog, 0);
+	s.clear();
+	CHECK(appendDialogScript(s, MAKEINTRESOURCE(100), dialog.data(), dialog.size()));
+	CHECK(s.compare(0, 32, "100 DIALOG 10, 20, 200, 100\nSTYL") == 0);
+	CHECK(s.find("CAPTION \"About\"") != std::string::npos);
+	CHECK(s.find("\"OK\", 1,") != std::string::npos);
+
+	// truncated and malformed resources give nothing
+	s.clear();
+	CHECK(!appendMenuScript(s, MAKEINTRESOURCE(1), menu.data(), menu.size() - 4));
+	CHECK(!appendAcceleratorScript(s, MAKEINTRESOURCE(1), accel.data(), 6));
+	CHECK(!appendStringTableScript(s, 3, table.data(), 5));
+	CHECK(!appendDialogScript(s, MAKEINTRESOURCE(1), dialog.data(), 20));
+	CHECK(s.empty());
+}
+
+static void testDeflate() {
+	const char* wiki = "Wikipedia";
+	CHECK(adler32(1, wiki, strlen(wiki)) == 0x11E60398);
+	uint32_t seed = 1;
+	const size_t sizes[] = { 0, 1, 100, 65535, 65536, 70000, 1 << 20 };
+	for (size_t size : sizes) {
+		for (int kind = 0; kind < 4; kind++) {
+			Bytes data(size);
+			for (size_t i = 0; i < size; i++) {
+				seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+				data[i] = kind == 0 ? (uint8_t)seed : kind == 1 ? (uint8_t)(seed % 4) : kind == 2 ? (uint8_t)(i / 100) : 0;
+			}
+			Bytes z, back;
+			zlibCompress(data.data(), data.size(), z);
+			CHECK(zlibDecompress(z.data(), z.size(), back) && back == data);
+			if (kind == 3 && size > 1000) { CHECK(z.size() < size / 100); }
+			if (kind == 0) { CHECK(z.size() <= size + size / 1000 + 32); }
+		}
+	}
+}
+
+/* Converts a DIB to a PNG image, returns false if it cannot be converted */
+static bool encodePNG(const void* dib, size_t size, bool icon, Bytes& png) {
+	size_t png_size = 0;
+	uint8_t* data = dib2png(dib, size, icon, png_size);
+	if (!data) { return false; }
+	png.assign(data, data + png_size);
+	free(data);
+	return true;
+}
+
+static void testPNG() {
+	// a 3x2 24-bit bitmap has rows padded from 9 to 12 bytes
+	Bytes pixels;
+	for (int i = 0; i < 24; i++) { pixels.push_back((uint8_t)(i * 10)); }
+	Bytes dib = makeDIB(3, 2, 24, 0, Bytes(), pixels);
+	Bytes png, rgba;
+	uint32_t w = 0, h = 0;
+	CHECK(encodePNG(dib.data(), dib.size(), false, png));
+	CHECK(decodePNG(png, w, h, rgba) && w == 3 && h == 2);
+	Bytes expected;
+	for (int y = 1; y >= 0; y--) {
+		for (int x = 0; x < 3; x++) {
+			const uint8_t* p = &pixels[y * 12 + x * 3];
+			expected.push_back(p[2]); expected.push_back(p[1]); expected.push_back(p[0]); expected.push_back(0xFF);
+		}
+	}
+	CHECK(rgba == expected);
+	Bytes rows;
+	uint32_t dw = 0, dh = 0;
+	CHECK(decodeDIB(dib.data(), dib.size(), false, dw, dh, [&rows, &dw](const uint8_t* row) { putBytes(rows, row, dw * 4); }));
+	CHECK(dw == 3 && dh == 2 && rows == expected);
+
+	// an 8-bit bitmap with a palette
+	Bytes palette;
+	put32(palette, 0x00FF0000); put32(palette, 0x0000FF00);
+	const uint8_t indices[8] = { 1, 0, 0, 0, 0, 1, 0, 0 };
+	dib = makeDIB(2, 2, 8, 0, palette, Bytes(indices, indices + 8));
+	CHECK(encodePNG(dib.data(), dib.size(), false, png));
+	const uint8_t pal_rgba[16] = { 0xFF, 0, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0xFF, 0, 0, 0xFF };
+	CHECK(decodePNG(png, w, h, rgba) && rgba == Bytes(pal_rgba, pal_rgba + 16));
+
+	// a 24-bit icon gets its transparency from the AND mask
+	Bytes icon_pixels(2 * 8, 0x40);
+	put32(icon_pixels, 0x00000000); put32(icon_pixels, 0x00000080); // bottom row opaque, top row has the first pixel transparent
+	dib = makeDIB(2, 4, 24, 0, Bytes(), icon_pixels);
+	CHECK(encodePNG(dib.data(), dib.size(), true, png));
+	CHECK(decodePNG(png, w, h, rgba) && w == 2 && h == 2 && rgba.size() == 16);
+	if (rgba.size() == 16) { CHECK(rgba[3] == 0 && rgba[7] == 0xFF && rgba[11] == 0xFF && rgba[15] == 0xFF); }
+
+	// compressed, truncated, and absurdly large DIBs are rejected
+	dib = makeDIB(2, 2, 8, 1 /* BI_RLE8 */, palette, Bytes(indices, indices + 8));
+	CHECK(!encodePNG(dib.data(), dib.size(), false, png));
+	dib = makeDIB(3, 2, 24, 0, Bytes(), pixels);
+	CHECK(!encodePNG(dib.data(), dib.size() - 4, false, png));
+	CHECK(!encodePNG(dib.data(), 20, false, png));
+	dib = makeDIB(0x7FFFFFFF, 0x7FFFFFFF, 24, 0, Bytes(), pixels);
+	CHECK(!encodePNG(dib.data(), dib.size(), false, png));
+}
+#pragma endregion
+
+#pragma region Files
+///////////////////////////////////////////////////////////////////////////////
+///// Files
+///////////////////////////////////////////////////////////////////////////////
+static const std::wstring test_dir = L"test_output";
+
+/* Writes a corrupted copy of a file: cut to the size or with the byte at the offset changed */
+static bool corrupt(const std::wstring& from, const std::wstring& to, size_t size, size_t offset = (size_t)-1) {
+	FILE* f = openFile(from, "rb");
+	if (!f) { return false; }
+	Bytes data(size);
+	size = fread(data.data(), 1, size, f);
+	fclose(f);
+	data.resize(size);
+	if (offset < size) { data[offset] ^= 0xFF; }
+	return writeFile(to, data.data(), data.size());
+}
+
+/* Outputs large enough to be streamed release the pages of a mapped file once they are written, but never
+   memory that the caller gave, and a sink that reads the output after it was hashed gets all of the data */
+static void testStreamed() {
+	SyntheticPE syn;
+	Bytes big(DumpOutput::STREAM_THRESHOLD + 4096);
+	for (size_t i = 0; i < big.size(); i++) { big[i] = (uint8_t)(i * 7 + (i >> 12)); }
+	syn.add(RT_RCDATA, MAKEINTRESOURCE(1), 1033, big);
+	Bytes file = syn.build(), copy = file;
+
+	// in memory, with a search index so the output is hashed before the sink copies it
+	SearchIndexWriter index;
+	index.load(test_dir + PATH_SEP + L"streamed.idx");
+	MemorySink sink;
+	{
+		PE::File pe(file.data(), file.size());
+		CHECK(pe.isLoaded() && !pe.getResources()->isMapped());
+		DumpOptions opts;
+		opts.sink = &sink;
+		opts.index = &index;
+		const DumpContext ctx(pe.getResources(), opts);
+		std::set<std::wstring> dirs;
+		for (const DumpTask& task : enumerateResources(pe.getResources(), L"", dirs, opts)) { dumpResource(ctx, task); }
+	}
+	CHECK(file == copy);
+	CHECK(sink.items().size() == 1 && sink.items()[0].data == big);
+
+	// from a mapped file, where the pages are released and read again
+	const std::wstring path = test_dir + PATH_SEP + L"streamed.dll";
+	CHECK(writeFile(path, file.data(), file.size()));
+	MemorySink mapped;
+	DumpOptions opts;
+	opts.sink = &mapped;
+	opts.index = &index;
+	CHECK(dumpFile(path, L"", opts) == 0);
+	CHECK(mapped.items().size() == 1 && mapped.items()[0].data == big);
+}
+
+/* Names that have the same filename each get a suffix in the order of the file, no matter which thread
+   writes first */
+static void testDuplicateNames() {
+	SyntheticPE syn;
+	const wchar_t* const names[] = { L"1", L"a:b", L"a?b", L"a_b~1" };
+	for (uint8_t i = 0; i < ARRAYSIZE(names); i++) { syn.add(RT_RCDATA, names[i], 1033, Bytes(8, i)); }
+	syn.add(RT_RCDATA, MAKEINTRESOURCE(1), 1033, Bytes(8, 9));
+	Bytes file = syn.build();
+	const std::wstring path = test_dir + PATH_SEP + L"duplicates.dll", dir = test_dir + PATH_SEP + L"duplicates";
+	CHECK(writeFile(path, file.data(), file.size()));
+	CHECK(createDirectory(dir));
+	DumpOptions opts;
+	opts.jobs = 4;
+	CHECK(dumpFile(path, dir, opts) == 0);
+
+	// the string names come before the numbers, then each is in the order added
+	const wchar_t* const files[] = { L"1.bin", L"a_b.bin", L"a_b~1.bin", L"a_b~1~1.bin", L"1~1.bin" };
+	const uint8_t values[] = { 0, 1, 2, 3, 9 };
+	for (size_t i = 0; i < ARRAYSIZE(files); i++) {
+		FILE* f = openFile(dir + PATH_SEP + L"RCDATA" + PATH_SEP + files[i], "rb");
+		CHECK(f);
+		if (!f) { continue; }
+		uint8_t data[16];
+		size_t n = fread(data, 1, sizeof(data), f);
+		fclose(f);
+		CHECK(n == 8 && data[0] == values[i] && data[7] == values[i]);
+	}
+}
+
+static void testArchive() {
+	const std::wstring path = test_dir + PATH_SEP + L"test.perd";
+	ArchiveWriter writer;
+	CHECK(writer.create(path));
+	const uint8_t a[3] = { 1, 2, 3 }, b[5] = { 4, 5, 6, 7, 8 };
+	DumpOutput out_a, out_b;
+	out_a.ext = L"bin"; out_a.add(a, 3);
+	out_b.ext = L"xml"; out_b.add(b, 2); out_b.add(b + 2, 3);
+	CHECK(writer.add(L"x.dll", RT_RCDATA, MAKEINTRESOURCE(5), 1033, out_a));
+	CHECK(writer.add(L"x.dll", RT_MANIFEST, MAKEINTRESOURCE(1), 0, out_b));
+	CHECK(writer.add(L"a.dll", L"CUSTOM", L"NAME", 1031, out_a));
+	CHECK(writer.close());
+
+	ArchiveReader reader;
+	CHECK(reader.open(path.c_str()));
+	CHECK(reader.count() == 3);
+	ArchiveReader::Entry e;
+	CHECK(reader.find("x.dll", "MANIFEST", "1", 0, e) && e.size == 5 && memcmp(e.data, b, 5) == 0 && strcmp(e.ext, "xml") == 0);
+	CHECK(e.hash == XXH64::hash(b, 5));
+	CHECK(reader.find("a.dll", "CUSTOM", "NAME", 1031, e) && e.size == 3 && memcmp(e.data, a, 3) == 0);
+	CHECK(reader.count() && strcmp(reader[0].file, "a.dll") == 0);
+	CHECK(!reader.find("x.dll", "RCDATA", "5", 1031, e));
+	CHECK(!reader.find("y.dll", "RCDATA", "5", 1033, e));
+
+	// a truncated archive and one with a broken footer are not valid
+	uint64_t size = 0, mtime;
+	CHECK(getFileInfo(path, size, mtime));
+	const std::wstring bad = test_dir + PATH_SEP + L"bad.perd";
+	ArchiveReader broken;
+	CHECK(corrupt(path, bad, (size_t)size - 1));
+	CHECK(!broken.open(bad.c_str()));
+	CHECK(corrupt(path, bad, (size_t)size, (size_t)size - 20));
+	CHECK(!broken.open(bad.c_str()));
+	CHECK(corrupt(path, bad, 0));
+	CHECK(!broken.open(bad.c_str()));
+}
+
+static void testSearchIndex() {
+	std::vector<std::string> tokens;
+	const char text[] = "Hello, WORLD hello x \xC3\xA9t\xC3\xA9";
+	tokenize(text, sizeof(text) - 1, tokens);
+	std::sort(tokens.begin(), tokens.end());
+	CHECK(tokens == (std::vector<std::string>{ "hello", "world", "\xC3\xA9t\xC3\xA9" }));
+
+	const std::wstring path = test_dir + PATH_SEP + L"test.idx";
+	removeFile(path);
+	const char manifest[] = "<assembly name=\"Contoso.App\"/>";
+	const uint8_t data[4] = { 9, 8, 7, 6 };
+	DumpOutput xml, bin;
+	xml.ext = L"xml"; xml.add(manifest, sizeof(manifest) - 1);
+	bin.ext = L"bin"; bin.add(data, 4);
+	{
+		SearchIndexWriter writer;
+		writer.load(path);
+		writer.begin(L"a.dll");
+		writer.add(L"a.dll", L"", RT_MANIFEST, MAKEINTRESOURCE(1), 1033, manifest, sizeof(manifest) - 1, xml);
+		writer.add(L"a.dll", L"", RT_RCDATA, MAKEINTRESOURCE(2), 1033, data, 4, bin);
+		writer.begin(L"b.dll");
+		writer.add(L"b.dll", L"RCDATA/1/0", RT_RCDATA, MAKEINTRESOURCE(3), 0, data, 4, bin);
+		CHECK(writer.save() && writer.count() == 3);
+	}
+	SearchIndexReader reader;
+	CHECK(reader.open(path.c_str()) && reader.count() == 3);
+	std::vector<size_t> found;
+	reader.findHash(XXH64::hash(data, 4), found);
+	CHECK(found.size() == 2);
+	found.clear();
+	reader.findText("contoso app", found);
+	CHECK(found.size() == 1 && found.size() && strcmp(reader[found[0]].type, "MANIFEST") == 0);
+	found.clear();
+	reader.findText("missing", found);
+	CHECK(found.empty());
+	bool embedded = false;
+	for (size_t i = 0; i < reader.count(); i++) { embedded |= strcmp(reader[i].embedded, "RCDATA/1/0") == 0; }
+	CHECK(embedded);
+
+	// dumping a file again replaces its entries and keeps the others
+	{
+		SearchIndexWriter writer;
+		writer.load(path);
+		writer.begin(L"a.dll");
+		writer.add(L"a.dll", L"", RT_RCDATA, MAKEINTRESOURCE(2), 1033, data, 4, bin);
+		CHECK(writer.save() && writer.count() == 2);
+	}
+	SearchIndexReader again;
+	CHECK(again.open(path.c_str()) && again.count() == 2);
+	found.clear();
+	again.findText("contoso", found);
+	CHECK(found.empty());
+
+	uint64_t size = 0, mtime;
+	CHECK(getFileInfo(path, size, mtime));
+	const std::wstring bad = test_dir + PATH_SEP + L"bad.idx";
+	SearchIndexReader broken;
+	CHECK(corrupt(path, bad, (size_t)size - 8));
+	CHECK(!broken.open(bad.c_str()));
+	CHECK(corrupt(path, bad, (size_t)size, (size_t)size - 12));
+	CHECK(!broken.open(bad.c_str()));
+}
+#pragma endregion
+
+int wmain(int argc, const wchar_t *argv[]) {
+	if (!createDirectory(test_dir)) { ReportLastError(L"Cannot create directory '" + test_dir + L"'"); return 1; }
+	testCorpus();
+	testKnownOutputs();
+	testUnsortedDirectory();
+	testStrings();
+	testVersion();
+	testResourceScript();
+	testDeflate();
+	testPNG();
+	testStreamed();
+	testDuplicateNames();
+	testArchive();
+	testSearchIndex();
+	if (failures) { std::wcerr << failures << L" checks failed" << std::endl; }
+	else { std::wcout << L"All tests passed" << std::endl; }
+	return failures ? 1 : 0;
+}
+
+#ifndef _WIN32
+// Everywhere besides Windows the arguments are converted from UTF-8
+int main(int argc, char *argv[]) {
+	setlocale(LC_ALL, "");
+	std::vector<std::wstring> args;
+	std::vector<const wchar_t*> wargv;
+	for (int i = 0; i < argc; i++) { args.push_back(fromUTF8(argv[i], strlen(argv[i]))); }
+	for (int i = 0; i < argc; i++) { wargv.push_back(args[i].c_str()); }
+	return wmain(argc, wargv.data());
+}
+#endif
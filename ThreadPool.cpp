@@ -0,0 +1,101 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+// The pool and worker index of the current thread, used to submit tasks from tasks to their own queue
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+ThreadPool::ThreadPool(unsigned int threads) : queued(0), next(0), pending(0), stopping(false) {
+	if (threads == 0) { threads = std::max(std::thread::hardware_concurrency(), 1u); }
+	for (unsigned int i = 0; i < threads; i++) { this->queues.emplace_back(new Queue()); }
+	for (unsigned int i = 0; i < threads; i++) { this->threads.emplace_back(&ThreadPool::run, this, (size_t)i); }
+}
+
+ThreadPool::~ThreadPool() {
+	this->wait();
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->cv_work.notify_all();
+	for (std::thread& t : this->threads) { t.join(); }
+}
+
+void ThreadPool::submit(Task task) {
+	size_t q = (current_pool == this) ? current_worker : (this->next++ % this->queues.size());
+	{
+		// counted before it is queued so the count never drops below zero when it is taken right away
+		std::lock_guard<std::mutex> lock(this->mutex);
+		++this->pending;
+		++this->queued;
+	}
+	{
+		std::lock_guard<std::mutex> lock(this->queues[q]->mutex);
+		this->queues[q]->tasks.push_back(std::move(task));
+	}
+	this->cv_work.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->cv_done.wait(lock, [this] { return this->pending == 0; });
+}
+
+bool ThreadPool::pop(size_t self, Task& task) {
+	// Newest task from our own queue
+	{
+		Queue& q = *this->queues[self];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+			--this->queued;
+			return true;
+		}
+	}
+	// Oldest task from someone else's queue
+	for (size_t i = 1; i < this->queues.size(); i++) {
+		Queue& q = *this->queues[(self + i) % this->queues.size()];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+			--this->queued;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::run(size_t self) {
+	current_pool = this;
+	current_worker = self;
+	for (;;) {
+		Task task;
+		if (this->pop(self, task)) {
+			task();
+			std::lock_guard<std::mutex> lock(this->mutex);
+			if (--this->pending == 0) { this->cv_done.notify_all(); }
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->cv_work.wait(lock, [this] { return this->stopping || this->queued != 0; });
+		if (this->stopping && this->queued == 0) { return; }
+	}
+}
@@ -0,0 +1,68 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// A work-stealing thread pool used for dumping resources in parallel
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Each worker has its own queue of tasks. Workers take tasks from the back of their own queue and when
+// it is empty they steal from the front of the other queues. Tasks submitted from inside a task go to
+// the queue of the current worker, others are spread across all of the queues.
+class ThreadPool {
+public:
+	typedef std::function<void()> Task;
+
+	// Creates a pool with the given number of threads, 0 means one per hardware thread
+	explicit ThreadPool(unsigned int threads);
+	// Waits for all tasks to finish then stops all threads
+	~ThreadPool();
+
+	void submit(Task task);
+	// Waits until every submitted task (including those submitted by other tasks) has finished
+	void wait();
+
+	unsigned int size() const { return (unsigned int)this->threads.size(); }
+
+private:
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void run(size_t self);
+	bool pop(size_t self, Task& task);
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable cv_work, cv_done;
+	std::atomic<size_t> queued, next;
+	size_t pending; // tasks submitted but not yet finished, protected by mutex
+	bool stopping;
+};
@@ -0,0 +1,170 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "stdafx.h"
+#include "Version.h"
+#include "Strings.h"
+
+#include <stdio.h>
+
+#define VS_FFI_SIGNATURE   0xFEEF04BD
+#define FIXED_FILE_INFO_SIZE 52
+
+static inline uint16_t read16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t read32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+// Every part of version info is a block: its length, the length of its value, its type (1 for text, where
+// the value length is in characters instead of bytes), and its null-terminated key, followed by the value and
+// then the children. The value and the children are aligned to 4 bytes from the start of the resource.
+struct Block {
+	VersionInfo::Text key;
+	const uint8_t* value;
+	size_t value_size; // in bytes
+	uint16_t type;
+	const uint8_t* children, *end;
+};
+
+static inline const uint8_t* align4(const uint8_t* base, const uint8_t* p) { return base + ((p - base + 3) & ~(size_t)3); }
+
+/* Reads the block at p, fails if it does not fit before end */
+static bool readBlock(const uint8_t* base, const uint8_t* p, const uint8_t* end, Block& b) {
+	if (end - p < 6) { return false; }
+	size_t length = read16(p), value_len = read16(p + 2);
+	b.type = read16(p + 4);
+	if (length < 6 || length > (size_t)(end - p)) { return false; }
+	b.end = p + length;
+	b.key.data = p + 6;
+	const uint8_t* q = b.key.data;
+	while (b.end - q >= 2 && read16(q) != 0) { q += 2; }
+	if (b.end - q < 2) { return false; }
+	b.key.len = (q - b.key.data) / 2;
+	b.value = align4(base, q + 2);
+	if (b.value > b.end) { b.value = b.end; }
+	// some files have the length of text values in bytes, the value never goes past the block
+	b.value_size = std::min(b.type == 1 ? 2 * value_len : value_len, (size_t)(b.end - b.value));
+	b.children = align4(base, b.value + b.value_size);
+	if (b.children > b.end) { b.children = b.end; }
+	return true;
+}
+
+/* Checks if a key is the given ASCII text */
+static bool keyIs(const VersionInfo::Text& key, const char* s) {
+	size_t len = strlen(s);
+	if (key.len != len) { return false; }
+	for (size_t i = 0; i < len; i++) { if (read16(key.data + 2*i) != (uint8_t)s[i]) { return false; } }
+	return true;
+}
+
+/* Gets the text of a block's value without the null terminator */
+static VersionInfo::Text textValue(const Block& b) {
+	VersionInfo::Text t = { b.value, b.value_size / 2 };
+	while (t.len && read16(t.data + 2*(t.len-1)) == 0) { --t.len; }
+	return t;
+}
+
+bool decodeVersionInfo(const void* data, size_t size, VersionInfo& info) {
+	const uint8_t* base = (const uint8_t*)data, *end = base + size;
+	Block root;
+	if (!readBlock(base, base, end, root) || !keyIs(root.key, "VS_VERSION_INFO")) { return false; }
+
+	info.has_fixed = root.value_size >= FIXED_FILE_INFO_SIZE && read32(root.value) == VS_FFI_SIGNATURE;
+	if (info.has_fixed) {
+		const uint8_t* v = root.value;
+		info.file_version_ms = read32(v + 8); info.file_version_ls = read32(v + 12);
+		info.product_version_ms = read32(v + 16); info.product_version_ls = read32(v + 20);
+		info.flags_mask = read32(v + 24); info.flags = read32(v + 28);
+		info.os = read32(v + 32); info.type = read32(v + 36); info.subtype = read32(v + 40);
+		info.date_ms = read32(v + 44); info.date_ls = read32(v + 48);
+	}
+
+	// a bad child ends its list of children but keeps everything decoded before it
+	Block child;
+	for (const uint8_t* p = root.children; readBlock(base, p, root.end, child); p = align4(base, child.end)) {
+		if (keyIs(child.key, "StringFileInfo")) {
+			Block table;
+			for (const uint8_t* q = child.children; readBlock(base, q, child.end, table); q = align4(base, table.end)) {
+				VersionInfo::Table t;
+				t.key = table.key;
+				Block str;
+				for (const uint8_t* r = table.children; readBlock(base, r, table.end, str); r = align4(base, str.end)) {
+					VersionInfo::String s = { str.key, textValue(str) };
+					t.strings.push_back(s);
+				}
+				info.tables.push_back(std::move(t));
+			}
+		}
+		else if (keyIs(child.key, "VarFileInfo")) {
+			Block var;
+			for (const uint8_t* q = child.children; readBlock(base, q, child.end, var); q = align4(base, var.end)) {
+				if (!keyIs(var.key, "Translation")) { continue; }
+				for (size_t i = 0; i + 4 <= var.value_size; i += 4) { info.translations.push_back(read16(var.value + i) | ((uint32_t)read16(var.value + i + 2) << 16)); }
+			}
+		}
+	}
+	return true;
+}
+
+static void appendText(std::string& s, const VersionInfo::Text& t) {
+	std::string utf8;
+	appendUTF16(utf8, t.data, t.len);
+	appendJSONString(s, utf8.data(), utf8.size());
+}
+
+static void appendVersion(std::string& s, const char* name, uint32_t ms, uint32_t ls) {
+	char buf[64];
+	snprintf(buf, sizeof(buf), ",\"%s\":\"%u.%u.%u.%u\"", name, ms >> 16, ms & 0xFFFF, ls >> 16, ls & 0xFFFF);
+	s += buf;
+}
+
+void appendVersionFields(std::string& s, const VersionInfo& info, uint16_t lang) {
+	s += "\"lang\":";
+	s += std::to_string(lang);
+	if (info.has_fixed) {
+		char buf[160];
+		appendVersion(s, "file_version", info.file_version_ms, info.file_version_ls);
+		appendVersion(s, "product_version", info.product_version_ms, info.product_version_ls);
+		snprintf(buf, sizeof(buf), ",\"flags\":%u,\"os\":%u,\"type\":%u,\"subtype\":%u,\"date\":%llu",
+			info.flags & info.flags_mask, info.os, info.type, info.subtype, ((unsigned long long)info.date_ms << 32) | info.date_ls);
+		s += buf;
+	}
+	s += ",\"translations\":[";
+	for (size_t i = 0; i < info.translations.size(); i++) {
+		if (i) { s += ','; }
+		s += "{\"lang\":" + std::to_string(info.translations[i] & 0xFFFF) + ",\"codepage\":" + std::to_string(info.translations[i] >> 16) + "}";
+	}
+	s += "],\"strings\":{";
+	for (size_t i = 0; i < info.tables.size(); i++) {
+		const VersionInfo::Table& t = info.tables[i];
+		if (i) { s += ','; }
+		appendText(s, t.key);
+		s += ":{";
+		for (size_t j = 0; j < t.strings.size(); j++) {
+			if (j) { s += ','; }
+			appendText(s, t.strings[j].key);
+			s += ':';
+			appendText(s, t.strings[j].value);
+		}
+		s += '}';
+	}
+	s += '}';
+}
+
+void appendVersionJSON(std::string& s, const VersionInfo& info, uint16_t lang) {
+	s += '{';
+	appendVersionFields(s, info, lang);
+	s += "}\n";
+}
@@ -0,0 +1,55 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// A decoder for version info (RT_VERSION) resources. The decoded info points into the resource data for all
+// of its text so nothing is copied until it is written out.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct VersionInfo {
+	// Text in the resource data, little-endian UTF-16 that may be unaligned
+	struct Text {
+		const uint8_t* data;
+		size_t len; // in characters
+	};
+	struct String { Text key, value; };
+	// A StringFileInfo table, the key is the language and code page in hex (like 040904B0)
+	struct Table {
+		Text key;
+		std::vector<String> strings;
+	};
+
+	// VS_FIXEDFILEINFO, only set if has_fixed is true
+	bool has_fixed;
+	uint32_t file_version_ms, file_version_ls, product_version_ms, product_version_ls;
+	uint32_t flags_mask, flags, os, type, subtype, date_ms, date_ls;
+
+	std::vector<Table> tables;
+	std::vector<uint32_t> translations; // from VarFileInfo, each is the language in the low word and code page in the high word
+};
+
+// Decodes VS_VERSIONINFO from the resource data, including the fixed file info, StringFileInfo, and VarFileInfo
+bool decodeVersionInfo(const void* data, size_t size, VersionInfo& info);
+// Appends the version info as a single line of JSON
+void appendVersionJSON(std::string& s, const VersionInfo& info, uint16_t lang);
+// Appends the fields of the version info without the braces or newline, for adding them to other fields
+void appendVersionFields(std::string& s, const VersionInfo& info, uint16_t lang);
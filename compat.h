@@ -0,0 +1,126 @@
+// PEResourceDump: program for automated dumping of resources from pe-files
+// Copyright (C) 2019  Jeffrey Bush  jeff@coderforlife.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Includes windows.h on Windows, everywhere else it defines the small part of the Windows API that is used
+// for reading resources (types, resource IDs, bitmap structures, and error codes mapped to errno)
+
+#pragma once
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#define PATH_SEP L"\\"
+
+#else
+
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+
+#define PATH_SEP L"/"
+
+typedef uint8_t  BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t  LONG;
+typedef int      BOOL;
+typedef BYTE*    LPBYTE;
+typedef void*    LPVOID;
+typedef wchar_t* LPWSTR;
+typedef const wchar_t* LPCWSTR;
+typedef uintptr_t ULONG_PTR;
+
+#define MAKEINTRESOURCE(i) ((LPCWSTR)(ULONG_PTR)(WORD)(i))
+#define IS_INTRESOURCE(r)  ((((ULONG_PTR)(r)) >> 16) == 0)
+
+#define RT_CURSOR       MAKEINTRESOURCE(1)
+#define RT_BITMAP       MAKEINTRESOURCE(2)
+#define RT_ICON         MAKEINTRESOURCE(3)
+#define RT_MENU         MAKEINTRESOURCE(4)
+#define RT_DIALOG       MAKEINTRESOURCE(5)
+#define RT_STRING       MAKEINTRESOURCE(6)
+#define RT_FONTDIR      MAKEINTRESOURCE(7)
+#define RT_FONT         MAKEINTRESOURCE(8)
+#define RT_ACCELERATOR  MAKEINTRESOURCE(9)
+#define RT_RCDATA       MAKEINTRESOURCE(10)
+#define RT_MESSAGETABLE MAKEINTRESOURCE(11)
+#define RT_GROUP_CURSOR MAKEINTRESOURCE(12)
+#define RT_GROUP_ICON   MAKEINTRESOURCE(14)
+#define RT_VERSION      MAKEINTRESOURCE(16)
+#define RT_DLGINCLUDE   MAKEINTRESOURCE(17)
+#define RT_PLUGPLAY     MAKEINTRESOURCE(19)
+#define RT_VXD          MAKEINTRESOURCE(20)
+#define RT_ANICURSOR    MAKEINTRESOURCE(21)
+#define RT_ANIICON      MAKEINTRESOURCE(22)
+#define RT_HTML         MAKEINTRESOURCE(23)
+#define RT_MANIFEST     MAKEINTRESOURCE(24)
+
+#define ARRAYSIZE(a) (sizeof(a)/sizeof((a)[0]))
+#define UNREFERENCED_PARAMETER(p) (void)(p)
+#define LOWORD(l) ((WORD)((ULONG_PTR)(l) & 0xFFFF))
+
+// Errors are reported through errno
+#define ERROR_FILE_NOT_FOUND  ENOENT
+#define ERROR_ALREADY_EXISTS  EEXIST
+#define ERROR_MOD_NOT_FOUND   ENOENT
+#define ERROR_BAD_FORMAT      ENOEXEC
+#define ERROR_OUTOFMEMORY     ENOMEM
+inline DWORD GetLastError() { return (DWORD)errno; }
+inline void SetLastError(DWORD err) { errno = (int)err; }
+
+#define BI_RGB       0
+#define BI_RLE8      1
+#define BI_RLE4      2
+#define BI_BITFIELDS 3
+
+#pragma pack(push, 2)
+typedef struct tagBITMAPFILEHEADER {
+	WORD  bfType;
+	DWORD bfSize;
+	WORD  bfReserved1;
+	WORD  bfReserved2;
+	DWORD bfOffBits;
+} BITMAPFILEHEADER;
+#pragma pack(pop)
+
+typedef struct tagBITMAPCOREHEADER {
+	DWORD bcSize;
+	WORD  bcWidth;
+	WORD  bcHeight;
+	WORD  bcPlanes;
+	WORD  bcBitCount;
+} BITMAPCOREHEADER;
+
+typedef struct tagBITMAPINFOHEADER {
+	DWORD biSize;
+	LONG  biWidth;
+	LONG  biHeight;
+	WORD  biPlanes;
+	WORD  biBitCount;
+	DWORD biCompression;
+	DWORD biSizeImage;
+	LONG  biXPelsPerMeter;
+	LONG  biYPelsPerMeter;
+	DWORD biClrUsed;
+	DWORD biClrImportant;
+} BITMAPINFOHEADER;
+
+#endif
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "general.h"
+#include "MappedFile.h"
 
 #include <iostream>
 #include <iomanip>
@@ -8,6 +9,20 @@
 #include <array>
 #include <algorithm>
 
+#ifndef _WIN32
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <glob.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+
+std::mutex output_mutex;
+
+#ifdef _WIN32
 std::wstring LastErrorString() {
 	DWORD err = GetLastError();
 	std::wstring str;
@@ -23,85 +38,484 @@ std::wstring LastErrorString() {
 	}
 	return str;
 }
+#else
+std::wstring LastErrorString() {
+	int err = errno;
+	const char* s = strerror(err);
+	return fromUTF8(s, strlen(s)) + L" [" + to_string(err) + L"]";
+}
+#endif
 
 void ReportLastError(const std::wstring& s) {
 	ReportLastError(s, false);
 }
 void ReportLastError(const std::wstring& s, bool warning) {
-	std::wcerr << (warning ? L"* Warning: " : L"! Error: ") << s << ": " << LastErrorString();
-}
-
-std::wstring getTypeName(PE::const_resid rid) {
-	if (!IS_INTRESOURCE(rid)) { return std::wstring(rid); }
-	else if (rid == RT_CURSOR) { return L"CURSOR"; }
-	else if (rid == RT_BITMAP) { return L"BITMAP"; }
-	else if (rid == RT_ICON) { return L"ICON"; }
-	else if (rid == RT_MENU) { return L"MENU"; }
-	else if (rid == RT_DIALOG) { return L"DIALOG"; }
-	else if (rid == RT_STRING) { return L"STRING"; }
-	else if (rid == RT_FONTDIR) { return L"FONTDIR"; }
-	else if (rid == RT_FONT) { return L"FONT"; }
-	else if (rid == RT_ACCELERATOR) { return L"ACCELERATOR"; }
-	else if (rid == RT_RCDATA) { return L"RCDATA"; }
-	else if (rid == RT_MESSAGETABLE) { return L"MESSAGETABLE"; }
-	else if (rid == RT_GROUP_ICON) { return L"GROUP_ICON"; }
-	else if (rid == RT_GROUP_CURSOR) { return L"GROUP_CURSOR"; }
-	else if (rid == RT_VERSION) { return L"VERSION"; }
-	else if (rid == RT_DLGINCLUDE) { return L"DLGINCLUDE"; }
-	else if (rid == RT_PLUGPLAY) { return L"PLUGPLAY"; }
-	else if (rid == RT_VXD) { return L"VXD"; }
-	else if (rid == RT_ANICURSOR) { return L"ANICURSOR"; }
-	else if (rid == RT_ANIICON) { return L"ANIICON"; }
-	else if (rid == RT_HTML) { return L"HTML"; }
-	else if (rid == RT_MANIFEST) { return L"MANIFEST"; }
-	else { return to_string((int)(intptr_t)rid); }
-}
-
-std::wstring getName(PE::const_resid rid) {
-	return IS_INTRESOURCE(rid) ? to_string((int)(intptr_t)rid) : std::wstring(rid);
+	std::wstring err = LastErrorString();
+	std::lock_guard<std::mutex> lock(output_mutex);
+	std::wcerr << (warning ? L"* Warning: " : L"! Error: ") << s << ": " << err << std::endl;
 }
 
-std::wstring getPath(const std::wstring& directory, PE::const_resid name, const std::wstring& ext) {
-	return directory + L"\\" + sanitizeFilename(getName(name) + L'.' + ext);
+wchar_t* formatUInt(wchar_t* end, uint64_t x) {
+	do { *--end = (wchar_t)(L'0' + x % 10); x /= 10; } while (x);
+	return end;
 }
+void appendUInt(std::wstring& s, uint64_t x) {
+	wchar_t buf[20], *end = buf + ARRAYSIZE(buf);
+	s.append(formatUInt(end, x), end);
+}
+
+// The names of the standard resource types by their ids, NULL for ids that are not used
+static const wchar_t* const type_names[] = {
+	nullptr, L"CURSOR", L"BITMAP", L"ICON", L"MENU", L"DIALOG", L"STRING", L"FONTDIR", L"FONT", L"ACCELERATOR", L"RCDATA",
+	L"MESSAGETABLE", L"GROUP_CURSOR", nullptr, L"GROUP_ICON", nullptr, L"VERSION", L"DLGINCLUDE", nullptr, L"PLUGPLAY", L"VXD",
+	L"ANICURSOR", L"ANIICON", L"HTML", L"MANIFEST",
+};
 
-template <typename T, size_t N>
-bool contains(const std::array<T, N>& arr, const T& val) {
-	return std::find(std::begin(arr), std::end(arr), val) != std::end(arr);
+void appendTypeName(std::wstring& s, PE::const_resid rid) {
+	if (!IS_INTRESOURCE(rid)) { s += rid; return; }
+	size_t id = LOWORD((ULONG_PTR)rid);
+	if (id < ARRAYSIZE(type_names) && type_names[id]) { s += type_names[id]; }
+	else { appendUInt(s, id); }
+}
+void appendName(std::wstring& s, PE::const_resid rid) {
+	if (IS_INTRESOURCE(rid)) { appendUInt(s, LOWORD((ULONG_PTR)rid)); }
+	else { s += rid; }
+}
+std::wstring getTypeName(PE::const_resid rid) { std::wstring s; appendTypeName(s, rid); return s; }
+std::wstring getName(PE::const_resid rid) { std::wstring s; appendName(s, rid); return s; }
+void appendFileName(std::wstring& s, PE::const_resid name, unsigned int duplicate) {
+	appendName(s, name);
+	if (duplicate) { s += L'~'; appendUInt(s, duplicate); }
+}
+bool parseTypeName(const std::wstring& s, uint16_t& id) {
+	for (size_t i = 0; i < ARRAYSIZE(type_names); i++) {
+		if (type_names[i] && s == type_names[i]) { id = (uint16_t)i; return true; }
+	}
+	// types with names are never given as numbers
+	return parseName(s, id) && !(id < ARRAYSIZE(type_names) && type_names[id]);
+}
+bool parseName(const std::wstring& s, uint16_t& id) {
+	// only the digits that appendUInt() gives, without leading zeros
+	if (s.empty() || s.size() > 5 || (s[0] == L'0' && s.size() > 1)) { return false; }
+	uint32_t x = 0;
+	for (wchar_t c : s) {
+		if (c < L'0' || c > L'9') { return false; }
+		x = x * 10 + (c - L'0');
+	}
+	if (x > 0xFFFF) { return false; }
+	id = (uint16_t)x;
+	return true;
+}
+
+std::wstring getPath(const std::wstring& directory, PE::const_resid name, const std::wstring& ext) {
+	std::wstring path;
+	buildPath(path, directory, name, ext);
+	return path;
+}
+void buildPath(std::wstring& path, const std::wstring& directory, PE::const_resid name, const std::wstring& ext, unsigned int duplicate) {
+	path.assign(directory);
+	path += PATH_SEP;
+	size_t start = path.size();
+	appendFileName(path, name, duplicate);
+	path += L'.';
+	path += ext;
+	sanitizeFilename(path, start);
 }
 
+// Reserved names are found with a perfect hash: the name is packed into an integer (up to 6 ASCII characters,
+// uppercased) and multiplied by a constant that gives each of the 25 names its own slot of the table
+static const uint64_t RESERVED_MULT = 0xf463b337d20b5d59ull;
+static const unsigned RESERVED_BITS = 5, RESERVED_MAX_LEN = 6;
+static inline bool packName(const wchar_t* name, size_t len, uint64_t& key) {
+	if (len == 0 || len > RESERVED_MAX_LEN) { return false; }
+	key = 0;
+	for (size_t i = 0; i < len; i++) {
+		wchar_t c = name[i];
+		if (c >= L'a' && c <= L'z') { c -= L'a' - L'A'; }
+		else if (c > 0x7F) { return false; }
+		key = (key << 8) | (uint64_t)c;
+	}
+	return true;
+}
+static inline size_t reservedSlot(uint64_t key) { return (size_t)((key * RESERVED_MULT) >> (64 - RESERVED_BITS)); }
+struct ReservedNames {
+	uint64_t keys[1 << RESERVED_BITS];
+	ReservedNames() {
+		static const wchar_t* const names[] = {
+			L"CON", L"PRN", L"AUX", L"CLOCK$", L"NUL",
+			L"COM0", L"COM1", L"COM2", L"COM3", L"COM4", L"COM5", L"COM6", L"COM7", L"COM8", L"COM9",
+			L"LPT0", L"LPT1", L"LPT2", L"LPT3", L"LPT4", L"LPT5", L"LPT6", L"LPT7", L"LPT8", L"LPT9",
+		};
+		memset(this->keys, 0, sizeof(this->keys)); // no name packs to 0
+		for (const wchar_t* n : names) {
+			uint64_t key = 0;
+			packName(n, wcslen(n), key);
+			this->keys[reservedSlot(key)] = key;
+		}
+	}
+};
+bool isReservedName(const wchar_t* name, size_t len) {
+	static const ReservedNames reserved;
+	uint64_t key = 0;
+	return packName(name, len, key) && reserved.keys[reservedSlot(key)] == key;
+}
 
-std::wstring sanitizeFilename(std::wstring filename) {
-	static const std::array<wchar_t, 9> invalids = {{ L'\"', L'*', L'/', L':', L'<', L'>', L'?', L'\\', L'|' }}; // sorted by ASCII code
-	for (size_t i = 0; i < filename.size(); i++) {
-		if (!iswprint(filename[i]) || contains(invalids, filename[i])) {
-			filename[i] = L'_';
+void sanitizeFilename(std::wstring& s, size_t start) {
+	for (size_t i = start; i < s.size(); i++) {
+		wchar_t c = s[i];
+		if (c < 0x80) {
+			// the common case: printable ASCII besides the characters not allowed in filenames
+			if (c < 0x20 || c == 0x7F || c == L'\"' || c == L'*' || c == L'/' || c == L':' || c == L'<' || c == L'>' || c == L'?' || c == L'\\' || c == L'|') { s[i] = L'_'; }
 		}
+		else if (!iswprint(c)) { s[i] = L'_'; }
 	}
-	static const std::array<std::wstring, 25> reserved = {{
-		L"CON", L"PRN", L"AUX", L"CLOCK$", L"NUL",
-		L"COM0", L"COM1", L"COM2", L"COM3", L"COM4", L"COM5", L"COM6", L"COM7", L"COM8", L"COM9",
-		L"LPT0", L"LPT1", L"LPT2", L"LPT3", L"LPT4", L"LPT5", L"LPT6", L"LPT7", L"LPT8", L"LPT9",
-	}};
-	std::wstring upper(filename);
-	std::transform(upper.begin(), upper.end(), upper.begin(), ::towupper);
-	if (contains(reserved, upper)) { filename = filename + L"_"; }
+	if (isReservedName(s.data() + start, s.size() - start)) { s += L'_'; }
+}
+std::wstring sanitizeFilename(std::wstring filename) {
+	sanitizeFilename(filename, 0);
 	return filename;
 }
 
+DumpOutput::DumpOutput(DumpOutput&& o) : ext(o.ext), _spans(std::move(o._spans)), owned(std::move(o.owned)), total(o.total),
+	owned_bytes(o.owned_bytes), source(o.source), source_size(o.source_size), keep(std::move(o.keep)) {
+	o._spans.clear();
+	o.owned.clear();
+	o.total = 0;
+	o.owned_bytes = 0;
+	o.ext = nullptr;
+}
+
+void DumpOutput::add(const void* data, size_t size) {
+	if (size == 0) { return; }
+	DataSpan span = { data, size };
+	this->_spans.push_back(span);
+	this->total += size;
+}
+
+void* DumpOutput::addOwned(size_t size) {
+	void* data = malloc(size);
+	if (!data) { return nullptr; }
+	this->addOwned(data, size);
+	return data;
+}
+
+void DumpOutput::addOwned(void* data, size_t size) {
+	this->own(data);
+	this->add(data, size);
+	this->owned_bytes += size;
+}
+
+void DumpOutput::own(void* data) {
+	if (data) { this->owned.push_back(data); }
+}
+
+void DumpOutput::clear() {
+	for (void* data : this->owned) { free(data); }
+	this->owned.clear();
+	this->_spans.clear();
+	this->total = 0;
+	this->owned_bytes = 0;
+	this->ext = nullptr;
+}
+
+void DumpOutput::release(const void* data, size_t size) const {
+	const uint8_t* p = (const uint8_t*)data;
+	if (p >= this->source && p + size <= this->source + this->source_size) { MappedFile::release(data, size); }
+}
+
 bool writeFile(const std::wstring& path, const void * const data, size_t size) {
-	FILE* f = _wfopen(path.c_str(), L"wb");
-	if (!f || ferror(f)) { return false; }
-	size_t total = 0, written;
-	do {
-		written = fwrite(((const unsigned char * const)data) + total, 1, size - total, f);
-		if (ferror(f)) { fclose(f); return false; }
-		total += written;
-	} while (total != size);
-	fclose(f);
+	DataSpan span = { data, size };
+	return writeFile(path, &span, 1);
+}
+
+static bool writeStreamed(const std::wstring& path, const DumpOutput& out);
+
+bool writeFile(const std::wstring& path, const DumpOutput& out) {
+	if (out.isStreamed()) { return writeStreamed(path, out); }
+	return writeFile(path, out.spans().data(), out.spans().size());
+}
+
+// Writes all of the spans directly with the file handle so there is no intermediate buffering or copying
+#ifdef _WIN32
+static bool writeAll(HANDLE f, const void* data, size_t size) {
+	const BYTE* p = (const BYTE*)data;
+	while (size) {
+		DWORD written;
+		if (!WriteFile(f, p, (DWORD)std::min<size_t>(size, 0x40000000), &written, NULL)) { return false; }
+		p += written; size -= written;
+	}
+	return true;
+}
+
+// The old file is deleted first instead of being overwritten since it may be a hard link to a blob in a
+// content store (or any other file) that must not change
+static HANDLE createFile(const std::wstring& path) {
+	DeleteFile(path.c_str());
+	return CreateFile(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+bool writeFile(const std::wstring& path, const DataSpan* spans, size_t count) {
+	HANDLE f = createFile(path);
+	if (f == INVALID_HANDLE_VALUE) { return false; }
+	for (size_t i = 0; i < count; i++) {
+		if (!writeAll(f, spans[i].data, spans[i].size)) { CloseHandle(f); return false; }
+	}
+	CloseHandle(f);
+	return true;
+}
+
+static bool writeStreamed(const std::wstring& path, const DumpOutput& out) {
+	HANDLE f = createFile(path);
+	if (f == INVALID_HANDLE_VALUE) { return false; }
+	if (!out.stream([f](const void* data, size_t size) { return writeAll(f, data, size); }, true)) { CloseHandle(f); return false; }
+	CloseHandle(f);
 	return true;
 }
 
 bool createDirectory(const std::wstring& path) {
 	return CreateDirectory(path.c_str(), NULL) != 0 || GetLastError() == ERROR_ALREADY_EXISTS;
 }
+
+FILE* openFile(const std::wstring& path, const char* mode) {
+	return _wfopen(path.c_str(), fromUTF8(mode, strlen(mode)).c_str());
+}
+
+bool removeFile(const std::wstring& path) {
+	return DeleteFile(path.c_str()) != 0 || GetLastError() == ERROR_FILE_NOT_FOUND;
+}
+
+bool linkFile(const std::wstring& existing, const std::wstring& path) {
+	if (CreateHardLink(path.c_str(), existing.c_str(), NULL)) { return true; }
+	return GetLastError() == ERROR_ALREADY_EXISTS && DeleteFile(path.c_str()) && CreateHardLink(path.c_str(), existing.c_str(), NULL);
+}
+
+bool getFileInfo(const std::wstring& path, uint64_t& size, uint64_t& mtime) {
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &data)) { return false; }
+	size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	mtime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+#else
+static bool writeAll(int fd, const void* data, size_t size) {
+	const char* p = (const char*)data;
+	while (size) {
+		ssize_t written = write(fd, p, size);
+		if (written < 0) {
+			if (errno == EINTR) { continue; }
+			return false;
+		}
+		p += written; size -= (size_t)written;
+	}
+	return true;
+}
+
+// The old file is unlinked first instead of being truncated since it may be a hard link to a blob in a
+// content store (or any other file) that must not change
+static int createFile(const std::wstring& path) {
+	std::string p = toUTF8(path);
+	unlink(p.c_str());
+	return open(p.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+}
+
+bool writeFile(const std::wstring& path, const DataSpan* spans, size_t count) {
+	int fd = createFile(path);
+	if (fd < 0) { return false; }
+	// writev with as many spans as allowed at a time, continuing after partial writes
+	std::vector<struct iovec> iov;
+	iov.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		if (spans[i].size) { struct iovec v = { (void*)spans[i].data, spans[i].size }; iov.push_back(v); }
+	}
+	size_t i = 0;
+	while (i < iov.size()) {
+		ssize_t written = writev(fd, &iov[i], (int)std::min<size_t>(iov.size() - i, IOV_MAX));
+		if (written < 0) {
+			if (errno == EINTR) { continue; }
+			int err = errno; close(fd); errno = err; return false;
+		}
+		size_t w = (size_t)written;
+		while (i < iov.size() && w >= iov[i].iov_len) { w -= iov[i++].iov_len; }
+		if (w) { iov[i].iov_base = (char*)iov[i].iov_base + w; iov[i].iov_len -= w; }
+	}
+	return close(fd) == 0;
+}
+
+static bool writeStreamed(const std::wstring& path, const DumpOutput& out) {
+	int fd = createFile(path);
+	if (fd < 0) { return false; }
+	if (!out.stream([fd](const void* data, size_t size) { return writeAll(fd, data, size); }, true)) {
+		int err = errno; close(fd); errno = err; return false;
+	}
+	return close(fd) == 0;
+}
+
+bool createDirectory(const std::wstring& path) {
+	return mkdir(toUTF8(path).c_str(), 0777) == 0 || errno == EEXIST;
+}
+
+FILE* openFile(const std::wstring& path, const char* mode) {
+	return fopen(toUTF8(path).c_str(), mode);
+}
+
+bool removeFile(const std::wstring& path) {
+	return unlink(toUTF8(path).c_str()) == 0 || errno == ENOENT;
+}
+
+bool linkFile(const std::wstring& existing, const std::wstring& path) {
+	std::string from = toUTF8(existing), to = toUTF8(path);
+	if (link(from.c_str(), to.c_str()) == 0) { return true; }
+	return errno == EEXIST && unlink(to.c_str()) == 0 && link(from.c_str(), to.c_str()) == 0;
+}
+
+bool getFileInfo(const std::wstring& path, uint64_t& size, uint64_t& mtime) {
+	struct stat st;
+	if (stat(toUTF8(path).c_str(), &st) != 0) { return false; }
+	size = (uint64_t)st.st_size;
+	mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	return true;
+}
+#endif
+
+std::wstring fromUTF8(const char* s, size_t len) {
+	std::wstring str;
+	str.reserve(len);
+	const unsigned char* p = (const unsigned char*)s, *end = p + len;
+	while (p < end) {
+		unsigned int c = *p++, n = 0;
+		if (c >= 0xF0 && c < 0xF8) { c &= 0x07; n = 3; }
+		else if (c >= 0xE0) { c &= 0x0F; n = 2; }
+		else if (c >= 0xC0) { c &= 0x1F; n = 1; }
+		else if (c >= 0x80) { str += (wchar_t)0xFFFD; continue; }
+		if (c >= 0xF8 || (size_t)(end - p) < n) { str += (wchar_t)0xFFFD; break; }
+		bool valid = true;
+		for (unsigned int i = 0; i < n; i++) {
+			if ((p[i] & 0xC0) != 0x80) { valid = false; break; }
+			c = (c << 6) | (p[i] & 0x3F);
+		}
+		if (!valid) { str += (wchar_t)0xFFFD; continue; }
+		p += n;
+		if (c >= 0x10000 && sizeof(wchar_t) == 2) {
+			// surrogate pair
+			c -= 0x10000;
+			str += (wchar_t)(0xD800 | (c >> 10));
+			str += (wchar_t)(0xDC00 | (c & 0x3FF));
+		}
+		else { str += (wchar_t)c; }
+	}
+	return str;
+}
+
+std::wstring fromUTF16(const void* s, size_t len) {
+	const uint8_t* p = (const uint8_t*)s;
+	std::wstring str;
+	str.reserve(len);
+	for (size_t i = 0; i < len; i++) {
+		unsigned int c = p[2*i] | (p[2*i+1] << 8);
+		if (sizeof(wchar_t) != 2 && c >= 0xD800 && c < 0xDC00 && i + 1 < len) {
+			unsigned int c2 = p[2*i+2] | (p[2*i+3] << 8);
+			if (c2 >= 0xDC00 && c2 < 0xE000) { c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00); i++; }
+		}
+		str += (wchar_t)c;
+	}
+	return str;
+}
+
+std::string toUTF8(const std::wstring& s) {
+	std::string str;
+	str.reserve(s.size());
+	for (size_t i = 0; i < s.size(); i++) {
+		unsigned int c = (unsigned int)s[i];
+		if (sizeof(wchar_t) == 2 && c >= 0xD800 && c < 0xDC00 && i + 1 < s.size() && s[i+1] >= 0xDC00 && s[i+1] < 0xE000) {
+			c = 0x10000 + ((c - 0xD800) << 10) + ((unsigned int)s[++i] - 0xDC00);
+		}
+		if (c < 0x80) { str += (char)c; }
+		else if (c < 0x800) { str += (char)(0xC0 | (c >> 6)); str += (char)(0x80 | (c & 0x3F)); }
+		else if (c < 0x10000) { str += (char)(0xE0 | (c >> 12)); str += (char)(0x80 | ((c >> 6) & 0x3F)); str += (char)(0x80 | (c & 0x3F)); }
+		else { str += (char)(0xF0 | (c >> 18)); str += (char)(0x80 | ((c >> 12) & 0x3F)); str += (char)(0x80 | ((c >> 6) & 0x3F)); str += (char)(0x80 | (c & 0x3F)); }
+	}
+	return str;
+}
+
+std::wstring getBaseName(const std::wstring& path) {
+	size_t i = path.find_last_of(L"\\/:");
+	return i == std::wstring::npos ? path : path.substr(i + 1);
+}
+
+// Reads a list of files, one per line, from a UTF-8 or UTF-16 text file
+static bool readFileList(const std::wstring& path, std::vector<std::wstring>& files) {
+	FILE* f = openFile(path, "rb");
+	if (!f) { return false; }
+	std::string raw;
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) != 0) { raw.append(buf, n); }
+	bool ok = !ferror(f);
+	fclose(f);
+	if (!ok) { return false; }
+
+	std::wstring text;
+	if (raw.size() >= 2 && (unsigned char)raw[0] == 0xFF && (unsigned char)raw[1] == 0xFE) {
+		for (size_t i = 2; i + 1 < raw.size(); i += 2) { text += (wchar_t)((unsigned char)raw[i] | ((unsigned char)raw[i+1] << 8)); }
+	}
+	else {
+		size_t start = (raw.size() >= 3 && raw.compare(0, 3, "\xEF\xBB\xBF") == 0) ? 3 : 0;
+		text = fromUTF8(raw.data() + start, raw.size() - start);
+	}
+
+	std::wistringstream lines(text);
+	std::wstring line;
+	while (std::getline(lines, line)) {
+		size_t end = line.find_last_not_of(L" \t\r");
+		if (end == std::wstring::npos) { continue; }
+		files.push_back(line.substr(0, end + 1));
+	}
+	return true;
+}
+
+#ifdef _WIN32
+bool listFiles(const std::wstring& spec, std::vector<std::wstring>& files) {
+	std::wstring pattern = spec;
+	if (spec.find_first_of(L"*?") == std::wstring::npos) {
+		DWORD attrib = GetFileAttributes(spec.c_str());
+		if (attrib == INVALID_FILE_ATTRIBUTES) { return false; }
+		if (!(attrib & FILE_ATTRIBUTE_DIRECTORY)) { return readFileList(spec, files); }
+		pattern = spec + L"\\*";
+	}
+	size_t sep = pattern.find_last_of(L"\\/");
+	std::wstring dir = (sep == std::wstring::npos) ? L"" : pattern.substr(0, sep + 1);
+	WIN32_FIND_DATA ffd;
+	HANDLE find = FindFirstFile(pattern.c_str(), &ffd);
+	if (find == INVALID_HANDLE_VALUE) { return GetLastError() == ERROR_FILE_NOT_FOUND; }
+	std::vector<std::wstring> found;
+	do {
+		if (!(ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) { found.push_back(dir + ffd.cFileName); }
+	} while (FindNextFile(find, &ffd));
+	DWORD err = GetLastError();
+	FindClose(find);
+	if (err != ERROR_NO_MORE_FILES) { SetLastError(err); return false; }
+	std::sort(found.begin(), found.end());
+	files.insert(files.end(), found.begin(), found.end());
+	return true;
+}
+#else
+bool listFiles(const std::wstring& spec, std::vector<std::wstring>& files) {
+	std::string pattern = toUTF8(spec);
+	if (spec.find_first_of(L"*?[") == std::wstring::npos) {
+		struct stat st;
+		if (stat(pattern.c_str(), &st) != 0) { return false; }
+		if (!S_ISDIR(st.st_mode)) { return readFileList(spec, files); }
+		pattern += "/*";
+	}
+	glob_t g;
+	int res = glob(pattern.c_str(), 0, NULL, &g);
+	if (res == GLOB_NOMATCH) { return true; }
+	if (res != 0) { errno = EIO; return false; }
+	for (size_t i = 0; i < g.gl_pathc; i++) {
+		struct stat st;
+		if (stat(g.gl_pathv[i], &st) == 0 && S_ISREG(st.st_mode)) { files.push_back(fromUTF8(g.gl_pathv[i], strlen(g.gl_pathv[i]))); }
+	}
+	globfree(&g);
+	return true;
+}
+#endif
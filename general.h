@@ -1,11 +1,12 @@
 #pragma once
 
-#include "PE\PEDataTypes.h"
-
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
+#include "PEResources.h"
 
+#include <stdio.h>
 #include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
 
 template <class T>
 inline std::wstring to_string(T t, std::ios_base & (*f)(std::ios_base&) = std::dec)
@@ -15,6 +16,9 @@ inline std::wstring to_string(T t, std::ios_base & (*f)(std::ios_base&) = std::d
 	return oss.str();
 }
 
+// Serializes messages written to stderr when multiple threads are running
+extern std::mutex output_mutex;
+
 // Gets the last error (GetLastError()) as a string
 std::wstring LastErrorString();
 // Outputs the last error
@@ -22,10 +26,142 @@ void ReportLastError(const std::wstring& s);
 // Outputs the last error, possibly only as a warning
 void ReportLastError(const std::wstring& s, bool warning);
 
+// Formats an unsigned integer into the characters just before end without allocating, returns the first
+// character. There must be room for 20 characters.
+wchar_t* formatUInt(wchar_t* end, uint64_t x);
+// Appends an unsigned integer to a string without any temporary strings
+void appendUInt(std::wstring& s, uint64_t x);
+
 std::wstring getTypeName(PE::const_resid rid);
 std::wstring getName(PE::const_resid rid);
+// Parses a type or name as given by getTypeName() and getName() into an integer id, returns false if it can only
+// be a string (a name like "1" could be either, so a string is still possible when this returns true)
+bool parseTypeName(const std::wstring& s, uint16_t& id);
+bool parseName(const std::wstring& s, uint16_t& id);
+// Appends the name of a resource type or a resource, like getTypeName() and getName() but without allocating
+// when the string has room
+void appendTypeName(std::wstring& s, PE::const_resid rid);
+void appendName(std::wstring& s, PE::const_resid rid);
+// Appends the name of a resource as used for its file, which is followed by ~N when it is the Nth other
+// resource of its directory whose file would have the same name (0 is the first one, that has no suffix)
+void appendFileName(std::wstring& s, PE::const_resid name, unsigned int duplicate);
 std::wstring getPath(const std::wstring& directory, PE::const_resid name, const std::wstring& ext);
+// Builds the same path as getPath() into path, reusing its memory so building the path of every resource
+// does not allocate once the string is large enough
+void buildPath(std::wstring& path, const std::wstring& directory, PE::const_resid name, const std::wstring& ext, unsigned int duplicate = 0);
 std::wstring sanitizeFilename(std::wstring filename);
+// Sanitizes the end of a string from start on as a filename in place
+void sanitizeFilename(std::wstring& s, size_t start);
+// Checks if a filename is reserved by Windows (like CON or LPT1), ignoring case
+bool isReservedName(const wchar_t* name, size_t len);
+
+// A run of bytes to be written, the span does not own the bytes
+struct DataSpan {
+	const void* data;
+	size_t size;
+};
+
+// The converted form of a resource: the file extension and a gather list of spans that are written in
+// order. The spans normally point directly into the resource data, anything the converter has to create
+// (such as file headers) is allocated from and owned by the output.
+class DumpOutput {
+public:
+	const wchar_t* ext;
+
+	// Outputs at least this large are streamed: they are handled a chunk at a time and the pages of the
+	// source that each chunk came from are released afterwards, so the memory used does not grow with the
+	// size of the resource
+	static const size_t STREAM_THRESHOLD = 16 << 20;
+	static const size_t STREAM_CHUNK = 4 << 20;
+
+	DumpOutput() : ext(nullptr), total(0), owned_bytes(0), source(nullptr), source_size(0) { }
+	// Takes the spans and owned memory of another output, leaving it empty
+	DumpOutput(DumpOutput&& o);
+	~DumpOutput() { this->clear(); }
+
+	// Appends a span that is not owned by the output
+	void add(const void* data, size_t size);
+	// Allocates memory that is owned by the output and appends it as a span
+	void* addOwned(size_t size);
+	// Appends memory from malloc as a span and takes ownership of it, such as an image encoded by a dumper
+	void addOwned(void* data, size_t size);
+	// Takes ownership of memory from malloc without appending it
+	void own(void* data);
+	// Removes the extension and all spans and frees all owned memory
+	void clear();
+	// Sets the mapped memory (normally the resource data) that spans may point into, only the pages of spans
+	// within it are released while streaming. It must be part of a file mapping, nothing is released without it.
+	void setSource(const void* data, size_t size) { this->source = (const uint8_t*)data; this->source_size = size; }
+	// Keeps something alive for as long as the output, such as the PE file that the spans point into when
+	// the output is written after the code that converted it is done
+	void keepAlive(std::shared_ptr<const void> ref) { this->keep = std::move(ref); }
+
+	const std::vector<DataSpan>& spans() const { return this->_spans; }
+	size_t size() const { return this->total; }
+	// The number of allocations owned by the output and the bytes allocated with addOwned
+	size_t ownedCount() const { return this->owned.size(); }
+	size_t ownedBytes() const { return this->owned_bytes; }
+
+	bool isStreamed() const { return this->total >= STREAM_THRESHOLD; }
+	// Calls f(data, size) for each span in order, streamed outputs are split into chunks of at most
+	// STREAM_CHUNK bytes. Stops and returns false as soon as f returns false. Only the last pass over the
+	// output (normally writing it) releases the pages of each chunk of the source, so the passes before it
+	// (such as hashing) do not have to read them back in.
+	template <class F>
+	bool stream(F f, bool last = false) const {
+		bool streamed = this->isStreamed();
+		for (const DataSpan& span : this->_spans) {
+			if (!streamed) {
+				if (!f(span.data, span.size)) { return false; }
+				continue;
+			}
+			const uint8_t* data = (const uint8_t*)span.data;
+			for (size_t off = 0; off < span.size; off += STREAM_CHUNK) {
+				size_t n = span.size - off < STREAM_CHUNK ? span.size - off : STREAM_CHUNK;
+				if (!f(data + off, n)) { return false; }
+				if (last) { this->release(data + off, n); }
+			}
+		}
+		return true;
+	}
+
+private:
+	DumpOutput(const DumpOutput&) = delete;
+	DumpOutput& operator=(const DumpOutput&) = delete;
+
+	// Releases the pages of a chunk that has been streamed if it is part of the source
+	void release(const void* data, size_t size) const;
+
+	std::vector<DataSpan> _spans;
+	std::vector<void*> owned;
+	size_t total, owned_bytes;
+	const uint8_t* source;
+	size_t source_size;
+	std::shared_ptr<const void> keep;
+};
+
 bool writeFile(const std::wstring& path, const void * const data, size_t size);
+bool writeFile(const std::wstring& path, const DataSpan* spans, size_t count);
+// Writes all of the spans of the output, streaming it if it is large
+bool writeFile(const std::wstring& path, const DumpOutput& out);
 
 bool createDirectory(const std::wstring& path);
+bool removeFile(const std::wstring& path);
+// Creates a hard link to an existing file, replacing anything already at the path
+bool linkFile(const std::wstring& existing, const std::wstring& path);
+// Gets the size and the last modification time of a file, the time is only useful for comparisons
+bool getFileInfo(const std::wstring& path, uint64_t& size, uint64_t& mtime);
+// Opens a file with a wide path, mode is the same as for fopen
+FILE* openFile(const std::wstring& path, const char* mode);
+
+// Converts UTF-8 text to a wide string, invalid sequences become U+FFFD
+std::wstring fromUTF8(const char* s, size_t len);
+// Converts little-endian UTF-16 text (which may be unaligned) to a wide string
+std::wstring fromUTF16(const void* s, size_t len);
+// Converts a wide string to UTF-8
+std::string toUTF8(const std::wstring& s);
+// Gets a list of files from a wildcard pattern (like C:\Windows\System32\*.dll), all files in a
+// directory, or a text file that has one file per line
+bool listFiles(const std::wstring& spec, std::vector<std::wstring>& files);
+// Gets the final component of a path
+std::wstring getBaseName(const std::wstring& path);
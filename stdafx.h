@@ -1,5 +1,6 @@
 #pragma once
 
+#ifdef _WIN32
 // Target Windows XP
 #define WINVER 0x0501
 #define _WIN32_WINNT 0x0501
@@ -8,13 +9,18 @@
 #define NOMINMAX
 #define _CRT_SECURE_NO_WARNINGS
 #include <windows.h>
-#undef ABSOLUTE // interferes with PE library
+#include <tchar.h>
+#endif
+#include "compat.h"
 
 #include <assert.h>
-#include <tchar.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+#include <locale.h>
 
 #include <iostream>
 #include <iomanip>
@@ -23,9 +29,3 @@
 #include <vector>
 #include <array>
 #include <algorithm>
-
-#if _WIN64
-#pragma comment(lib, "PE\\PEFile64.lib")
-#else
-#pragma comment(lib, "PE\\PEFile.lib")
-#endif